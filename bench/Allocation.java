@@ -0,0 +1,30 @@
+/**
+ * Measures the rate at which small, short-lived objects can be
+ * allocated.
+ */
+public class Allocation extends Benchmark {
+  private static class Cell {
+    public final int value;
+    public final Cell next;
+
+    public Cell(int value, Cell next) {
+      this.value = value;
+      this.next = next;
+    }
+  }
+
+  protected int run(int operations) {
+    int sum = 0;
+    Cell cell = null;
+    for (int i = 0; i < operations; ++i) {
+      // keep a short chain alive so objects survive a little while
+      cell = new Cell(i, (i & 15) == 0 ? null : cell);
+      sum += cell.value;
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new Allocation(), args);
+  }
+}
@@ -0,0 +1,36 @@
+/**
+ * Measures System.arraycopy for primitive and reference arrays of a
+ * few different lengths.
+ */
+public class ArrayCopy extends Benchmark {
+  private final int[] ints = new int[1024];
+  private final int[] intCopy = new int[1024];
+  private final Object[] objects = new Object[1024];
+  private final Object[] objectCopy = new Object[1024];
+
+  public ArrayCopy() {
+    for (int i = 0; i < objects.length; ++i) {
+      ints[i] = i;
+      objects[i] = Integer.valueOf(i);
+    }
+  }
+
+  protected int run(int operations) {
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      int length = 16 << (i & 6);
+      if ((i & 1) == 0) {
+        System.arraycopy(ints, 0, intCopy, 0, length);
+        sum += intCopy[length - 1];
+      } else {
+        System.arraycopy(objects, 0, objectCopy, 0, length);
+        sum += objectCopy[length - 1].hashCode();
+      }
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new ArrayCopy(), args);
+  }
+}
@@ -0,0 +1,69 @@
+/**
+ * Base class for the programs run by "make bench".  Each benchmark
+ * runs a number of warm-up batches followed by a number of measured
+ * batches, printing one line per measured batch in the form
+ *
+ *   batch <operations> <nanoseconds>
+ *
+ * which the benchmark harness parses.  Batches are sized so that each
+ * takes at least MinimumBatchMillis, since System.nanoTime only has
+ * millisecond resolution on some platforms.
+ */
+public abstract class Benchmark {
+  private static final int MinimumBatchMillis = 50;
+  private static final int DefaultWarmups = 3;
+  private static final int DefaultBatches = 20;
+
+  private static int sink;
+
+  /**
+   * Performs the specified number of operations, returning a value
+   * which depends on their results so they cannot be optimized away.
+   */
+  protected abstract int run(int operations) throws Exception;
+
+  private static void consume(int value) {
+    sink += value;
+  }
+
+  private static int calibrate(Benchmark benchmark) throws Exception {
+    int operations = 1;
+    while (true) {
+      long start = System.currentTimeMillis();
+      consume(benchmark.run(operations));
+      if (System.currentTimeMillis() - start >= MinimumBatchMillis
+          || operations >= (Integer.MAX_VALUE / 2))
+      {
+        return operations;
+      }
+      operations *= 2;
+    }
+  }
+
+  public static void run(Benchmark benchmark, String[] args)
+    throws Exception
+  {
+    int batches = args.length > 0 ? Integer.parseInt(args[0])
+      : DefaultBatches;
+    int warmups = args.length > 1 ? Integer.parseInt(args[1])
+      : DefaultWarmups;
+
+    int operations = calibrate(benchmark);
+
+    for (int i = 0; i < warmups; ++i) {
+      consume(benchmark.run(operations));
+    }
+
+    for (int i = 0; i < batches; ++i) {
+      long start = System.nanoTime();
+      consume(benchmark.run(operations));
+      long elapsed = System.nanoTime() - start;
+
+      System.out.println("batch " + operations + " " + elapsed);
+    }
+
+    if (sink == 42) {
+      System.out.println("");
+    }
+  }
+}
@@ -0,0 +1,62 @@
+import java.io.ByteArrayOutputStream;
+import java.io.InputStream;
+
+/**
+ * Measures defining and linking a small class, using a new class
+ * loader for each definition.
+ */
+public class ClassLoading extends Benchmark {
+  private final byte[] bytes;
+
+  public ClassLoading() throws Exception {
+    InputStream in = ClassLoading.class.getResourceAsStream
+      ("/ClassLoading$Payload.class");
+    try {
+      ByteArrayOutputStream out = new ByteArrayOutputStream();
+      byte[] buffer = new byte[4096];
+      int c;
+      while ((c = in.read(buffer)) > 0) {
+        out.write(buffer, 0, c);
+      }
+      bytes = out.toByteArray();
+    } finally {
+      in.close();
+    }
+  }
+
+  protected int run(int operations) throws Exception {
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      Class c = new MyClassLoader(ClassLoading.class.getClassLoader())
+        .define("ClassLoading$Payload", bytes);
+      sum += ((Runnable) c.newInstance()).hashCode() & 1;
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new ClassLoading(), args);
+  }
+
+  private static class MyClassLoader extends ClassLoader {
+    public MyClassLoader(ClassLoader parent) {
+      super(parent);
+    }
+
+    public Class define(String name, byte[] bytes) {
+      return defineClass(name, bytes, 0, bytes.length);
+    }
+  }
+
+  public static class Payload implements Runnable {
+    private int count;
+
+    public void run() {
+      ++ count;
+    }
+
+    public String toString() {
+      return "payload " + count;
+    }
+  }
+}
@@ -0,0 +1,47 @@
+/**
+ * Measures virtual and interface method dispatch at call sites which
+ * see several receiver types.
+ */
+public class Dispatch extends Benchmark {
+  private interface Shape {
+    public int area();
+  }
+
+  private static abstract class Base implements Shape {
+    public abstract int sides();
+  }
+
+  private static class Square extends Base {
+    public int sides() { return 4; }
+    public int area() { return 16; }
+  }
+
+  private static class Triangle extends Base {
+    public int sides() { return 3; }
+    public int area() { return 6; }
+  }
+
+  private static class Hexagon extends Base {
+    public int sides() { return 6; }
+    public int area() { return 24; }
+  }
+
+  private final Base[] objects = new Base[] {
+    new Square(), new Triangle(), new Hexagon(), new Triangle()
+  };
+
+  protected int run(int operations) {
+    Base[] objects = this.objects;
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      Base b = objects[i & 3];
+      Shape s = b;
+      sum += b.sides() + s.area();
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new Dispatch(), args);
+  }
+}
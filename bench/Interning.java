@@ -0,0 +1,36 @@
+/**
+ * Measures String.intern, mostly for strings which are already
+ * interned, with an occasional new one.
+ */
+public class Interning extends Benchmark {
+  private static final int Count = 1024;
+
+  private final String[] strings = new String[Count];
+  private int fresh;
+
+  public Interning() {
+    for (int i = 0; i < Count; ++i) {
+      strings[i] = ("interned-" + i).intern();
+    }
+  }
+
+  protected int run(int operations) {
+    String[] strings = this.strings;
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      String s;
+      if ((i & 63) == 0) {
+        s = ("fresh-" + (fresh++)).intern();
+      } else {
+        // build an equal but distinct copy so intern must look it up
+        s = new String(strings[i & (Count - 1)]).intern();
+      }
+      sum += s.length();
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new Interning(), args);
+  }
+}
@@ -0,0 +1,30 @@
+/**
+ * Measures uncontended monitor enter and exit, using both synchronized
+ * blocks and synchronized methods.
+ */
+public class Monitors extends Benchmark {
+  private final Object lock = new Object();
+  private int count;
+
+  private synchronized int increment() {
+    return ++ count;
+  }
+
+  protected int run(int operations) {
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      if ((i & 1) == 0) {
+        synchronized (lock) {
+          sum += ++ count;
+        }
+      } else {
+        sum += increment();
+      }
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new Monitors(), args);
+  }
+}
@@ -0,0 +1,37 @@
+/**
+ * Measures throwing an exception and catching it a few frames up the
+ * stack.
+ */
+public class Throw extends Benchmark {
+  private static class MyException extends Exception {
+    public final int value;
+
+    public MyException(int value) {
+      this.value = value;
+    }
+  }
+
+  private static int thrower(int depth, int value) throws MyException {
+    if (depth == 0) {
+      throw new MyException(value);
+    } else {
+      return thrower(depth - 1, value) + 1;
+    }
+  }
+
+  protected int run(int operations) {
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      try {
+        sum += thrower(4, i);
+      } catch (MyException e) {
+        sum += e.value;
+      }
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new Throw(), args);
+  }
+}
@@ -0,0 +1,51 @@
+/**
+ * A GC-heavy workload: repeatedly builds binary trees of various
+ * depths while keeping one long-lived tree alive, so that both minor
+ * and major collections are exercised.
+ */
+public class TreeGC extends Benchmark {
+  private static final int LongLivedDepth = 16;
+  private static final int MaximumDepth = 12;
+
+  private static class Node {
+    public Node left;
+    public Node right;
+
+    public Node(Node left, Node right) {
+      this.left = left;
+      this.right = right;
+    }
+  }
+
+  private final Node longLived = make(LongLivedDepth);
+
+  private static Node make(int depth) {
+    if (depth == 0) {
+      return new Node(null, null);
+    } else {
+      return new Node(make(depth - 1), make(depth - 1));
+    }
+  }
+
+  private static int count(Node node) {
+    return node == null ? 0 : 1 + count(node.left) + count(node.right);
+  }
+
+  protected int run(int operations) {
+    int sum = 0;
+    for (int i = 0; i < operations; ++i) {
+      Node n = make(4 + (i % (MaximumDepth - 3)));
+      // replace a subtree of the long-lived tree now and then so old
+      // objects point to young ones
+      if ((i & 7) == 0) {
+        longLived.left.right = n;
+      }
+      sum += count(n);
+    }
+    return sum;
+  }
+
+  public static void main(String[] args) throws Exception {
+    run(new TreeGC(), args);
+  }
+}
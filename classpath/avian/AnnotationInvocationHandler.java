@@ -16,14 +16,39 @@ import java.lang.reflect.InvocationHandler;
 public class AnnotationInvocationHandler implements InvocationHandler {
   private Object[] data;
 
+  // pairs of methods and the values they return, searched by identity
+  // before falling back to comparing names.  Proxy classes reuse
+  // their Method instances, so this saves converting the method name
+  // to a string on every call.  The array is replaced rather than
+  // modified so it may be read without synchronization:
+  private Object[] cache = new Object[0];
+
   public AnnotationInvocationHandler(Object[] data) {
     this.data = data;
   }
     
   public Object invoke(Object proxy, Method method, Object[] arguments) {
+    Object[] cache = this.cache;
+    for (int i = 0; i < cache.length; i += 2) {
+      if (cache[i] == method) {
+        return cache[i + 1];
+      }
+    }
+
+    String name = method.getName();
     for (int i = 2; i < data.length; i += 2) {
-      if (method.getName().equals(data[i])) {
-        return data[i + 1];
+      if (name.equals(data[i])) {
+        Object value = data[i + 1];
+
+        synchronized (this) {
+          Object[] array = new Object[this.cache.length + 2];
+          System.arraycopy(this.cache, 0, array, 0, this.cache.length);
+          array[this.cache.length] = method;
+          array[this.cache.length + 1] = value;
+          this.cache = array;
+        }
+
+        return value;
       }
     }
     throw new IllegalArgumentException();
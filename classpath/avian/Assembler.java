@@ -25,21 +25,32 @@ public class Assembler {
   public static final int ACC_STATIC       = 1 <<  3;
 
   public static final int aaload = 0x32;
+  public static final int aconst_null = 0x01;
   public static final int aastore = 0x53;
   public static final int aload = 0x19;
   public static final int aload_0 = 0x2a;
   public static final int aload_1 = 0x2b;
+  public static final int astore = 0x3a;
   public static final int astore_0 = 0x4b;
+  public static final int athrow = 0xbf;
   public static final int anewarray = 0xbd;
   public static final int areturn = 0xb0;
+  public static final int checkcast = 0xc0;
   public static final int dload = 0x18;
   public static final int dreturn = 0xaf;
   public static final int dup = 0x59;
+  public static final int dup_x1 = 0x5a;
   public static final int fload = 0x17;
   public static final int freturn = 0xae;
   public static final int getfield = 0xb4;
+  public static final int getstatic = 0xb2;
   public static final int goto_ = 0xa7;
+  public static final int i2d = 0x87;
+  public static final int i2f = 0x86;
+  public static final int i2l = 0x85;
+  public static final int ifne = 0x9a;
   public static final int iload = 0x15;
+  public static final int instanceof_ = 0xc1;
   public static final int invokeinterface = 0xb9;
   public static final int invokespecial = 0xb7;
   public static final int invokestatic = 0xb8;
@@ -52,8 +63,10 @@ public class Assembler {
   public static final int new_ = 0xbb;
   public static final int pop = 0x57;
   public static final int putfield = 0xb5;
+  public static final int putstatic = 0xb3;
   public static final int ret = 0xa9;
   public static final int return_ = 0xb1;
+  public static final int swap = 0x5f;
 
   public static void writeClass(OutputStream out,
                                 List<PoolEntry> pool,
@@ -62,6 +75,19 @@ public class Assembler {
                                 int[] interfaces,
                                 MethodData[] methods)
     throws IOException
+  {
+    writeClass(out, pool, name, super_, interfaces, new FieldData[0],
+               methods);
+  }
+
+  public static void writeClass(OutputStream out,
+                                List<PoolEntry> pool,
+                                int name,
+                                int super_,
+                                int[] interfaces,
+                                FieldData[] fields,
+                                MethodData[] methods)
+    throws IOException
   {
     int codeAttributeName = ConstantPool.addUtf8(pool, "Code");
 
@@ -83,7 +109,14 @@ public class Assembler {
       write2(out, i + 1);
     }
 
-    write2(out, 0); // field count
+    write2(out, fields.length);
+    for (FieldData f: fields) {
+      write2(out, f.flags);
+      write2(out, f.nameIndex + 1);
+      write2(out, f.specIndex + 1);
+
+      write2(out, 0); // attribute count
+    }
 
     write2(out, methods.length);
     for (MethodData m: methods) {
@@ -113,4 +146,16 @@ public class Assembler {
       this.code = code;
     }
   }
+
+  public static class FieldData {
+    public final int flags;
+    public final int nameIndex;
+    public final int specIndex;
+
+    public FieldData(int flags, int nameIndex, int specIndex) {
+      this.flags = flags;
+      this.nameIndex = nameIndex;
+      this.specIndex = specIndex;
+    }
+  }
 }
@@ -18,6 +18,13 @@ public abstract class Machine {
 
   public static native void dumpHeap(String outputFile);
 
+  /**
+   * Writes the stacks sampled so far by the profiler enabled with
+   * the avian.profile property to its output file.  Returns false if
+   * the profiler is not enabled or the file could not be written.
+   */
+  public static native boolean dumpProfile();
+
   public static Unsafe getUnsafe() {
     return unsafe;
   }
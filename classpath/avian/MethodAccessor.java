@@ -0,0 +1,407 @@
+/* Copyright (c) 2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+package avian;
+
+import static avian.Stream.write1;
+import static avian.Stream.write2;
+import static avian.Stream.write4;
+import static avian.Stream.set4;
+import static avian.Assembler.*;
+
+import avian.ConstantPool.PoolEntry;
+import avian.Assembler.MethodData;
+
+import java.lang.reflect.Modifier;
+import java.lang.reflect.InvocationTargetException;
+
+import java.util.List;
+import java.util.ArrayList;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+
+/**
+ * Calls a specific method on behalf of
+ * java.lang.reflect.Method.invoke.  Subclasses are generated at
+ * runtime once a method has been invoked reflectively often enough,
+ * and unbox their arguments and call the target directly rather than
+ * going through the VM's generic argument marshalling.
+ */
+public abstract class MethodAccessor {
+  private static int nextNumber;
+
+  public abstract Object invoke(Object instance, Object[] arguments)
+    throws InvocationTargetException;
+
+  /**
+   * Returns a new accessor for the specified method, or null if one
+   * cannot be generated.
+   */
+  public static MethodAccessor make(VMMethod method) {
+    int number;
+    synchronized (MethodAccessor.class) {
+      number = nextNumber++;
+    }
+
+    try {
+      return (MethodAccessor) SystemClassLoader.getClass
+        (makeClass(method, "MethodAccessor-" + number)).newInstance();
+    } catch (Throwable e) {
+      return null;
+    }
+  }
+
+  private static String boxClass(byte type) {
+    switch (type) {
+    case 'Z': return "java/lang/Boolean";
+    case 'B': return "java/lang/Byte";
+    case 'S': return "java/lang/Short";
+    case 'C': return "java/lang/Character";
+    case 'I': return "java/lang/Integer";
+    case 'F': return "java/lang/Float";
+    case 'J': return "java/lang/Long";
+    case 'D': return "java/lang/Double";
+    default: throw new IllegalArgumentException();
+    }
+  }
+
+  private static String unboxMethod(byte type) {
+    switch (type) {
+    case 'Z': return "booleanValue";
+    case 'B': return "byteValue";
+    case 'S': return "shortValue";
+    case 'C': return "charValue";
+    case 'I': return "intValue";
+    case 'F': return "floatValue";
+    case 'J': return "longValue";
+    case 'D': return "doubleValue";
+    default: throw new IllegalArgumentException();
+    }
+  }
+
+  // Returns the boxes other than Character whose values may be widened
+  // to the specified primitive type, the first being its own box.
+  private static String[] numberBoxes(byte type) {
+    switch (type) {
+    case 'S': return new String[] { "java/lang/Short", "java/lang/Byte" };
+
+    case 'I': return new String[] {
+        "java/lang/Integer", "java/lang/Short", "java/lang/Byte" };
+
+    case 'J': return new String[] {
+        "java/lang/Long", "java/lang/Integer", "java/lang/Short",
+        "java/lang/Byte" };
+
+    case 'F': return new String[] {
+        "java/lang/Float", "java/lang/Long", "java/lang/Integer",
+        "java/lang/Short", "java/lang/Byte" };
+
+    case 'D': return new String[] {
+        "java/lang/Double", "java/lang/Float", "java/lang/Long",
+        "java/lang/Integer", "java/lang/Short", "java/lang/Byte" };
+
+    default: return null;
+    }
+  }
+
+  private static int charConversion(byte type) {
+    switch (type) {
+    case 'J': return i2l;
+    case 'F': return i2f;
+    case 'D': return i2d;
+    default: return -1;
+    }
+  }
+
+  // Writes code which unboxes the argument on top of the stack to the
+  // specified primitive type, widening it if it is a box for a
+  // narrower type, as Method.invoke requires.  Any other argument
+  // fails the final checkcast or throws a NullPointerException, both
+  // of which Method.invoke reports as an IllegalArgumentException.
+  private static void writeUnbox(ByteArrayOutputStream out,
+                                 List<PoolEntry> pool,
+                                 byte type)
+    throws IOException
+  {
+    String box = boxClass(type);
+    String unboxSpec = "()" + (char) type;
+    String[] numbers = numberBoxes(type);
+
+    if (numbers == null) {
+      write1(out, checkcast);
+      write2(out, ConstantPool.addClass(pool, box) + 1);
+      write1(out, invokevirtual);
+      write2(out, ConstantPool.addMethodRef
+             (pool, box, unboxMethod(type), unboxSpec) + 1);
+      return;
+    }
+
+    boolean character = type != 'S';
+    int conversion = charConversion(type);
+
+    // every instruction below has a fixed size, so we can lay out the
+    // branches in advance, relative to the first instanceof test:
+    final int testSize = 8;
+    final int failureSize = 11;
+    int tests = numbers.length + (character ? 1 : 0);
+    int failure = tests * testSize;
+    int characterCase = failure + failureSize;
+    int number = characterCase
+      + (character ? 11 + (conversion < 0 ? 0 : 1) : 0);
+    int done = number + 8;
+
+    write1(out, astore);
+    write1(out, 3);
+
+    int position = 0;
+    for (int i = 0; i < numbers.length; ++i) {
+      write1(out, aload);
+      write1(out, 3);
+      write1(out, instanceof_);
+      write2(out, ConstantPool.addClass(pool, numbers[i]) + 1);
+      write1(out, ifne);
+      write2(out, number - (position + 5));
+      position += testSize;
+    }
+
+    if (character) {
+      write1(out, aload);
+      write1(out, 3);
+      write1(out, instanceof_);
+      write2(out, ConstantPool.addClass(pool, "java/lang/Character") + 1);
+      write1(out, ifne);
+      write2(out, characterCase - (position + 5));
+      position += testSize;
+    }
+
+    write1(out, aload);
+    write1(out, 3);
+    write1(out, checkcast);
+    write2(out, ConstantPool.addClass(pool, box) + 1);
+    write1(out, invokevirtual);
+    write2(out, ConstantPool.addMethodRef
+           (pool, box, unboxMethod(type), unboxSpec) + 1);
+    write1(out, goto_);
+    write2(out, done - (failure + 8));
+
+    if (character) {
+      write1(out, aload);
+      write1(out, 3);
+      write1(out, checkcast);
+      write2(out, ConstantPool.addClass(pool, "java/lang/Character") + 1);
+      write1(out, invokevirtual);
+      write2(out, ConstantPool.addMethodRef
+             (pool, "java/lang/Character", "charValue", "()C") + 1);
+      if (conversion >= 0) {
+        write1(out, conversion);
+      }
+      write1(out, goto_);
+      write2(out, done - (number - 3));
+    }
+
+    write1(out, aload);
+    write1(out, 3);
+    write1(out, checkcast);
+    write2(out, ConstantPool.addClass(pool, "java/lang/Number") + 1);
+    write1(out, invokevirtual);
+    write2(out, ConstantPool.addMethodRef
+           (pool, "java/lang/Number", unboxMethod(type), unboxSpec) + 1);
+  }
+
+  private static byte[] makeInvokeCode(List<PoolEntry> pool,
+                                       VMMethod method)
+    throws IOException
+  {
+    String className = Classes.toString(method.class_.name);
+    String name = Classes.toString(method.name);
+    String specString = Classes.toString(method.spec);
+    byte[] spec = method.spec;
+    boolean static_ = (method.flags & Modifier.STATIC) != 0;
+
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    write2(out, method.parameterFootprint + 3); // max stack
+    write2(out, 4); // max locals
+    write4(out, 0); // length (we'll set the real value later)
+
+    if (! static_) {
+      write1(out, aload_1);
+      write1(out, checkcast);
+      write2(out, ConstantPool.addClass(pool, className) + 1);
+    }
+
+    int ai = 0;
+    int si;
+    for (si = 1; spec[si] != ')'; ++si) {
+      write1(out, aload);
+      write1(out, 2);
+      write1(out, ldc_w);
+      write2(out, ConstantPool.addInteger(pool, ai) + 1);
+      write1(out, aaload);
+
+      switch (spec[si]) {
+      case 'L': {
+        int start = ++ si;
+        while (spec[si] != ';') ++si;
+
+        write1(out, checkcast);
+        write2(out, ConstantPool.addClass
+               (pool, new String(spec, start, si - start, false)) + 1);
+      } break;
+
+      case '[': {
+        int start = si;
+        while (spec[si] == '[') ++si;
+        if (spec[si] == 'L') {
+          while (spec[si] != ';') ++si;
+        }
+
+        write1(out, checkcast);
+        write2(out, ConstantPool.addClass
+               (pool, new String(spec, start, si - start + 1, false)) + 1);
+      } break;
+
+      default:
+        writeUnbox(out, pool, spec[si]);
+        break;
+      }
+
+      ++ ai;
+    }
+
+    // any exception thrown by the target (and nothing else) is
+    // wrapped in an InvocationTargetException, so we record the
+    // extent of the call instruction for the handler table below:
+    int start = out.size() - 8;
+
+    if (static_) {
+      write1(out, invokestatic);
+      write2(out, ConstantPool.addMethodRef
+             (pool, className, name, specString) + 1);
+    } else if ((method.class_.flags & Modifier.INTERFACE) != 0) {
+      write1(out, invokeinterface);
+      write2(out, ConstantPool.addMethodRef
+             (pool, className, name, specString) + 1);
+      write2(out, 0); // this will be ignored by the VM
+    } else if ((method.flags & Modifier.PRIVATE) != 0
+               || name.equals("<init>"))
+    {
+      write1(out, invokespecial);
+      write2(out, ConstantPool.addMethodRef
+             (pool, className, name, specString) + 1);
+    } else {
+      write1(out, invokevirtual);
+      write2(out, ConstantPool.addMethodRef
+             (pool, className, name, specString) + 1);
+    }
+
+    int end = out.size() - 8;
+
+    switch (spec[si + 1]) {
+    case 'L':
+    case '[':
+      break;
+
+    case 'V':
+      write1(out, aconst_null);
+      break;
+
+    default: {
+      String box = boxClass(spec[si + 1]);
+
+      write1(out, invokestatic);
+      write2(out, ConstantPool.addMethodRef
+             (pool, box, "valueOf",
+              "(" + (char) spec[si + 1] + ")L" + box + ";") + 1);
+    } break;
+    }
+
+    write1(out, areturn);
+
+    int handler = out.size() - 8;
+
+    String exceptionClass = "java/lang/reflect/InvocationTargetException";
+    write1(out, new_);
+    write2(out, ConstantPool.addClass(pool, exceptionClass) + 1);
+    write1(out, dup_x1);
+    write1(out, swap);
+    write1(out, invokespecial);
+    write2(out, ConstantPool.addMethodRef
+           (pool, exceptionClass, "<init>", "(Ljava/lang/Throwable;)V") + 1);
+    write1(out, athrow);
+
+    int length = out.size() - 8;
+
+    write2(out, 1); // exception handler table length
+    write2(out, start);
+    write2(out, end);
+    write2(out, handler);
+    write2(out, 0); // catch any type
+    write2(out, 0); // attribute count
+
+    byte[] result = out.toByteArray();
+    set4(result, 4, length);
+
+    return result;
+  }
+
+  private static byte[] makeConstructorCode(List<PoolEntry> pool)
+    throws IOException
+  {
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    write2(out, 1); // max stack
+    write2(out, 1); // max locals
+    write4(out, 5); // length
+
+    write1(out, aload_0);
+    write1(out, invokespecial);
+    write2(out, ConstantPool.addMethodRef
+           (pool, "avian/MethodAccessor", "<init>", "()V") + 1);
+    write1(out, return_);
+
+    write2(out, 0); // exception handler table length
+    write2(out, 0); // attribute count
+
+    return out.toByteArray();
+  }
+
+  private static VMClass makeClass(VMMethod method, String name)
+    throws IOException
+  {
+    List<PoolEntry> pool = new ArrayList();
+
+    MethodData[] methodTable = new MethodData[] {
+      new MethodData
+      (Modifier.PUBLIC,
+       ConstantPool.addUtf8(pool, "invoke"),
+       ConstantPool.addUtf8
+       (pool, "(Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;"),
+       makeInvokeCode(pool, method)),
+
+      new MethodData
+      (Modifier.PUBLIC,
+       ConstantPool.addUtf8(pool, "<init>"),
+       ConstantPool.addUtf8(pool, "()V"),
+       makeConstructorCode(pool))
+    };
+
+    int nameIndex = ConstantPool.addClass(pool, name);
+    int superIndex = ConstantPool.addClass(pool, "avian/MethodAccessor");
+
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    Assembler.writeClass
+      (out, pool, nameIndex, superIndex, new int[0], methodTable);
+
+    // define the accessor in the target's loader so that the class
+    // names it refers to resolve exactly as they do for the target:
+    byte[] classData = out.toByteArray();
+    return Classes.defineVMClass
+      (method.class_.loader, classData, 0, classData.length);
+  }
+}
@@ -30,6 +30,7 @@
 #  define READ _read
 #  define WRITE _write
 #  define STAT _wstat
+#  define FSTAT _fstat
 #  define STRUCT_STAT struct _stat
 #  define MKDIR(path, mode) _wmkdir(path)
 #  define CHMOD(path, mode) _wchmod(path, mode)
@@ -76,6 +77,7 @@ typedef wchar_t char_t;
 #  define READ read
 #  define WRITE write
 #  define STAT stat
+#  define FSTAT fstat
 #  define STRUCT_STAT struct stat
 #  define MKDIR mkdir
 #  define CHMOD chmod
@@ -154,9 +156,8 @@ doClose(JNIEnv* e, jint fd)
 }
 
 inline int
-doRead(JNIEnv* e, jint fd, jbyte* data, jint length)
+readResult(JNIEnv* e, int r)
 {
-  int r = READ(fd, data, length);
   if (r > 0) {
     return r;
   } else if (r == 0) {
@@ -167,15 +168,38 @@ doRead(JNIEnv* e, jint fd, jbyte* data, jint length)
   }  
 }
 
+inline int
+doRead(JNIEnv* e, jint fd, jbyte* data, jint length)
+{
+  return readResult(e, READ(fd, data, length));
+}
+
 inline void
-doWrite(JNIEnv* e, jint fd, const jbyte* data, jint length)
+writeResult(JNIEnv* e, int r, jint length)
 {
-  int r = WRITE(fd, data, length);
   if (r != length) {
     throwNewErrno(e, "java/io/IOException");
   }
 }
 
+inline void
+doWrite(JNIEnv* e, jint fd, const jbyte* data, jint length)
+{
+  writeResult(e, WRITE(fd, data, length), length);
+}
+
+// Returns true if the specified file is a regular file, which we may
+// read or write directly from a Java array in a critical region since
+// doing so will not wait on anything but the disk.  Anything else,
+// e.g. a pipe or terminal, may block indefinitely and hold up the
+// garbage collector, so we copy through a temporary buffer instead.
+inline bool
+regularFile(jint fd)
+{
+  STRUCT_STAT s;
+  return FSTAT(fd, &s) == 0 and S_ISREG(s.st_mode);
+}
+
 
 #ifdef PLATFORM_WINDOWS
 
@@ -725,6 +749,18 @@ extern "C" JNIEXPORT jint JNICALL
 Java_java_io_FileInputStream_read__I_3BII
 (JNIEnv* e, jclass, jint fd, jbyteArray b, jint offset, jint length)
 {
+  if (regularFile(fd)) {
+    jbyte* data = static_cast<jbyte*>(e->GetPrimitiveArrayCritical(b, 0));
+
+    int r = READ(fd, data + offset, length);
+    int error = errno;
+
+    e->ReleasePrimitiveArrayCritical(b, data, 0);
+
+    errno = error;
+    return readResult(e, r);
+  }
+
   jbyte* data = static_cast<jbyte*>(malloc(length));
   if (data == 0) {
     throwNew(e, "java/lang/OutOfMemoryError", 0);
@@ -733,7 +769,9 @@ Java_java_io_FileInputStream_read__I_3BII
 
   int r = doRead(e, fd, data, length);
 
-  e->SetByteArrayRegion(b, offset, length, data);
+  if (r > 0) {
+    e->SetByteArrayRegion(b, offset, r, data);
+  }
 
   free(data);
 
@@ -772,6 +810,19 @@ extern "C" JNIEXPORT void JNICALL
 Java_java_io_FileOutputStream_write__I_3BII
 (JNIEnv* e, jclass, jint fd, jbyteArray b, jint offset, jint length)
 {
+  if (regularFile(fd)) {
+    jbyte* data = static_cast<jbyte*>(e->GetPrimitiveArrayCritical(b, 0));
+
+    int r = WRITE(fd, data + offset, length);
+    int error = errno;
+
+    e->ReleasePrimitiveArrayCritical(b, data, 0);
+
+    errno = error;
+    writeResult(e, r, length);
+    return;
+  }
+
   jbyte* data = static_cast<jbyte*>(malloc(length));
 
   if (data == 0) {
@@ -20,6 +20,7 @@
 #  include <winsock2.h>
 #  include <ws2tcpip.h>
 #  include <errno.h>
+#  include <io.h>
 #  ifdef _MSC_VER
 #    define snprintf sprintf_s
 #  else
@@ -36,6 +37,12 @@
 #  include <netinet/ip.h>
 #  include <netinet/tcp.h>
 #  include <sys/socket.h>
+#  include <sys/uio.h>
+#  include <sys/mman.h>
+#  include <poll.h>
+#  ifdef __linux__
+#    include <sys/sendfile.h>
+#  endif
 #endif
 
 #define java_nio_channels_SelectionKey_OP_READ 1L
@@ -43,6 +50,11 @@
 #define java_nio_channels_SelectionKey_OP_CONNECT 8L
 #define java_nio_channels_SelectionKey_OP_ACCEPT 16L
 
+#define java_nio_channels_FileChannel_Unsupported -2L
+#define java_nio_channels_FileChannel_MapReadOnly 0L
+#define java_nio_channels_FileChannel_MapReadWrite 1L
+#define java_nio_channels_FileChannel_MapPrivate 2L
+
 #ifdef PLATFORM_WINDOWS
 typedef int socklen_t;
 #endif
@@ -382,6 +394,282 @@ makeSocket(JNIEnv* e, int type = SOCK_STREAM, int protocol = IPPROTO_TCP)
   return s;
 }
 
+// the most buffers passed to the kernel by a single scattering read or
+// gathering write; any more are left for the caller to retry
+const unsigned MaxVectorCount = 16;
+
+#ifndef PLATFORM_WINDOWS
+
+// Waits until the socket may be read from or written to without
+// blocking.  Blocking transfers on Java arrays wait here, outside of
+// any critical region, and then transfer without blocking, so that the
+// garbage collector is never held up waiting on the network.
+bool
+waitForSocket(int socket, bool write)
+{
+  pollfd p;
+  p.fd = socket;
+  p.events = write ? POLLOUT : POLLIN;
+  p.revents = 0;
+
+  int r;
+  do {
+    r = ::poll(&p, 1, -1);
+  } while (r < 0 and errno == EINTR);
+
+  return r > 0;
+}
+
+#endif
+
+// Reads into or writes from a region of a Java byte array, returning
+// the number of bytes transferred as read(2) or write(2) would.  A
+// blocking write transfers the whole region, as it would for a socket
+// in blocking mode.
+int
+transferArray(JNIEnv* e, int socket, jbyteArray buffer, jint offset,
+              jint length, bool blocking, bool write)
+{
+#ifdef PLATFORM_WINDOWS
+  int r;
+  if (blocking) {
+    // Winsock has no way to avoid blocking for a single call, so we
+    // copy through a temporary buffer rather than block while the
+    // array is in a critical region
+    uint8_t* buf = static_cast<uint8_t*>(allocate(e, length));
+    if (buf == 0) {
+      return 0;
+    }
+
+    if (write) {
+      e->GetByteArrayRegion
+        (buffer, offset, length, reinterpret_cast<jbyte*>(buf));
+      r = ::doWrite(socket, buf, length);
+    } else {
+      r = ::doRead(socket, buf, length);
+      if (r > 0) {
+        e->SetByteArrayRegion
+          (buffer, offset, r, reinterpret_cast<jbyte*>(buf));
+      }
+    }
+
+    free(buf);
+  } else {
+    uint8_t* buf = static_cast<uint8_t*>
+      (e->GetPrimitiveArrayCritical(buffer, 0));
+
+    if (write) {
+      r = ::doWrite(socket, buf + offset, length);
+    } else {
+      r = ::doRead(socket, buf + offset, length);
+    }
+
+    e->ReleasePrimitiveArrayCritical(buffer, buf, 0);
+  }
+  return r;
+#else
+  int total = 0;
+  while (true) {
+    if (blocking and not waitForSocket(socket, write)) {
+      return total ? total : -1;
+    }
+
+    uint8_t* buf = static_cast<uint8_t*>
+      (e->GetPrimitiveArrayCritical(buffer, 0));
+
+    int r;
+    if (write) {
+      r = ::send(socket, buf + offset + total, length - total, MSG_DONTWAIT);
+    } else {
+      r = ::recv(socket, buf + offset, length, MSG_DONTWAIT);
+    }
+    int error = errno;
+
+    e->ReleasePrimitiveArrayCritical(buffer, buf, 0);
+
+    errno = error;
+
+    if (r > 0) {
+      total += r;
+      if (not (blocking and write) or total == length) {
+        return total;
+      }
+    } else if (not (blocking and r < 0 and eagain())) {
+      return total ? total : r;
+    }
+  }
+#endif
+}
+
+int
+transferAddress(int socket, uint8_t* address, jint length, bool write)
+{
+  if (write) {
+    return ::doWrite(socket, address, length);
+  } else {
+    return ::doRead(socket, address, length);
+  }
+}
+
+// Reads into or writes from up to MaxVectorCount buffers with a single
+// system call.  Each element of buffers is either a byte array, or a
+// direct ByteBuffer whose memory is used as is.
+jlong
+transferVector(JNIEnv* e, int socket, jobjectArray buffers,
+               jintArray offsets, jintArray lengths, bool blocking,
+               bool write)
+{
+  jint count = e->GetArrayLength(buffers);
+  if (count > static_cast<jint>(MaxVectorCount)) {
+    count = MaxVectorCount;
+  }
+
+  jint offsetArray[MaxVectorCount];
+  jint lengthArray[MaxVectorCount];
+  e->GetIntArrayRegion(offsets, 0, count, offsetArray);
+  e->GetIntArrayRegion(lengths, 0, count, lengthArray);
+
+  jclass byteArrayType = e->FindClass("[B");
+  if (e->ExceptionCheck()) {
+    return 0;
+  }
+
+  // addresses[i] is null if objects[i] is a byte array
+  jobject objects[MaxVectorCount];
+  uint8_t* addresses[MaxVectorCount];
+  for (jint i = 0; i < count; ++i) {
+    objects[i] = e->GetObjectArrayElement(buffers, i);
+    if (e->IsInstanceOf(objects[i], byteArrayType)) {
+      addresses[i] = 0;
+    } else {
+      addresses[i] = static_cast<uint8_t*>
+        (e->GetDirectBufferAddress(objects[i]));
+    }
+  }
+
+#ifdef PLATFORM_WINDOWS
+  jlong total = 0;
+  for (jint i = 0; i < count; ++i) {
+    int r;
+    if (addresses[i]) {
+      r = transferAddress
+        (socket, addresses[i] + offsetArray[i], lengthArray[i], write);
+    } else {
+      r = transferArray
+        (e, socket, static_cast<jbyteArray>(objects[i]), offsetArray[i],
+         lengthArray[i], blocking, write);
+    }
+
+    if (r <= 0) {
+      return total ? total : r;
+    }
+
+    total += r;
+    if (r < lengthArray[i]) {
+      break;
+    }
+  }
+  return total;
+#else
+  jlong total = 0;
+  jint start = 0;
+  while (true) {
+    while (start < count and lengthArray[start] == 0) {
+      ++ start;
+    }
+
+    if (start == count) {
+      return total;
+    }
+
+    if (blocking and not waitForSocket(socket, write)) {
+      return total ? total : -1;
+    }
+
+    uint8_t* bodies[MaxVectorCount];
+    iovec vector[MaxVectorCount];
+    for (jint i = start; i < count; ++i) {
+      uint8_t* base = addresses[i];
+      if (base == 0) {
+        base = bodies[i] = static_cast<uint8_t*>
+          (e->GetPrimitiveArrayCritical
+           (static_cast<jarray>(objects[i]), 0));
+      }
+      vector[i - start].iov_base = base + offsetArray[i];
+      vector[i - start].iov_len = lengthArray[i];
+    }
+
+    msghdr message;
+    memset(&message, 0, sizeof(msghdr));
+    message.msg_iov = vector;
+    message.msg_iovlen = count - start;
+
+    ssize_t r;
+    if (write) {
+      r = ::sendmsg(socket, &message, MSG_DONTWAIT);
+    } else {
+      r = ::recvmsg(socket, &message, MSG_DONTWAIT);
+    }
+    int error = errno;
+
+    for (jint i = count - 1; i >= start; --i) {
+      if (addresses[i] == 0) {
+        e->ReleasePrimitiveArrayCritical
+          (static_cast<jarray>(objects[i]), bodies[i], 0);
+      }
+    }
+
+    errno = error;
+
+    if (r > 0) {
+      total += r;
+      if (not (blocking and write)) {
+        return total;
+      }
+
+      for (; r and start < count; ++ start) {
+        if (r < lengthArray[start]) {
+          offsetArray[start] += r;
+          lengthArray[start] -= r;
+          break;
+        }
+        r -= lengthArray[start];
+      }
+    } else if (not (blocking and r < 0 and eagain())) {
+      return total ? total : r;
+    }
+  }
+#endif
+}
+
+jlong
+readResult(JNIEnv* e, jlong r)
+{
+  if (r < 0) {
+    if (eagain()) {
+      return 0;
+    } else {
+      throwIOException(e);
+    }
+  } else if (r == 0) {
+    return -1;
+  }
+  return r;
+}
+
+jlong
+writeResult(JNIEnv* e, jlong r)
+{
+  if (r < 0) {
+    if (eagain()) {
+      return 0;
+    } else {
+      throwIOException(e);
+    }
+  }
+  return r;
+}
+
 } // namespace <anonymous>
 
 
@@ -516,39 +804,37 @@ Java_java_nio_channels_SocketChannel_natRead(JNIEnv *e,
 					     jint length,
                                              jboolean blocking)
 {
-  int r;
-  if (blocking) {
-    uint8_t* buf = static_cast<uint8_t*>(allocate(e, length));
-    if (buf) {
-      r = ::doRead(socket, buf, length);
-      if (r > 0) {
-        e->SetByteArrayRegion
-          (buffer, offset, r, reinterpret_cast<jbyte*>(buf));
-      }
-      free(buf);
-    } else {
-      return 0;
-    }
-  } else {
-    jboolean isCopy;
-    uint8_t* buf = static_cast<uint8_t*>
-      (e->GetPrimitiveArrayCritical(buffer, &isCopy));
+  return readResult
+    (e, transferArray(e, socket, buffer, offset, length, blocking, false));
+}
 
-    r = ::doRead(socket, buf + offset, length);
+extern "C" JNIEXPORT jint JNICALL
+Java_java_nio_channels_SocketChannel_natReadDirect(JNIEnv *e,
+                                                   jclass,
+                                                   jint socket,
+                                                   jobject buffer,
+                                                   jint offset,
+                                                   jint length)
+{
+  uint8_t* address = static_cast<uint8_t*>(e->GetDirectBufferAddress(buffer));
 
-    e->ReleasePrimitiveArrayCritical(buffer, buf, 0);
-  }
+  return readResult
+    (e, transferAddress(socket, address + offset, length, false));
+}
 
-  if (r < 0) {
-    if (eagain()) {
-      return 0;
-    } else {
-      throwIOException(e);
-    }
-  } else if (r == 0) {
-    return -1;
-  }
-  return r;
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_SocketChannel_natReadv(JNIEnv *e,
+                                              jclass,
+                                              jint socket,
+                                              jobjectArray buffers,
+                                              jintArray offsets,
+                                              jintArray lengths,
+                                              jboolean blocking)
+{
+  jlong r = transferVector
+    (e, socket, buffers, offsets, lengths, blocking, false);
+
+  return e->ExceptionCheck() ? 0 : readResult(e, r);
 }
 
 extern "C" JNIEXPORT jint JNICALL
@@ -611,35 +897,37 @@ Java_java_nio_channels_SocketChannel_natWrite(JNIEnv *e,
 					      jint length,
                                               jboolean blocking)
 {
-  int r;
-  if (blocking) {
-    uint8_t* buf = static_cast<uint8_t*>(allocate(e, length));
-    if (buf) {
-      e->GetByteArrayRegion
-        (buffer, offset, length, reinterpret_cast<jbyte*>(buf));
-      r = ::doWrite(socket, buf, length);
-      free(buf);
-    } else {
-      return 0;
-    }
-  } else {
-    jboolean isCopy;
-    uint8_t* buf = static_cast<uint8_t*>
-      (e->GetPrimitiveArrayCritical(buffer, &isCopy));
+  return writeResult
+    (e, transferArray(e, socket, buffer, offset, length, blocking, true));
+}
 
-    r = ::doWrite(socket, buf + offset, length);
+extern "C" JNIEXPORT jint JNICALL
+Java_java_nio_channels_SocketChannel_natWriteDirect(JNIEnv *e,
+                                                    jclass,
+                                                    jint socket,
+                                                    jobject buffer,
+                                                    jint offset,
+                                                    jint length)
+{
+  uint8_t* address = static_cast<uint8_t*>(e->GetDirectBufferAddress(buffer));
 
-    e->ReleasePrimitiveArrayCritical(buffer, buf, 0);
-  }
+  return writeResult
+    (e, transferAddress(socket, address + offset, length, true));
+}
 
-  if (r < 0) {
-    if (eagain()) {
-      return 0;
-    } else {
-      throwIOException(e);
-    }
-  }
-  return r;
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_SocketChannel_natWritev(JNIEnv *e,
+                                               jclass,
+                                               jint socket,
+                                               jobjectArray buffers,
+                                               jintArray offsets,
+                                               jintArray lengths,
+                                               jboolean blocking)
+{
+  jlong r = transferVector
+    (e, socket, buffers, offsets, lengths, blocking, true);
+
+  return e->ExceptionCheck() ? 0 : writeResult(e, r);
 }
 
 extern "C" JNIEXPORT jint JNICALL
@@ -1027,3 +1315,467 @@ Java_java_nio_ByteOrder_isNativeBigEndian(JNIEnv *, jclass)
     return JNI_TRUE;
   return JNI_FALSE;
 }
+
+namespace {
+
+void
+throwFileException(JNIEnv* e)
+{
+  throwIOException(e, errorString(e, errno));
+}
+
+// Reads or writes at the specified position without moving the file
+// position, or at the file position if the specified one is negative.
+int
+fileTransfer(int fd, void* buffer, jint count, jlong position, bool write)
+{
+#ifdef PLATFORM_WINDOWS
+  if (position >= 0) {
+    // there is no pread or pwrite for C runtime descriptors, so we
+    // move the file position and put it back afterwards
+    __int64 saved = _lseeki64(fd, 0, SEEK_CUR);
+    if (saved < 0 or _lseeki64(fd, position, SEEK_SET) < 0) {
+      return -1;
+    }
+
+    int r = write ? _write(fd, buffer, count) : _read(fd, buffer, count);
+    int error = errno;
+
+    _lseeki64(fd, saved, SEEK_SET);
+
+    errno = error;
+    return r;
+  } else {
+    return write ? _write(fd, buffer, count) : _read(fd, buffer, count);
+  }
+#else
+  if (position >= 0) {
+    return write
+      ? ::pwrite(fd, buffer, count, position)
+      : ::pread(fd, buffer, count, position);
+  } else {
+    return write
+      ? ::write(fd, buffer, count)
+      : ::read(fd, buffer, count);
+  }
+#endif
+}
+
+// Returns true if the specified descriptor refers to a regular file,
+// which we may read or write directly from a Java array in a critical
+// region.  Anything else, e.g. a pipe or terminal, may block
+// indefinitely and hold up the garbage collector, so we copy through
+// a temporary buffer instead.
+bool
+regularFile(int fd)
+{
+#ifdef PLATFORM_WINDOWS
+  struct _stati64 s;
+  return _fstati64(fd, &s) == 0 and (s.st_mode & _S_IFMT) == _S_IFREG;
+#else
+  struct stat s;
+  return fstat(fd, &s) == 0 and S_ISREG(s.st_mode);
+#endif
+}
+
+jint
+fileResult(JNIEnv* e, int r, bool write)
+{
+  if (r < 0) {
+    throwFileException(e);
+  } else if (r == 0 and not write) {
+    return -1;
+  }
+  return r;
+}
+
+// Returns the granularity to which the start of a file mapping must be
+// aligned.
+uintptr_t
+mappingAlignment()
+{
+#ifdef PLATFORM_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+#else
+  return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+} // namespace
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_FileChannel_natSize(JNIEnv* e, jclass, jint fd)
+{
+#ifdef PLATFORM_WINDOWS
+  struct _stati64 s;
+  int r = _fstati64(fd, &s);
+#else
+  struct stat s;
+  int r = fstat(fd, &s);
+#endif
+  if (r != 0) {
+    throwFileException(e);
+    return 0;
+  }
+  return s.st_size;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_java_nio_channels_FileChannel_natSetSize(JNIEnv* e, jclass, jint fd,
+                                              jlong size)
+{
+#ifdef PLATFORM_WINDOWS
+  int r = _chsize_s(fd, size) == 0 ? 0 : -1;
+#else
+  int r = ftruncate(fd, size);
+#endif
+  if (r != 0) {
+    throwFileException(e);
+  }
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_FileChannel_natPosition(JNIEnv* e, jclass, jint fd)
+{
+#ifdef PLATFORM_WINDOWS
+  jlong r = _lseeki64(fd, 0, SEEK_CUR);
+#else
+  jlong r = lseek(fd, 0, SEEK_CUR);
+#endif
+  if (r < 0) {
+    throwFileException(e);
+    return 0;
+  }
+  return r;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_java_nio_channels_FileChannel_natSetPosition(JNIEnv* e, jclass, jint fd,
+                                                  jlong position)
+{
+#ifdef PLATFORM_WINDOWS
+  jlong r = _lseeki64(fd, position, SEEK_SET);
+#else
+  jlong r = lseek(fd, position, SEEK_SET);
+#endif
+  if (r < 0) {
+    throwFileException(e);
+  }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_java_nio_channels_FileChannel_natForce(JNIEnv* e, jclass, jint fd,
+                                            jboolean metaData UNUSED)
+{
+#ifdef PLATFORM_WINDOWS
+  int r = _commit(fd);
+#elif defined __linux__
+  int r = metaData ? fsync(fd) : fdatasync(fd);
+#else
+  int r = fsync(fd);
+#endif
+  if (r != 0) {
+    throwFileException(e);
+  }
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_java_nio_channels_FileChannel_natRead(JNIEnv* e, jclass, jint fd,
+                                           jbyteArray buffer, jint offset,
+                                           jint length, jlong position)
+{
+  if (regularFile(fd)) {
+    uint8_t* buf = static_cast<uint8_t*>
+      (e->GetPrimitiveArrayCritical(buffer, 0));
+
+    int r = fileTransfer(fd, buf + offset, length, position, false);
+    int error = errno;
+
+    e->ReleasePrimitiveArrayCritical(buffer, buf, 0);
+
+    errno = error;
+    return fileResult(e, r, false);
+  }
+
+  uint8_t* buf = static_cast<uint8_t*>(malloc(length));
+  if (buf == 0) {
+    throwNew(e, "java/lang/OutOfMemoryError", 0);
+    return 0;
+  }
+
+  int r = fileTransfer(fd, buf, length, position, false);
+  int error = errno;
+
+  if (r > 0) {
+    e->SetByteArrayRegion(buffer, offset, r, reinterpret_cast<jbyte*>(buf));
+  }
+
+  free(buf);
+
+  errno = error;
+  return fileResult(e, r, false);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_java_nio_channels_FileChannel_natReadDirect(JNIEnv* e, jclass, jint fd,
+                                                 jobject buffer, jint offset,
+                                                 jint length, jlong position)
+{
+  uint8_t* address = static_cast<uint8_t*>(e->GetDirectBufferAddress(buffer));
+
+  return fileResult
+    (e, fileTransfer(fd, address + offset, length, position, false), false);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_java_nio_channels_FileChannel_natWrite(JNIEnv* e, jclass, jint fd,
+                                            jbyteArray buffer, jint offset,
+                                            jint length, jlong position)
+{
+  if (regularFile(fd)) {
+    uint8_t* buf = static_cast<uint8_t*>
+      (e->GetPrimitiveArrayCritical(buffer, 0));
+
+    int r = fileTransfer(fd, buf + offset, length, position, true);
+    int error = errno;
+
+    e->ReleasePrimitiveArrayCritical(buffer, buf, 0);
+
+    errno = error;
+    return fileResult(e, r, true);
+  }
+
+  uint8_t* buf = static_cast<uint8_t*>(malloc(length));
+  if (buf == 0) {
+    throwNew(e, "java/lang/OutOfMemoryError", 0);
+    return 0;
+  }
+
+  e->GetByteArrayRegion(buffer, offset, length, reinterpret_cast<jbyte*>(buf));
+
+  int r = fileTransfer(fd, buf, length, position, true);
+  int error = errno;
+
+  free(buf);
+
+  errno = error;
+  return fileResult(e, r, true);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_java_nio_channels_FileChannel_natWriteDirect(JNIEnv* e, jclass, jint fd,
+                                                  jobject buffer, jint offset,
+                                                  jint length, jlong position)
+{
+  uint8_t* address = static_cast<uint8_t*>(e->GetDirectBufferAddress(buffer));
+
+  return fileResult
+    (e, fileTransfer(fd, address + offset, length, position, true), true);
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_FileChannel_natMap(JNIEnv* e, jclass, jint fd,
+                                          jint mode, jlong position,
+                                          jlong size)
+{
+  // the mapping must start at an aligned offset, so we map from the
+  // preceding boundary and return a pointer into the middle
+  jlong skew = position % mappingAlignment();
+  jlong start = position - skew;
+  size_t length = size + skew;
+
+#ifdef PLATFORM_WINDOWS
+  DWORD protection;
+  DWORD access;
+  switch (mode) {
+  case java_nio_channels_FileChannel_MapReadOnly:
+    protection = PAGE_READONLY;
+    access = FILE_MAP_READ;
+    break;
+
+  case java_nio_channels_FileChannel_MapReadWrite:
+    protection = PAGE_READWRITE;
+    access = FILE_MAP_WRITE;
+    break;
+
+  default:
+    protection = PAGE_WRITECOPY;
+    access = FILE_MAP_COPY;
+    break;
+  }
+
+  jlong end = position + size;
+  HANDLE mapping = CreateFileMapping
+    (reinterpret_cast<HANDLE>(_get_osfhandle(fd)), 0, protection,
+     static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), 0);
+  if (mapping == 0) {
+    throwIOException(e, "unable to map file");
+    return 0;
+  }
+
+  void* p = MapViewOfFile
+    (mapping, access, static_cast<DWORD>(start >> 32),
+     static_cast<DWORD>(start), length);
+
+  // the view keeps the mapping object alive until it is unmapped
+  CloseHandle(mapping);
+
+  if (p == 0) {
+    throwIOException(e, "unable to map file");
+    return 0;
+  }
+#else
+  void* p = mmap
+    (0, length,
+     mode == java_nio_channels_FileChannel_MapReadOnly
+     ? PROT_READ : PROT_READ | PROT_WRITE,
+     mode == java_nio_channels_FileChannel_MapPrivate
+     ? MAP_PRIVATE : MAP_SHARED,
+     fd, start);
+
+  if (p == MAP_FAILED) {
+    throwFileException(e);
+    return 0;
+  }
+#endif
+
+  return reinterpret_cast<intptr_t>(static_cast<uint8_t*>(p) + skew);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_java_nio_channels_FileChannel_natUnmap(JNIEnv*, jclass, jlong address,
+                                            jlong size UNUSED)
+{
+  uintptr_t skew = static_cast<uintptr_t>(address) % mappingAlignment();
+  void* base = reinterpret_cast<void*>(static_cast<uintptr_t>(address - skew));
+
+#ifdef PLATFORM_WINDOWS
+  UnmapViewOfFile(base);
+#else
+  munmap(base, size + skew);
+#endif
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_java_nio_channels_FileChannel_natForceMapping(JNIEnv*, jclass,
+                                                   jlong address, jlong size)
+{
+  uintptr_t skew = static_cast<uintptr_t>(address) % mappingAlignment();
+  void* base = reinterpret_cast<void*>(static_cast<uintptr_t>(address - skew));
+
+#ifdef PLATFORM_WINDOWS
+  return FlushViewOfFile(base, size + skew) != 0;
+#else
+  return msync(base, size + skew, MS_SYNC) == 0;
+#endif
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_FileChannel_natTransferTo(JNIEnv* e UNUSED, jclass,
+                                                 jint fd UNUSED,
+                                                 jlong position UNUSED,
+                                                 jlong count UNUSED,
+                                                 jint target UNUSED)
+{
+#ifdef __linux__
+  off_t offset = position;
+  ssize_t r = ::sendfile(target, fd, &offset, count);
+  if (r < 0) {
+    if (eagain()) {
+      return 0;
+    } else if (errno == EINVAL or errno == ENOSYS) {
+      return java_nio_channels_FileChannel_Unsupported;
+    } else {
+      throwIOException(e);
+    }
+  }
+  return r;
+#elif (defined __APPLE__) || (defined __FreeBSD__)
+  // these only send to sockets
+# ifdef __APPLE__
+  off_t length = count;
+  int r = ::sendfile(fd, target, position, &length, 0, 0);
+# else
+  off_t length = 0;
+  int r = ::sendfile(fd, target, position, count, 0, &length, 0);
+# endif
+  if (r < 0) {
+    if (length > 0 or eagain()) {
+      return length;
+    } else if (errno == ENOTSOCK or errno == EINVAL or errno == ENOTSUP) {
+      return java_nio_channels_FileChannel_Unsupported;
+    } else {
+      throwIOException(e);
+    }
+  }
+  return length;
+#else
+  return java_nio_channels_FileChannel_Unsupported;
+#endif
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_java_nio_channels_FileChannel_natTransferFrom(JNIEnv* e UNUSED, jclass,
+                                                   jint source UNUSED,
+                                                   jint fd UNUSED,
+                                                   jlong position UNUSED,
+                                                   jlong count UNUSED)
+{
+#ifdef __linux__
+  // splice moves data between a pipe and something else, so we bounce
+  // it through a pipe of our own without copying it to user space
+  int pipes[2];
+  if (pipe(pipes) != 0) {
+    throwIOException(e);
+    return 0;
+  }
+
+  loff_t offset = position;
+  jlong total = 0;
+  bool failed = false;
+  while (total < count) {
+    ssize_t r = splice
+      (source, 0, pipes[1], 0, count - total, SPLICE_F_MOVE);
+
+    if (r < 0) {
+      if (total == 0 and (errno == EINVAL or errno == ENOSYS)) {
+        total = java_nio_channels_FileChannel_Unsupported;
+      } else if (not eagain()) {
+        failed = true;
+      }
+      break;
+    } else if (r == 0) {
+      break;
+    }
+
+    while (r > 0) {
+      ssize_t w = splice(pipes[0], 0, fd, &offset, r, SPLICE_F_MOVE);
+      if (w <= 0) {
+        failed = true;
+        break;
+      }
+      r -= w;
+      total += w;
+    }
+
+    if (failed) {
+      break;
+    }
+  }
+
+  int error = errno;
+  close(pipes[0]);
+  close(pipes[1]);
+
+  if (failed) {
+    errno = error;
+    throwIOException(e);
+  }
+
+  return total;
+#else
+  return java_nio_channels_FileChannel_Unsupported;
+#endif
+}
@@ -10,6 +10,8 @@
 
 package java.io;
 
+import java.nio.channels.FileChannel;
+
 public class FileInputStream extends InputStream {
   //   static {
   //     System.loadLibrary("natives");
@@ -17,6 +19,7 @@ public class FileInputStream extends InputStream {
 
   private int fd;
   private int remaining;
+  private FileChannel channel;
 
   public FileInputStream(FileDescriptor fd) {
     this.fd = fd.value;
@@ -57,7 +60,7 @@ public class FileInputStream extends InputStream {
       throw new NullPointerException();
     }
 
-    if (offset < 0 || offset + length > b.length) {
+    if (offset < 0 || length < 0 || offset + length > b.length) {
       throw new ArrayIndexOutOfBoundsException();
     }
 
@@ -68,10 +71,21 @@ public class FileInputStream extends InputStream {
     return c;
   }
 
+  public FileChannel getChannel() {
+    if (channel == null) {
+      channel = new FileChannel(fd, this, true, false);
+    }
+    return channel;
+  }
+
   public void close() throws IOException {
     if (fd != -1) {
       close(fd);
       fd = -1;
+
+      if (channel != null) {
+        channel.close();
+      }
     }
   }
 }
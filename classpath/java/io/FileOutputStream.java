@@ -10,12 +10,15 @@
 
 package java.io;
 
+import java.nio.channels.FileChannel;
+
 public class FileOutputStream extends OutputStream {
   //   static {
   //     System.loadLibrary("natives");
   //   }
 
   private int fd;
+  private FileChannel channel;
 
   public FileOutputStream(FileDescriptor fd) {
     this.fd = fd.value;
@@ -52,17 +55,28 @@ public class FileOutputStream extends OutputStream {
       throw new NullPointerException();
     }
 
-    if (offset < 0 || offset + length > b.length) {
+    if (offset < 0 || length < 0 || offset + length > b.length) {
       throw new ArrayIndexOutOfBoundsException();
     }
 
     write(fd, b, offset, length);
   }
 
+  public FileChannel getChannel() {
+    if (channel == null) {
+      channel = new FileChannel(fd, this, false, true);
+    }
+    return channel;
+  }
+
   public void close() throws IOException {
     if (fd != -1) {
       close(fd);
       fd = -1;
+
+      if (channel != null) {
+        channel.close();
+      }
     }
   }
 }
@@ -11,9 +11,11 @@
 package java.io;
 
 import java.lang.IllegalArgumentException;
+import java.nio.channels.FileChannel;
 
-public class RandomAccessFile {
+public class RandomAccessFile implements Closeable {
   private long peer;
+  private FileChannel channel;
   private File file;
   private long position = 0;
   private long length;
@@ -37,9 +39,16 @@ public class RandomAccessFile {
     throws FileNotFoundException;
 
   private void refresh() throws IOException {
-    if (file.length() != length) {
-      close();
-      open();
+    long length = file.length();
+    if (length != this.length) {
+      if (channel == null) {
+        close(peer);
+        open();
+      } else {
+        // reopening the file would leave the channel with a stale
+        // descriptor
+        this.length = length;
+      }
     }
   }
 
@@ -122,10 +131,21 @@ public class RandomAccessFile {
   private static native int readBytes(long peer, long position, byte[] buffer,
                                   int offset, int length);
 
+  public FileChannel getChannel() {
+    if (channel == null) {
+      channel = new FileChannel((int) peer, this, true, false);
+    }
+    return channel;
+  }
+
   public void close() throws IOException {
     if (peer != 0) {
       close(peer);
       peer = 0;
+
+      if (channel != null) {
+        channel.close();
+      }
     }
   }
 
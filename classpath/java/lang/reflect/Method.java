@@ -11,6 +11,7 @@
 package java.lang.reflect;
 
 import avian.VMMethod;
+import avian.MethodAccessor;
 import avian.AnnotationInvocationHandler;
 import avian.SystemClassLoader;
 import avian.Classes;
@@ -20,6 +21,8 @@ import java.lang.annotation.Annotation;
 public class Method<T> extends AccessibleObject implements Member {
   private final VMMethod vmMethod;
   private boolean accessible;
+  private MethodAccessor accessor;
+  private Class[] parameterTypes;
 
   public Method(VMMethod vmMethod) {
     this.vmMethod = vmMethod;
@@ -59,8 +62,16 @@ public class Method<T> extends AccessibleObject implements Member {
     return new String(vmMethod.spec, 0, vmMethod.spec.length - 1, false);
   }
 
+  private Class[] parameterTypes() {
+    Class[] types = parameterTypes;
+    if (types == null) {
+      parameterTypes = types = Classes.getParameterTypes(vmMethod);
+    }
+    return types;
+  }
+
   public Class[] getParameterTypes() {
-    return Classes.getParameterTypes(vmMethod);
+    return (Class[]) parameterTypes().clone();
   }
 
   public Object invoke(Object instance, Object ... arguments)
@@ -81,7 +92,22 @@ public class Method<T> extends AccessibleObject implements Member {
       }
 
       if (arguments.length == vmMethod.parameterCount) {
-        return invoke(vmMethod, instance, arguments);        
+        MethodAccessor a = accessor;
+        if (a == null) {
+          a = getAccessor(vmMethod);
+          if (a == null) {
+            return invoke(vmMethod, instance, checkArguments(arguments));
+          }
+          accessor = a;
+        }
+
+        try {
+          return a.invoke(instance, arguments);
+        } catch (ClassCastException e) {
+          throw new IllegalArgumentException(e);
+        } catch (NullPointerException e) {
+          throw new IllegalArgumentException(e);
+        }
       } else {
         throw new ArrayIndexOutOfBoundsException();
       }
@@ -92,6 +118,110 @@ public class Method<T> extends AccessibleObject implements Member {
     }
   }
 
+  private static boolean isIntegral(Object o) {
+    return o instanceof Integer || o instanceof Short || o instanceof Byte;
+  }
+
+  // Returns the box for the specified primitive type of o, converting
+  // o as necessary if it is a box for a narrower type, or throws
+  // IllegalArgumentException if it may not be converted.
+  private static Object unbox(byte type, Object o) {
+    switch (type) {
+    case 'Z':
+      if (o instanceof Boolean) return o;
+      break;
+
+    case 'B':
+      if (o instanceof Byte) return o;
+      break;
+
+    case 'C':
+      if (o instanceof Character) return o;
+      break;
+
+    case 'S':
+      if (o instanceof Short) return o;
+      if (o instanceof Byte) return Short.valueOf(((Byte) o).shortValue());
+      break;
+
+    case 'I':
+      if (o instanceof Integer) return o;
+      if (o instanceof Character) {
+        return Integer.valueOf(((Character) o).charValue());
+      }
+      if (isIntegral(o)) return Integer.valueOf(((Number) o).intValue());
+      break;
+
+    case 'J':
+      if (o instanceof Long) return o;
+      if (o instanceof Character) {
+        return Long.valueOf(((Character) o).charValue());
+      }
+      if (isIntegral(o)) return Long.valueOf(((Number) o).longValue());
+      break;
+
+    case 'F':
+      if (o instanceof Float) return o;
+      if (o instanceof Character) {
+        return Float.valueOf(((Character) o).charValue());
+      }
+      if (o instanceof Long || isIntegral(o)) {
+        return Float.valueOf(((Number) o).floatValue());
+      }
+      break;
+
+    case 'D':
+      if (o instanceof Double) return o;
+      if (o instanceof Character) {
+        return Double.valueOf(((Character) o).charValue());
+      }
+      if (o instanceof Float || o instanceof Long || isIntegral(o)) {
+        return Double.valueOf(((Number) o).doubleValue());
+      }
+      break;
+
+    default: break;
+    }
+    throw new IllegalArgumentException();
+  }
+
+  // The VM's generic invocation path neither checks argument types
+  // nor widens primitives, so we do both here, as the code in a
+  // generated MethodAccessor would.  The caller's array is copied
+  // before any argument is replaced.
+  private Object[] checkArguments(Object[] arguments) {
+    byte[] spec = vmMethod.spec;
+    Object[] result = arguments;
+    int ai = 0;
+    for (int si = 1; spec[si] != ')'; ++si) {
+      Object argument = arguments[ai];
+      byte type = spec[si];
+      if (type == 'L' || type == '[') {
+        while (spec[si] == '[') ++si;
+        if (spec[si] == 'L') {
+          while (spec[si] != ';') ++si;
+        }
+
+        if (argument != null && ! parameterTypes()[ai].isInstance(argument)) {
+          throw new IllegalArgumentException();
+        }
+      } else {
+        Object box = unbox(type, argument);
+        if (box != argument) {
+          if (result == arguments) {
+            result = (Object[]) arguments.clone();
+          }
+          result[ai] = box;
+        }
+      }
+
+      ++ ai;
+    }
+    return result;
+  }
+
+  private static native MethodAccessor getAccessor(VMMethod method);
+
   private static native Object invoke(VMMethod method, Object instance,
                                       Object ... arguments)
     throws InvocationTargetException, IllegalAccessException;
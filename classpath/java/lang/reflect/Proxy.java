@@ -24,18 +24,35 @@ import avian.ConstantPool.PoolEntry;
 
 import avian.Assembler;
 import avian.Assembler.MethodData;
+import avian.Assembler.FieldData;
 
 import java.util.List;
 import java.util.ArrayList;
 import java.util.Map;
 import java.util.HashMap;
+import java.util.WeakHashMap;
+import java.util.Arrays;
+import java.lang.ref.WeakReference;
 import java.io.OutputStream;
 import java.io.ByteArrayOutputStream;
 import java.io.IOException;
 
 public class Proxy {
+  private static final String MethodsField = "methods";
+  private static final String MethodsSpec = "[Ljava/lang/reflect/Method;";
+  private static final String NoArgumentsField = "noArguments";
+  private static final String NoArgumentsSpec = "[Ljava/lang/Object;";
+
   private static int nextNumber;
 
+  // proxy classes by defining loader and interface names.  The loaders
+  // are weakly referenced, and so are the classes, since each refers
+  // to its loader.  We key on names rather than the interfaces
+  // themselves, since those may belong to the loader as well, and a
+  // generated class refers to its interfaces by name anyway:
+  private static final Map<ClassLoader, Map<InterfaceList,
+    WeakReference<Class>>> classes = new WeakHashMap();
+
   protected InvocationHandler h;
 
   public static Class getProxyClass(ClassLoader loader,
@@ -47,17 +64,30 @@ public class Proxy {
       }
     }
 
-    int number;
+    InterfaceList key = new InterfaceList(interfaces);
+
     synchronized (Proxy.class) {
-      number = nextNumber++;
-    }
+      Map<InterfaceList, WeakReference<Class>> map = classes.get(loader);
+      if (map == null) {
+        map = new HashMap();
+        classes.put(loader, map);
+      }
 
-    try {
-      return makeClass(loader, interfaces, "Proxy-" + number);
-    } catch (IOException e) {
-      AssertionError error = new AssertionError();
-      error.initCause(e);
-      throw error;      
+      WeakReference<Class> reference = map.get(key);
+      Class c = reference == null ? null : reference.get();
+      if (c == null) {
+        try {
+          c = makeClass(loader, interfaces, "Proxy-" + (nextNumber++));
+        } catch (IOException e) {
+          AssertionError error = new AssertionError();
+          error.initCause(e);
+          throw error;      
+        }
+
+        map.put(key, new WeakReference(c));
+      }
+
+      return c;
     }
   }
 
@@ -90,20 +120,23 @@ public class Proxy {
 
     write1(out, aload_0);
     
-    write1(out, ldc_w);
-    write2(out, ConstantPool.addClass(pool, className) + 1);
+    write1(out, getstatic);
+    write2(out, ConstantPool.addFieldRef
+           (pool, className, MethodsField, MethodsSpec) + 1);
     write1(out, ldc_w);
     write2(out, ConstantPool.addInteger(pool, index) + 1);
-    write1(out, invokestatic);
-    write2(out, ConstantPool.addMethodRef
-           (pool, "avian/Classes",
-            "makeMethod", "(Ljava/lang/Class;I)Ljava/lang/reflect/Method;")
-           + 1);
+    write1(out, aaload);
 
-    write1(out, ldc_w);
-    write2(out, ConstantPool.addInteger(pool, parameterCount) + 1);
-    write1(out, anewarray);
-    write2(out, ConstantPool.addClass(pool, "java/lang/Object") + 1);
+    if (parameterCount == 0) {
+      write1(out, getstatic);
+      write2(out, ConstantPool.addFieldRef
+             (pool, className, NoArgumentsField, NoArgumentsSpec) + 1);
+    } else {
+      write1(out, ldc_w);
+      write2(out, ConstantPool.addInteger(pool, parameterCount) + 1);
+      write1(out, anewarray);
+      write2(out, ConstantPool.addClass(pool, "java/lang/Object") + 1);
+    }
 
     int ai = 0;
     int si;
@@ -340,6 +373,60 @@ public class Proxy {
     return out.toByteArray();
   }
 
+  private static byte[] makeStaticInitializerCode(List<PoolEntry> pool,
+                                                  String className,
+                                                  int methodCount)
+    throws IOException
+  {
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    write2(out, 5); // max stack
+    write2(out, 0); // max locals
+    write4(out, 0); // length (we'll set the real value later)
+
+    write1(out, ldc_w);
+    write2(out, ConstantPool.addInteger(pool, methodCount) + 1);
+    write1(out, anewarray);
+    write2(out, ConstantPool.addClass(pool, "java/lang/reflect/Method") + 1);
+
+    for (int i = 0; i < methodCount; ++i) {
+      write1(out, dup);
+      write1(out, ldc_w);
+      write2(out, ConstantPool.addInteger(pool, i) + 1);
+      write1(out, ldc_w);
+      write2(out, ConstantPool.addClass(pool, className) + 1);
+      write1(out, ldc_w);
+      write2(out, ConstantPool.addInteger(pool, i) + 1);
+      write1(out, invokestatic);
+      write2(out, ConstantPool.addMethodRef
+             (pool, "avian/Classes",
+              "makeMethod", "(Ljava/lang/Class;I)Ljava/lang/reflect/Method;")
+             + 1);
+      write1(out, aastore);
+    }
+
+    write1(out, putstatic);
+    write2(out, ConstantPool.addFieldRef
+           (pool, className, MethodsField, MethodsSpec) + 1);
+
+    write1(out, ldc_w);
+    write2(out, ConstantPool.addInteger(pool, 0) + 1);
+    write1(out, anewarray);
+    write2(out, ConstantPool.addClass(pool, "java/lang/Object") + 1);
+    write1(out, putstatic);
+    write2(out, ConstantPool.addFieldRef
+           (pool, className, NoArgumentsField, NoArgumentsSpec) + 1);
+
+    write1(out, return_);
+
+    write2(out, 0); // exception handler table length
+    write2(out, 0); // attribute count
+
+    byte[] result = out.toByteArray();
+    set4(result, 4, result.length - 12);
+
+    return result;
+  }
+
   private static Class makeClass(ClassLoader loader,
                                  Class[] interfaces,
                                  String name)
@@ -364,7 +451,7 @@ public class Proxy {
       }
     }
 
-    MethodData[] methodTable = new MethodData[virtualMap.size() + 1];
+    MethodData[] methodTable = new MethodData[virtualMap.size() + 2];
     { int i = 0;
       for (avian.VMMethod m: virtualMap.values()) {
         methodTable[i] = new MethodData
@@ -382,20 +469,59 @@ public class Proxy {
          ConstantPool.addUtf8
          (pool, "(Ljava/lang/reflect/InvocationHandler;)V"),
          makeConstructorCode(pool));
+
+      methodTable[i++] = new MethodData
+        (Modifier.STATIC,
+         ConstantPool.addUtf8(pool, "<clinit>"),
+         ConstantPool.addUtf8(pool, "()V"),
+         makeStaticInitializerCode(pool, name, virtualMap.size()));
     }
 
+    FieldData[] fieldTable = new FieldData[] {
+      new FieldData
+      (Modifier.PRIVATE | Modifier.STATIC | Modifier.FINAL,
+       ConstantPool.addUtf8(pool, MethodsField),
+       ConstantPool.addUtf8(pool, MethodsSpec)),
+
+      new FieldData
+      (Modifier.PRIVATE | Modifier.STATIC | Modifier.FINAL,
+       ConstantPool.addUtf8(pool, NoArgumentsField),
+       ConstantPool.addUtf8(pool, NoArgumentsSpec))
+    };
+
     int nameIndex = ConstantPool.addClass(pool, name);
     int superIndex = ConstantPool.addClass(pool, "java/lang/reflect/Proxy");
 
     ByteArrayOutputStream out = new ByteArrayOutputStream();
     Assembler.writeClass
-      (out, pool, nameIndex, superIndex, interfaceIndexes, methodTable);
+      (out, pool, nameIndex, superIndex, interfaceIndexes, fieldTable,
+       methodTable);
 
     byte[] classData = out.toByteArray();
     return avian.SystemClassLoader.getClass
       (avian.Classes.defineVMClass(loader, classData, 0, classData.length));
   }
 
+  private static class InterfaceList {
+    public final String[] names;
+
+    public InterfaceList(Class[] interfaces) {
+      names = new String[interfaces.length];
+      for (int i = 0; i < interfaces.length; ++i) {
+        names[i] = interfaces[i].getName();
+      }
+    }
+
+    public boolean equals(Object o) {
+      return o instanceof InterfaceList
+        && Arrays.equals(names, ((InterfaceList) o).names);
+    }
+
+    public int hashCode() {
+      return Arrays.hashCode(names);
+    }
+  }
+
   public static Object newProxyInstance(ClassLoader loader,
                                         Class[] interfaces,
                                         InvocationHandler handler)
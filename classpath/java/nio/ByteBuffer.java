@@ -52,6 +52,14 @@ public abstract class ByteBuffer
     return false;
   }
 
+  public boolean isDirect() {
+    return false;
+  }
+
+  public boolean isReadOnly() {
+    return readOnly;
+  }
+
   public ByteBuffer compact() {
     int remaining = remaining();
 
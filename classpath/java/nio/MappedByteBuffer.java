@@ -0,0 +1,19 @@
+/* Copyright (c) 2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+package java.nio;
+
+public abstract class MappedByteBuffer extends DirectByteBuffer {
+  protected MappedByteBuffer(long address, int capacity, boolean readOnly) {
+    super(address, capacity, readOnly);
+  }
+
+  public abstract MappedByteBuffer force();
+}
@@ -0,0 +1,411 @@
+/* Copyright (c) 2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+package java.nio.channels;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.ReadOnlyBufferException;
+
+public class FileChannel implements ReadableByteChannel, WritableByteChannel {
+  // returned by natTransferTo and natTransferFrom if the kernel cannot
+  // transfer between the specified descriptors itself
+  private static final int Unsupported = -2;
+
+  private static final int MapReadOnly = 0;
+  private static final int MapReadWrite = 1;
+  private static final int MapPrivate = 2;
+
+  private static final int TransferBufferSize = 8192;
+
+  private final int fd;
+  private final Closeable owner;
+  private final boolean readable;
+  private final boolean writable;
+  private boolean open = true;
+
+  // Wraps a descriptor owned by a FileInputStream, FileOutputStream or
+  // RandomAccessFile; closing the channel closes the owner.
+  public FileChannel(int fd, Closeable owner, boolean readable,
+                     boolean writable)
+  {
+    this.fd = fd;
+    this.owner = owner;
+    this.readable = readable;
+    this.writable = writable;
+  }
+
+  public boolean isOpen() {
+    return open;
+  }
+
+  public void close() throws IOException {
+    if (open) {
+      open = false;
+      owner.close();
+    }
+  }
+
+  private void checkReadable() throws IOException {
+    if (! open) throw new ClosedChannelException();
+    if (! readable) throw new NonReadableChannelException();
+  }
+
+  private void checkWritable() throws IOException {
+    if (! open) throw new ClosedChannelException();
+    if (! writable) throw new NonWritableChannelException();
+  }
+
+  public long position() throws IOException {
+    if (! open) throw new ClosedChannelException();
+
+    return natPosition(fd);
+  }
+
+  public FileChannel position(long position) throws IOException {
+    if (! open) throw new ClosedChannelException();
+    if (position < 0) throw new IllegalArgumentException();
+
+    natSetPosition(fd, position);
+    return this;
+  }
+
+  public long size() throws IOException {
+    if (! open) throw new ClosedChannelException();
+
+    return natSize(fd);
+  }
+
+  public FileChannel truncate(long size) throws IOException {
+    checkWritable();
+    if (size < 0) throw new IllegalArgumentException();
+
+    if (size < natSize(fd)) {
+      natSetSize(fd, size);
+    }
+
+    if (natPosition(fd) > size) {
+      natSetPosition(fd, size);
+    }
+
+    return this;
+  }
+
+  public void force(boolean metaData) throws IOException {
+    if (! open) throw new ClosedChannelException();
+
+    natForce(fd, metaData);
+  }
+
+  public int read(ByteBuffer dst) throws IOException {
+    return doRead(dst, -1);
+  }
+
+  public int read(ByteBuffer dst, long position) throws IOException {
+    if (position < 0) throw new IllegalArgumentException();
+
+    return doRead(dst, position);
+  }
+
+  // reads at the specified position, or at the channel position if it
+  // is negative
+  private int doRead(ByteBuffer b, long position) throws IOException {
+    checkReadable();
+    if (b.remaining() == 0) return 0;
+
+    int r;
+    if (b.isDirect()) {
+      if (b.isReadOnly()) throw new ReadOnlyBufferException();
+
+      r = natReadDirect(fd, b, b.position(), b.remaining(), position);
+    } else {
+      r = natRead(fd, b.array(), b.arrayOffset() + b.position(),
+                  b.remaining(), position);
+    }
+
+    if (r > 0) {
+      b.position(b.position() + r);
+    }
+    return r;
+  }
+
+  public int write(ByteBuffer src) throws IOException {
+    return doWrite(src, -1);
+  }
+
+  public int write(ByteBuffer src, long position) throws IOException {
+    if (position < 0) throw new IllegalArgumentException();
+
+    return doWrite(src, position);
+  }
+
+  private int doWrite(ByteBuffer b, long position) throws IOException {
+    checkWritable();
+    if (b.remaining() == 0) return 0;
+
+    int w;
+    if (b.isDirect()) {
+      w = natWriteDirect(fd, b, b.position(), b.remaining(), position);
+    } else {
+      w = natWrite(fd, b.array(), b.arrayOffset() + b.position(),
+                   b.remaining(), position);
+    }
+
+    if (w > 0) {
+      b.position(b.position() + w);
+    }
+    return w;
+  }
+
+  public MappedByteBuffer map(MapMode mode, long position, long size)
+    throws IOException
+  {
+    // a private mapping is copy-on-write, so it needs only read access
+    checkReadable();
+    if (mode == MapMode.READ_WRITE) {
+      checkWritable();
+    }
+
+    if (position < 0 || size < 0 || size > Integer.MAX_VALUE) {
+      throw new IllegalArgumentException();
+    }
+
+    // as with other implementations, a writable mapping extends the
+    // file if necessary
+    if (mode == MapMode.READ_WRITE && position + size > natSize(fd)) {
+      natSetSize(fd, position + size);
+    }
+
+    long address = size == 0 ? 0 : natMap(fd, mode.value, position, size);
+
+    return new MappedFile
+      (new Mapping(address, size), address, (int) size,
+       mode == MapMode.READ_ONLY);
+  }
+
+  public long transferTo(long position, long count,
+                         WritableByteChannel target)
+    throws IOException
+  {
+    checkReadable();
+    if (position < 0 || count < 0) throw new IllegalArgumentException();
+
+    long size = natSize(fd);
+    if (position >= size || count == 0) return 0;
+    count = Math.min(count, size - position);
+
+    int targetFD = -1;
+    if (target instanceof SocketChannel) {
+      targetFD = ((SocketChannel) target).socketFD();
+    } else if (target instanceof FileChannel) {
+      FileChannel c = (FileChannel) target;
+      c.checkWritable();
+      targetFD = c.fd;
+    }
+
+    if (targetFD != -1) {
+      long n = natTransferTo(fd, position, count, targetFD);
+      if (n != Unsupported) {
+        return n;
+      }
+    }
+
+    ByteBuffer buffer = ByteBuffer.allocate
+      ((int) Math.min(count, TransferBufferSize));
+    long total = 0;
+    while (total < count) {
+      buffer.clear();
+      buffer.limit((int) Math.min(count - total, buffer.capacity()));
+
+      int r = doRead(buffer, position + total);
+      if (r <= 0) {
+        break;
+      }
+
+      buffer.flip();
+      int w = target.write(buffer);
+      total += w;
+
+      if (w < r) {
+        break;
+      }
+    }
+    return total;
+  }
+
+  public long transferFrom(ReadableByteChannel src, long position,
+                           long count)
+    throws IOException
+  {
+    checkWritable();
+    if (position < 0 || count < 0) throw new IllegalArgumentException();
+
+    if (position > natSize(fd) || count == 0) return 0;
+
+    if (src instanceof SocketChannel) {
+      long n = natTransferFrom
+        (((SocketChannel) src).socketFD(), fd, position, count);
+      if (n != Unsupported) {
+        return n;
+      }
+    }
+
+    ByteBuffer buffer = ByteBuffer.allocate
+      ((int) Math.min(count, TransferBufferSize));
+    long total = 0;
+    while (total < count) {
+      buffer.clear();
+      buffer.limit((int) Math.min(count - total, buffer.capacity()));
+
+      int r = src.read(buffer);
+      if (r <= 0) {
+        break;
+      }
+
+      buffer.flip();
+      while (buffer.hasRemaining()) {
+        total += doWrite(buffer, position + total);
+      }
+    }
+    return total;
+  }
+
+  public static class MapMode {
+    public static final MapMode READ_ONLY
+      = new MapMode("READ_ONLY", MapReadOnly);
+
+    public static final MapMode READ_WRITE
+      = new MapMode("READ_WRITE", MapReadWrite);
+
+    public static final MapMode PRIVATE
+      = new MapMode("PRIVATE", MapPrivate);
+
+    private final String name;
+    private final int value;
+
+    private MapMode(String name, int value) {
+      this.name = name;
+      this.value = value;
+    }
+
+    public String toString() {
+      return name;
+    }
+  }
+
+  // A region of a file mapped into memory, which is unmapped once no
+  // buffer refers to it any longer.
+  private static class Mapping {
+    private final long address;
+    private final long size;
+
+    public Mapping(long address, long size) {
+      this.address = address;
+      this.size = size;
+    }
+
+    protected void finalize() {
+      if (size != 0) {
+        natUnmap(address, size);
+      }
+    }
+  }
+
+  private static class MappedFile extends MappedByteBuffer {
+    private final Mapping mapping;
+    private final long start;
+
+    public MappedFile(Mapping mapping, long start, int capacity,
+                      boolean readOnly)
+    {
+      super(start, capacity, readOnly);
+
+      this.mapping = mapping;
+      this.start = start;
+    }
+
+    public ByteBuffer asReadOnlyBuffer() {
+      ByteBuffer b = new MappedFile(mapping, start, capacity(), true);
+      b.position(position());
+      b.limit(limit());
+      return b;
+    }
+
+    public ByteBuffer slice() {
+      return new MappedFile
+        (mapping, start + position(), remaining(), isReadOnly());
+    }
+
+    public MappedByteBuffer force() {
+      if (capacity() != 0 && ! isReadOnly()
+          && ! natForceMapping(start, capacity()))
+      {
+        throw new RuntimeException("unable to write mapped buffer to file");
+      }
+      return this;
+    }
+
+    public String toString() {
+      return "(MappedFile with address: " + start
+        + " position: " + position()
+        + " limit: " + limit()
+        + " capacity: " + capacity() + ")";
+    }
+  }
+
+  private static native long natSize(int fd) throws IOException;
+
+  private static native void natSetSize(int fd, long size)
+    throws IOException;
+
+  private static native long natPosition(int fd) throws IOException;
+
+  private static native void natSetPosition(int fd, long position)
+    throws IOException;
+
+  private static native void natForce(int fd, boolean metaData)
+    throws IOException;
+
+  private static native int natRead(int fd, byte[] buffer, int offset,
+                                    int length, long position)
+    throws IOException;
+
+  private static native int natReadDirect(int fd, ByteBuffer buffer,
+                                          int offset, int length,
+                                          long position)
+    throws IOException;
+
+  private static native int natWrite(int fd, byte[] buffer, int offset,
+                                     int length, long position)
+    throws IOException;
+
+  private static native int natWriteDirect(int fd, ByteBuffer buffer,
+                                           int offset, int length,
+                                           long position)
+    throws IOException;
+
+  private static native long natMap(int fd, int mode, long position,
+                                    long size)
+    throws IOException;
+
+  private static native void natUnmap(long address, long size);
+
+  private static native boolean natForceMapping(long address, long size);
+
+  private static native long natTransferTo(int fd, long position, long count,
+                                           int target)
+    throws IOException;
+
+  private static native long natTransferFrom(int source, int fd,
+                                             long position, long count)
+    throws IOException;
+}
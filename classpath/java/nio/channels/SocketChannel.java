@@ -16,9 +16,10 @@ import java.net.SocketAddress;
 import java.net.InetSocketAddress;
 import java.net.Socket;
 import java.nio.ByteBuffer;
+import java.nio.ReadOnlyBufferException;
 
 public class SocketChannel extends SelectableChannel
-  implements ReadableByteChannel, GatheringByteChannel
+  implements ReadableByteChannel, GatheringByteChannel, ScatteringByteChannel
 {
   public static final int InvalidSocket = -1;
 
@@ -107,26 +108,65 @@ public class SocketChannel extends SelectableChannel
     if (! isOpen()) return -1;
     if (b.remaining() == 0) return 0;
 
-    byte[] array = b.array();
-    if (array == null) throw new NullPointerException();
+    int r;
+    if (b.isDirect()) {
+      if (b.isReadOnly()) throw new ReadOnlyBufferException();
+
+      r = natReadDirect(socket, b, b.position(), b.remaining());
+    } else {
+      byte[] array = b.array();
+      if (array == null) throw new NullPointerException();
+
+      r = natRead(socket, array, b.arrayOffset() + b.position(), b.remaining(), blocking);
+    }
 
-    int r = natRead(socket, array, b.arrayOffset() + b.position(), b.remaining(), blocking);
     if (r > 0) {
       b.position(b.position() + r);
     }
     return r;
   }
 
+  public long read(ByteBuffer[] dsts) throws IOException {
+    return read(dsts, 0, dsts.length);
+  }
+
+  public long read(ByteBuffer[] dsts, int offset, int length)
+    throws IOException
+  {
+    if (! isOpen()) return -1;
+
+    int end = offset + length;
+    for (int i = offset; i < end; ++i) {
+      if (dsts[i].isReadOnly()) throw new ReadOnlyBufferException();
+    }
+
+    while (offset < end && ! dsts[offset].hasRemaining()) {
+      ++ offset;
+    }
+
+    if (offset == end) {
+      return 0;
+    }
+
+    return transfer(dsts, offset, end - offset, false);
+  }
+
   public int write(ByteBuffer b) throws IOException {
     if (! connected) {
       natThrowWriteError(socket);
     }
     if (b.remaining() == 0) return 0;
 
-    byte[] array = b.array();
-    if (array == null) throw new NullPointerException();
+    int w;
+    if (b.isDirect()) {
+      w = natWriteDirect(socket, b, b.position(), b.remaining());
+    } else {
+      byte[] array = b.array();
+      if (array == null) throw new NullPointerException();
+
+      w = natWrite(socket, array, b.arrayOffset() + b.position(), b.remaining(), blocking);
+    }
 
-    int w = natWrite(socket, array, b.arrayOffset() + b.position(), b.remaining(), blocking);
     if (w > 0) {
       b.position(b.position() + w);
     }
@@ -140,14 +180,62 @@ public class SocketChannel extends SelectableChannel
   public long write(ByteBuffer[] srcs, int offset, int length)
     throws IOException
   {
+    if (! connected) {
+      natThrowWriteError(socket);
+    }
+
+    // the native code only hands so many buffers to the kernel at once,
+    // so keep going until everything is written or the socket is full
     long total = 0;
-    for (int i = offset; i < offset + length; ++i) {
-      total += write(srcs[i]);
-      if (srcs[i].hasRemaining()) {
+    int end = offset + length;
+    while (true) {
+      while (offset < end && ! srcs[offset].hasRemaining()) {
+        ++ offset;
+      }
+
+      if (offset == end) {
         return total;
       }
+
+      long w = transfer(srcs, offset, end - offset, true);
+      if (w <= 0) {
+        return total == 0 ? w : total;
+      }
+      total += w;
+    }
+  }
+
+  private long transfer(ByteBuffer[] buffers, int offset, int length,
+                        boolean write)
+    throws IOException
+  {
+    Object[] objects = new Object[length];
+    int[] offsets = new int[length];
+    int[] lengths = new int[length];
+    for (int i = 0; i < length; ++i) {
+      ByteBuffer b = buffers[offset + i];
+      if (b.isDirect()) {
+        objects[i] = b;
+        offsets[i] = b.position();
+      } else {
+        objects[i] = b.array();
+        offsets[i] = b.arrayOffset() + b.position();
+      }
+      lengths[i] = b.remaining();
+    }
+
+    long n = write
+      ? natWritev(socket, objects, offsets, lengths, blocking)
+      : natReadv(socket, objects, offsets, lengths, blocking);
+
+    long remaining = n;
+    for (int i = offset; remaining > 0 && i < offset + length; ++i) {
+      int count = (int) Math.min(remaining, buffers[i].remaining());
+      buffers[i].position(buffers[i].position() + count);
+      remaining -= count;
     }
-    return total;
+
+    return n;
   }
 
   private void closeSocket() {
@@ -184,6 +272,14 @@ public class SocketChannel extends SelectableChannel
     throws IOException;
   private static native int natWrite(int socket, byte[] buffer, int offset, int length, boolean blocking)
     throws IOException;
+  private static native int natReadDirect(int socket, ByteBuffer buffer, int offset, int length)
+    throws IOException;
+  private static native int natWriteDirect(int socket, ByteBuffer buffer, int offset, int length)
+    throws IOException;
+  private static native long natReadv(int socket, Object[] buffers, int[] offsets, int[] lengths, boolean blocking)
+    throws IOException;
+  private static native long natWritev(int socket, Object[] buffers, int[] offsets, int[] lengths, boolean blocking)
+    throws IOException;
   private static native void natThrowWriteError(int socket) throws IOException;
   private static native void natCloseSocket(int socket);
 }
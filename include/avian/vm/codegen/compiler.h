@@ -117,6 +117,8 @@ class Compiler {
   virtual void checkBounds(Operand* object, unsigned lengthOffset,
                            Operand* index, intptr_t handler) = 0;
 
+  virtual void checkNull(Operand* object) = 0;
+
   virtual void store(unsigned srcSize, Operand* src, unsigned dstSize,
                      Operand* dst) = 0;
   virtual Operand* load(unsigned srcSize, unsigned srcSelectSize, Operand* src,
@@ -67,6 +67,16 @@ class Heap: public Allocator {
   virtual void* tryAllocateImmortalFixed(Allocator* allocator,
                                          unsigned sizeInWords, bool objectMask,
                                          unsigned* totalInBytes) = 0;
+  // Keeps the specified object at its current address until a
+  // matching call to unpin.  Returns false if the object is too young
+  // to be pinned or the heap is too crowded to be compacted in place,
+  // in which case the caller must keep the collector from running for
+  // as long as it depends on the address.
+  virtual bool pin(void* p) = 0;
+
+  // Releases a pin taken by a successful call to pin.  Returns false
+  // if the object was not pinned.
+  virtual bool unpin(void* p) = 0;
   virtual void mark(void* p, unsigned offset, unsigned count) = 0;
   virtual void pad(void* p) = 0;
   virtual void* follow(void* p) = 0;
@@ -77,7 +87,10 @@ class Heap: public Allocator {
   virtual void dispose() = 0;
 };
 
-Heap* makeHeap(System* system, unsigned limit);
+// If compactGen2 is true, major collections compact the tenured
+// generation in place rather than copying it to a new space, except
+// when it needs to grow or shrink.
+Heap* makeHeap(System* system, unsigned limit, bool compactGen2 = false);
 
 } // namespace vm
 
@@ -133,12 +133,20 @@ class System : public avian::util::Aborter {
   virtual Status make(Local**) = 0;
   virtual Status handleSegFault(SignalHandler* handler) = 0;
   virtual Status handleDivideByZero(SignalHandler* handler) = 0;
+  // Calls visitor->visit from within whichever thread is running each
+  // time the process has used the specified amount of CPU time, or
+  // stops doing so if visitor is null.  The visitor runs in signal
+  // context and must not block or allocate.  A call which stops
+  // profiling returns only once no handler is using the old visitor.
+  virtual Status handleProfileTick(ThreadVisitor* visitor,
+                                   unsigned intervalInMicroseconds) = 0;
   virtual Status visit(Thread* thread, Thread* target,
                        ThreadVisitor* visitor) = 0;
   virtual uint64_t call(void* function, uintptr_t* arguments, uint8_t* types,
                         unsigned count, unsigned size,
                         unsigned returnType) = 0;
   virtual Status map(Region**, const char* name) = 0;
+  virtual Status mapImage(Region**, const char* name, void* address) = 0;
   virtual FileType stat(const char* name, unsigned* length) = 0;
   virtual Status open(Directory**, const char* name) = 0;
   virtual const char* libraryPrefix() = 0;
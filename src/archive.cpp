@@ -0,0 +1,976 @@
+/* Copyright (c) 2008-2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#include "avian/archive.h"
+#include "avian/util.h"
+#include "avian/alloc-vector.h"
+
+#include <avian/util/math.h>
+#include <avian/util/runtime-array.h>
+
+using namespace vm;
+using namespace avian::util;
+
+namespace {
+
+const bool DebugArchive = false;
+
+const uint32_t ArchiveMagic = 0x41435641; // "AVCA"
+const uint32_t ArchiveVersion = 2;
+
+// a checksum of the sources and options this VM was built from; see
+// the makefile
+const uint32_t ArchiveBuild =
+#include "build-id.cpp"
+  ;
+
+#ifdef AVIAN_PROCESS_compile
+const uint32_t ArchiveProcessor = 1;
+#else
+const uint32_t ArchiveProcessor = 0;
+#endif
+
+enum LoaderKind {
+  BootLoaderKind,
+  AppLoaderKind
+};
+
+const unsigned LoaderKindCount = AppLoaderKind + 1;
+
+// Describes how a pointer field of an archived object is filled in
+// when the object is materialized.  Anything which is not owned by
+// the archived class is referred to symbolically, so that the record
+// stays valid no matter where the heap puts things.
+enum ReferenceKind {
+  LocalReference,      // value: index of an object in the same record
+  ClassReference,      // value: index into the record's class table
+  MethodReference,     // value: class table index << 16 | method index
+  ClassFieldReference, // value: class table index << 16 | field offset
+  LoaderReference      // value: LoaderKind
+};
+
+const uint32_t InternedFlag = 1 << 0;
+
+class Header {
+ public:
+  uint32_t magic;
+  uint32_t version;
+  uint32_t wordSize;
+  uint32_t processor;
+  uint32_t build;
+  uint32_t layout;
+  uint32_t loaders;
+  uint32_t fingerprints[LoaderKindCount];
+  uint32_t recordCount;
+  uint32_t directoryOffset;
+};
+
+// A record holds one class and the objects it owns.  The header is
+// followed by the class name, the class table, and the objects, each
+// padded to a word boundary.  The class itself is always object zero.
+class RecordHeader {
+ public:
+  uint32_t loader;
+  uint32_t nameLength;
+  uint32_t classCount;
+  uint32_t objectCount;
+};
+
+// followed by the class name
+class ClassEntry {
+ public:
+  uint32_t loader;
+  uint32_t nameLength;
+};
+
+// followed by an image of the object, with its class and pointer
+// fields cleared, and then a Slot for each of those pointer fields
+// which is not null
+class ObjectHeader {
+ public:
+  uint32_t type;
+  uint32_t flags;
+  uint32_t size;
+  uint32_t slotCount;
+};
+
+class Slot {
+ public:
+  uint32_t offset;
+  uint32_t kind;
+  uint32_t value;
+};
+
+inline const uint8_t*
+recordName(const RecordHeader* r)
+{
+  return reinterpret_cast<const uint8_t*>(r + 1);
+}
+
+inline const uintptr_t*
+objectImage(const ObjectHeader* h)
+{
+  return reinterpret_cast<const uintptr_t*>(h + 1);
+}
+
+inline const Slot*
+objectSlots(const ObjectHeader* h)
+{
+  return reinterpret_cast<const Slot*>(objectImage(h) + h->size);
+}
+
+inline const ObjectHeader*
+nextObject(const ObjectHeader* h)
+{
+  return reinterpret_cast<const ObjectHeader*>
+    (reinterpret_cast<const uint8_t*>(objectSlots(h))
+     + pad(h->slotCount * sizeof(Slot)));
+}
+
+bool
+loaderKind(Thread* t, object loader, unsigned* kind)
+{
+  if (loader == root(t, Machine::BootLoader)) {
+    *kind = BootLoaderKind;
+    return true;
+  } else if (loader and loader == root(t, Machine::AppLoader)) {
+    *kind = AppLoaderKind;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+object
+loaderObject(Thread* t, unsigned kind)
+{
+  return root(t, kind == BootLoaderKind
+              ? Machine::BootLoader : Machine::AppLoader);
+}
+
+// Identifies the layout of the built-in types.  This is checked in
+// addition to ArchiveBuild, which covers everything else about the
+// VM that wrote an archive.
+uint32_t
+layoutHash(Thread* t)
+{
+  uint32_t h = 0;
+  for (unsigned i = 0; i < arrayLength(t, t->m->types); ++i) {
+    object c = arrayBody(t, t->m->types, i);
+    if (c) {
+      h = (h * 31) + classFixedSize(t, c);
+      h = (h * 31) + classArrayElementSize(t, c);
+
+      object mask = classObjectMask(t, c);
+      if (mask) {
+        for (unsigned j = 0; j < intArrayLength(t, mask); ++j) {
+          h = (h * 31) + intArrayBody(t, mask, j);
+        }
+      }
+    }
+  }
+  return h;
+}
+
+void
+appendName(Vector* out, const void* name, unsigned length)
+{
+  out->append(name, length);
+  while (out->length() % BytesPerWord) {
+    out->append(static_cast<uint8_t>(0));
+  }
+}
+
+// Maps objects to their positions in a record while it is being
+// written.  No collection may happen meanwhile, so raw addresses
+// serve as keys.
+class ObjectIndex {
+ public:
+  ObjectIndex(Allocator* allocator):
+    allocator(allocator), capacity(0), count(0), keys(0), values(0)
+  { }
+
+  int find(object o) {
+    if (capacity) {
+      for (unsigned i = hash(o) & (capacity - 1); keys[i];
+           i = (i + 1) & (capacity - 1))
+      {
+        if (keys[i] == o) {
+          return values[i];
+        }
+      }
+    }
+    return -1;
+  }
+
+  void add(object o, unsigned value) {
+    if ((count + 1) * 2 > capacity) {
+      grow();
+    }
+
+    unsigned i = hash(o) & (capacity - 1);
+    while (keys[i]) {
+      i = (i + 1) & (capacity - 1);
+    }
+
+    keys[i] = o;
+    values[i] = value;
+    ++ count;
+  }
+
+  void grow() {
+    unsigned oldCapacity = capacity;
+    object* oldKeys = keys;
+    unsigned* oldValues = values;
+
+    capacity = oldCapacity ? oldCapacity * 2 : 256;
+    keys = static_cast<object*>
+      (allocator->allocate(capacity * sizeof(object)));
+    values = static_cast<unsigned*>
+      (allocator->allocate(capacity * sizeof(unsigned)));
+    memset(keys, 0, capacity * sizeof(object));
+
+    count = 0;
+    for (unsigned i = 0; i < oldCapacity; ++i) {
+      if (oldKeys[i]) {
+        add(oldKeys[i], oldValues[i]);
+      }
+    }
+
+    if (oldCapacity) {
+      allocator->free(oldKeys, oldCapacity * sizeof(object));
+      allocator->free(oldValues, oldCapacity * sizeof(unsigned));
+    }
+  }
+
+  static unsigned hash(object o) {
+    return reinterpret_cast<uintptr_t>(o) / BytesPerWord;
+  }
+
+  void dispose() {
+    if (capacity) {
+      allocator->free(keys, capacity * sizeof(object));
+      allocator->free(values, capacity * sizeof(unsigned));
+    }
+  }
+
+  Allocator* allocator;
+  unsigned capacity;
+  unsigned count;
+  object* keys;
+  unsigned* values;
+};
+
+// Serializes a newly parsed class along with every object reachable
+// from it which it owns.  This never allocates from the heap, so the
+// objects stay put while we work.
+class Writer {
+ public:
+  Writer(Thread* t, object class_):
+    t(t),
+    class_(class_),
+    objects(t->m->system, t->m->heap, 256 * BytesPerWord),
+    classes(t->m->system, t->m->heap, 16 * BytesPerWord),
+    index(t->m->heap)
+  { }
+
+  ~Writer() {
+    index.dispose();
+  }
+
+  bool write(Vector* record) {
+    unsigned loader;
+    if (not loaderKind(t, classLoader(t, class_), &loader)) {
+      return false;
+    }
+
+    add(class_);
+
+    Vector body(t->m->system, t->m->heap, 4096);
+    for (unsigned i = 0; i < objectCount(); ++i) {
+      if (not writeObject(&body, objectAt(i))) {
+        return false;
+      }
+    }
+
+    object name = className(t, class_);
+    RecordHeader header;
+    header.loader = loader;
+    header.nameLength = byteArrayLength(t, name) - 1;
+    header.classCount = classCount();
+    header.objectCount = objectCount();
+
+    record->append(&header, sizeof(RecordHeader));
+    appendName(record, &byteArrayBody(t, name, 0), header.nameLength);
+
+    for (unsigned i = 0; i < classCount(); ++i) {
+      object c = classAt(i);
+      ClassEntry entry;
+      loaderKind(t, classLoader(t, c), &loader);
+      entry.loader = loader;
+      entry.nameLength = byteArrayLength(t, className(t, c)) - 1;
+
+      record->append(&entry, sizeof(ClassEntry));
+      appendName(record, &byteArrayBody(t, className(t, c), 0),
+                 entry.nameLength);
+    }
+
+    record->append(body.data, body.length());
+
+    return true;
+  }
+
+  bool writeObject(Vector* body, object o) {
+    object c = objectClass(t, o);
+
+    unsigned typeIndex;
+    if (not findType(c, &typeIndex)
+        or (classVmFlags(t, c) & (WeakReferenceFlag | HasFinalizerFlag)))
+    {
+      return false;
+    }
+
+    ObjectHeader header;
+    header.type = typeIndex;
+    header.flags = interned(o) ? InternedFlag : 0;
+    header.size = baseSize(t, o, c);
+    header.slotCount = 0;
+
+    unsigned headerOffset = body->length();
+    body->append(&header, sizeof(ObjectHeader));
+
+    unsigned imageOffset = body->length();
+    body->append(o, header.size * BytesPerWord);
+
+    uintptr_t zero = 0;
+    body->set(imageOffset, &zero, BytesPerWord);
+
+    if (c == type(t, Machine::ClassType)) {
+      // the processor fills in the vtable of each new copy
+      for (unsigned i = ceilingDivide(classFixedSize(t, c), BytesPerWord);
+           i < header.size; ++i)
+      {
+        body->set(imageOffset + (i * BytesPerWord), &zero, BytesPerWord);
+      }
+    } else if (c == type(t, Machine::CodeType)) {
+      // ...as well as the entry point of each method
+      body->set(imageOffset + CodeCompiled, &zero, BytesPerWord);
+    }
+
+    class Walker: public Heap::Walker {
+     public:
+      Walker(Writer* w, Vector* body, object o, unsigned imageOffset):
+        w(w), body(body), o(o), imageOffset(imageOffset), count(0), ok(true)
+      { }
+
+      virtual bool visit(unsigned offset) {
+        // the class is recorded in the object header instead
+        if (offset) {
+          object p = fieldAtOffset<object>(o, offset * BytesPerWord);
+          if (p) {
+            Slot slot;
+            slot.offset = offset;
+            if (not w->reference(p, &(slot.kind), &(slot.value))) {
+              ok = false;
+              return false;
+            }
+
+            uintptr_t zero = 0;
+            body->set(imageOffset + (offset * BytesPerWord), &zero,
+                      BytesPerWord);
+            body->append(&slot, sizeof(Slot));
+            ++ count;
+          }
+        }
+        return true;
+      }
+
+      Writer* w;
+      Vector* body;
+      object o;
+      unsigned imageOffset;
+      unsigned count;
+      bool ok;
+    } walker(this, body, o, imageOffset);
+
+    walk(t, &walker, o, 0);
+
+    if (not walker.ok) {
+      return false;
+    }
+
+    header.slotCount = walker.count;
+    body->set(headerOffset, &header, sizeof(ObjectHeader));
+
+    while (body->length() % BytesPerWord) {
+      body->append(static_cast<uint8_t>(0));
+    }
+
+    return true;
+  }
+
+  bool reference(object p, uint32_t* kind, uint32_t* value) {
+    object c = objectClass(t, p);
+    if (c == type(t, Machine::ClassType)) {
+      if (self(p)) {
+        *kind = LocalReference;
+        *value = 0;
+        return true;
+      } else {
+        *kind = ClassReference;
+        return classIndex(p, value);
+      }
+    } else if (c == type(t, Machine::MethodType)
+               and not self(methodClass(t, p)))
+    {
+      object owner = methodClass(t, p);
+      object table = classMethodTable(t, owner);
+      uint32_t ci;
+      if (table and classIndex(owner, &ci) and ci <= 0xFFFF) {
+        for (unsigned i = 0; i < arrayLength(t, table) and i <= 0xFFFF; ++i) {
+          if (arrayBody(t, table, i) == p) {
+            *kind = MethodReference;
+            *value = (ci << 16) | i;
+            return true;
+          }
+        }
+      }
+      return false;
+    } else if (c == type(t, Machine::FieldType)
+               and not self(fieldClass(t, p)))
+    {
+      return false;
+    }
+
+    unsigned loader;
+    if (loaderKind(t, p, &loader)) {
+      *kind = LoaderReference;
+      *value = loader;
+      return true;
+    }
+
+    // a class which declares nothing new may share these with its
+    // superclass
+    object super = classSuper(t, class_);
+    if (super) {
+      const unsigned fields[] = {
+        ClassVirtualTable, ClassInterfaceTable, ClassObjectMask
+      };
+
+      for (unsigned i = 0; i < sizeof(fields) / sizeof(unsigned); ++i) {
+        if (p == fieldAtOffset<object>(super, fields[i])) {
+          uint32_t ci;
+          if (classIndex(super, &ci) and ci <= 0xFFFF) {
+            *kind = ClassFieldReference;
+            *value = (ci << 16) | fields[i];
+            return true;
+          } else {
+            return false;
+          }
+        }
+      }
+    }
+
+    int i = index.find(p);
+    if (i < 0) {
+      i = objectCount();
+      add(p);
+    }
+
+    *kind = LocalReference;
+    *value = i;
+    return true;
+  }
+
+  // Returns true if the specified class is the one being archived or
+  // the temporary copy of it made while parsing.
+  bool self(object c) {
+    return c == class_
+      or (classLoader(t, c) == classLoader(t, class_)
+          and byteArrayEqual(t, className(t, c), className(t, class_)));
+  }
+
+  bool classIndex(object c, uint32_t* index) {
+    for (unsigned i = 0; i < classCount(); ++i) {
+      if (classAt(i) == c) {
+        *index = i;
+        return true;
+      }
+    }
+
+    unsigned loader;
+    if (loaderKind(t, classLoader(t, c), &loader)) {
+      *index = classCount();
+      classes.appendAddress(c);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  bool findType(object c, unsigned* index) {
+    for (unsigned i = 0; i < arrayLength(t, t->m->types); ++i) {
+      if (arrayBody(t, t->m->types, i) == c) {
+        *index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool interned(object o) {
+    object c = objectClass(t, o);
+    object n;
+    if (c == type(t, Machine::ByteArrayType)) {
+      n = weakHashMapFindNode
+        (t, root(t, Machine::ByteArrayMap), o, byteArrayHash, byteArrayEqual);
+    } else if (c == type(t, Machine::StringType)) {
+      n = weakHashMapFindNode
+        (t, root(t, Machine::StringMap), o, stringHash, stringEqual);
+    } else {
+      return false;
+    }
+    return n and weakNodeKey(t, n) == o;
+  }
+
+  void add(object o) {
+    index.add(o, objectCount());
+    objects.appendAddress(o);
+  }
+
+  unsigned objectCount() {
+    return objects.length() / BytesPerWord;
+  }
+
+  object objectAt(unsigned i) {
+    return reinterpret_cast<object>(objects.getAddress(i * BytesPerWord));
+  }
+
+  unsigned classCount() {
+    return classes.length() / BytesPerWord;
+  }
+
+  object classAt(unsigned i) {
+    return reinterpret_cast<object>(classes.getAddress(i * BytesPerWord));
+  }
+
+  Thread* t;
+  object class_;
+  Vector objects;
+  Vector classes;
+  ObjectIndex index;
+};
+
+object
+resolve(Thread* t, object objects, object classes, const Slot* slot)
+{
+  switch (slot->kind) {
+  case LocalReference:
+    return arrayBody(t, objects, slot->value);
+
+  case ClassReference:
+    return arrayBody(t, classes, slot->value);
+
+  case MethodReference:
+    return arrayBody
+      (t, classMethodTable(t, arrayBody(t, classes, slot->value >> 16)),
+       slot->value & 0xFFFF);
+
+  case ClassFieldReference:
+    return fieldAtOffset<object>
+      (arrayBody(t, classes, slot->value >> 16), slot->value & 0xFFFF);
+
+  case LoaderReference:
+    return loaderObject(t, slot->value);
+
+  default: abort(t);
+  }
+}
+
+void
+fill(Thread* t, object objects, object classes, unsigned index,
+     const ObjectHeader* h)
+{
+  object o = arrayBody(t, objects, index);
+  const Slot* slots = objectSlots(h);
+  for (unsigned i = 0; i < h->slotCount; ++i) {
+    set(t, o, slots[i].offset * BytesPerWord,
+        resolve(t, objects, classes, slots + i));
+  }
+}
+
+object
+materialize(Thread* t, const RecordHeader* r, Machine::Type throwType)
+{
+  const uint8_t* p = recordName(r) + pad(r->nameLength);
+
+  object classes = makeArray(t, r->classCount);
+  PROTECT(t, classes);
+
+  for (unsigned i = 0; i < r->classCount; ++i) {
+    const ClassEntry* e = reinterpret_cast<const ClassEntry*>(p);
+    p += sizeof(ClassEntry);
+
+    object name = makeByteArray(t, e->nameLength + 1);
+    memcpy(&byteArrayBody(t, name, 0), p, e->nameLength);
+    byteArrayBody(t, name, e->nameLength) = 0;
+    p += pad(e->nameLength);
+
+    object c = resolveClass
+      (t, loaderObject(t, e->loader), name, true, throwType);
+
+    set(t, classes, ArrayBody + (i * BytesPerWord), c);
+  }
+
+  const ObjectHeader* first = reinterpret_cast<const ObjectHeader*>(p);
+
+  object objects = makeArray(t, r->objectCount);
+  PROTECT(t, objects);
+
+  // allocate everything first, leaving pointer fields null until all
+  // the objects they might refer to exist
+  const ObjectHeader* h = first;
+  for (unsigned i = 0; i < r->objectCount; ++i) {
+    expect(t, h->type < arrayLength(t, t->m->types));
+
+    object c = arrayBody(t, t->m->types, h->type);
+    object o = allocate
+      (t, h->size * BytesPerWord,
+       classObjectMask(t, c) or (classVmFlags(t, c) & SingletonFlag));
+
+    // the first word holds the class along with any flags the heap
+    // set when allocating
+    memcpy(&fieldAtOffset<uintptr_t>(o, BytesPerWord), objectImage(h) + 1,
+           (h->size - 1) * BytesPerWord);
+    setObjectClass(t, o, c);
+
+    set(t, objects, ArrayBody + (i * BytesPerWord), o);
+
+    h = nextObject(h);
+  }
+
+  // interned strings refer to byte arrays which may themselves be
+  // interned, so we replace the arrays with their canonical copies
+  // before looking up the strings
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    h = first;
+    for (unsigned i = 0; i < r->objectCount; ++i) {
+      if ((h->flags & InternedFlag) and (h->slotCount != 0) == (pass == 1)) {
+        fill(t, objects, classes, i, h);
+
+        object o = arrayBody(t, objects, i);
+        if (objectClass(t, o) == type(t, Machine::StringType)) {
+          o = intern(t, o);
+        } else {
+          o = internByteArray(t, o);
+        }
+
+        set(t, objects, ArrayBody + (i * BytesPerWord), o);
+      }
+
+      h = nextObject(h);
+    }
+  }
+
+  h = first;
+  for (unsigned i = 0; i < r->objectCount; ++i) {
+    if ((h->flags & InternedFlag) == 0) {
+      fill(t, objects, classes, i, h);
+
+      object o = arrayBody(t, objects, i);
+      if (objectClass(t, o) == type(t, Machine::MethodType)) {
+        t->m->processor->initMethod(t, o);
+      }
+    }
+
+    h = nextObject(h);
+  }
+
+  object class_ = arrayBody(t, objects, 0);
+
+  t->m->processor->initVtable(t, class_);
+
+  return class_;
+}
+
+class MyArchive: public Archive {
+ public:
+  class Entry {
+   public:
+    const RecordHeader* record;
+    Entry* next;
+  };
+
+  MyArchive(Thread* t, const char* file):
+    s(t->m->system),
+    allocator(t->m->heap),
+    file(copy(allocator, file)),
+    region(0),
+    table(0),
+    entries(0),
+    capacity(0),
+    recordCount(0),
+    lock(0),
+    records(s, allocator, 64 * 1024),
+    offsets(s, allocator, 1024),
+    layout(layoutHash(t)),
+    loaders(0)
+  {
+    Finder* finders[] = { t->m->bootFinder, t->m->appFinder };
+    for (unsigned i = 0; i < LoaderKindCount; ++i) {
+      if (finders[i]->fingerprint(fingerprints + i)) {
+        loaders |= 1 << i;
+      } else {
+        fingerprints[i] = 0;
+      }
+    }
+
+    if (not (s->success(s->map(&region, file)) and open())) {
+      if (region) {
+        region->dispose();
+        region = 0;
+      }
+
+      // no archive yet, or the class path has changed since it was
+      // written, so record a new one as we go and write it out when
+      // we're disposed
+      expect(s, s->success(s->make(&lock)));
+    }
+  }
+
+  // Checks that the mapped archive was written by this build of the VM
+  // for the same class paths, and indexes its records if so.
+  bool open() {
+    if (region->length() < sizeof(Header)) {
+      return false;
+    }
+
+    const Header* h = reinterpret_cast<const Header*>(region->start());
+    if (h->magic != ArchiveMagic
+        or h->version != ArchiveVersion
+        or h->wordSize != BytesPerWord
+        or h->processor != ArchiveProcessor
+        or h->build != ArchiveBuild
+        or h->layout != layout
+        or h->loaders != loaders)
+    {
+      return false;
+    }
+
+    for (unsigned i = 0; i < LoaderKindCount; ++i) {
+      if (h->fingerprints[i] != fingerprints[i]) {
+        return false;
+      }
+    }
+
+    if (h->directoryOffset > region->length()
+        or region->length() - h->directoryOffset != h->recordCount * 4)
+    {
+      return false;
+    }
+
+    recordCount = h->recordCount;
+    capacity = nextPowerOfTwo(recordCount ? recordCount : 1);
+    table = static_cast<Entry**>
+      (allocator->allocate(capacity * sizeof(Entry*)));
+    memset(table, 0, capacity * sizeof(Entry*));
+    entries = static_cast<Entry*>
+      (allocator->allocate((recordCount ? recordCount : 1) * sizeof(Entry)));
+
+    const uint32_t* directory = reinterpret_cast<const uint32_t*>
+      (region->start() + h->directoryOffset);
+
+    for (unsigned i = 0; i < recordCount; ++i) {
+      if (directory[i] + sizeof(RecordHeader) > h->directoryOffset) {
+        return false;
+      }
+
+      const RecordHeader* r = reinterpret_cast<const RecordHeader*>
+        (region->start() + directory[i]);
+
+      unsigned bucket = hash(recordName(r), r->nameLength) & (capacity - 1);
+      Entry* e = entries + i;
+      e->record = r;
+      e->next = table[bucket];
+      table[bucket] = e;
+    }
+
+    return true;
+  }
+
+  const RecordHeader* find(unsigned loader, const uint8_t* name,
+                           unsigned length)
+  {
+    for (Entry* e = table[hash(name, length) & (capacity - 1)]; e;
+         e = e->next)
+    {
+      const RecordHeader* r = e->record;
+      if (r->loader == loader and r->nameLength == length
+          and memcmp(recordName(r), name, length) == 0)
+      {
+        return r;
+      }
+    }
+    return 0;
+  }
+
+  virtual object load(Thread* t, object loader, object spec,
+                      Machine::Type throwType)
+  {
+    unsigned kind;
+    if (region == 0 or not loaderKind(t, loader, &kind)) {
+      return 0;
+    }
+
+    const RecordHeader* r = find
+      (kind, reinterpret_cast<const uint8_t*>(&byteArrayBody(t, spec, 0)),
+       byteArrayLength(t, spec) - 1);
+
+    if (r) {
+      if (DebugArchive) {
+        fprintf(stderr, "loading %s from archive\n",
+                &byteArrayBody(t, spec, 0));
+      }
+
+      return materialize(t, r, throwType);
+    } else {
+      return 0;
+    }
+  }
+
+  virtual void save(Thread* t, object class_) {
+    unsigned kind;
+    if (lock == 0
+        or not loaderKind(t, classLoader(t, class_), &kind)
+        or (loaders & (1 << kind)) == 0)
+    {
+      return;
+    }
+
+    Vector record(s, allocator, 4096);
+    Writer writer(t, class_);
+    if (writer.write(&record)) {
+      lock->acquire();
+
+      offsets.append4(records.length());
+      records.append(record.data, record.length());
+
+      lock->release();
+    } else if (DebugArchive) {
+      fprintf(stderr, "unable to archive %s\n",
+              &byteArrayBody(t, className(t, class_), 0));
+    }
+  }
+
+  void write() {
+    // write to a temporary file and then rename it, so that any
+    // process which has the old archive mapped is unaffected
+    unsigned length = strlen(file);
+    RUNTIME_ARRAY(char, temporary, length + 5);
+    memcpy(RUNTIME_ARRAY_BODY(temporary), file, length);
+    memcpy(RUNTIME_ARRAY_BODY(temporary) + length, ".tmp", 5);
+
+    FILE* out = vm::fopen(RUNTIME_ARRAY_BODY(temporary), "wb");
+    if (out == 0) {
+      if (DebugArchive) {
+        fprintf(stderr, "unable to open %s\n", RUNTIME_ARRAY_BODY(temporary));
+      }
+      return;
+    }
+
+    unsigned start = pad(sizeof(Header));
+
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    header.magic = ArchiveMagic;
+    header.version = ArchiveVersion;
+    header.wordSize = BytesPerWord;
+    header.processor = ArchiveProcessor;
+    header.build = ArchiveBuild;
+    header.layout = layout;
+    header.loaders = loaders;
+    memcpy(header.fingerprints, fingerprints, sizeof(fingerprints));
+    header.recordCount = offsets.length() / 4;
+    header.directoryOffset = start + records.length();
+
+    uint8_t padding[BytesPerWord] = { 0 };
+    fwrite(&header, sizeof(Header), 1, out);
+    fwrite(padding, 1, start - sizeof(Header), out);
+    fwrite(records.data, 1, records.length(), out);
+
+    for (unsigned i = 0; i < header.recordCount; ++i) {
+      uint32_t offset = start + offsets.get4(i * 4);
+      fwrite(&offset, 4, 1, out);
+    }
+
+    bool ok = ferror(out) == 0;
+    ok = fclose(out) == 0 and ok;
+
+    if (ok and ::rename(RUNTIME_ARRAY_BODY(temporary), file) != 0) {
+      // some systems won't rename over an existing file
+      ::remove(file);
+      ok = ::rename(RUNTIME_ARRAY_BODY(temporary), file) == 0;
+    }
+
+    if (not ok) {
+      ::remove(RUNTIME_ARRAY_BODY(temporary));
+    }
+  }
+
+  virtual void dispose() {
+    if (lock) {
+      write();
+      lock->dispose();
+    }
+
+    if (region) {
+      region->dispose();
+    }
+
+    if (table) {
+      allocator->free(table, capacity * sizeof(Entry*));
+      allocator->free(entries, (recordCount ? recordCount : 1)
+                      * sizeof(Entry));
+    }
+
+    records.dispose();
+    offsets.dispose();
+
+    allocator->free(file, strlen(file) + 1);
+    allocator->free(this, sizeof(*this));
+  }
+
+  System* s;
+  Allocator* allocator;
+  const char* file;
+  System::Region* region;
+  Entry** table;
+  Entry* entries;
+  unsigned capacity;
+  unsigned recordCount;
+  System::Mutex* lock;
+  Vector records;
+  Vector offsets;
+  uint32_t layout;
+  uint32_t loaders;
+  uint32_t fingerprints[LoaderKindCount];
+};
+
+} // namespace
+
+namespace vm {
+
+Archive*
+makeArchive(Thread* t, const char* file)
+{
+  return new (t->m->heap->allocate(sizeof(MyArchive))) MyArchive(t, file);
+}
+
+} // namespace vm
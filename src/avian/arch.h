@@ -49,4 +49,20 @@ compileTimeMemoryBarrier()
 #  error unsupported architecture
 #endif
 
+#ifdef USE_ATOMIC_OPERATIONS
+namespace vm {
+
+inline void
+atomicAdd(volatile uintptr_t* p, intptr_t v)
+{
+  uintptr_t* q = const_cast<uintptr_t*>(p);
+  for (uintptr_t old = *p;
+       not atomicCompareAndSwap(q, old, old + v);
+       old = *p)
+  { }
+}
+
+} // namespace vm
+#endif // USE_ATOMIC_OPERATIONS
+
 #endif//ARCH_H
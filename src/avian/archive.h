@@ -0,0 +1,49 @@
+/* Copyright (c) 2008-2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "avian/machine.h"
+
+namespace vm {
+
+// A file of classes parsed by an earlier run of the VM, allowing
+// later runs with the same class path to skip parsing them.  The
+// file is mapped read-only, so the pages holding it are shared by
+// every process using it.
+class Archive {
+ public:
+  // Returns a new copy of the named class as it was when it was
+  // archived, or null if the archive has no such class for the
+  // specified system class loader.  The caller is responsible for
+  // registering the class just as if it had been parsed.
+  virtual object load(Thread* t, object loader, object spec,
+                      Machine::Type throwType) = 0;
+
+  // Records a class which was just parsed by a system class loader,
+  // if this archive is being built.  Classes which refer to objects
+  // the archive cannot represent are silently skipped.
+  virtual void save(Thread* t, object class_) = 0;
+
+  // Writes the archive out if it is being built, then frees it.
+  virtual void dispose() = 0;
+};
+
+// Maps the specified file if it holds a valid archive for the current
+// class paths; otherwise, returns an archive which records the
+// classes parsed during this run and replaces the file with them on
+// exit.
+Archive*
+makeArchive(Thread* t, const char* file);
+
+} // namespace vm
+
+#endif//ARCHIVE_H
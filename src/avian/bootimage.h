@@ -51,8 +51,33 @@ class BootImage {
 #undef FIELD
 
   ThunkCollection thunks;
+
+  // If non-zero, the heap and the compiled method addresses it
+  // contains were resolved at build time against these addresses
+  // rather than being stored as offsets (see BootImageFile):
+  uint64_t heapBase;
+  uint64_t codeBase;
 } PACKED;
 
+// A boot image and its code image written to a single file which may
+// be mapped at runtime instead of being linked into the executable.
+// Both sections start on an ImageFileAlignment boundary, and base is
+// the address the generator relocated the file for (zero if it did
+// not).
+class BootImageFile {
+ public:
+  static const uint32_t Magic = 0x42494d47;
+
+  uint32_t magic;
+  uint32_t codeOffset;
+  uint32_t codeSize;
+  uint32_t imageOffset;
+  uint32_t imageSize;
+  uint64_t base;
+} PACKED;
+
+const unsigned ImageFileAlignment = 64 * 1024;
+
 class OffsetResolver {
  public:
   virtual unsigned fieldOffset(Thread*, object) = 0;
@@ -87,6 +87,10 @@ inline uint16_t localExtraFieldLength(const uint8_t* localHeader) {
   return get2(localHeader + 28);
 }
 
+inline uint32_t centralDirectorySize(const uint8_t* centralHeader) {
+  return get4(centralHeader + 12);
+}
+
 inline uint32_t centralDirectoryOffset(const uint8_t* centralHeader) {
   return get4(centralHeader + 16);
 }
@@ -170,11 +174,29 @@ class Finder {
   virtual const char* urlPrefix(const char* name) = 0;
   virtual const char* sourceUrl(const char* name) = 0;
   virtual const char* path() = 0;
+
+  // Computes a value which identifies the path along with the current
+  // contents of each jar on it, returning false if the path contains
+  // anything else, such as a directory, whose contents cannot be
+  // identified that way.
+  virtual bool fingerprint(uint32_t* value) = 0;
+
+  // Starts threadCount threads which inflate compressed entries in the
+  // background.  If profile names an existing file, it is read as a
+  // newline-separated list of entries to prefetch in that order;
+  // otherwise, the names of the entries found are appended to it when
+  // the finder is disposed.
+  virtual void prefetch(unsigned threadCount, const char* profile) = 0;
+
   virtual void dispose() = 0;
 };
 
+// If indexCache is non-null, it names a file used to persist the
+// finder's index of the entries on the path, allowing later instances
+// created with the same path to skip scanning each jar.
 JNIEXPORT Finder*
-makeFinder(System* s, Allocator* a, const char* path, const char* bootLibrary);
+makeFinder(System* s, Allocator* a, const char* path, const char* bootLibrary,
+           const char* indexCache = 0);
 
 Finder*
 makeFinder(System* s, Allocator* a, const uint8_t* jarData,
@@ -18,6 +18,13 @@
 #define EMBED_PREFIX_PROPERTY "avian.embed.prefix"
 #define CLASSPATH_PROPERTY "java.class.path"
 #define JAVA_HOME_PROPERTY "java.home"
+#define CLASSPATH_PREFETCH_PROPERTY "avian.classpath.prefetch"
+#define CLASSPATH_PROFILE_PROPERTY "avian.classpath.profile"
+#define CLASSPATH_INDEX_PROPERTY "avian.classpath.index"
+#define GC_COMPACT_PROPERTY "avian.gc.compact"
+#define INTERN_STATS_PROPERTY "avian.intern.stats"
+#define ARCHIVE_PROPERTY "avian.archive"
+#define PROFILE_PROPERTY "avian.profile"
 #define BOOTCLASSPATH_PREPEND_OPTION "bootclasspath/p"
 #define BOOTCLASSPATH_OPTION "bootclasspath"
 #define BOOTCLASSPATH_APPEND_OPTION "bootclasspath/a"
@@ -16,13 +16,24 @@
 
 namespace vm {
 
+// Large inputs may be split into chunks which are compressed
+// independently so that they can be decoded in parallel.  Chunked
+// data starts with LZMAChunkedMagic (which can't be mistaken for the
+// properties byte of an ordinary LZMA stream), the chunk count, and
+// the total uncompressed size, followed by the compressed size of
+// each chunk and then the chunks themselves, each an ordinary LZMA
+// stream.  All integers are four bytes, little-endian.
+const uint32_t LZMAChunkedMagic = 0x435a4cff;
+const unsigned LZMAChunkSize = 1024 * 1024;
+const unsigned LZMADecodeThreadCount = 4;
+
 uint8_t*
 decodeLZMA(System* s, Allocator* a, uint8_t* in, unsigned inSize,
            unsigned* outSize);
 
 uint8_t*
 encodeLZMA(System* s, Allocator* a, uint8_t* in, unsigned inSize,
-           unsigned* outSize);
+           unsigned* outSize, unsigned chunkSize = 0);
 
 } // namespace vm
 
@@ -162,6 +162,9 @@ const unsigned ContinuationFlag = 1 << 11;
 // method vmFlags:
 const unsigned ClassInitFlag = 1 << 0;
 const unsigned ConstructorFlag = 1 << 1;
+const unsigned EffectivelyFinalFlag = 1 << 2;
+const unsigned LazyCompileFlag = 1 << 3;
+const unsigned TrivialConstructorFlag = 1 << 4;
 
 #ifndef JNI_VERSION_1_6
 #define JNI_VERSION_1_6 0x00010006
@@ -1193,6 +1196,10 @@ class Reference {
 
 class Classpath;
 
+class ClassLoadLock;
+class Archive;
+class Profiler;
+
 class Machine {
  public:
   enum Type {
@@ -1259,6 +1266,9 @@ class Machine {
   Thread* exclusive;
   Thread* finalizeThread;
   Reference* jniReferences;
+  ClassLoadLock* classLoadLocks;
+  Archive* archive;
+  Profiler* profiler;
   const char** properties;
   unsigned propertyCount;
   const char** arguments;
@@ -1274,10 +1284,12 @@ class Machine {
   System::Monitor* heapLock;
   System::Monitor* classLock;
   System::Monitor* referenceLock;
+  System::Monitor* internLock;
   System::Monitor* shutdownLock;
   System::Library* libraries;
   FILE* errorLog;
   BootImage* bootimage;
+  System::Region* bootimageRegion;
   object types;
   object roots;
   object finalizers;
@@ -1295,6 +1307,8 @@ class Machine {
   uintptr_t* heapPool[ThreadHeapPoolSize];
   unsigned heapPoolIndex;
   unsigned bootimageSize;
+  unsigned internLockCount;
+  unsigned internContentionCount;
 };
 
 void
@@ -1500,6 +1514,18 @@ class Thread {
     Thread* t;
   };
 
+  // A buffer handed out by GetStringChars or GetStringUTFChars.  A
+  // few released buffers are kept per thread for reuse by later
+  // calls (see jnienv.cpp).
+  class StringBuffer {
+   public:
+    StringBuffer(uintptr_t capacity): next(0), capacity(capacity) { }
+
+    StringBuffer* next;
+    uintptr_t capacity;
+    uint8_t data[0];
+  };
+
   Thread(Machine* m, object javaThread, Thread* parent);
 
   void init();
@@ -1530,6 +1556,7 @@ class Thread {
   uintptr_t backupHeap[ThreadBackupHeapSizeInWords];
   unsigned backupHeapIndex;
   unsigned flags;
+  StringBuffer* stringBuffers;
 };
 
 class Classpath {
@@ -3322,6 +3349,9 @@ exceptionMatch(Thread* t, object type, object exception)
 object
 intern(Thread* t, object s);
 
+object
+internByteArray(Thread* t, object array);
+
 void
 walk(Thread* t, Heap::Walker* w, object o, unsigned start);
 
@@ -3730,7 +3760,7 @@ getMethodRuntimeData(Thread* t, object method)
     ACQUIRE(t, t->m->classLock);
 
     if (methodRuntimeDataIndex(t, method) == 0) {
-      object runtimeData = makeMethodRuntimeData(t, 0);
+      object runtimeData = makeMethodRuntimeData(t, 0, 0, 0);
 
       setRoot(t, Machine::MethodRuntimeDataTable, vectorAppend
               (t, root(t, Machine::MethodRuntimeDataTable), runtimeData));
@@ -3900,6 +3930,102 @@ lineNumberLine(uint64_t ln)
   return ln & 0xFFFFFFFF;
 }
 
+// The exception handler and line number tables of a method are kept
+// in class file form, as a byte array in the exception handler table
+// field, until the method is compiled (see parseCode).  The following
+// functions read either form without allocating.
+
+inline bool
+codeTablesExpanded(Thread* t, object tables)
+{
+  return tables == 0
+    or objectClass(t, tables) != type(t, Machine::ByteArrayType);
+}
+
+inline unsigned
+codeTablesRead2(Thread* t, object tables, unsigned offset)
+{
+  return (static_cast<unsigned>
+          (static_cast<uint8_t>(byteArrayBody(t, tables, offset))) << 8)
+    | static_cast<uint8_t>(byteArrayBody(t, tables, offset + 1));
+}
+
+inline unsigned
+codeExceptionHandlerCount(Thread* t, object code)
+{
+  object tables = codeExceptionHandlerTable(t, code);
+  if (codeTablesExpanded(t, tables)) {
+    return tables ? exceptionHandlerTableLength(t, tables) : 0;
+  } else {
+    return codeTablesRead2(t, tables, 0);
+  }
+}
+
+inline uint64_t
+codeExceptionHandler(Thread* t, object code, unsigned index)
+{
+  object tables = codeExceptionHandlerTable(t, code);
+  if (codeTablesExpanded(t, tables)) {
+    return exceptionHandlerTableBody(t, tables, index);
+  } else {
+    unsigned offset = 2 + (index * 8);
+    return exceptionHandler
+      (codeTablesRead2(t, tables, offset),
+       codeTablesRead2(t, tables, offset + 2),
+       codeTablesRead2(t, tables, offset + 4),
+       codeTablesRead2(t, tables, offset + 6));
+  }
+}
+
+inline unsigned
+codeLineNumberTablesOffset(Thread* t, object tables)
+{
+  return 2 + (codeTablesRead2(t, tables, 0) * 8);
+}
+
+inline unsigned
+codeLineNumberCount(Thread* t, object code)
+{
+  object tables = codeExceptionHandlerTable(t, code);
+  if (codeTablesExpanded(t, tables)) {
+    loadMemoryBarrier();
+
+    object lnt = codeLineNumberTable(t, code);
+    return lnt ? lineNumberTableLength(t, lnt) : 0;
+  } else {
+    unsigned offset = codeLineNumberTablesOffset(t, tables);
+    return offset < byteArrayLength(t, tables)
+      ? codeTablesRead2(t, tables, offset) : 0;
+  }
+}
+
+inline uint64_t
+codeLineNumber(Thread* t, object code, unsigned index)
+{
+  object tables = codeExceptionHandlerTable(t, code);
+  if (codeTablesExpanded(t, tables)) {
+    loadMemoryBarrier();
+
+    return lineNumberTableBody(t, codeLineNumberTable(t, code), index);
+  } else {
+    unsigned offset = codeLineNumberTablesOffset(t, tables) + 2
+      + (index * 4);
+    return lineNumber(codeTablesRead2(t, tables, offset),
+                      codeTablesRead2(t, tables, offset + 2));
+  }
+}
+
+void
+expandCodeTables(Thread* t, object code);
+
+inline void
+ensureCodeTables(Thread* t, object code)
+{
+  if (not codeTablesExpanded(t, codeExceptionHandlerTable(t, code))) {
+    expandCodeTables(t, code);
+  }
+}
+
 inline FILE*
 errorLog(Thread* t)
 {
@@ -93,12 +93,22 @@ class Processor {
   virtual void
   initVtable(Thread* t, object c) = 0;
 
+  virtual void
+  initMethod(Thread* t, object method) = 0;
+
   virtual void
   visitObjects(Thread* t, Heap::Visitor* v) = 0;
 
   virtual void
   walkStack(Thread* t, StackVisitor* v) = 0;
 
+  // Walks the stack of the current thread from within a signal
+  // handler, given the register values at the point it was
+  // interrupted.  The visitor must not allocate.
+  virtual void
+  walkInterruptedStack(Thread* t, void* ip, void* stack, void* link,
+                       StackVisitor* v) = 0;
+
   virtual int
   lineNumber(Thread* t, object method, int ip) = 0;
 
@@ -108,6 +118,9 @@ class Processor {
   virtual void
   disposeLocalReference(Thread* t, object* r) = 0;
 
+  virtual bool
+  ensureLocalCapacity(Thread* t, unsigned capacity) = 0;
+
   virtual bool
   pushLocalFrame(Thread* t, unsigned capacity) = 0;
 
@@ -125,6 +138,18 @@ class Processor {
   invokeList(Thread* t, object method, object this_, bool indirectObjects,
              va_list arguments) = 0;
 
+  // These are like invokeArray and invokeList above, except that
+  // primitive results are returned as raw bits rather than boxed, and
+  // references as the object itself, which the caller must protect
+  // before allocating.
+  virtual uint64_t
+  invokeArrayUnboxed(Thread* t, object method, object this_,
+                     const jvalue* arguments) = 0;
+
+  virtual uint64_t
+  invokeListUnboxed(Thread* t, object method, object this_,
+                    bool indirectObjects, va_list arguments) = 0;
+
   virtual object
   invokeList(Thread* t, object loader, const char* className,
              const char* methodName, const char* methodSpec,
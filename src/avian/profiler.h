@@ -0,0 +1,46 @@
+/* Copyright (c) 2008-2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "avian/machine.h"
+
+namespace vm {
+
+// A sampling CPU profiler.  Each time the process uses another
+// interval of CPU time, the thread which happens to be running records
+// its Java stack into a buffer without taking any locks, and a
+// background thread periodically folds those samples into a table of
+// distinct stacks.  The table is written in the "collapsed stack"
+// format understood by flame graph tools, one stack per line with its
+// frames separated by semicolons, outermost first, followed by the
+// number of samples.
+class Profiler {
+ public:
+  // Writes the stacks sampled so far to the profile file, replacing
+  // its previous contents.  Returns false if the file could not be
+  // written.
+  virtual bool dump(Thread* t) = 0;
+
+  // Stops sampling, writes the profile file, and frees the profiler.
+  virtual void dispose(Thread* t) = 0;
+};
+
+// Starts a profiler as specified by a string of the form
+// "<file>[,interval=<microseconds>]".  If sampling is not supported
+// on this platform, a warning is printed and the profile will be
+// empty.
+Profiler*
+makeProfiler(Thread* t, const char* spec);
+
+} // namespace vm
+
+#endif//PROFILER_H
@@ -72,6 +72,24 @@ hashMapRemove(Thread* t, object map, object key,
               uint32_t (*hash)(Thread*, object),
               bool (*equal)(Thread*, object, object));
 
+object
+weakHashMapFindNode(Thread* t, object map, object key,
+                    uint32_t (*hash)(Thread*, object),
+                    bool (*equal)(Thread*, object, object));
+
+inline object
+weakHashMapFind(Thread* t, object map, object key,
+                uint32_t (*hash)(Thread*, object),
+                bool (*equal)(Thread*, object, object))
+{
+  object n = weakHashMapFindNode(t, map, key, hash, equal);
+  return (n ? weakNodeValue(t, n) : 0);
+}
+
+object
+weakHashMapInsert(Thread* t, object map, object key, object value,
+                  uint32_t (*hash)(Thread*, object));
+
 object
 hashMapIterator(Thread* t, object map);
 
@@ -32,9 +32,81 @@ class Zone: public Allocator {
     uint8_t data[0];
   };
 
-  Zone(System* s, Allocator* allocator, unsigned minimumFootprint):
+  // Keeps the segments of disposed zones so that later zones can
+  // reuse them instead of going back to the allocator.  Segments
+  // beyond the retention limit are freed as usual.  An arena is not
+  // thread safe, so each thread which builds zones should have its
+  // own.
+  class Arena {
+   public:
+    Arena(Allocator* allocator, unsigned retention):
+      allocator(allocator),
+      segment(0),
+      retention(retention),
+      footprint(0),
+      peakFootprint(0),
+      reuseCount(0),
+      allocationCount(0),
+      releaseCount(0)
+    { }
+
+    // returns a retained segment with room for at least size bytes,
+    // including the segment header, or null if there is none
+    Segment* take(unsigned size) {
+      for (Segment** p = &segment; *p; p = &((*p)->next)) {
+        Segment* s = *p;
+        if (sizeof(Segment) + s->size >= size) {
+          *p = s->next;
+          footprint -= sizeof(Segment) + s->size;
+          ++ reuseCount;
+          return s;
+        }
+      }
+
+      ++ allocationCount;
+      return 0;
+    }
+
+    void give(Segment* s) {
+      unsigned size = sizeof(Segment) + s->size;
+      if (footprint + size > retention) {
+        ++ releaseCount;
+        allocator->free(s, size);
+      } else {
+        s->next = segment;
+        segment = s;
+        footprint += size;
+        if (footprint > peakFootprint) {
+          peakFootprint = footprint;
+        }
+      }
+    }
+
+    void dispose() {
+      for (Segment* s = segment, *next; s; s = next) {
+        next = s->next;
+        allocator->free(s, sizeof(Segment) + s->size);
+      }
+
+      segment = 0;
+      footprint = 0;
+    }
+
+    Allocator* allocator;
+    Segment* segment;
+    unsigned retention;
+    unsigned footprint;
+    unsigned peakFootprint;
+    unsigned reuseCount;
+    unsigned allocationCount;
+    unsigned releaseCount;
+  };
+
+  Zone(System* s, Allocator* allocator, unsigned minimumFootprint,
+       Arena* arena = 0):
     s(s),
     allocator(allocator),
+    arena(arena),
     segment(0),
     minimumFootprint(minimumFootprint < sizeof(Segment) ? 0 :
                      minimumFootprint - sizeof(Segment))
@@ -44,15 +116,45 @@ class Zone: public Allocator {
     dispose();
   }
 
+  // Frees every segment, or returns them to the arena if there is
+  // one, so that the zone may be reused from scratch.
   void dispose() {
     for (Segment* seg = segment, *next; seg; seg = next) {
       next = seg->next;
-      allocator->free(seg, sizeof(Segment) + seg->size);
+      release(seg);
     }
 
     segment = 0;
   }
 
+  Segment* tryMakeSegment(unsigned size) {
+    if (arena) {
+      Segment* seg = arena->take(size);
+      if (seg) {
+        seg->next = segment;
+        seg->position = 0;
+        return seg;
+      }
+    }
+
+    void* p = allocator->tryAllocate(size);
+    return p ? new (p) Segment(segment, size - sizeof(Segment)) : 0;
+  }
+
+  Segment* makeSegment(unsigned size) {
+    Segment* seg = tryMakeSegment(size);
+    return seg ? seg : new (allocator->allocate(size))
+      Segment(segment, size - sizeof(Segment));
+  }
+
+  void release(Segment* seg) {
+    if (arena) {
+      arena->give(seg);
+    } else {
+      allocator->free(seg, sizeof(Segment) + seg->size);
+    }
+  }
+
   static unsigned padToPage(unsigned size) {
     return (size + (LikelyPageSizeInBytes - 1))
       & ~(LikelyPageSizeInBytes - 1);
@@ -66,26 +168,22 @@ class Zone: public Allocator {
           (minimumFootprint, segment == 0 ? 0 : segment->size * 2))
          + sizeof(Segment));
 
-      void* p = allocator->tryAllocate(size);
-      if (p == 0) {
-        size = padToPage(space + sizeof(Segment));
-        p = allocator->tryAllocate(size);
-        if (p == 0) {
+      Segment* seg = tryMakeSegment(size);
+      if (seg == 0) {
+        seg = tryMakeSegment(padToPage(space + sizeof(Segment)));
+        if (seg == 0) {
           return false;
         }
       }
 
-      segment = new (p) Segment(segment, size - sizeof(Segment));
+      segment = seg;
     }
     return true;
   }
 
   void ensure(unsigned space) {
     if (segment == 0 or segment->position + space > segment->size) {
-      unsigned size = padToPage(space + sizeof(Segment));
-
-      segment = new (allocator->allocate(size))
-        Segment(segment, size - sizeof(Segment));
+      segment = makeSegment(padToPage(space + sizeof(Segment)));
     }
   }
 
@@ -129,7 +227,7 @@ class Zone: public Allocator {
     while (s->position < size) {
       size -= s->position;
       Segment* next = s->next;
-      allocator->free(s, sizeof(Segment) + s->size);
+      release(s);
       s = next;
     }
     s->position -= size;
@@ -143,6 +241,7 @@ class Zone: public Allocator {
   
   System* s;
   Allocator* allocator;
+  Arena* arena;
   void* context;
   Segment* segment;
   unsigned minimumFootprint;
@@ -12,6 +12,7 @@
 #include "avian/constants.h"
 #include "avian/processor.h"
 #include "avian/util.h"
+#include "avian/profiler.h"
 
 #include <avian/util/runtime-array.h>
 
@@ -184,6 +185,21 @@ Avian_avian_Machine_dumpHeap
 
 #endif//AVIAN_HEAPDUMP
 
+extern "C" JNIEXPORT int64_t JNICALL
+Avian_avian_Machine_dumpProfile
+(Thread* t, object, uintptr_t*)
+{
+  Profiler* profiler = t->m->profiler;
+  if (profiler) {
+    // writing the file doesn't touch the heap, so let the collector
+    // run meanwhile
+    ENTER(t, Thread::IdleState);
+    return profiler->dump(t);
+  } else {
+    return false;
+  }
+}
+
 extern "C" JNIEXPORT void JNICALL
 Avian_java_lang_Runtime_exit
 (Thread* t, object, uintptr_t* arguments)
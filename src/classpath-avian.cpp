@@ -61,7 +61,7 @@ class MyClasspath : public Classpath {
   {
     PROTECT(t, vmMethod);
 
-    object jmethod = makeJmethod(t, vmMethod, false);
+    object jmethod = makeJmethod(t, vmMethod, false, 0);
 
     return byteArrayBody(t, methodName(t, vmMethod), 0) == '<'
       ? makeJconstructor(t, jmethod) : jmethod;
@@ -418,6 +418,43 @@ Avian_java_lang_reflect_Method_invoke
      (t, returnCode, t->m->processor->invokeArray(t, method, instance, args)));
 }
 
+extern "C" JNIEXPORT int64_t JNICALL
+Avian_java_lang_reflect_Method_getAccessor
+(Thread* t, object, uintptr_t* arguments)
+{
+  // number of reflective calls to a method after which we generate a
+  // dedicated accessor class for it rather than continuing to box
+  // and unbox arguments in invokeArray:
+  const unsigned AccessorThreshold = 15;
+
+  object method = reinterpret_cast<object>(arguments[0]);
+  PROTECT(t, method);
+
+  object runtimeData = getMethodRuntimeData(t, method);
+  object accessor = methodRuntimeDataAccessor(t, runtimeData);
+
+  // only the call which reaches the threshold generates the accessor,
+  // so a failed (or reentrant) attempt is never repeated:
+  if (accessor == 0
+      and methodRuntimeDataInvocationCount(t, runtimeData)
+      < AccessorThreshold
+      and ++ methodRuntimeDataInvocationCount(t, runtimeData)
+      == AccessorThreshold)
+  {
+    PROTECT(t, runtimeData);
+
+    object make = resolveMethod
+      (t, root(t, Machine::BootLoader), "avian/MethodAccessor", "make",
+       "(Lavian/VMMethod;)Lavian/MethodAccessor;");
+
+    accessor = t->m->processor->invoke(t, make, 0, method);
+
+    set(t, runtimeData, MethodRuntimeDataAccessor, accessor);
+  }
+
+  return reinterpret_cast<int64_t>(accessor);
+}
+
 extern "C" JNIEXPORT int64_t JNICALL
 Avian_java_lang_reflect_Array_getLength
 (Thread* t, object, uintptr_t* arguments)
@@ -2569,6 +2569,10 @@ class MyCompiler: public Compiler {
                       static_cast<Value*>(index), handler);
   }
 
+  virtual void checkNull(Operand* object) {
+    appendNullCheck(&c, static_cast<Value*>(object));
+  }
+
   virtual void store(unsigned srcSize, Operand* src, unsigned dstSize,
                      Operand* dst)
   {
@@ -1608,6 +1608,54 @@ appendBoundsCheck(Context* c, Value* object, unsigned lengthOffset,
   append(c, new(c->zone) BoundsCheckEvent(c, object, lengthOffset, index, handler));
 }
 
+// Reads the first word of an object so that a null reference faults
+// here, where the signal handler will turn it into a
+// NullPointerException, rather than somewhere else (or nowhere).  The
+// comparison's outcome is irrelevant; both paths continue with the
+// next instruction.
+class NullCheckEvent: public Event {
+ public:
+  NullCheckEvent(Context* c, Value* object):
+    Event(c), object(object)
+  {
+    this->addRead(c, object, generalRegisterMask(c));
+  }
+
+  virtual const char* name() {
+    return "NullCheckEvent";
+  }
+
+  virtual void compile(Context* c) {
+    Assembler* a = c->assembler;
+
+    assert(c, object->source->type(c) == lir::RegisterOperand);
+    MemorySite header(static_cast<RegisterSite*>(object->source)->number,
+                      0, lir::NoRegister, 1);
+    header.acquired = true;
+
+    CodePromise* nextPromise = compiler::codePromise(c, static_cast<Promise*>(0));
+
+    ConstantSite zero(resolvedPromise(c, 0));
+    ConstantSite next(nextPromise);
+    apply(c, lir::JumpIfEqual,
+      4, &zero, &zero,
+      4, &header, &header,
+      vm::TargetBytesPerWord, &next, &next);
+
+    nextPromise->offset = a->offset();
+
+    popRead(c, this, object);
+  }
+
+  Value* object;
+};
+
+void
+appendNullCheck(Context* c, Value* object)
+{
+  append(c, new(c->zone) NullCheckEvent(c, object));
+}
+
 
 class FrameSiteEvent: public Event {
  public:
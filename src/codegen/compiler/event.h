@@ -155,6 +155,9 @@ void
 appendBoundsCheck(Context* c, Value* object, unsigned lengthOffset,
                   Value* index, intptr_t handler);
 
+void
+appendNullCheck(Context* c, Value* object);
+
 void
 appendFrameSite(Context* c, Value* value, int index);
 
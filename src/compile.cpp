@@ -50,6 +50,8 @@ const bool DebugCallTable = false;
 const bool DebugMethodTree = false;
 const bool DebugFrameMaps = false;
 const bool DebugIntrinsics = false;
+const bool DebugScalarReplacement = false;
+const bool DebugLoopHoisting = false;
 
 const bool CheckArrayBounds = true;
 
@@ -63,8 +65,24 @@ const unsigned MaxNativeCallFootprint = TargetBytesPerWord == 8 ? 4 : 5;
 
 const unsigned InitialZoneCapacityInBytes = 64 * 1024;
 
+const unsigned DefaultArenaRetentionInBytes = 4 * InitialZoneCapacityInBytes;
+
 const unsigned ExecutableAreaSizeInBytes = 30 * 1024 * 1024;
 
+const unsigned ReferenceSegmentCapacity = 256;
+
+const unsigned MaxScalarReplacementSites = 16;
+
+const unsigned MaxScalarReplacementFields = 8;
+
+const unsigned MaxScalarReplacementStateSize = 64 * 1024;
+
+const unsigned MaxLoopHoistingPasses = 16;
+
+const unsigned MaxLoopHoistingChains = 16;
+
+const unsigned MaxLoopHoistingOccurrences = 64;
+
 enum Root {
   CallTable,
   MethodTree,
@@ -107,6 +125,13 @@ class MyThread;
 void*
 getIp(MyThread*);
 
+unsigned
+arenaRetention(Machine* m)
+{
+  const char* retention = findProperty(m, "avian.jit.arena.retention");
+  return retention ? atoi(retention) : DefaultArenaRetentionInBytes;
+}
+
 class MyThread: public Thread {
  public:
   class CallTrace {
@@ -208,15 +233,35 @@ class MyThread: public Thread {
     bool methodIsMostRecent;
   };
 
+  // JNI local references are slots in a stack of segments, so
+  // creating one is a bump of the top segment's position, and
+  // releasing everything created since some point is a matter of
+  // restoring that segment and position.
+  class ReferenceSegment {
+   public:
+    ReferenceSegment(ReferenceSegment* next, unsigned capacity):
+      next(next),
+      capacity(capacity),
+      position(0)
+    { }
+
+    ReferenceSegment* next;
+    unsigned capacity;
+    unsigned position;
+    object slots[0];
+  };
+
   class ReferenceFrame {
    public:
-    ReferenceFrame(ReferenceFrame* next, Reference* reference):
+    ReferenceFrame(ReferenceFrame* next, ReferenceSegment* segment):
       next(next),
-      reference(reference)
+      segment(segment),
+      position(segment ? segment->position : 0)
     { }
 
     ReferenceFrame* next;
-    Reference* reference;
+    ReferenceSegment* segment;
+    unsigned position;
   };
 
   static void doTransition(MyThread* t, void* ip, void* stack,
@@ -265,7 +310,8 @@ class MyThread: public Thread {
     codeImage(0),
     thunkTable(0),
     trace(0),
-    reference(0),
+    referenceSegment(0),
+    spareReferenceSegment(0),
     arch(parent
          ? parent->arch
          : avian::codegen::makeArchitectureNative(m->system, useNativeFeatures)),
@@ -273,7 +319,8 @@ class MyThread: public Thread {
     traceContext(0),
     stackLimit(0),
     referenceFrame(0),
-    methodLockIsClean(true)
+    methodLockIsClean(true),
+    arena(m->heap, arenaRetention(m))
   {
     arch->acquire();
   }
@@ -293,13 +340,15 @@ class MyThread: public Thread {
   uint8_t* codeImage;
   void** thunkTable;
   CallTrace* trace;
-  Reference* reference;
+  ReferenceSegment* referenceSegment;
+  ReferenceSegment* spareReferenceSegment;
   avian::codegen::Assembler::Architecture* arch;
   Context* transition;
   TraceContext* traceContext;
   uintptr_t stackLimit;
   ReferenceFrame* referenceFrame;
   bool methodLockIsClean;
+  Zone::Arena arena;
 };
 
 void
@@ -309,6 +358,82 @@ transition(MyThread* t, void* ip, void* stack, object continuation,
   MyThread::doTransition(t, ip, stack, continuation, trace);
 }
 
+void
+disposeReferenceSegment(MyThread* t, MyThread::ReferenceSegment* s)
+{
+  t->m->heap->free(s, sizeof(MyThread::ReferenceSegment)
+                   + (s->capacity * BytesPerWord));
+}
+
+// Makes room for the specified number of local references in the top
+// segment, pushing a new segment if necessary.  Returns false if
+// memory could not be allocated.
+bool
+ensureReferences(MyThread* t, unsigned count)
+{
+  MyThread::ReferenceSegment* s = t->referenceSegment;
+  if (s and s->capacity - s->position >= count) {
+    return true;
+  }
+
+  MyThread::ReferenceSegment* spare = t->spareReferenceSegment;
+  if (spare and spare->capacity >= count) {
+    t->spareReferenceSegment = 0;
+    spare->next = s;
+    spare->position = 0;
+    t->referenceSegment = spare;
+    return true;
+  }
+
+  unsigned capacity = avian::util::max(count, ReferenceSegmentCapacity);
+  void* p = t->m->heap->tryAllocate
+    (sizeof(MyThread::ReferenceSegment) + (capacity * BytesPerWord));
+  if (p) {
+    t->referenceSegment = new (p) MyThread::ReferenceSegment(s, capacity);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+// Releases every local reference created since the specified segment
+// was at the specified position.  We keep one emptied segment around
+// so that code which repeatedly crosses a segment boundary doesn't
+// allocate and free a segment each time.
+void
+restoreReferences(MyThread* t, MyThread::ReferenceSegment* segment,
+                  unsigned position)
+{
+  while (t->referenceSegment != segment) {
+    MyThread::ReferenceSegment* s = t->referenceSegment;
+    t->referenceSegment = s->next;
+
+    if (t->spareReferenceSegment == 0) {
+      t->spareReferenceSegment = s;
+    } else {
+      disposeReferenceSegment(t, s);
+    }
+  }
+
+  if (segment) {
+    segment->position = position;
+  }
+}
+
+// Pops local frames until the specified one is on top, releasing
+// their references.
+void
+popReferenceFrames(MyThread* t, MyThread::ReferenceFrame* frame)
+{
+  while (t->referenceFrame != frame) {
+    MyThread::ReferenceFrame* f = t->referenceFrame;
+    t->referenceFrame = f->next;
+    restoreReferences(t, f->segment, f->position);
+
+    t->m->heap->free(f, sizeof(MyThread::ReferenceFrame));
+  }
+}
+
 object
 resolveThisPointer(MyThread* t, void* stack)
 {
@@ -1228,7 +1353,7 @@ class Context {
 
   Context(MyThread* t, BootContext* bootContext, object method):
     thread(t),
-    zone(t->m->system, t->m->heap, InitialZoneCapacityInBytes),
+    zone(t->m->system, t->m->heap, InitialZoneCapacityInBytes, &(t->arena)),
     assembler(t->arch->makeAssembler(t->m->heap, &zone)),
     client(t),
     compiler(makeCompiler(t->m->system, assembler, &zone, &client)),
@@ -1254,7 +1379,7 @@ class Context {
 
   Context(MyThread* t):
     thread(t),
-    zone(t->m->system, t->m->heap, InitialZoneCapacityInBytes),
+    zone(t->m->system, t->m->heap, InitialZoneCapacityInBytes, &(t->arena)),
     assembler(t->arch->makeAssembler(t->m->heap, &zone)),
     client(t),
     compiler(0),
@@ -1354,6 +1479,9 @@ storeLocal(Context* context, unsigned footprint, Compiler::Operand* value,
 FixedAllocator*
 codeAllocator(MyThread* t);
 
+System::Monitor*
+codeLock(MyThread* t);
+
 class Frame {
  public:
   enum StackType {
@@ -3475,7 +3603,8 @@ compileDirectInvoke(MyThread* t, Frame* frame, object target, bool tailCall)
       if ((methodClass(t, target) == methodClass(t, frame->context->method)
            or (not classNeedsInit(t, methodClass(t, target))))
           and (not (avian::codegen::TailCalls and tailCall
-                    and (methodFlags(t, target) & ACC_NATIVE))))
+                    and (methodFlags(t, target) & ACC_NATIVE)))
+          and (methodVmFlags(t, target) & LazyCompileFlag) == 0)
       {
         avian::codegen::Promise* p = new(bc->zone) avian::codegen::ListenPromise(t->m->system, bc->zone);
 
@@ -5327,7 +5456,26 @@ compile(MyThread* t, Frame* initialFrame, unsigned initialIp,
         if (not intrinsic(t, frame, target)) {
           bool tailCall = isTailCall(t, code, ip, context->method, target);
 
-          if (LIKELY(methodVirtual(t, target))) {
+          if (context->bootContext
+              and (methodVmFlags(t, target) & EffectivelyFinalFlag))
+          {
+            // the boot image generator has determined that no class
+            // overrides this method, so we can call it directly.  The
+            // vtable load would have faulted on a null receiver, and
+            // the callee need not touch it, so we check explicitly:
+
+            Compiler::Operand* instance = c->peek
+              (1, methodParameterFootprint(t, target) - 1);
+
+            if (inTryBlock(t, code, ip - 3)) {
+              c->saveLocals();
+              frame->trace(0, 0);
+            }
+
+            c->checkNull(instance);
+
+            compileDirectInvoke(t, frame, target, tailCall);
+          } else if (LIKELY(methodVirtual(t, target))) {
             unsigned parameterFootprint = methodParameterFootprint(t, target);
 
             unsigned offset = TargetClassVtable
@@ -7705,7 +7853,12 @@ invokeNativeSlow(MyThread* t, object method, void* function)
     }
   }
 
-  Reference* reference = t->reference;
+  // anything the native method leaves behind in the way of local
+  // references and frames is released when it returns
+  MyThread::ReferenceFrame* referenceFrame = t->referenceFrame;
+  MyThread::ReferenceSegment* referenceSegment = t->referenceSegment;
+  unsigned referencePosition
+    = referenceSegment ? referenceSegment->position : 0;
 
   { ENTER(t, Thread::IdleState);
 
@@ -7739,6 +7892,10 @@ invokeNativeSlow(MyThread* t, object method, void* function)
   if (UNLIKELY(t->exception)) {
     object exception = t->exception;
     t->exception = 0;
+
+    popReferenceFrames(t, referenceFrame);
+    restoreReferences(t, referenceSegment, referencePosition);
+
     vm::throw_(t, exception);
   }
 
@@ -7777,9 +7934,8 @@ invokeNativeSlow(MyThread* t, object method, void* function)
   default: abort(t);
   }
 
-  while (t->reference != reference) {
-    dispose(t, t->reference);
-  }
+  popReferenceFrames(t, referenceFrame);
+  restoreReferences(t, referenceSegment, referencePosition);
 
   return result;
 }
@@ -8565,8 +8721,11 @@ class ArgumentList {
   } protector;
 };
 
-object
-invoke(Thread* thread, object method, ArgumentList* arguments)
+// Invokes the method and returns its result as raw bits: the value
+// itself for int, long, float, and double results (zero-extended to
+// 64 bits), or the object for reference results.
+uint64_t
+invokeUnboxed(Thread* thread, object method, ArgumentList* arguments)
 {
   MyThread* t = static_cast<MyThread*>(thread);
 
@@ -8623,7 +8782,6 @@ invoke(Thread* thread, object method, ArgumentList* arguments)
     vm::throw_(t, exception);
   }
 
-  object r;
   switch (returnCode) {
   case ByteField:
   case BooleanField:
@@ -8631,27 +8789,53 @@ invoke(Thread* thread, object method, ArgumentList* arguments)
   case ShortField:
   case FloatField:
   case IntField:
-    r = makeInt(t, result);
-    break;
+    return static_cast<uint32_t>(result);
 
   case LongField:
   case DoubleField:
-    r = makeLong(t, result);
-    break;
+  case ObjectField:
+    return result;
+
+  case VoidField:
+    return 0;
+
+  default:
+    abort(t);
+  }
+}
+
+object
+box(Thread* t, unsigned returnCode, uint64_t result)
+{
+  switch (returnCode) {
+  case ByteField:
+  case BooleanField:
+  case CharField:
+  case ShortField:
+  case FloatField:
+  case IntField:
+    return makeInt(t, result);
+
+  case LongField:
+  case DoubleField:
+    return makeLong(t, result);
 
   case ObjectField:
-    r = reinterpret_cast<object>(result);
-    break;
+    return reinterpret_cast<object>(result);
 
   case VoidField:
-    r = 0;
-    break;
+    return 0;
 
   default:
     abort(t);
   }
+}
 
-  return r;
+object
+invoke(Thread* t, object method, ArgumentList* arguments)
+{
+  unsigned returnCode = methodReturnCode(t, method);
+  return box(t, returnCode, invokeUnboxed(t, method, arguments));
 }
 
 class SignalHandler: public System::SignalHandler {
@@ -8799,10 +8983,16 @@ class MyProcessor: public Processor {
                         Machine::ArithmeticException,
                         FixedSizeOfArithmeticException),
     codeAllocator(s, 0, 0),
+    codeLock(0),
     callTableSize(0),
     useNativeFeatures(useNativeFeatures),
     compilationHandlers(0)
   {
+    if (not s->success(s->make(&codeLock))) {
+      s->abort();
+    }
+
+
     thunkTable[compileMethodIndex] = voidPointer(local::compileMethod);
     thunkTable[compileVirtualMethodIndex] = voidPointer(compileVirtualMethod);
     thunkTable[invokeNativeIndex] = voidPointer(invokeNative);
@@ -8924,6 +9114,15 @@ class MyProcessor: public Processor {
     }
   }
 
+  virtual void
+  initMethod(Thread* t, object method)
+  {
+    if (methodCode(t, method)) {
+      codeCompiled(t, methodCode(t, method))
+        = local::defaultThunk(static_cast<MyThread*>(t));
+    }
+  }
+
   virtual void
   visitObjects(Thread* vmt, Heap::Visitor* v)
   {
@@ -8942,8 +9141,14 @@ class MyProcessor: public Processor {
 
     v->visit(&(t->continuation));
 
-    for (Reference* r = t->reference; r; r = r->next) {
-      v->visit(&(r->target));
+    for (MyThread::ReferenceSegment* s = t->referenceSegment; s;
+         s = s->next)
+    {
+      for (unsigned i = 0; i < s->position; ++i) {
+        if (s->slots[i]) {
+          v->visit(s->slots + i);
+        }
+      }
     }
 
     visitStack(t, v);
@@ -8958,6 +9163,19 @@ class MyProcessor: public Processor {
     walker.walk(v);
   }
 
+  virtual void
+  walkInterruptedStack(Thread* vmt, void* ip, void* stack, void* link,
+                       StackVisitor* v)
+  {
+    MyThread* t = static_cast<MyThread*>(vmt);
+
+    MyThread::TraceContext c(t, link);
+    initInterruptedContext(t, t, &c, ip, stack, link);
+
+    MyStackWalker walker(t);
+    walker.walk(v);
+  }
+
   virtual int
   lineNumber(Thread* vmt, object method, int ip)
   {
@@ -8970,42 +9188,55 @@ class MyProcessor: public Processor {
     if (o) {
       MyThread* t = static_cast<MyThread*>(vmt);
 
-      for (Reference* r = t->reference; r; r = r->next) {
-        if (r->target == o) {
-          acquire(t, r);
-
-          return &(r->target);
-        }
-      }
-
-      Reference* r = new (t->m->heap->allocate(sizeof(Reference)))
-        Reference(o, &(t->reference), false);
+      expect(t, ensureReferences(t, 1));
 
-      acquire(t, r);
+      MyThread::ReferenceSegment* s = t->referenceSegment;
+      object* r = s->slots + (s->position++);
+      *r = o;
 
-      return &(r->target);
+      return r;
     } else {
       return 0;
     }
   }
 
   virtual void
-  disposeLocalReference(Thread* t, object* r)
+  disposeLocalReference(Thread* vmt, object* r)
   {
     if (r) {
-      release(t, reinterpret_cast<Reference*>(r));
+      MyThread* t = static_cast<MyThread*>(vmt);
+
+      *r = 0;
+
+      // reclaim the slot right away if it's the most recent one, as
+      // is typical for code which deletes each reference it makes in
+      // a loop
+      MyThread::ReferenceSegment* s = t->referenceSegment;
+      if (s->position and r == s->slots + s->position - 1) {
+        -- s->position;
+      }
     }
   }
 
   virtual bool
-  pushLocalFrame(Thread* vmt, unsigned)
+  ensureLocalCapacity(Thread* vmt, unsigned capacity)
+  {
+    return ensureReferences(static_cast<MyThread*>(vmt), capacity);
+  }
+
+  virtual bool
+  pushLocalFrame(Thread* vmt, unsigned capacity)
   {
     MyThread* t = static_cast<MyThread*>(vmt);
 
+    if (not ensureReferences(t, capacity)) {
+      return false;
+    }
+
     t->referenceFrame = new
       (t->m->heap->allocate(sizeof(MyThread::ReferenceFrame)))
-      MyThread::ReferenceFrame(t->referenceFrame, t->reference);
-    
+      MyThread::ReferenceFrame(t->referenceFrame, t->referenceSegment);
+
     return true;
   }
 
@@ -9014,13 +9245,7 @@ class MyProcessor: public Processor {
   {
     MyThread* t = static_cast<MyThread*>(vmt);
 
-    MyThread::ReferenceFrame* f = t->referenceFrame;
-    t->referenceFrame = f->next;
-    while (t->reference != f->reference) {
-      vm::dispose(t, t->reference);
-    }
-
-    t->m->heap->free(f, sizeof(MyThread::ReferenceFrame));
+    popReferenceFrames(t, t->referenceFrame->next);
   }
 
   virtual object
@@ -9055,6 +9280,15 @@ class MyProcessor: public Processor {
 
   virtual object
   invokeArray(Thread* t, object method, object this_, const jvalue* arguments)
+  {
+    unsigned returnCode = methodReturnCode(t, method);
+    return local::box
+      (t, returnCode, invokeArrayUnboxed(t, method, this_, arguments));
+  }
+
+  virtual uint64_t
+  invokeArrayUnboxed(Thread* t, object method, object this_,
+                     const jvalue* arguments)
   {
     assert(t, t->exception == 0);
 
@@ -9080,12 +9314,22 @@ class MyProcessor: public Processor {
     compile(static_cast<MyThread*>(t),
             local::codeAllocator(static_cast<MyThread*>(t)), 0, method);
 
-    return local::invoke(t, method, &list);
+    return local::invokeUnboxed(t, method, &list);
   }
 
   virtual object
   invokeList(Thread* t, object method, object this_, bool indirectObjects,
              va_list arguments)
+  {
+    unsigned returnCode = methodReturnCode(t, method);
+    return local::box
+      (t, returnCode, invokeListUnboxed
+       (t, method, this_, indirectObjects, arguments));
+  }
+
+  virtual uint64_t
+  invokeListUnboxed(Thread* t, object method, object this_,
+                    bool indirectObjects, va_list arguments)
   {
     assert(t, t->exception == 0);
 
@@ -9111,7 +9355,7 @@ class MyProcessor: public Processor {
     compile(static_cast<MyThread*>(t),
             local::codeAllocator(static_cast<MyThread*>(t)), 0, method);
 
-    return local::invoke(t, method, &list);
+    return local::invokeUnboxed(t, method, &list);
   }
 
   virtual object
@@ -9147,17 +9391,33 @@ class MyProcessor: public Processor {
   virtual void dispose(Thread* vmt) {
     MyThread* t = static_cast<MyThread*>(vmt);
 
-    while (t->reference) {
-      vm::dispose(t, t->reference);
+    popReferenceFrames(t, 0);
+    restoreReferences(t, 0, 0);
+    if (t->spareReferenceSegment) {
+      disposeReferenceSegment(t, t->spareReferenceSegment);
     }
 
     t->arch->release();
 
+    if (t->arena.reuseCount or t->arena.allocationCount) {
+      const char* stats = findProperty(t, "avian.jit.arena.stats");
+      if (stats and ::strcmp(stats, "true") == 0) {
+        fprintf(stderr, "compiler arena for thread %p: %u segments reused, "
+                "%u allocated, %u released, peak retained %u bytes\n",
+                t, t->arena.reuseCount, t->arena.allocationCount,
+                t->arena.releaseCount, t->arena.peakFootprint);
+      }
+    }
+
+    t->arena.dispose();
+
     t->m->heap->free(t, sizeof(*t));
 
   }
 
   virtual void dispose() {
+    codeLock->dispose();
+
     if (codeAllocator.base) {
 #if !defined(AVIAN_AOT_ONLY)
       s->freeExecutable(codeAllocator.base, codeAllocator.capacity);
@@ -9171,6 +9431,61 @@ class MyProcessor: public Processor {
     allocator->free(this, sizeof(*this));
   }
 
+  // Finds the most recent Java frame of a thread which was interrupted
+  // by a signal with the specified register values, and records it in
+  // the trace context.
+  void initInterruptedContext(MyThread* t, MyThread* target,
+                              MyThread::TraceContext* c, void* ip,
+                              void* stack, void* link)
+  {
+    if (methodForIp(t, ip)) {
+      // we caught the thread in Java code - use the register values
+      c->ip = ip;
+      c->stack = stack;
+      c->methodIsMostRecent = true;
+    } else if (target->transition) {
+      // we caught the thread in native code while in the middle
+      // of updating the context fields (MyThread::stack, etc.)
+      static_cast<MyThread::Context&>(*c) = *(target->transition);
+    } else if (isVmInvokeUnsafeStack(ip)) {
+      // we caught the thread in native code just after returning
+      // from java code, but before clearing MyThread::stack
+      // (which now contains a garbage value), and the most recent
+      // Java frame, if any, can be found in
+      // MyThread::continuation or MyThread::trace
+      c->ip = 0;
+      c->stack = 0;
+    } else if (target->stack
+               and (not isThunkUnsafeStack(t, ip))
+               and (not isVirtualThunk(t, ip)))
+    {
+      // we caught the thread in a thunk or native code, and the
+      // saved stack pointer indicates the most recent Java frame
+      // on the stack
+      c->ip = getIp(target);
+      c->stack = target->stack;
+    } else if (isThunk(t, ip) or isVirtualThunk(t, ip)) {
+      // we caught the thread in a thunk where the stack register
+      // indicates the most recent Java frame on the stack
+      
+      // On e.g. x86, the return address will have already been
+      // pushed onto the stack, in which case we use getIp to
+      // retrieve it.  On e.g. PowerPC and ARM, it will be in the
+      // link register.  Note that we can't just check if the link
+      // argument is null here, since we use ecx/rcx as a
+      // pseudo-link register on x86 for the purpose of tail
+      // calls.
+      c->ip = t->arch->hasLinkRegister() ? link : getIp(t, link, stack);
+      c->stack = stack;
+    } else {
+      // we caught the thread in native code, and the most recent
+      // Java frame, if any, can be found in
+      // MyThread::continuation or MyThread::trace
+      c->ip = 0;
+      c->stack = 0;
+    }
+  }
+
   virtual object getStackTrace(Thread* vmt, Thread* vmTarget) {
     MyThread* t = static_cast<MyThread*>(vmt);
     MyThread* target = static_cast<MyThread*>(vmTarget);
@@ -9185,52 +9500,7 @@ class MyProcessor: public Processor {
       virtual void visit(void* ip, void* stack, void* link) {
         MyThread::TraceContext c(target, link);
 
-        if (methodForIp(t, ip)) {
-          // we caught the thread in Java code - use the register values
-          c.ip = ip;
-          c.stack = stack;
-          c.methodIsMostRecent = true;
-        } else if (target->transition) {
-          // we caught the thread in native code while in the middle
-          // of updating the context fields (MyThread::stack, etc.)
-          static_cast<MyThread::Context&>(c) = *(target->transition);
-        } else if (isVmInvokeUnsafeStack(ip)) {
-          // we caught the thread in native code just after returning
-          // from java code, but before clearing MyThread::stack
-          // (which now contains a garbage value), and the most recent
-          // Java frame, if any, can be found in
-          // MyThread::continuation or MyThread::trace
-          c.ip = 0;
-          c.stack = 0;
-        } else if (target->stack
-                   and (not isThunkUnsafeStack(t, ip))
-                   and (not isVirtualThunk(t, ip)))
-        {
-          // we caught the thread in a thunk or native code, and the
-          // saved stack pointer indicates the most recent Java frame
-          // on the stack
-          c.ip = getIp(target);
-          c.stack = target->stack;
-        } else if (isThunk(t, ip) or isVirtualThunk(t, ip)) {
-          // we caught the thread in a thunk where the stack register
-          // indicates the most recent Java frame on the stack
-          
-          // On e.g. x86, the return address will have already been
-          // pushed onto the stack, in which case we use getIp to
-          // retrieve it.  On e.g. PowerPC and ARM, it will be in the
-          // link register.  Note that we can't just check if the link
-          // argument is null here, since we use ecx/rcx as a
-          // pseudo-link register on x86 for the purpose of tail
-          // calls.
-          c.ip = t->arch->hasLinkRegister() ? link : getIp(t, link, stack);
-          c.stack = stack;
-        } else {
-          // we caught the thread in native code, and the most recent
-          // Java frame, if any, can be found in
-          // MyThread::continuation or MyThread::trace
-          c.ip = 0;
-          c.stack = 0;
-        }
+        p->initInterruptedContext(t, target, &c, ip, stack, link);
 
         if (ensure(t, traceSize(target))) {
           atomicOr(&(t->flags), Thread::TracingFlag);
@@ -9422,6 +9692,7 @@ class MyProcessor: public Processor {
   SignalHandler segFaultHandler;
   SignalHandler divideByZeroHandler;
   FixedAllocator codeAllocator;
+  System::Monitor* codeLock;
   ThunkCollection thunks;
   ThunkCollection bootThunks;
   unsigned callTableSize;
@@ -9749,12 +10020,12 @@ object
 makeStringMap(Thread* t, unsigned* table, unsigned count, uintptr_t* heap)
 {
   object array = makeArray(t, nextPowerOfTwo(count));
-  object map = makeWeakHashMap(t, 0, array);
+  object map = makeWeakHashMap(t, 0, array, 0);
   PROTECT(t, map);
   
   for (unsigned i = 0; i < count; ++i) {
     object s = bootObject(heap, table[i]);
-    hashMapInsert(t, map, s, 0, stringHash);
+    weakHashMapInsert(t, map, s, 0, stringHash);
   }
 
   return map;
@@ -9810,6 +10081,25 @@ fixupHeap(MyThread* t UNUSED, uintptr_t* map, unsigned size, uintptr_t* heap)
   }
 }
 
+void
+rebaseHeap(MyThread* t UNUSED, uintptr_t* map, unsigned size, uintptr_t* heap,
+           uintptr_t delta)
+{
+  for (unsigned word = 0; word < size; ++word) {
+    uintptr_t w = map[word];
+    if (w) {
+      for (unsigned bit = 0; bit < BitsPerWord; ++bit) {
+        if (w & (static_cast<uintptr_t>(1) << bit)) {
+          uintptr_t* p = heap + indexOf(word, bit);
+          if (*p & PointerMask) {
+            *p += delta;
+          }
+        }
+      }
+    }
+  }
+}
+
 void
 resetClassRuntimeState(Thread* t, object c, uintptr_t* heap, unsigned heapSize)
 {
@@ -9857,20 +10147,27 @@ resetRuntimeState(Thread* t, object map, uintptr_t* heap, unsigned heapSize)
 }
 
 void
-fixupMethods(Thread* t, object map, BootImage* image UNUSED, uint8_t* code)
+fixupMethods(Thread* t, object map, BootImage* image, uint8_t* code)
 {
+  // compiled addresses are stored either as offsets into the code
+  // image or, if the image was relocated at build time, relative to
+  // image->codeBase, in which case there may be nothing to do:
+  uintptr_t delta = reinterpret_cast<uintptr_t>(code)
+    - static_cast<uintptr_t>(image->codeBase);
+
   for (HashMapIterator it(t, map); it.hasMore();) {
     object c = tripleSecond(t, it.next());
 
-    if (classMethodTable(t, c)) {
+    if (delta and classMethodTable(t, c)) {
       for (unsigned i = 0; i < arrayLength(t, classMethodTable(t, c)); ++i) {
         object method = arrayBody(t, classMethodTable(t, c), i);
         if (methodCode(t, method)) {
           assert(t, methodCompiled(t, method)
-                 <= static_cast<int32_t>(image->codeSize));
+                 - static_cast<uintptr_t>(image->codeBase)
+                 <= image->codeSize);
 
           codeCompiled(t, methodCode(t, method))
-            = methodCompiled(t, method) + reinterpret_cast<uintptr_t>(code);
+            = methodCompiled(t, method) + delta;
 
           if (DebugCompile) {
             logCompile
@@ -9957,7 +10254,17 @@ boot(MyThread* t, BootImage* image, uint8_t* code)
   // fprintf(stderr, "code from %p to %p\n",
   //         code, code + image->codeSize);
  
-  if (not image->initialized) {
+  if (image->heapBase) {
+    // the image was relocated when it was generated, so unless we
+    // were unable to map it at the intended address, its pages may
+    // remain untouched and shared with other processes
+    uintptr_t delta = reinterpret_cast<uintptr_t>(heap)
+      - static_cast<uintptr_t>(image->heapBase);
+
+    if (delta and not image->initialized) {
+      rebaseHeap(t, heapMap, heapMapSizeInWords, heap, delta);
+    }
+  } else if (not image->initialized) {
     fixupHeap(t, heapMap, heapMapSizeInWords, heap);
   }
   
@@ -10370,7 +10677,7 @@ compileVirtualThunk(MyThread* t, unsigned index, unsigned* size)
 uintptr_t
 virtualThunk(MyThread* t, unsigned index)
 {
-  ACQUIRE(t, t->m->classLock);
+  ACQUIRE(t, codeLock(t));
 
   if (root(t, VirtualThunks) == 0
       or wordArrayLength(t, root(t, VirtualThunks)) <= index * 2)
@@ -10394,77 +10701,2296 @@ virtualThunk(MyThread* t, unsigned index)
   return wordArrayBody(t, root(t, VirtualThunks), index * 2);
 }
 
-void
-compile(MyThread* t, FixedAllocator* allocator, BootContext* bootContext,
-        object method)
-{
-  PROTECT(t, method);
+// Scalar replacement of non-escaping allocations.
+//
+// We don't inline, so an object can only be shown not to escape the
+// method which allocates it if no code but that method's field
+// accesses ever sees it.  This means it must be created by the
+// sequence "new C; dup; invokespecial C.<init>()V" where that
+// constructor is trivial (see TrivialConstructorFlag), and thereafter
+// only be held in locals and used as the target of getfield and
+// putfield.  We find such allocations by abstract interpretation of
+// the bytecode and remove them by rewriting it before compiling: the
+// fields become additional locals, loads and stores of the reference
+// become nops, and getfield and putfield become loads and stores of
+// the corresponding locals.  The result is ordinary bytecode, so the
+// frame maps we generate for it will account for any references held
+// in those locals.
+//
+// The rewrite leaves each instruction at its original address so
+// that the exception handler and line number tables remain valid.
+// This limits what we can replace: each field must be given a local
+// numbered below 256 so that it may be accessed with an instruction
+// no longer than getfield or putfield, and the seven bytes of the
+// allocation sequence must be enough to initialize (at three bytes
+// apiece) each field which is read.
+
+class ScalarField {
+ public:
+  unsigned offset;
+  unsigned code;
+  unsigned index;
+  bool read;
+};
 
-  if (bootContext == 0) {
-    initClass(t, methodClass(t, method));
+class ScalarSite {
+ public:
+  unsigned ip;
+  bool escaped;
+  unsigned fieldCount;
+  ScalarField fields[MaxScalarReplacementFields];
+};
+
+// Each local and stack slot is represented by an int which is zero if
+// it holds anything other than a reference to a candidate object, the
+// site index plus one if it holds such a reference, and the negation
+// of that if it may or may not hold one depending on the path taken to
+// reach the current instruction.  Such "poisoned" values may only
+// appear in locals and cause the site to escape if loaded.
+class ScalarAnalysis {
+ public:
+  ScalarAnalysis(Thread* t, object method, ScalarSite* sites,
+                 int* values, int* depths, unsigned* worklist, bool* queued):
+    t(t),
+    method(method),
+    sites(sites),
+    siteCount(0),
+    values(values),
+    depths(depths),
+    worklist(worklist),
+    queued(queued),
+    length(codeLength(t, methodCode(t, method))),
+    localCount(codeMaxLocals(t, methodCode(t, method))),
+    stackLimit(codeMaxStack(t, methodCode(t, method))),
+    width(localCount + stackLimit),
+    worklistSize(0),
+    changed(false),
+    failed(false)
+  { }
+
+  int* state(unsigned ip) {
+    return values + (ip * width);
   }
 
-  if (methodAddress(t, method) != defaultThunk(t)) {
-    return;
+  int site(unsigned ip) {
+    for (unsigned i = 0; i < siteCount; ++i) {
+      if (sites[i].ip == ip) {
+        return i;
+      }
+    }
+    return -1;
   }
 
-  assert(t, (methodFlags(t, method) & ACC_NATIVE) == 0);
+  void escape(int value) {
+    if (value) {
+      ScalarSite* s = sites + ((value > 0 ? value : -value) - 1);
+      if (not s->escaped) {
+        s->escaped = true;
+        changed = true;
+      }
+    }
+  }
 
-  // We must avoid acquiring any locks until after the first pass of
-  // compilation, since this pass may trigger classloading operations
-  // involving application classloaders and thus the potential for
-  // deadlock.  To make this safe, we use a private clone of the
-  // method so that we won't be confused if another thread updates the
-  // original while we're working.
+  // Returns true if the allocation at the specified address may be
+  // replaced, assuming it does not escape.
+  bool replaceable(unsigned ip) {
+    PROTECT(t, method);
 
-  object clone = methodClone(t, method);
+    object code = methodCode(t, method);
+    if (ip + 7 > length
+        or codeBody(t, code, ip + 3) != dup
+        or codeBody(t, code, ip + 4) != invokespecial)
+    {
+      return false;
+    }
 
-  loadMemoryBarrier();
+    unsigned constructorIndex
+      = (codeBody(t, code, ip + 5) << 8) | codeBody(t, code, ip + 6);
 
-  if (methodAddress(t, method) != defaultThunk(t)) {
-    return;
-  }
+    object class_ = resolveClassInPool
+      (t, method, ((codeBody(t, code, ip + 1) << 8)
+                   | codeBody(t, code, ip + 2)) - 1, false);
 
-  PROTECT(t, clone);
+    if (class_ == 0
+        or (classFlags(t, class_) & (ACC_INTERFACE | ACC_ABSTRACT)))
+    {
+      return false;
+    }
 
-  Context context(t, bootContext, clone);
-  compile(t, &context);
+    for (object c = class_; c; c = classSuper(t, c)) {
+      if (classVmFlags(t, c) & (WeakReferenceFlag | HasFinalizerFlag
+                                | NeedInitFlag | InitErrorFlag))
+      {
+        return false;
+      }
+    }
 
-  { object ehTable = codeExceptionHandlerTable(t, methodCode(t, clone));
+    PROTECT(t, class_);
 
-    if (ehTable) {
-      PROTECT(t, ehTable);
+    object constructor = resolveMethod
+      (t, method, constructorIndex - 1, false);
 
-      // resolve all exception handler catch types before we acquire
-      // the class lock:
-      for (unsigned i = 0; i < exceptionHandlerTableLength(t, ehTable); ++i) {
-        uint64_t handler = exceptionHandlerTableBody(t, ehTable, i);
-        if (exceptionHandlerCatchType(handler)) {
-          resolveClassInPool
-            (t, clone, exceptionHandlerCatchType(handler) - 1);
-        }
-      }
-    }
+    return constructor
+      and methodClass(t, constructor) == class_
+      and (methodVmFlags(t, constructor) & TrivialConstructorFlag);
   }
 
-  ACQUIRE(t, t->m->classLock);
+  // Records a newly discovered allocation site, returning its index
+  // or -1 if we have no room for it.  Since we may already have
+  // merged states into the middle of its allocation sequence, the
+  // current pass must be restarted.
+  int addSite(unsigned ip) {
+    if (siteCount == MaxScalarReplacementSites) {
+      return -1;
+    }
 
-  if (methodAddress(t, method) != defaultThunk(t)) {
-    return;
-  }
+    ScalarSite* s = sites + siteCount;
+    s->ip = ip;
+    s->escaped = not replaceable(ip);
+    s->fieldCount = 0;
 
-  finish(t, allocator, &context);
- 
-  if (DebugMethodTree) {
-    fprintf(stderr, "insert method at %p\n",
-            reinterpret_cast<void*>(methodCompiled(t, clone)));
+    changed = true;
+
+    return siteCount++;
   }
 
-  // We can't update the MethodCode field on the original method
-  // before it is placed into the method tree, since another thread
-  // might call the method, from which stack unwinding would fail
-  // (since there is not yet an entry in the method tree).  However,
-  // we can't insert the original method into the tree before updating
+  void merge(unsigned ip, const int* from, int depth) {
+    if (ip >= length) {
+      failed = true;
+      return;
+    }
+
+    // nothing may branch into the middle of an allocation sequence
+    // we intend to replace:
+    for (unsigned i = 0; i < siteCount; ++i) {
+      if ((not sites[i].escaped)
+          and ip > sites[i].ip and ip < sites[i].ip + 7)
+      {
+        escape(i + 1);
+      }
+    }
+
+    int* to = state(ip);
+    bool dirty = false;
+    if (depths[ip] < 0) {
+      memcpy(to, from, (localCount + depth) * sizeof(int));
+      depths[ip] = depth;
+      dirty = true;
+    } else if (depths[ip] != depth) {
+      failed = true;
+      return;
+    } else {
+      for (unsigned i = 0; i < localCount; ++i) {
+        int a = to[i];
+        int b = from[i];
+        if (a != b) {
+          int merged;
+          if (a and b and (a > 0 ? a : -a) != (b > 0 ? b : -b)) {
+            escape(a);
+            escape(b);
+            merged = 0;
+          } else {
+            merged = a ? (a > 0 ? -a : a) : (b > 0 ? -b : b);
+          }
+
+          if (merged != a) {
+            to[i] = merged;
+            dirty = true;
+          }
+        }
+      }
+
+      for (unsigned i = localCount; i < localCount + depth; ++i) {
+        if (to[i] != from[i]) {
+          escape(to[i]);
+          escape(from[i]);
+          to[i] = 0;
+          dirty = true;
+        }
+      }
+    }
+
+    if (dirty and not queued[ip]) {
+      queued[ip] = true;
+      worklist[worklistSize++] = ip;
+    }
+  }
+
+  // Returns the spec of the field or method referred to by the
+  // specified pool entry, which is valid until the next allocation.
+  const char* spec(unsigned index) {
+    object o = singletonObject
+      (t, codePool(t, methodCode(t, method)), index - 1);
+
+    if (objectClass(t, o) == type(t, Machine::ReferenceType)) {
+      o = referenceSpec(t, o);
+    } else if (objectClass(t, o) == type(t, Machine::MethodType)) {
+      o = methodSpec(t, o);
+    } else {
+      o = fieldSpec(t, o);
+    }
+
+    return reinterpret_cast<const char*>(&byteArrayBody(t, o, 0));
+  }
+
+  unsigned fieldFootprint(unsigned index) {
+    switch (*spec(index)) {
+    case 'J':
+    case 'D':
+      return 2;
+
+    default:
+      return 1;
+    }
+  }
+
+  ScalarField* field(int value, unsigned index) {
+    PROTECT(t, method);
+
+    ScalarSite* s = sites + (value - 1);
+
+    object field = resolveField(t, method, index - 1, false);
+    if (field == 0 or (fieldFlags(t, field) & ACC_STATIC)) {
+      escape(value);
+      return 0;
+    }
+
+    for (unsigned i = 0; i < s->fieldCount; ++i) {
+      if (s->fields[i].offset == fieldOffset(t, field)) {
+        return s->fields + i;
+      }
+    }
+
+    if (s->fieldCount == MaxScalarReplacementFields) {
+      escape(value);
+      return 0;
+    }
+
+    ScalarField* f = s->fields + (s->fieldCount++);
+    f->offset = fieldOffset(t, field);
+    f->code = fieldCode(t, field);
+    f->index = 0;
+    f->read = false;
+    return f;
+  }
+
+  bool run();
+
+  void execute(unsigned ip, int* frame, int* sp);
+
+  Thread* t;
+  object method;
+  ScalarSite* sites;
+  unsigned siteCount;
+  int* values;
+  int* depths;
+  unsigned* worklist;
+  bool* queued;
+  unsigned length;
+  unsigned localCount;
+  unsigned stackLimit;
+  unsigned width;
+  unsigned worklistSize;
+  bool changed;
+  bool failed;
+};
+
+// Interprets the instruction at the specified address given the
+// state in which it is reached, merging the result into the state of
+// each successor.
+void
+ScalarAnalysis::execute(unsigned ip, int* frame, int* sp)
+{
+  int* locals = frame;
+  int* stack = frame + localCount;
+  int& depth = *sp;
+
+#define POP(n) \
+  do { \
+    if (depth < (n)) { failed = true; return; } \
+    for (int i_ = 0; i_ < (n); ++i_) escape(stack[--depth]); \
+  } while (false)
+
+#define PUSH(n) \
+  do { \
+    if (depth + (n) > static_cast<int>(stackLimit)) { \
+      failed = true; return; \
+    } \
+    for (int i_ = 0; i_ < (n); ++i_) stack[depth++] = 0; \
+  } while (false)
+
+#define LOCAL(n, size) \
+  do { \
+    if ((n) + (size) > localCount) { failed = true; return; } \
+  } while (false)
+
+  object code = methodCode(t, method);
+  unsigned start = ip;
+  unsigned instruction = codeBody(t, code, ip++);
+  bool isWide = false;
+  if (instruction == wide) {
+    isWide = true;
+    instruction = codeBody(t, code, ip++);
+  }
+
+  unsigned localIndex = 0;
+
+  switch (instruction) {
+  case aload: case iload: case fload: case lload: case dload:
+  case astore: case istore: case fstore: case lstore: case dstore:
+    if (isWide) {
+      localIndex = static_cast<uint16_t>(codeReadInt16(t, code, ip));
+    } else {
+      localIndex = codeBody(t, code, ip++);
+    }
+    break;
+
+  case iinc:
+    ip += isWide ? 4 : 2;
+    break;
+
+  default:
+    if (isWide) {
+      failed = true;
+      return;
+    }
+    break;
+  }
+
+  bool fallsThrough = true;
+
+  // the exception handlers for this instruction see the locals as
+  // they are before it executes:
+  { object eht = codeExceptionHandlerTable(t, code);
+    if (eht) {
+      THREAD_RUNTIME_ARRAY(t, int, handlerState, localCount + 1);
+      memcpy(RUNTIME_ARRAY_BODY(handlerState), locals,
+             localCount * sizeof(int));
+      RUNTIME_ARRAY_BODY(handlerState)[localCount] = 0;
+
+      for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
+        uint64_t eh = exceptionHandlerTableBody(t, eht, i);
+        if (start >= exceptionHandlerStart(eh)
+            and start < exceptionHandlerEnd(eh))
+        {
+          merge(exceptionHandlerIp(eh), RUNTIME_ARRAY_BODY(handlerState), 1);
+        }
+      }
+    }
+  }
+
+  switch (instruction) {
+  case nop:
+    break;
+
+  case aconst_null:
+  case iconst_m1: case iconst_0: case iconst_1: case iconst_2:
+  case iconst_3: case iconst_4: case iconst_5:
+  case fconst_0: case fconst_1: case fconst_2:
+    PUSH(1);
+    break;
+
+  case lconst_0: case lconst_1: case dconst_0: case dconst_1:
+    PUSH(2);
+    break;
+
+  case bipush:
+    ++ ip;
+    PUSH(1);
+    break;
+
+  case sipush:
+    ip += 2;
+    PUSH(1);
+    break;
+
+  case ldc:
+    ++ ip;
+    PUSH(1);
+    break;
+
+  case ldc_w:
+    ip += 2;
+    PUSH(1);
+    break;
+
+  case ldc2_w:
+    ip += 2;
+    PUSH(2);
+    break;
+
+  case iload: case fload:
+    LOCAL(localIndex, 1);
+    PUSH(1);
+    break;
+
+  case iload_0: case iload_1: case iload_2: case iload_3:
+  case fload_0: case fload_1: case fload_2: case fload_3:
+    PUSH(1);
+    break;
+
+  case lload: case dload:
+    LOCAL(localIndex, 2);
+    PUSH(2);
+    break;
+
+  case lload_0: case lload_1: case lload_2: case lload_3:
+  case dload_0: case dload_1: case dload_2: case dload_3:
+    PUSH(2);
+    break;
+
+  case aload_0: case aload_1: case aload_2: case aload_3:
+    localIndex = instruction - aload_0;
+    // fall through
+  case aload: {
+    LOCAL(localIndex, 1);
+    PUSH(1);
+
+    int v = locals[localIndex];
+    if (v < 0) {
+      escape(v);
+    } else if (v > 0 and not sites[v - 1].escaped) {
+      stack[depth - 1] = v;
+    }
+  } break;
+
+  case istore: case fstore:
+    LOCAL(localIndex, 1);
+    POP(1);
+    locals[localIndex] = 0;
+    break;
+
+  case istore_0: case istore_1: case istore_2: case istore_3:
+  case fstore_0: case fstore_1: case fstore_2: case fstore_3:
+    localIndex = (instruction - istore_0) % 4;
+    LOCAL(localIndex, 1);
+    POP(1);
+    locals[localIndex] = 0;
+    break;
+
+  case lstore: case dstore:
+    LOCAL(localIndex, 2);
+    POP(2);
+    locals[localIndex] = 0;
+    locals[localIndex + 1] = 0;
+    break;
+
+  case lstore_0: case lstore_1: case lstore_2: case lstore_3:
+  case dstore_0: case dstore_1: case dstore_2: case dstore_3:
+    localIndex = (instruction - lstore_0) % 4;
+    LOCAL(localIndex, 2);
+    POP(2);
+    locals[localIndex] = 0;
+    locals[localIndex + 1] = 0;
+    break;
+
+  case astore_0: case astore_1: case astore_2: case astore_3:
+    localIndex = instruction - astore_0;
+    // fall through
+  case astore: {
+    LOCAL(localIndex, 1);
+    if (depth < 1) {
+      failed = true;
+      return;
+    }
+    locals[localIndex] = stack[--depth];
+  } break;
+
+  case iaload: case faload: case aaload: case baload: case caload:
+  case saload:
+    POP(2);
+    PUSH(1);
+    break;
+
+  case laload: case daload:
+    POP(2);
+    PUSH(2);
+    break;
+
+  case iastore: case fastore: case aastore: case bastore: case castore:
+  case sastore:
+    POP(3);
+    break;
+
+  case lastore: case dastore:
+    POP(4);
+    break;
+
+  case pop_:
+    POP(1);
+    break;
+
+  case pop2:
+    POP(2);
+    break;
+
+  case dup:
+    POP(1);
+    PUSH(2);
+    break;
+
+  case dup_x1:
+    POP(2);
+    PUSH(3);
+    break;
+
+  case dup_x2:
+    POP(3);
+    PUSH(4);
+    break;
+
+  case dup2:
+    POP(2);
+    PUSH(4);
+    break;
+
+  case dup2_x1:
+    POP(3);
+    PUSH(5);
+    break;
+
+  case dup2_x2:
+    POP(4);
+    PUSH(6);
+    break;
+
+  case swap:
+    POP(2);
+    PUSH(2);
+    break;
+
+  case iadd: case isub: case imul: case idiv: case irem: case iand:
+  case ior: case ixor: case ishl: case ishr: case iushr:
+  case fadd: case fsub: case fmul: case fdiv: case frem:
+  case fcmpl: case fcmpg:
+    POP(2);
+    PUSH(1);
+    break;
+
+  case ladd: case lsub: case lmul: case ldiv_: case lrem: case land:
+  case lor: case lxor:
+  case dadd: case dsub: case dmul: case ddiv: case drem:
+    POP(4);
+    PUSH(2);
+    break;
+
+  case lshl: case lshr: case lushr:
+    POP(3);
+    PUSH(2);
+    break;
+
+  case lcmp: case dcmpl: case dcmpg:
+    POP(4);
+    PUSH(1);
+    break;
+
+  case ineg: case fneg: case i2f: case f2i: case i2b: case i2c: case i2s:
+    POP(1);
+    PUSH(1);
+    break;
+
+  case lneg: case dneg: case l2d: case d2l:
+    POP(2);
+    PUSH(2);
+    break;
+
+  case i2l: case i2d: case f2l: case f2d:
+    POP(1);
+    PUSH(2);
+    break;
+
+  case l2i: case l2f: case d2i: case d2f:
+    POP(2);
+    PUSH(1);
+    break;
+
+  case iinc:
+    break;
+
+  case ifeq: case ifne: case iflt: case ifge: case ifgt: case ifle:
+  case ifnull: case ifnonnull: {
+    int16_t offset = codeReadInt16(t, code, ip);
+    POP(1);
+    merge(start + offset, frame, depth);
+  } break;
+
+  case if_icmpeq: case if_icmpne: case if_icmplt: case if_icmpge:
+  case if_icmpgt: case if_icmple: case if_acmpeq: case if_acmpne: {
+    int16_t offset = codeReadInt16(t, code, ip);
+    POP(2);
+    merge(start + offset, frame, depth);
+  } break;
+
+  case goto_: {
+    int16_t offset = codeReadInt16(t, code, ip);
+    merge(start + offset, frame, depth);
+    fallsThrough = false;
+  } break;
+
+  case goto_w: {
+    int32_t offset = codeReadInt32(t, code, ip);
+    merge(start + offset, frame, depth);
+    fallsThrough = false;
+  } break;
+
+  case tableswitch: {
+    POP(1);
+    ip = (ip + 3) & ~3;
+    merge(start + codeReadInt32(t, code, ip), frame, depth);
+    int32_t bottom = codeReadInt32(t, code, ip);
+    int32_t top = codeReadInt32(t, code, ip);
+    for (int32_t i = 0; i < top - bottom + 1 and not failed; ++i) {
+      merge(start + codeReadInt32(t, code, ip), frame, depth);
+    }
+    fallsThrough = false;
+  } break;
+
+  case lookupswitch: {
+    POP(1);
+    ip = (ip + 3) & ~3;
+    merge(start + codeReadInt32(t, code, ip), frame, depth);
+    int32_t pairCount = codeReadInt32(t, code, ip);
+    for (int32_t i = 0; i < pairCount and not failed; ++i) {
+      ip += 4;
+      merge(start + codeReadInt32(t, code, ip), frame, depth);
+    }
+    fallsThrough = false;
+  } break;
+
+  case ireturn: case freturn: case areturn: case athrow:
+    POP(1);
+    fallsThrough = false;
+    break;
+
+  case lreturn: case dreturn:
+    POP(2);
+    fallsThrough = false;
+    break;
+
+  case return_:
+    fallsThrough = false;
+    break;
+
+  case getstatic: {
+    uint16_t index = codeReadInt16(t, code, ip);
+    PUSH(static_cast<int>(fieldFootprint(index)));
+  } break;
+
+  case putstatic: {
+    uint16_t index = codeReadInt16(t, code, ip);
+    POP(static_cast<int>(fieldFootprint(index)));
+  } break;
+
+  case getfield: {
+    uint16_t index = codeReadInt16(t, code, ip);
+    if (depth < 1) {
+      failed = true;
+      return;
+    }
+
+    int v = stack[--depth];
+    if (v > 0) {
+      ScalarField* f = field(v, index);
+      if (f) {
+        f->read = true;
+      }
+    }
+
+    PUSH(static_cast<int>(fieldFootprint(index)));
+  } break;
+
+  case putfield: {
+    uint16_t index = codeReadInt16(t, code, ip);
+    POP(static_cast<int>(fieldFootprint(index)));
+    if (depth < 1) {
+      failed = true;
+      return;
+    }
+
+    int v = stack[--depth];
+    if (v > 0) {
+      field(v, index);
+    }
+  } break;
+
+  case invokevirtual: case invokespecial: case invokestatic:
+  case invokeinterface: {
+    uint16_t index = codeReadInt16(t, code, ip);
+    if (instruction == invokeinterface) {
+      ip += 2;
+    }
+
+    const char* s = spec(index);
+    int footprint = parameterFootprint
+      (t, s, instruction == invokestatic);
+
+    while (*s != ')') ++ s;
+    int returnFootprint = s[1] == 'V' ? 0
+      : (s[1] == 'J' or s[1] == 'D') ? 2 : 1;
+
+    POP(footprint);
+    PUSH(returnFootprint);
+  } break;
+
+  case new_: {
+    int i = site(start);
+    if (i < 0) {
+      i = addSite(start);
+    }
+
+    if (i >= 0 and not sites[i].escaped) {
+      // a second instance may not be created while the first is
+      // still reachable, since both would share the same locals:
+      for (unsigned j = 0; j < localCount + depth; ++j) {
+        if (frame[j] == i + 1) {
+          escape(i + 1);
+        }
+      }
+
+      PUSH(1);
+      stack[depth - 1] = i + 1;
+      ip = start + 7;
+    } else {
+      ip += 2;
+      PUSH(1);
+    }
+  } break;
+
+  case newarray:
+    ++ ip;
+    POP(1);
+    PUSH(1);
+    break;
+
+  case anewarray: case checkcast: case instanceof:
+    ip += 2;
+    POP(1);
+    PUSH(1);
+    break;
+
+  case arraylength:
+    POP(1);
+    PUSH(1);
+    break;
+
+  case multianewarray: {
+    ip += 2;
+    int dimensions = codeBody(t, code, ip++);
+    POP(dimensions);
+    PUSH(1);
+  } break;
+
+  case monitorenter: case monitorexit:
+    POP(1);
+    break;
+
+  default:
+    // jsr, ret, and anything we don't recognize
+    failed = true;
+    return;
+  }
+
+#undef POP
+#undef PUSH
+#undef LOCAL
+
+  if (fallsThrough and not failed) {
+    merge(ip, frame, depth);
+  }
+}
+
+// Runs the analysis to a fixed point, returning true if no further
+// sites were discovered or found to escape.
+bool
+ScalarAnalysis::run()
+{
+  for (unsigned i = 0; i < siteCount; ++i) {
+    sites[i].fieldCount = 0;
+  }
+
+  for (unsigned i = 0; i < length; ++i) {
+    depths[i] = -1;
+    queued[i] = false;
+  }
+
+  worklistSize = 0;
+  changed = false;
+
+  THREAD_RUNTIME_ARRAY(t, int, frame, width);
+  memset(RUNTIME_ARRAY_BODY(frame), 0, width * sizeof(int));
+  merge(0, RUNTIME_ARRAY_BODY(frame), 0);
+
+  while (worklistSize and not (changed or failed)) {
+    unsigned ip = worklist[--worklistSize];
+    queued[ip] = false;
+
+    int depth = depths[ip];
+    memcpy(RUNTIME_ARRAY_BODY(frame), state(ip),
+           (localCount + depth) * sizeof(int));
+
+    execute(ip, RUNTIME_ARRAY_BODY(frame), &depth);
+  }
+
+  return not (changed or failed);
+}
+
+// Finds allocations which may be replaced by locals as described
+// above, and rewrites the method's bytecode accordingly.
+void
+replaceScalars(MyThread* t, object method)
+{
+  PROTECT(t, method);
+
+  object code = methodCode(t, method);
+  unsigned length = codeLength(t, code);
+  unsigned localCount = codeMaxLocals(t, code);
+  unsigned width = localCount + codeMaxStack(t, code);
+
+  if (length * width > MaxScalarReplacementStateSize) {
+    return;
+  }
+
+  // the analysis is relatively expensive, so we only run it if there
+  // is at least something which looks like a candidate allocation:
+  bool found = false;
+  for (unsigned ip = 0; ip + 7 <= length and not found; ++ip) {
+    found = codeBody(t, code, ip) == new_
+      and codeBody(t, code, ip + 3) == dup
+      and codeBody(t, code, ip + 4) == invokespecial;
+  }
+
+  if (not found) {
+    return;
+  }
+
+  unsigned footprint = (length * width * sizeof(int))
+    + (length * sizeof(int))
+    + (length * sizeof(unsigned))
+    + (length * sizeof(bool));
+
+  uint8_t* memory = static_cast<uint8_t*>(t->m->heap->allocate(footprint));
+
+  THREAD_RESOURCE2(t, uint8_t*, memory, unsigned, footprint,
+                   t->m->heap->free(memory, footprint));
+
+  int* values = reinterpret_cast<int*>(memory);
+  int* depths = values + (length * width);
+  unsigned* worklist = reinterpret_cast<unsigned*>(depths + length);
+  bool* queued = reinterpret_cast<bool*>(worklist + length);
+
+  ScalarSite sites[MaxScalarReplacementSites];
+  ScalarAnalysis analysis(t, method, sites, values, depths, worklist, queued);
+  PROTECT(t, analysis.method);
+
+  // each pass either succeeds or discovers a new site or marks one as
+  // escaping, so this terminates:
+  unsigned siteCount = 0;
+  unsigned nextIndex = localCount;
+  while (true) {
+    bool done = analysis.run();
+
+    if (analysis.failed) {
+      return;
+    }
+
+    siteCount = analysis.siteCount;
+
+    if (done) {
+      nextIndex = localCount;
+      for (unsigned i = 0; i < siteCount and done; ++i) {
+        ScalarSite* s = sites + i;
+        if (s->escaped) {
+          continue;
+        }
+
+        unsigned readCount = 0;
+        unsigned next = nextIndex;
+        for (unsigned j = 0; j < s->fieldCount; ++j) {
+          ScalarField* f = s->fields + j;
+          if (f->read) {
+            ++ readCount;
+            f->index = next;
+            next += (f->code == LongField or f->code == DoubleField) ? 2 : 1;
+          }
+        }
+
+        if (readCount * 3 > 7 or next > 256) {
+          s->escaped = true;
+          done = false;
+        } else {
+          nextIndex = next;
+        }
+      }
+
+      if (done) {
+        break;
+      }
+    }
+  }
+
+  unsigned replacedCount = 0;
+  for (unsigned i = 0; i < siteCount; ++i) {
+    if (not sites[i].escaped) {
+      ++ replacedCount;
+    }
+  }
+
+  if (replacedCount == 0) {
+    return;
+  }
+
+  THREAD_RUNTIME_ARRAY(t, uint8_t, body, length);
+  memcpy(RUNTIME_ARRAY_BODY(body), &codeBody(t, methodCode(t, method), 0),
+         length);
+
+  for (unsigned ip = 0; ip < length; ++ip) {
+    if (depths[ip] < 0) {
+      continue;
+    }
+
+    uint8_t* p = RUNTIME_ARRAY_BODY(body) + ip;
+    int* locals = analysis.state(ip);
+    int* stack = locals + localCount;
+    int depth = depths[ip];
+
+    unsigned instruction = p[0];
+    unsigned size;
+    unsigned localIndex;
+    if (instruction == wide) {
+      instruction = p[1];
+      size = 4;
+      localIndex = (p[2] << 8) | p[3];
+    } else if (instruction == aload or instruction == astore) {
+      size = 2;
+      localIndex = p[1];
+    } else {
+      size = 1;
+      localIndex = (instruction >= astore_0 and instruction <= astore_3)
+        ? instruction - astore_0 : instruction - aload_0;
+    }
+
+    switch (instruction) {
+    case aload: case aload_0: case aload_1: case aload_2: case aload_3: {
+      int v = locals[localIndex];
+      if (v > 0 and not sites[v - 1].escaped) {
+        memset(p, nop, size);
+      }
+    } break;
+
+    case astore: case astore_0: case astore_1: case astore_2:
+    case astore_3: {
+      int v = stack[depth - 1];
+      if (v > 0 and not sites[v - 1].escaped) {
+        memset(p, nop, size);
+      }
+    } break;
+
+    case getfield:
+    case putfield: {
+      unsigned index = (p[1] << 8) | p[2];
+      unsigned valueFootprint = analysis.fieldFootprint(index);
+      int v = stack[depth - 1 - (instruction == putfield ? valueFootprint : 0)];
+      if (v <= 0 or sites[v - 1].escaped) {
+        break;
+      }
+
+      object field = resolveField(t, method, index - 1, false);
+      ScalarSite* s = sites + (v - 1);
+      ScalarField* f = 0;
+      for (unsigned j = 0; j < s->fieldCount; ++j) {
+        if (s->fields[j].offset == fieldOffset(t, field)) {
+          f = s->fields + j;
+        }
+      }
+      assert(t, f);
+
+      p[2] = nop;
+      if (f->read) {
+        unsigned op;
+        switch (f->code) {
+        case FloatField: op = fload; break;
+        case LongField: op = lload; break;
+        case DoubleField: op = dload; break;
+        case ObjectField: op = aload; break;
+        default: op = iload; break;
+        }
+
+        p[0] = instruction == getfield ? op : op + (istore - iload);
+        p[1] = f->index;
+      } else {
+        // the field is never read, so we need only discard the value
+        p[0] = valueFootprint == 2 ? pop2 : pop_;
+        p[1] = nop;
+      }
+    } break;
+
+    case new_: {
+      int i = analysis.site(ip);
+      if (i < 0 or sites[i].escaped) {
+        break;
+      }
+
+      memset(p, nop, 7);
+
+      ScalarSite* s = sites + i;
+      for (unsigned j = 0; j < s->fieldCount; ++j) {
+        ScalarField* f = s->fields + j;
+        if (f->read) {
+          switch (f->code) {
+          case FloatField:
+            *(p++) = fconst_0;
+            *(p++) = fstore;
+            break;
+
+          case LongField:
+            *(p++) = lconst_0;
+            *(p++) = lstore;
+            break;
+
+          case DoubleField:
+            *(p++) = dconst_0;
+            *(p++) = dstore;
+            break;
+
+          case ObjectField:
+            *(p++) = aconst_null;
+            *(p++) = astore;
+            break;
+
+          default:
+            *(p++) = iconst_0;
+            *(p++) = istore;
+            break;
+          }
+          *(p++) = f->index;
+        }
+      }
+    } break;
+
+    default:
+      break;
+    }
+  }
+
+  object oldCode = methodCode(t, method);
+  object newCode = makeCode
+    (t, codePool(t, oldCode), codeExceptionHandlerTable(t, oldCode),
+     codeLineNumberTable(t, oldCode), 0, 0, codeMaxStack(t, oldCode),
+     nextIndex, length);
+
+  memcpy(&codeBody(t, newCode, 0), RUNTIME_ARRAY_BODY(body), length);
+
+  set(t, method, MethodCode, newCode);
+
+  if (DebugScalarReplacement) {
+    fprintf(stderr, "replaced %d of %d allocations in %s.%s%s\n",
+            replacedCount, siteCount,
+            &byteArrayBody(t, className(t, methodClass(t, method)), 0),
+            &byteArrayBody(t, methodName(t, method), 0),
+            &byteArrayBody(t, methodSpec(t, method), 0));
+  }
+}
+
+// Loop-invariant code motion.
+//
+// Like scalar replacement, this works by rewriting a method's bytecode
+// before we compile it.  We find the natural loops in the bytecode's
+// control flow graph, insert a preheader in front of a loop's header
+// which evaluates each loop-invariant expression in the loop once and
+// stores the result in a new local, and replace each occurrence of the
+// expression in the loop with a load of that local.  Besides saving
+// the loads themselves, this lets the compiler carry the value in a
+// register across the loop's back edges, as it does for any other
+// local, instead of reloading it from memory on every iteration.
+//
+// The expressions we consider are chains of the form "aload n" or
+// "getstatic", followed by any number of getfield instructions and
+// optionally a final arraylength.  Local n must not be stored to
+// within the loop, and any field involved must not be volatile or
+// stored to within the loop, nor may the loop contain any invocations,
+// monitor operations, or instructions which may run a static
+// initializer if fields are involved.  A chain which can
+// neither throw nor run a static initializer (i.e. a field of "this"
+// or a static field of an initialized class) may be hoisted from
+// anywhere in the loop.  Any other chain may only be hoisted from the
+// part of the header which is always executed on entry to the loop
+// before anything which might throw or have a side effect, and only
+// if it is covered by the same exception handlers as the start of the
+// header, so that evaluating it in the preheader at most moves an
+// exception it throws slightly earlier.
+//
+// We only handle loops entered solely by falling through or branching
+// to their headers, which is how javac lays them out, and we pad each
+// preheader to a multiple of four bytes so that the alignment of any
+// switch instructions which follow it is unaffected.
+
+int32_t
+readInt16(const uint8_t* body, unsigned ip)
+{
+  return static_cast<int16_t>((body[ip] << 8) | body[ip + 1]);
+}
+
+int32_t
+readInt32(const uint8_t* body, unsigned ip)
+{
+  return (body[ip] << 24) | (body[ip + 1] << 16) | (body[ip + 2] << 8)
+    | body[ip + 3];
+}
+
+void
+writeInt16(uint8_t* body, unsigned ip, int32_t value)
+{
+  body[ip] = value >> 8;
+  body[ip + 1] = value;
+}
+
+void
+writeInt32(uint8_t* body, unsigned ip, int32_t value)
+{
+  body[ip] = value >> 24;
+  body[ip + 1] = value >> 16;
+  body[ip + 2] = value >> 8;
+  body[ip + 3] = value;
+}
+
+// Returns the size of the instruction at the specified address, or
+// zero if it is one we don't handle (i.e. jsr or ret) or it extends
+// past the end of the code.
+unsigned
+instructionSize(const uint8_t* body, unsigned length, unsigned ip)
+{
+  unsigned size;
+  switch (body[ip]) {
+  case bipush: case ldc: case newarray:
+  case iload: case lload: case fload: case dload: case aload:
+  case istore: case lstore: case fstore: case dstore: case astore:
+    size = 2;
+    break;
+
+  case sipush: case ldc_w: case ldc2_w: case iinc:
+  case ifeq: case ifne: case iflt: case ifge: case ifgt: case ifle:
+  case if_icmpeq: case if_icmpne: case if_icmplt: case if_icmpge:
+  case if_icmpgt: case if_icmple: case if_acmpeq: case if_acmpne:
+  case ifnull: case ifnonnull: case goto_:
+  case getstatic: case putstatic: case getfield: case putfield:
+  case invokevirtual: case invokespecial: case invokestatic:
+  case new_: case anewarray: case checkcast: case instanceof:
+    size = 3;
+    break;
+
+  case multianewarray:
+    size = 4;
+    break;
+
+  case invokeinterface: case goto_w:
+    size = 5;
+    break;
+
+  case wide:
+    if (ip + 1 >= length) {
+      return 0;
+    }
+
+    switch (body[ip + 1]) {
+    case iinc:
+      size = 6;
+      break;
+
+    case iload: case lload: case fload: case dload: case aload:
+    case istore: case lstore: case fstore: case dstore: case astore:
+      size = 4;
+      break;
+
+    default:
+      return 0;
+    }
+    break;
+
+  case tableswitch: {
+    unsigned p = (ip + 4) & ~3;
+    if (p + 12 > length) {
+      return 0;
+    }
+
+    int64_t count = static_cast<int64_t>(readInt32(body, p + 8))
+      - readInt32(body, p + 4) + 1;
+    if (count < 1 or count > length) {
+      return 0;
+    }
+
+    size = (p + 12 - ip) + (count * 4);
+  } break;
+
+  case lookupswitch: {
+    unsigned p = (ip + 4) & ~3;
+    if (p + 8 > length) {
+      return 0;
+    }
+
+    int32_t count = readInt32(body, p + 4);
+    if (count < 0 or static_cast<unsigned>(count) > length) {
+      return 0;
+    }
+
+    size = (p + 8 - ip) + (count * 8);
+  } break;
+
+  case jsr: case jsr_w: case ret:
+    return 0;
+
+  default:
+    if (body[ip] > monitorexit) {
+      return 0;
+    }
+
+    size = 1;
+    break;
+  }
+
+  return ip + size <= length ? size : 0;
+}
+
+// Writes the addresses of the instructions which may be executed next
+// after the one at the specified address (not counting exception
+// handlers) to successors, returning how many there are.
+unsigned
+instructionSuccessors(const uint8_t* body, unsigned ip, unsigned size,
+                      unsigned* successors)
+{
+  unsigned count = 0;
+  switch (body[ip]) {
+  case ifeq: case ifne: case iflt: case ifge: case ifgt: case ifle:
+  case if_icmpeq: case if_icmpne: case if_icmplt: case if_icmpge:
+  case if_icmpgt: case if_icmple: case if_acmpeq: case if_acmpne:
+  case ifnull: case ifnonnull:
+    successors[count++] = ip + readInt16(body, ip + 1);
+    successors[count++] = ip + size;
+    break;
+
+  case goto_:
+    successors[count++] = ip + readInt16(body, ip + 1);
+    break;
+
+  case goto_w:
+    successors[count++] = ip + readInt32(body, ip + 1);
+    break;
+
+  case tableswitch: {
+    unsigned p = (ip + 4) & ~3;
+    successors[count++] = ip + readInt32(body, p);
+    for (unsigned q = p + 12; q < ip + size; q += 4) {
+      successors[count++] = ip + readInt32(body, q);
+    }
+  } break;
+
+  case lookupswitch: {
+    unsigned p = (ip + 4) & ~3;
+    successors[count++] = ip + readInt32(body, p);
+    for (unsigned q = p + 12; q < ip + size; q += 8) {
+      successors[count++] = ip + readInt32(body, q);
+    }
+  } break;
+
+  case ireturn: case lreturn: case freturn: case dreturn: case areturn:
+  case return_: case athrow:
+    break;
+
+  default:
+    successors[count++] = ip + size;
+    break;
+  }
+
+  return count;
+}
+
+// Returns true if the instruction at the specified address stores to
+// a local, setting index and footprint to the local's index and size.
+bool
+storesLocal(const uint8_t* body, unsigned ip, unsigned* index,
+            unsigned* footprint)
+{
+  unsigned instruction = body[ip];
+  bool isWide = instruction == wide;
+  if (isWide) {
+    instruction = body[ip + 1];
+  }
+
+  switch (instruction) {
+  case istore: case fstore: case astore: case iinc:
+    *footprint = 1;
+    break;
+
+  case lstore: case dstore:
+    *footprint = 2;
+    break;
+
+  default:
+    if (instruction >= istore_0 and instruction <= astore_3) {
+      unsigned type = (instruction - istore_0) / 4;
+      *index = (instruction - istore_0) % 4;
+      *footprint = (type == 1 or type == 3) ? 2 : 1;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  *index = isWide
+    ? static_cast<uint16_t>(readInt16(body, ip + 2)) : body[ip + 1];
+
+  return true;
+}
+
+// Returns true if the specified instruction can neither throw nor
+// have any side effect other than on the operand stack.
+bool
+pureInstruction(unsigned instruction)
+{
+  return instruction == nop
+    or (instruction >= aconst_null and instruction <= sipush)
+    or (instruction >= iload and instruction <= aload_3)
+    or (instruction >= pop_ and instruction <= dmul)
+    or (instruction >= ineg and instruction <= lxor)
+    or (instruction >= i2l and instruction <= dcmpg);
+}
+
+bool
+fallsThrough(unsigned instruction)
+{
+  switch (instruction) {
+  case goto_: case goto_w: case tableswitch: case lookupswitch:
+  case ireturn: case lreturn: case freturn: case dreturn: case areturn:
+  case return_: case athrow:
+    return false;
+
+  default:
+    return true;
+  }
+}
+
+unsigned
+loadInstruction(unsigned code)
+{
+  switch (code) {
+  case ObjectField:
+    return aload;
+
+  case FloatField:
+    return fload;
+
+  case LongField:
+    return lload;
+
+  case DoubleField:
+    return dload;
+
+  default:
+    return iload;
+  }
+}
+
+class LoopChain {
+ public:
+  unsigned ip;
+  unsigned size;
+  unsigned code;
+  unsigned index;
+};
+
+class LoopOccurrence {
+ public:
+  unsigned ip;
+  unsigned chain;
+};
+
+class LoopAnalysis {
+ public:
+  enum {
+    InstructionFlag = 1 << 0,
+    TargetFlag = 1 << 1,
+    LoopFlag = 1 << 2
+  };
+
+  LoopAnalysis(Thread* t, object method, uint8_t* body, uint8_t* flags,
+               unsigned* predecessorIndex, unsigned* predecessors,
+               unsigned* worklist, unsigned* successors, bool* stored):
+    t(t),
+    method(method),
+    body(body),
+    flags(flags),
+    predecessorIndex(predecessorIndex),
+    predecessors(predecessors),
+    worklist(worklist),
+    successors(successors),
+    stored(stored),
+    length(codeLength(t, methodCode(t, method))),
+    localCount(codeMaxLocals(t, methodCode(t, method))),
+    nextIndex(localCount),
+    chainCount(0),
+    occurrenceCount(0),
+    thisInvariant(false),
+    fieldsMayChange(false)
+  { }
+
+  unsigned size(unsigned ip) {
+    return instructionSize(body, length, ip);
+  }
+
+  bool covers(uint64_t eh, unsigned ip) {
+    return ip >= exceptionHandlerStart(eh) and ip < exceptionHandlerEnd(eh);
+  }
+
+  // Returns the field referred to by the specified pool entry if it
+  // has been resolved, or null if not.
+  object field(unsigned index) {
+    object o = singletonObject
+      (t, codePool(t, methodCode(t, method)), index - 1);
+
+    return objectClass(t, o) == type(t, Machine::FieldType) ? o : 0;
+  }
+
+  // Returns true if the specified field has the same value throughout
+  // any execution of the current loop.
+  bool invariant(object field, bool static_) {
+    if (fieldsMayChange
+        or ((fieldFlags(t, field) & ACC_STATIC) != 0) != static_
+        or (fieldFlags(t, field) & ACC_VOLATILE))
+    {
+      return false;
+    }
+
+    for (unsigned ip = 0; ip < length; ++ip) {
+      if ((flags[ip] & LoopFlag)
+          and (body[ip] == putfield or body[ip] == putstatic))
+      {
+        object f = this->field(readInt16(body, ip + 1));
+        if (f == 0 or f == field) {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  // Returns the index of the recorded chain identical to the one of
+  // the specified size at the specified address, or chainCount if
+  // there is none.
+  unsigned find(unsigned ip, unsigned size) {
+    unsigned i = 0;
+    while (i < chainCount
+           and (chains[i].size != size
+                or memcmp(body + chains[i].ip, body + ip, size) != 0))
+    {
+      ++ i;
+    }
+    return i;
+  }
+
+  bool build();
+
+  bool findLoop(unsigned header);
+
+  bool chain(unsigned ip, unsigned* size, unsigned* code,
+             unsigned* safeSize, unsigned* safeCode);
+
+  void add(unsigned ip, unsigned size, unsigned code);
+
+  unsigned findChains(unsigned header);
+
+  Thread* t;
+  object method;
+  uint8_t* body;
+  uint8_t* flags;
+  unsigned* predecessorIndex;
+  unsigned* predecessors;
+  unsigned* worklist;
+  unsigned* successors;
+  bool* stored;
+  unsigned length;
+  unsigned localCount;
+  unsigned nextIndex;
+  unsigned chainCount;
+  unsigned occurrenceCount;
+  bool thisInvariant;
+  bool fieldsMayChange;
+  LoopChain chains[MaxLoopHoistingChains];
+  LoopOccurrence occurrences[MaxLoopHoistingOccurrences];
+};
+
+// Finds the instructions and branch targets in the method and builds
+// a table of the predecessors of each instruction (not counting
+// exception edges), returning false if the code contains anything we
+// don't handle.
+bool
+LoopAnalysis::build()
+{
+  memset(flags, 0, length);
+  memset(predecessorIndex, 0, (length + 1) * sizeof(unsigned));
+
+  thisInvariant = (methodFlags(t, method) & ACC_STATIC) == 0;
+
+  unsigned edgeCount = 0;
+  for (unsigned ip = 0; ip < length;) {
+    unsigned size = this->size(ip);
+    if (size == 0) {
+      return false;
+    }
+
+    flags[ip] |= InstructionFlag;
+
+    unsigned index;
+    unsigned footprint;
+    if (storesLocal(body, ip, &index, &footprint) and index == 0) {
+      thisInvariant = false;
+    }
+
+    unsigned count = instructionSuccessors(body, ip, size, successors);
+    for (unsigned i = 0; i < count; ++i) {
+      unsigned s = successors[i];
+      if (s >= length) {
+        return false;
+      }
+
+      if (s != ip + size) {
+        flags[s] |= TargetFlag;
+      }
+
+      ++ predecessorIndex[s];
+    }
+
+    edgeCount += count;
+    if (edgeCount > length) {
+      return false;
+    }
+
+    ip += size;
+  }
+
+  object eht = codeExceptionHandlerTable(t, methodCode(t, method));
+  if (eht) {
+    for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
+      uint64_t eh = exceptionHandlerTableBody(t, eht, i);
+      if (exceptionHandlerIp(eh) >= length
+          or exceptionHandlerEnd(eh) > length)
+      {
+        return false;
+      }
+
+      flags[exceptionHandlerIp(eh)] |= TargetFlag;
+    }
+  }
+
+  for (unsigned ip = 0; ip < length; ++ip) {
+    if ((flags[ip] & TargetFlag) and (flags[ip] & InstructionFlag) == 0) {
+      return false;
+    }
+  }
+
+  // convert the counts to offsets into the predecessor table, using
+  // the worklist to keep track of where the next entry for each
+  // instruction goes:
+  unsigned offset = 0;
+  for (unsigned ip = 0; ip < length; ++ip) {
+    unsigned count = predecessorIndex[ip];
+    predecessorIndex[ip] = offset;
+    worklist[ip] = offset;
+    offset += count;
+  }
+  predecessorIndex[length] = offset;
+
+  for (unsigned ip = 0; ip < length; ip += size(ip)) {
+    unsigned count = instructionSuccessors(body, ip, size(ip), successors);
+    for (unsigned i = 0; i < count; ++i) {
+      predecessors[worklist[successors[i]]++] = ip;
+    }
+  }
+
+  return true;
+}
+
+// Marks the instructions of the natural loop with the specified header
+// (i.e. those from which a back edge to it may be reached without
+// passing through it), returning false if there is no such loop or it
+// is not one we can insert a preheader into.
+bool
+LoopAnalysis::findLoop(unsigned header)
+{
+  for (unsigned ip = 0; ip < length; ++ip) {
+    flags[ip] &= ~LoopFlag;
+  }
+
+  flags[header] |= LoopFlag;
+
+  unsigned worklistSize = 0;
+  for (unsigned i = predecessorIndex[header];
+       i < predecessorIndex[header + 1]; ++i)
+  {
+    unsigned p = predecessors[i];
+    if (p >= header and (flags[p] & LoopFlag) == 0) {
+      flags[p] |= LoopFlag;
+      worklist[worklistSize++] = p;
+    }
+  }
+
+  if (worklistSize == 0) {
+    return false;
+  }
+
+  object eht = codeExceptionHandlerTable(t, methodCode(t, method));
+
+  while (worklistSize) {
+    unsigned ip = worklist[--worklistSize];
+
+    for (unsigned i = predecessorIndex[ip]; i < predecessorIndex[ip + 1];
+         ++i)
+    {
+      unsigned p = predecessors[i];
+      if ((flags[p] & LoopFlag) == 0) {
+        flags[p] |= LoopFlag;
+        worklist[worklistSize++] = p;
+      }
+    }
+
+    if (eht) {
+      for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
+        uint64_t eh = exceptionHandlerTableBody(t, eht, i);
+        if (exceptionHandlerIp(eh) == ip) {
+          for (unsigned p = exceptionHandlerStart(eh);
+               p < exceptionHandlerEnd(eh); ++p)
+          {
+            if ((flags[p] & (InstructionFlag | LoopFlag)) == InstructionFlag)
+            {
+              flags[p] |= LoopFlag;
+              worklist[worklistSize++] = p;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // if the entry point is part of the loop, the header doesn't
+  // dominate it, and there is some other way into the loop:
+  if (header != 0 and (flags[0] & LoopFlag)) {
+    return false;
+  }
+
+  // each edge from the loop back to the header must be a branch we can
+  // retarget, not a fall through into the preheader:
+  for (unsigned i = predecessorIndex[header];
+       i < predecessorIndex[header + 1]; ++i)
+  {
+    unsigned p = predecessors[i];
+    if ((flags[p] & LoopFlag) and p + size(p) == header
+        and fallsThrough(body[p]))
+    {
+      return false;
+    }
+  }
+
+  if (eht) {
+    for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
+      uint64_t eh = exceptionHandlerTableBody(t, eht, i);
+
+      // a handler in the loop which may be reached from the preheader
+      // could see the new locals before they have been initialized:
+      if (exceptionHandlerIp(eh) == header
+          or ((flags[exceptionHandlerIp(eh)] & LoopFlag)
+              and covers(eh, header)))
+      {
+        return false;
+      }
+    }
+  }
+
+  memset(stored, 0, localCount * sizeof(bool));
+  fieldsMayChange = false;
+
+  for (unsigned ip = 0; ip < length; ++ip) {
+    if (flags[ip] & LoopFlag) {
+      unsigned index;
+      unsigned footprint;
+      if (storesLocal(body, ip, &index, &footprint)) {
+        for (unsigned i = index; i < index + footprint and i < localCount;
+             ++i)
+        {
+          stored[i] = true;
+        }
+      }
+
+      switch (body[ip]) {
+      case invokevirtual: case invokespecial: case invokestatic:
+      case invokeinterface: case monitorenter: case monitorexit:
+      case new_:
+        fieldsMayChange = true;
+        break;
+
+      default:
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Finds the longest chain of the form described above which starts at
+// the specified address in the current loop, setting size and code to
+// its size and result type, and safeSize and safeCode to those of its
+// longest prefix which can neither throw nor have side effects (or
+// zero if there is no such prefix).  Returns false if there is no such
+// chain.
+bool
+LoopAnalysis::chain(unsigned ip, unsigned* size, unsigned* code,
+                    unsigned* safeSize, unsigned* safeCode)
+{
+  unsigned instruction = body[ip];
+  unsigned s;
+  unsigned c;
+  bool safe;
+  bool nonNull;
+
+  // a chain consisting of just an aload is not worth hoisting:
+  bool worthwhile;
+
+  if (instruction == aload
+      or (instruction >= aload_0 and instruction <= aload_3))
+  {
+    unsigned index = instruction == aload
+      ? body[ip + 1] : instruction - aload_0;
+
+    if (index >= localCount or stored[index]) {
+      return false;
+    }
+
+    s = instruction == aload ? 2 : 1;
+    c = ObjectField;
+    safe = true;
+    nonNull = index == 0 and thisInvariant;
+    worthwhile = false;
+  } else if (instruction == getstatic) {
+    object field = this->field(readInt16(body, ip + 1));
+    if (field == 0 or not invariant(field, true)) {
+      return false;
+    }
+
+    object class_ = fieldClass(t, field);
+
+    s = 3;
+    c = fieldCode(t, field);
+    safe = class_ == methodClass(t, method)
+      or (classVmFlags(t, class_) & NeedInitFlag) == 0;
+    nonNull = false;
+    worthwhile = true;
+  } else {
+    return false;
+  }
+
+  *size = worthwhile ? s : 0;
+  *code = c;
+  *safeSize = (safe and worthwhile) ? s : 0;
+  *safeCode = c;
+
+  while (c == ObjectField and ip + s < length
+         and (flags[ip + s] & (TargetFlag | LoopFlag)) == LoopFlag)
+  {
+    unsigned next = ip + s;
+    if (body[next] == getfield) {
+      object field = this->field(readInt16(body, next + 1));
+      if (field == 0 or not invariant(field, false)) {
+        break;
+      }
+
+      s += 3;
+      c = fieldCode(t, field);
+    } else if (body[next] == arraylength) {
+      s += 1;
+      c = IntField;
+    } else {
+      break;
+    }
+
+    // the only reference we know to be non-null is "this":
+    safe = safe and nonNull;
+    nonNull = false;
+
+    *size = s;
+    *code = c;
+
+    if (safe) {
+      *safeSize = s;
+      *safeCode = c;
+    }
+  }
+
+  return *size != 0;
+}
+
+// Records an occurrence of a chain to be hoisted, assigning the chain
+// a new local unless an identical one has already been recorded.
+void
+LoopAnalysis::add(unsigned ip, unsigned size, unsigned code)
+{
+  if (occurrenceCount == MaxLoopHoistingOccurrences) {
+    return;
+  }
+
+  unsigned i = find(ip, size);
+  if (i == chainCount) {
+    unsigned footprint
+      = (code == LongField or code == DoubleField) ? 2 : 1;
+
+    // the local must be accessible using an instruction no longer
+    // than the shortest chain:
+    if (chainCount == MaxLoopHoistingChains or nextIndex + footprint > 256)
+    {
+      return;
+    }
+
+    LoopChain* c = chains + (chainCount++);
+    c->ip = ip;
+    c->size = size;
+    c->code = code;
+    c->index = nextIndex;
+
+    nextIndex += footprint;
+  }
+
+  LoopOccurrence* o = occurrences + (occurrenceCount++);
+  o->ip = ip;
+  o->chain = i;
+}
+
+// Finds the chains to be hoisted out of the loop with the specified
+// header, which must have been found by findLoop, returning how many
+// there are.
+unsigned
+LoopAnalysis::findChains(unsigned header)
+{
+  chainCount = 0;
+  occurrenceCount = 0;
+  nextIndex = localCount;
+
+  // resolve any fields referred to in the loop up front, since we
+  // can't allocate once we've started looking at field objects.  A
+  // static field access may also run a static initializer, which may
+  // write to any field, unless its class is already initialized (or
+  // is our own, which is initialized before any of our code runs):
+  for (unsigned ip = 0; ip < length; ++ip) {
+    if (flags[ip] & LoopFlag) {
+      switch (body[ip]) {
+      case getfield: case putfield:
+        resolveField
+          (t, method, static_cast<uint16_t>(readInt16(body, ip + 1)) - 1,
+           false);
+        break;
+
+      case getstatic: case putstatic: {
+        object field = resolveField
+          (t, method, static_cast<uint16_t>(readInt16(body, ip + 1)) - 1,
+           false);
+
+        if (field == 0
+            or (fieldClass(t, field) != methodClass(t, method)
+                and (classVmFlags(t, fieldClass(t, field)) & NeedInitFlag)))
+        {
+          fieldsMayChange = true;
+        }
+      } break;
+
+      default:
+        break;
+      }
+    }
+  }
+
+  object eht = codeExceptionHandlerTable(t, methodCode(t, method));
+
+  unsigned size;
+  unsigned code;
+  unsigned safeSize;
+  unsigned safeCode;
+
+  // first, the part of the header which is always executed on entry:
+  unsigned ip = header;
+  while (ip < length and (flags[ip] & LoopFlag)) {
+    if (chain(ip, &size, &code, &safeSize, &safeCode)) {
+      bool sameHandlers = true;
+      if (eht) {
+        for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
+          uint64_t eh = exceptionHandlerTableBody(t, eht, i);
+          for (unsigned j = ip; j < ip + size; ++j) {
+            if (covers(eh, j) != covers(eh, header)) {
+              sameHandlers = false;
+            }
+          }
+        }
+      }
+
+      if (sameHandlers) {
+        add(ip, size, code);
+        ip += size;
+        continue;
+      }
+    } else if (pureInstruction(body[ip])) {
+      ip += this->size(ip);
+      continue;
+    }
+
+    break;
+  }
+
+  unsigned headerEnd = ip;
+
+  // then, anything else in the loop which is safe to evaluate early
+  // or which we're evaluating in the preheader anyway:
+  for (ip = 0; ip < length;) {
+    if ((flags[ip] & LoopFlag)
+        and (ip < header or ip >= headerEnd)
+        and chain(ip, &size, &code, &safeSize, &safeCode))
+    {
+      if (find(ip, size) < chainCount) {
+        add(ip, size, code);
+        ip += size;
+        continue;
+      } else if (safeSize) {
+        add(ip, safeSize, safeCode);
+        ip += safeSize;
+        continue;
+      }
+    }
+
+    ip += this->size(ip);
+  }
+
+  return chainCount;
+}
+
+// Inserts a preheader in front of the loop most recently found by the
+// specified analysis, and replaces the occurrences of the chains found
+// in that loop with loads of the locals the preheader stores them in.
+// Returns false if the resulting code would be too long.
+bool
+hoistChains(Thread* t, LoopAnalysis* a, unsigned header)
+{
+  object method = a->method;
+  PROTECT(t, method);
+
+  unsigned length = a->length;
+  uint8_t* body = a->body;
+
+  unsigned preheaderSize = 0;
+  for (unsigned i = 0; i < a->chainCount; ++i) {
+    preheaderSize += a->chains[i].size + 2;
+  }
+  preheaderSize = (preheaderSize + 3) & ~3;
+
+  // all branch offsets must still fit in 16 bits:
+  unsigned newLength = length + preheaderSize;
+  if (newLength > 0x7FFF) {
+    return false;
+  }
+
+  THREAD_RUNTIME_ARRAY(t, uint8_t, newBody, newLength);
+  uint8_t* p = RUNTIME_ARRAY_BODY(newBody);
+
+  memcpy(p, body, header);
+  memcpy(p + header + preheaderSize, body + header, length - header);
+
+  unsigned q = header;
+  for (unsigned i = 0; i < a->chainCount; ++i) {
+    LoopChain* c = a->chains + i;
+    memcpy(p + q, body + c->ip, c->size);
+    q += c->size;
+    p[q++] = loadInstruction(c->code) + (istore - iload);
+    p[q++] = c->index;
+  }
+
+  while (q < header + preheaderSize) {
+    p[q++] = nop;
+  }
+
+  // branches to the header from outside the loop should go to the
+  // preheader, and everything else should go where it did before:
+#define MAP(ip) ((ip) < header ? (ip) : (ip) + preheaderSize)
+#define TARGET(from, to) \
+  (((to) == header and (a->flags[from] & LoopAnalysis::LoopFlag) == 0) \
+   ? header : MAP(to))
+
+  for (unsigned ip = 0; ip < length; ip += a->size(ip)) {
+    unsigned np = MAP(ip);
+
+    switch (body[ip]) {
+    case ifeq: case ifne: case iflt: case ifge: case ifgt: case ifle:
+    case if_icmpeq: case if_icmpne: case if_icmplt: case if_icmpge:
+    case if_icmpgt: case if_icmple: case if_acmpeq: case if_acmpne:
+    case ifnull: case ifnonnull: case goto_:
+      writeInt16
+        (p, np + 1, TARGET(ip, ip + readInt16(body, ip + 1)) - np);
+      break;
+
+    case goto_w:
+      writeInt32
+        (p, np + 1, TARGET(ip, ip + readInt32(body, ip + 1)) - np);
+      break;
+
+    case tableswitch:
+    case lookupswitch: {
+      // the padding is unchanged, since the preheader size is a
+      // multiple of four:
+      unsigned b = (ip + 4) & ~3;
+      unsigned nb = (np + 4) & ~3;
+
+      writeInt32(p, nb, TARGET(ip, ip + readInt32(body, b)) - np);
+
+      unsigned step = body[ip] == tableswitch ? 4 : 8;
+      for (unsigned r = b + 12; r < ip + a->size(ip); r += step) {
+        writeInt32
+          (p, r - b + nb, TARGET(ip, ip + readInt32(body, r)) - np);
+      }
+    } break;
+
+    default:
+      break;
+    }
+  }
+
+  for (unsigned i = 0; i < a->occurrenceCount; ++i) {
+    LoopOccurrence* o = a->occurrences + i;
+    LoopChain* c = a->chains + o->chain;
+    unsigned np = MAP(o->ip);
+
+    p[np] = loadInstruction(c->code);
+    p[np + 1] = c->index;
+    memset(p + np + 2, nop, c->size - 2);
+  }
+
+  object eht = codeExceptionHandlerTable(t, methodCode(t, method));
+  if (eht) {
+    eht = makeExceptionHandlerTable(t, exceptionHandlerTableLength(t, eht));
+  }
+  PROTECT(t, eht);
+
+  object lnt = codeLineNumberTable(t, methodCode(t, method));
+  if (lnt) {
+    lnt = makeLineNumberTable(t, lineNumberTableLength(t, lnt));
+  }
+  PROTECT(t, lnt);
+
+  object oldCode = methodCode(t, method);
+
+  // a handler range which includes the header now includes the
+  // preheader too:
+  if (eht) {
+    object oldEht = codeExceptionHandlerTable(t, oldCode);
+    for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
+      uint64_t eh = exceptionHandlerTableBody(t, oldEht, i);
+      unsigned start = exceptionHandlerStart(eh);
+      unsigned end = exceptionHandlerEnd(eh);
+      exceptionHandlerTableBody(t, eht, i) = exceptionHandler
+        (start <= header ? start : start + preheaderSize,
+         end <= header ? end : end + preheaderSize,
+         MAP(exceptionHandlerIp(eh)),
+         exceptionHandlerCatchType(eh));
+    }
+  }
+
+  if (lnt) {
+    object oldLnt = codeLineNumberTable(t, oldCode);
+    for (unsigned i = 0; i < lineNumberTableLength(t, lnt); ++i) {
+      uint64_t ln = lineNumberTableBody(t, oldLnt, i);
+      unsigned ip = lineNumberIp(ln);
+      lineNumberTableBody(t, lnt, i) = lineNumber
+        (ip <= header ? ip : ip + preheaderSize, lineNumberLine(ln));
+    }
+  }
+
+#undef TARGET
+#undef MAP
+
+  object newCode = makeCode
+    (t, codePool(t, oldCode), eht, lnt, 0, 0, codeMaxStack(t, oldCode) + 2,
+     a->nextIndex, newLength);
+
+  memcpy(&codeBody(t, newCode, 0), p, newLength);
+
+  set(t, method, MethodCode, newCode);
+
+  return true;
+}
+
+// Hoists loop-invariant expressions out of the loops in the specified
+// method as described above, innermost loops first.
+void
+hoistLoopInvariants(MyThread* t, object method)
+{
+  PROTECT(t, method);
+
+  for (unsigned pass = 0; pass < MaxLoopHoistingPasses; ++pass) {
+    object code = methodCode(t, method);
+    unsigned length = codeLength(t, code);
+    unsigned localCount = codeMaxLocals(t, code);
+
+    // a method without a backward branch has no loops:
+    bool found = false;
+    for (unsigned ip = 0; ip + 3 <= length and not found; ++ip) {
+      unsigned instruction = codeBody(t, code, ip);
+      found = ((instruction >= ifeq and instruction <= goto_)
+               or instruction == ifnull or instruction == ifnonnull
+               or instruction == goto_w)
+        and (codeBody(t, code, ip + 1) & 0x80);
+    }
+
+    if (not found) {
+      return;
+    }
+
+    unsigned footprint = (length * sizeof(uint8_t) * 2)
+      + ((length + 1) * sizeof(unsigned))
+      + (length * sizeof(unsigned) * 2)
+      + ((length + 2) * sizeof(unsigned))
+      + (localCount * sizeof(bool));
+
+    uint8_t* memory = static_cast<uint8_t*>(t->m->heap->allocate(footprint));
+
+    THREAD_RESOURCE2(t, uint8_t*, memory, unsigned, footprint,
+                     t->m->heap->free(memory, footprint));
+
+    unsigned* predecessorIndex = reinterpret_cast<unsigned*>(memory);
+    unsigned* predecessors = predecessorIndex + length + 1;
+    unsigned* worklist = predecessors + length;
+    unsigned* successors = worklist + length;
+    uint8_t* body = reinterpret_cast<uint8_t*>(successors + length + 2);
+    uint8_t* flags = body + length;
+    bool* stored = reinterpret_cast<bool*>(flags + length);
+
+    memcpy(body, &codeBody(t, code, 0), length);
+
+    LoopAnalysis analysis(t, method, body, flags, predecessorIndex,
+                          predecessors, worklist, successors, stored);
+    PROTECT(t, analysis.method);
+
+    if (not analysis.build()) {
+      return;
+    }
+
+    // inner loops have higher addressed headers than the loops which
+    // contain them, and hoisting out of them first exposes more
+    // opportunities in the outer loops (including the preheaders
+    // we've added):
+    bool hoisted = false;
+    for (unsigned header = length; header > 0 and not hoisted;) {
+      -- header;
+
+      if ((flags[header] & LoopAnalysis::InstructionFlag)
+          and analysis.findLoop(header)
+          and analysis.findChains(header))
+      {
+        if (not hoistChains(t, &analysis, header)) {
+          return;
+        }
+
+        if (DebugLoopHoisting) {
+          fprintf(stderr, "hoisted %d expressions from loop at %d in "
+                  "%s.%s%s\n", analysis.chainCount, header,
+                  &byteArrayBody(t, className(t, methodClass(t, method)), 0),
+                  &byteArrayBody(t, methodName(t, method), 0),
+                  &byteArrayBody(t, methodSpec(t, method), 0));
+        }
+
+        hoisted = true;
+      }
+    }
+
+    if (not hoisted) {
+      return;
+    }
+  }
+}
+
+void
+compile(MyThread* t, FixedAllocator* allocator, BootContext* bootContext,
+        object method)
+{
+  PROTECT(t, method);
+
+  if (bootContext == 0) {
+    initClass(t, methodClass(t, method));
+  }
+
+  if (not unresolved(t, methodAddress(t, method))) {
+    return;
+  }
+
+  assert(t, (methodFlags(t, method) & ACC_NATIVE) == 0);
+
+  ensureCodeTables(t, methodCode(t, method));
+
+  // We must avoid acquiring any locks until after the first pass of
+  // compilation, since this pass may trigger classloading operations
+  // involving application classloaders and thus the potential for
+  // deadlock.  To make this safe, we use a private clone of the
+  // method so that we won't be confused if another thread updates the
+  // original while we're working.
+
+  object clone = methodClone(t, method);
+
+  loadMemoryBarrier();
+
+  if (not unresolved(t, methodAddress(t, method))) {
+    return;
+  }
+
+  PROTECT(t, clone);
+
+  if (bootContext == 0) {
+    replaceScalars(t, clone);
+    hoistLoopInvariants(t, clone);
+  }
+
+  Context context(t, bootContext, clone);
+  compile(t, &context);
+
+  { object ehTable = codeExceptionHandlerTable(t, methodCode(t, clone));
+
+    if (ehTable) {
+      PROTECT(t, ehTable);
+
+      // resolve all exception handler catch types before we acquire
+      // the code lock:
+      for (unsigned i = 0; i < exceptionHandlerTableLength(t, ehTable); ++i) {
+        uint64_t handler = exceptionHandlerTableBody(t, ehTable, i);
+        if (exceptionHandlerCatchType(handler)) {
+          resolveClassInPool
+            (t, clone, exceptionHandlerCatchType(handler) - 1);
+        }
+      }
+    }
+  }
+
+  // only code generation and publication are serialized here, and
+  // separately from class loading; readers of the method tree never
+  // take this lock, since treeInsert leaves the existing tree intact
+  // and we publish the new root only once it is complete
+  ACQUIRE(t, codeLock(t));
+
+  if (not unresolved(t, methodAddress(t, method))) {
+    return;
+  }
+
+  finish(t, allocator, &context);
+ 
+  if (DebugMethodTree) {
+    fprintf(stderr, "insert method at %p\n",
+            reinterpret_cast<void*>(methodCompiled(t, clone)));
+  }
+
+  // We can't update the MethodCode field on the original method
+  // before it is placed into the method tree, since another thread
+  // might call the method, from which stack unwinding would fail
+  // (since there is not yet an entry in the method tree).  However,
+  // we can't insert the original method into the tree before updating
   // the MethodCode field on it since we rely on that field to
   // determine its position in the tree.  Therefore, we insert the
   // clone in its place.  Later, we'll replace the clone with the
@@ -10513,6 +13039,12 @@ codeAllocator(MyThread* t)
   return &(processor(t)->codeAllocator);
 }
 
+System::Monitor*
+codeLock(MyThread* t)
+{
+  return processor(t)->codeLock;
+}
+
 } // namespace local
 
 } // namespace
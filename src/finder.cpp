@@ -11,6 +11,7 @@
 #include <avian/vm/system/system.h>
 #include <avian/util/string.h>
 #include <avian/util/runtime-array.h>
+#include <avian/util/math.h>
 
 #include "avian/zlib-custom.h"
 #include "avian/finder.h"
@@ -24,6 +25,13 @@ namespace {
 
 const bool DebugFind = false;
 const bool DebugStat = false;
+const bool DebugPrefetch = false;
+
+// upper bound on the number of bytes the prefetch threads may hold
+// inflated but not yet claimed by Finder::find:
+const unsigned PrefetchCacheLimit = 16 * 1024 * 1024;
+
+class Prefetcher;
 
 class Element {
  public:
@@ -33,8 +41,15 @@ class Element {
     virtual void dispose() = 0;
   };
 
+  enum Kind {
+    DirectoryKind,
+    JarKind,
+    BuiltinKind
+  };
+
   Element(): next(0) { }
 
+  virtual Kind kind() = 0;
   virtual Iterator* iterator() = 0;
   virtual System::Region* find(const char* name) = 0;
   virtual System::FileType stat(const char* name, unsigned* length,
@@ -43,6 +58,14 @@ class Element {
   virtual const char* sourceUrl() = 0;
   virtual void dispose() = 0;
 
+  // Queues the specified entry (or every entry, if name is null) for
+  // background inflation, returning true if this element contains the
+  // named entry and thus shadows any later element.
+  virtual bool prefetch(Prefetcher*, const char* name) {
+    unsigned length;
+    return name and stat(name, &length, false) != System::TypeDoesNotExist;
+  }
+
   Element* next;
 };
 
@@ -117,6 +140,10 @@ class DirectoryElement: public Element {
     sourceUrl_(append(allocator, "file:", this->name))
   { }
 
+  virtual Kind kind() {
+    return DirectoryKind;
+  }
+
   virtual Element::Iterator* iterator() {
     return new (allocator->allocate(sizeof(Iterator)))
       Iterator(s, allocator, name, strlen(name) + 1);
@@ -234,6 +261,13 @@ class DataRegion: public System::Region {
   uint8_t data[0];
 };
 
+class PrefetchCache {
+ public:
+  System::Mutex* lock;
+  unsigned size;
+  bool stop;
+};
+
 class JarIndex {
  public:
   enum CompressionMethod {
@@ -243,13 +277,22 @@ class JarIndex {
 
   class Node {
    public:
+    enum State {
+      Pending,
+      Inflating,
+      Ready,
+      Taken
+    };
+
     Node(uint32_t hash, const uint8_t* entry, Node* next):
-      hash(hash), entry(entry), next(next)
+      hash(hash), entry(entry), next(next), prefetched(0), state(Pending)
     { }
 
     uint32_t hash;
     const uint8_t* entry;
     Node* next;
+    DataRegion* prefetched;
+    uint8_t state;
   };
 
   JarIndex(System* s, Allocator* allocator, unsigned capacity):
@@ -257,6 +300,7 @@ class JarIndex {
     allocator(allocator),
     capacity(capacity),
     position(0),
+    cache(0),
     nodes(static_cast<Node*>(allocator->allocate(sizeof(Node) * capacity)))
   {
     memset(table, 0, sizeof(Node*) * capacity);
@@ -268,30 +312,33 @@ class JarIndex {
       JarIndex(s, allocator, capacity);
   }
   
+  static const uint8_t* findEndOfCentralDirectory(System::Region* region) {
+    const uint8_t* start = region->start();
+    const uint8_t* p = start + region->length() - CentralDirectorySearchStart;
+    while (p > start) {
+      if (signature(p) == CentralDirectorySignature) {
+        return p;
+      } else {
+        p--;
+      }
+    }
+    return 0;
+  }
+
   static JarIndex* open(System* s, Allocator* allocator,
                         System::Region* region)
   {
     JarIndex* index = make(s, allocator, 32);
 
-    const uint8_t* start = region->start();
-    const uint8_t* end = start + region->length();
-    const uint8_t* p = end - CentralDirectorySearchStart;
-    // Find end of central directory record
-    while (p > start) {
-      if (signature(p) == CentralDirectorySignature) {
-	p = region->start() + centralDirectoryOffset(p);
-	
-	while (p < end) {
-	  if (signature(p) == EntrySignature) {
-	    index = index->add(hash(fileName(p), fileNameLength(p)), p);
-
-	    p = endOfEntry(p);
-	  } else {
-	    return index;
-	  }
-	}
-      } else {
-	p--;
+    const uint8_t* end = region->start() + region->length();
+    const uint8_t* p = findEndOfCentralDirectory(region);
+    if (p) {
+      p = region->start() + centralDirectoryOffset(p);
+
+      while (p < end and signature(p) == EntrySignature) {
+        index = index->add(hash(fileName(p), fileNameLength(p)), p);
+
+        p = endOfEntry(p);
       }
     }
 
@@ -338,28 +385,14 @@ class JarIndex {
       } break;
 
       case Deflated: {
-        DataRegion* region = new
-          (allocator->allocate(sizeof(DataRegion) + uncompressedSize(p)))
-          DataRegion(s, allocator, uncompressedSize(p));
-          
-        z_stream zStream; memset(&zStream, 0, sizeof(z_stream));
-
-        zStream.next_in = const_cast<uint8_t*>(fileData(start +
-							localHeaderOffset(p)));
-        zStream.avail_in = compressedSize(p);
-        zStream.next_out = region->data;
-        zStream.avail_out = region->length();
-
-        // -15 means max window size and raw deflate (no zlib wrapper)
-        int r = inflateInit2(&zStream, -15);
-        expect(s, r == Z_OK);
-
-        r = inflate(&zStream, Z_FINISH);
-        expect(s, r == Z_STREAM_END);
-
-        inflateEnd(&zStream);
+        if (cache) {
+          DataRegion* region = take(n);
+          if (region) {
+            return region;
+          }
+        }
 
-        return region;
+        return inflateEntry(p, start);
       } break;
 
       default:
@@ -370,6 +403,98 @@ class JarIndex {
     return 0;
   }
 
+  DataRegion* inflateEntry(const uint8_t* p, const uint8_t* start) {
+    DataRegion* region = new
+      (allocator->allocate(sizeof(DataRegion) + uncompressedSize(p)))
+      DataRegion(s, allocator, uncompressedSize(p));
+
+    z_stream zStream; memset(&zStream, 0, sizeof(z_stream));
+
+    zStream.next_in = const_cast<uint8_t*>(fileData(start +
+                                                    localHeaderOffset(p)));
+    zStream.avail_in = compressedSize(p);
+    zStream.next_out = region->data;
+    zStream.avail_out = region->length();
+
+    // -15 means max window size and raw deflate (no zlib wrapper)
+    int r = inflateInit2(&zStream, -15);
+    expect(s, r == Z_OK);
+
+    r = inflate(&zStream, Z_FINISH);
+    expect(s, r == Z_STREAM_END);
+
+    inflateEnd(&zStream);
+
+    return region;
+  }
+
+  // Claims the result of a background inflation of the specified
+  // node, if any.  Once a node has been taken, any inflation still in
+  // progress is discarded when it finishes, since the caller has
+  // already done the work itself.
+  DataRegion* take(Node* n) {
+    cache->lock->acquire();
+
+    DataRegion* region = n->prefetched;
+    if (region) {
+      cache->size -= region->length();
+      n->prefetched = 0;
+    }
+    n->state = Node::Taken;
+
+    cache->lock->release();
+
+    if (DebugPrefetch) {
+      fprintf(stderr, "%s prefetched entry %.*s\n",
+              region ? "use" : "miss", fileNameLength(n->entry),
+              fileName(n->entry));
+    }
+
+    return region;
+  }
+
+  // Inflates the specified node on behalf of a prefetch thread,
+  // returning false if the cache is full or the prefetcher is
+  // stopping.
+  bool prefetch(Node* n, const uint8_t* start) {
+    unsigned size = uncompressedSize(n->entry);
+
+    cache->lock->acquire();
+
+    if (cache->stop or cache->size + size > PrefetchCacheLimit) {
+      cache->lock->release();
+      return false;
+    } else if (n->state != Node::Pending) {
+      cache->lock->release();
+      return true;
+    }
+
+    n->state = Node::Inflating;
+    cache->size += size;
+
+    cache->lock->release();
+
+    DataRegion* region = inflateEntry(n->entry, start);
+
+    cache->lock->acquire();
+
+    bool keep = n->state == Node::Inflating;
+    if (keep) {
+      n->prefetched = region;
+      n->state = Node::Ready;
+    } else {
+      cache->size -= size;
+    }
+
+    cache->lock->release();
+
+    if (not keep) {
+      region->dispose();
+    }
+
+    return true;
+  }
+
   System::FileType stat(const char* name, unsigned* length, bool tryDirectory)
   {
     Node* node = findNode(name);
@@ -399,6 +524,12 @@ class JarIndex {
   }
 
   void dispose() {
+    for (unsigned i = 0; i < position; ++i) {
+      if (nodes[i].prefetched) {
+        nodes[i].prefetched->dispose();
+      }
+    }
+
     allocator->free(nodes, sizeof(Node) * capacity);
     allocator->free(this, sizeof(*this) + (sizeof(Node*) * capacity));
   }
@@ -407,7 +538,8 @@ class JarIndex {
   Allocator* allocator;
   unsigned capacity;
   unsigned position;
-  
+  PrefetchCache* cache;
+
   Node* nodes;
   Node* table[0];
 };
@@ -467,6 +599,10 @@ class JarElement: public Element {
     index(JarIndex::open(s, allocator, region))
   { }
 
+  virtual Kind kind() {
+    return JarKind;
+  }
+
   virtual Element::Iterator* iterator() {
     init();
 
@@ -474,14 +610,37 @@ class JarElement: public Element {
       Iterator(s, allocator, index);
   }
 
-  virtual void init() {
-    if (index == 0) {
+  bool map() {
+    if (region == 0) {
       System::Region* r;
       if (s->success(s->map(&r, name))) {
         region = r;
-        index = JarIndex::open(s, allocator, r);
       }
     }
+    return region != 0;
+  }
+
+  virtual void init() {
+    if (index == 0 and map()) {
+      index = JarIndex::open(s, allocator, region);
+    }
+  }
+
+  // Identifies the current version of the jar without scanning its
+  // central directory.
+  bool stamp(uint32_t* length, uint32_t* directoryOffset,
+             uint32_t* directorySize)
+  {
+    if (map()) {
+      const uint8_t* p = JarIndex::findEndOfCentralDirectory(region);
+      if (p) {
+        *length = region->length();
+        *directoryOffset = centralDirectoryOffset(p);
+        *directorySize = centralDirectorySize(p);
+        return true;
+      }
+    }
+    return false;
   }
 
   virtual System::Region* find(const char* name) {
@@ -515,6 +674,8 @@ class JarElement: public Element {
     return type;
   }
 
+  virtual bool prefetch(Prefetcher* prefetcher, const char* name);
+
   virtual const char* urlPrefix() {
     return urlPrefix_;
   }
@@ -563,6 +724,10 @@ class BuiltinElement: public JarElement {
     libraryName(libraryName ? copy(allocator, libraryName) : 0)
   { }
 
+  virtual Kind kind() {
+    return BuiltinKind;
+  }
+
   virtual void init() {
     if (index == 0) {
       if (s->success(s->load(&library, libraryName))) {
@@ -625,6 +790,175 @@ class BuiltinElement: public JarElement {
   const char* libraryName;
 };
 
+// Inflates compressed jar entries on background threads ahead of the
+// requests for them, so that class loading on the main thread finds
+// most entries ready to use.  Entries are processed in the order they
+// were queued, which is the order given by a recorded profile when one
+// is available.
+class Prefetcher {
+ public:
+  class Item {
+   public:
+    JarIndex* index;
+    JarIndex::Node* node;
+    const uint8_t* start;
+  };
+
+  class Worker: public System::Runnable {
+   public:
+    Worker(Prefetcher* prefetcher):
+      prefetcher(prefetcher), thread(0)
+    { }
+
+    virtual void attach(System::Thread* t) {
+      thread = t;
+    }
+
+    virtual void run() {
+      prefetcher->run();
+    }
+
+    virtual bool interrupted() {
+      return false;
+    }
+
+    virtual void setInterrupted(bool) { }
+
+    Prefetcher* prefetcher;
+    System::Thread* thread;
+  };
+
+  Prefetcher(System* s, Allocator* allocator):
+    s(s),
+    allocator(allocator),
+    items(0),
+    capacity(0),
+    count(0),
+    position(0),
+    workers(0),
+    workerCount(0)
+  {
+    expect(s, s->success(s->make(&cache.lock)));
+    cache.size = 0;
+    cache.stop = false;
+  }
+
+  void add(JarIndex* index, JarIndex::Node* node, const uint8_t* start) {
+    if (compressionMethod(node->entry) != JarIndex::Deflated
+        or node->state != JarIndex::Node::Pending)
+    {
+      return;
+    }
+
+    if (count == capacity) {
+      unsigned newCapacity = capacity ? capacity * 2 : 256;
+      Item* newItems = static_cast<Item*>
+        (allocator->allocate(sizeof(Item) * newCapacity));
+      if (items) {
+        memcpy(newItems, items, sizeof(Item) * count);
+        allocator->free(items, sizeof(Item) * capacity);
+      }
+      items = newItems;
+      capacity = newCapacity;
+    }
+
+    index->cache = &cache;
+
+    Item* item = items + (count++);
+    item->index = index;
+    item->node = node;
+    item->start = start;
+  }
+
+  void start(unsigned threadCount) {
+    if (DebugPrefetch) {
+      fprintf(stderr, "prefetch %d entries using %d threads\n",
+              count, threadCount);
+    }
+
+    workers = static_cast<Worker*>
+      (allocator->allocate(sizeof(Worker) * threadCount));
+    workerCount = threadCount;
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+      new (workers + i) Worker(this);
+      expect(s, s->success(s->start(workers + i)));
+    }
+  }
+
+  void run() {
+    while (true) {
+      cache.lock->acquire();
+      Item* item = position < count ? items + (position++) : 0;
+      cache.lock->release();
+
+      if (item == 0 or not item->index->prefetch(item->node, item->start)) {
+        return;
+      }
+    }
+  }
+
+  void dispose() {
+    cache.lock->acquire();
+    cache.stop = true;
+    cache.lock->release();
+
+    for (unsigned i = 0; i < workerCount; ++i) {
+      workers[i].thread->join();
+      workers[i].thread->dispose();
+    }
+
+    if (workers) {
+      allocator->free(workers, sizeof(Worker) * workerCount);
+    }
+
+    if (items) {
+      allocator->free(items, sizeof(Item) * capacity);
+    }
+
+    cache.lock->dispose();
+
+    allocator->free(this, sizeof(*this));
+  }
+
+  System* s;
+  Allocator* allocator;
+  PrefetchCache cache;
+  Item* items;
+  unsigned capacity;
+  unsigned count;
+  unsigned position;
+  Worker* workers;
+  unsigned workerCount;
+};
+
+bool
+JarElement::prefetch(Prefetcher* prefetcher, const char* name)
+{
+  init();
+
+  if (index == 0) {
+    return false;
+  }
+
+  if (name) {
+    while (*name == '/') name++;
+
+    JarIndex::Node* node = index->findNode(name);
+    if (node) {
+      prefetcher->add(index, node, region->start());
+      return true;
+    } else {
+      return false;
+    }
+  } else {
+    for (unsigned i = 0; i < index->position; ++i) {
+      prefetcher->add(index, index->nodes + i, region->start());
+    }
+    return false;
+  }
+}
+
 void
 add(Element** first, Element** last, Element* e)
 {
@@ -859,15 +1193,176 @@ class MyIterator: public Finder::IteratorImp {
   Element::Iterator* it;
 };
 
+// Maps each entry name to the position on the path of the first jar
+// containing it, so that lookups need not probe every element in
+// turn.  Names point into the jars' central directories or into a
+// mapped index cache file, which must outlive the index.
+class ClasspathIndex {
+ public:
+  class Entry {
+   public:
+    const uint8_t* name;
+    unsigned length;
+    unsigned element;
+    Entry* next;
+  };
+
+  ClasspathIndex(System* s, Allocator* allocator, unsigned capacity):
+    s(s),
+    allocator(allocator),
+    capacity(capacity),
+    count(0),
+    entries(static_cast<Entry*>(allocator->allocate(sizeof(Entry) * capacity)))
+  {
+    memset(table, 0, sizeof(Entry*) * capacity);
+  }
+
+  static ClasspathIndex* make(System* s, Allocator* allocator,
+                              unsigned count)
+  {
+    unsigned capacity = nextPowerOfTwo(count ? count : 1);
+    return new
+      (allocator->allocate(sizeof(ClasspathIndex)
+                           + (sizeof(Entry*) * capacity)))
+      ClasspathIndex(s, allocator, capacity);
+  }
+
+  Entry* findEntry(const uint8_t* name, unsigned length) {
+    unsigned i = hash(name, length) & (capacity - 1);
+    for (Entry* e = table[i]; e; e = e->next) {
+      if (equal(name, length, e->name, e->length)) {
+        return e;
+      }
+    }
+    return 0;
+  }
+
+  unsigned find(const char* name, unsigned length, unsigned notFound) {
+    Entry* e = findEntry(reinterpret_cast<const uint8_t*>(name), length);
+    return e ? e->element : notFound;
+  }
+
+  // adds the specified name unless an earlier element on the path
+  // already provides it
+  void add(const uint8_t* name, unsigned length, unsigned element) {
+    if (findEntry(name, length) == 0) {
+      expect(s, count < capacity);
+
+      unsigned i = hash(name, length) & (capacity - 1);
+      Entry* e = entries + (count++);
+      e->name = name;
+      e->length = length;
+      e->element = element;
+      e->next = table[i];
+      table[i] = e;
+    }
+  }
+
+  void dispose() {
+    allocator->free(entries, sizeof(Entry) * capacity);
+    allocator->free(this, sizeof(*this) + (sizeof(Entry*) * capacity));
+  }
+
+  System* s;
+  Allocator* allocator;
+  unsigned capacity;
+  unsigned count;
+  Entry* entries;
+  Entry* table[0];
+};
+
+const uint32_t IndexCacheMagic = 0x58495641; // "AVIX"
+const uint32_t IndexCacheVersion = 1;
+
+void
+write4(FILE* out, uint32_t v)
+{
+  fwrite(&v, 4, 1, out);
+}
+
+void
+writeString(FILE* out, const void* s, unsigned length)
+{
+  write4(out, length);
+  fwrite(s, 1, length, out);
+}
+
+class IndexReader {
+ public:
+  IndexReader(const uint8_t* p, unsigned length):
+    p(p), end(p + length), ok(true)
+  { }
+
+  uint32_t read4() {
+    uint32_t v = 0;
+    if (end - p < 4) {
+      ok = false;
+    } else {
+      memcpy(&v, p, 4);
+      p += 4;
+    }
+    return v;
+  }
+
+  const uint8_t* readString(unsigned* length) {
+    *length = read4();
+    if (not ok or static_cast<unsigned>(end - p) < *length) {
+      ok = false;
+      return 0;
+    } else {
+      const uint8_t* v = p;
+      p += *length;
+      return v;
+    }
+  }
+
+  bool matchString(const char* s) {
+    unsigned length;
+    const uint8_t* v = readString(&length);
+    return ok and equal(v, length, s, strlen(s));
+  }
+
+  const uint8_t* p;
+  const uint8_t* end;
+  bool ok;
+};
+
+class ProfileEntry {
+ public:
+  ProfileEntry* next;
+  unsigned length;
+  char name[0];
+};
+
 class MyFinder: public Finder {
  public:
   MyFinder(System* system, Allocator* allocator, const char* path,
-           const char* bootLibrary):
+           const char* bootLibrary, const char* indexCache):
     system(system),
     allocator(allocator),
-    path_(parsePath(system, allocator, path, bootLibrary)),
-    pathString(copy(allocator, path))
-  { }
+    path_(0),
+    pathString(copy(allocator, path)),
+    elements(0),
+    elementCount(0),
+    directories(0),
+    directoryCount(0),
+    index(0),
+    indexRegion(0),
+    prefetcher(0),
+    profile(0),
+    profileLock(0),
+    profileFirst(0),
+    profileLast(0)
+  {
+    if (indexCache == 0 or not loadIndex(indexCache)) {
+      path_ = parsePath(system, allocator, path, bootLibrary);
+      buildIndex();
+
+      if (indexCache) {
+        writeIndex(indexCache);
+      }
+    }
+  }
 
   MyFinder(System* system, Allocator* allocator, const uint8_t* jarData,
            unsigned jarLength):
@@ -875,72 +1370,536 @@ class MyFinder: public Finder {
     allocator(allocator),
     path_(new (allocator->allocate(sizeof(JarElement)))
           JarElement(system, allocator, jarData, jarLength)),
-    pathString(0)
-  { }
+    pathString(0),
+    elements(0),
+    elementCount(0),
+    directories(0),
+    directoryCount(0),
+    index(0),
+    indexRegion(0),
+    prefetcher(0),
+    profile(0),
+    profileLock(0),
+    profileFirst(0),
+    profileLast(0)
+  {
+    buildIndex();
+  }
+
+  void listElements() {
+    for (Element* e = path_; e; e = e->next) {
+      ++ elementCount;
+      if (e->kind() == Element::DirectoryKind) {
+        ++ directoryCount;
+      }
+    }
+
+    elements = static_cast<Element**>
+      (allocator->allocate(sizeof(Element*) * elementCount));
+    directories = static_cast<unsigned*>
+      (allocator->allocate(sizeof(unsigned) * directoryCount));
+
+    unsigned i = 0;
+    unsigned di = 0;
+    for (Element* e = path_; e; e = e->next) {
+      if (e->kind() == Element::DirectoryKind) {
+        directories[di++] = i;
+      }
+      elements[i++] = e;
+    }
+  }
+
+  // Directories are not indexed, since their contents may change
+  // while we run; they are probed directly whenever they precede the
+  // indexed jar on the path.
+  void buildIndex() {
+    listElements();
+
+    unsigned count = 0;
+    for (unsigned i = 0; i < elementCount; ++i) {
+      if (elements[i]->kind() != Element::DirectoryKind) {
+        JarElement* jar = static_cast<JarElement*>(elements[i]);
+        jar->init();
+        if (jar->index) {
+          count += jar->index->position;
+        }
+      }
+    }
+
+    index = ClasspathIndex::make(system, allocator, count);
+
+    for (unsigned i = 0; i < elementCount; ++i) {
+      if (elements[i]->kind() != Element::DirectoryKind) {
+        JarIndex* jarIndex = static_cast<JarElement*>(elements[i])->index;
+        if (jarIndex) {
+          for (unsigned j = 0; j < jarIndex->position; ++j) {
+            const uint8_t* p = jarIndex->nodes[j].entry;
+            index->add(fileName(p), fileNameLength(p), i);
+          }
+        }
+      }
+    }
+  }
+
+  void writeIndex(const char* file) {
+    for (unsigned i = 0; i < elementCount; ++i) {
+      if (elements[i]->kind() == Element::BuiltinKind) {
+        // embedded jars can't be checked for staleness, and they're
+        // cheap to scan anyway
+        return;
+      }
+    }
+
+    FILE* out = vm::fopen(file, "wb");
+    if (out == 0) {
+      if (DebugFind) {
+        fprintf(stderr, "unable to open %s\n", file);
+      }
+      return;
+    }
+
+    write4(out, IndexCacheMagic);
+    write4(out, IndexCacheVersion);
+    writeString(out, pathString, strlen(pathString));
+
+    unsigned tokenCount = 0;
+    for (Tokenizer t(pathString, system->pathSeparator()); t.hasMore();) {
+      t.next();
+      ++ tokenCount;
+    }
+
+    write4(out, tokenCount);
+    for (Tokenizer t(pathString, system->pathSeparator()); t.hasMore();) {
+      String token(t.next());
+      RUNTIME_ARRAY(char, n, token.length + 1);
+      memcpy(RUNTIME_ARRAY_BODY(n), token.text, token.length);
+      RUNTIME_ARRAY_BODY(n)[token.length] = 0;
+
+      const char* name = system->toAbsolutePath
+        (allocator, RUNTIME_ARRAY_BODY(n));
+      unsigned length;
+      write4(out, system->stat(name, &length));
+      writeString(out, name, strlen(name));
+      allocator->free(name, strlen(name) + 1);
+    }
+
+    write4(out, elementCount);
+    for (unsigned i = 0; i < elementCount; ++i) {
+      Element* e = elements[i];
+      write4(out, e->kind());
+      if (e->kind() == Element::DirectoryKind) {
+        const char* name = static_cast<DirectoryElement*>(e)->name;
+        writeString(out, name, strlen(name));
+      } else {
+        JarElement* jar = static_cast<JarElement*>(e);
+        writeString(out, jar->name, strlen(jar->name));
+
+        uint32_t length = 0;
+        uint32_t directoryOffset = 0;
+        uint32_t directorySize = 0;
+        jar->stamp(&length, &directoryOffset, &directorySize);
+        write4(out, length);
+        write4(out, directoryOffset);
+        write4(out, directorySize);
+      }
+    }
+
+    write4(out, index->count);
+    for (unsigned i = 0; i < index->count; ++i) {
+      ClasspathIndex::Entry* e = index->entries + i;
+      write4(out, e->element);
+      writeString(out, e->name, e->length);
+    }
+
+    write4(out, IndexCacheMagic);
+
+    fclose(out);
+  }
+
+  bool readTokens(IndexReader* in) {
+    unsigned tokenCount = in->read4();
+    for (Tokenizer t(pathString, system->pathSeparator()); t.hasMore();) {
+      String token(t.next());
+      if (tokenCount-- == 0) {
+        return false;
+      }
+
+      RUNTIME_ARRAY(char, n, token.length + 1);
+      memcpy(RUNTIME_ARRAY_BODY(n), token.text, token.length);
+      RUNTIME_ARRAY_BODY(n)[token.length] = 0;
+
+      const char* name = system->toAbsolutePath
+        (allocator, RUNTIME_ARRAY_BODY(n));
+      unsigned length;
+      bool match = in->read4() == static_cast<uint32_t>
+        (system->stat(name, &length))
+        and in->matchString(name);
+      allocator->free(name, strlen(name) + 1);
+
+      if (not match) {
+        return false;
+      }
+    }
+
+    return in->ok and tokenCount == 0;
+  }
+
+  bool readElements(IndexReader* in) {
+    Element* last = 0;
+    unsigned count = in->read4();
+    for (unsigned i = 0; in->ok and i < count; ++i) {
+      unsigned kind = in->read4();
+      unsigned length;
+      const uint8_t* p = in->readString(&length);
+      if (not in->ok) {
+        return false;
+      }
+
+      char* name = static_cast<char*>(allocator->allocate(length + 1));
+      memcpy(name, p, length);
+      name[length] = 0;
+
+      if (kind == Element::DirectoryKind) {
+        add(&path_, &last, new (allocator->allocate(sizeof(DirectoryElement)))
+            DirectoryElement(system, allocator, name));
+      } else if (kind == Element::JarKind) {
+        JarElement* jar = new (allocator->allocate(sizeof(JarElement)))
+          JarElement(system, allocator, name);
+        add(&path_, &last, jar);
+
+        uint32_t jarLength = 0;
+        uint32_t directoryOffset = 0;
+        uint32_t directorySize = 0;
+        jar->stamp(&jarLength, &directoryOffset, &directorySize);
+        if (in->read4() != jarLength
+            or in->read4() != directoryOffset
+            or in->read4() != directorySize)
+        {
+          return false;
+        }
+      } else {
+        allocator->free(name, length + 1);
+        return false;
+      }
+    }
+
+    return in->ok;
+  }
+
+  bool readEntries(IndexReader* in) {
+    unsigned count = in->read4();
+    if (not in->ok or count > static_cast<unsigned>(in->end - in->p)) {
+      return false;
+    }
+
+    index = ClasspathIndex::make(system, allocator, count);
+    for (unsigned i = 0; in->ok and i < count; ++i) {
+      unsigned element = in->read4();
+      unsigned length;
+      const uint8_t* name = in->readString(&length);
+      if (not in->ok or element >= elementCount
+          or elements[element]->kind() == Element::DirectoryKind)
+      {
+        return false;
+      }
+
+      index->add(name, length, element);
+    }
+
+    return in->read4() == IndexCacheMagic and in->ok and in->p == in->end;
+  }
+
+  // Reads a previously written index cache, returning true if it was
+  // written for the same path and none of the jars on that path have
+  // changed since.
+  bool loadIndex(const char* file) {
+    System::Region* region;
+    if (not system->success(system->map(&region, file))) {
+      return false;
+    }
+
+    IndexReader in(region->start(), region->length());
+    bool valid = in.read4() == IndexCacheMagic
+      and in.read4() == IndexCacheVersion
+      and in.matchString(pathString)
+      and readTokens(&in)
+      and readElements(&in);
+
+    if (valid) {
+      listElements();
+      valid = readEntries(&in);
+    }
+
+    if (valid) {
+      indexRegion = region;
+    } else {
+      if (DebugFind) {
+        fprintf(stderr, "ignore stale index cache %s\n", file);
+      }
+
+      disposeElements();
+      region->dispose();
+    }
+
+    return valid;
+  }
 
   virtual IteratorImp* iterator() {
     return new (allocator->allocate(sizeof(MyIterator)))
       MyIterator(system, allocator, path_);
   }
 
-  virtual System::Region* find(const char* name) {
-    for (Element* e = path_; e; e = e->next) {
-      System::Region* r = e->find(name);
-      if (r) {
-        return r;
+  unsigned indexedElement(const char* name, bool tryDirectory) {
+    while (*name == '/') name++;
+
+    unsigned length = strlen(name);
+    unsigned i = index->find(name, length, elementCount);
+    if (tryDirectory) {
+      RUNTIME_ARRAY(char, n, length + 1);
+      memcpy(RUNTIME_ARRAY_BODY(n), name, length);
+      RUNTIME_ARRAY_BODY(n)[length] = '/';
+
+      unsigned j = index->find(RUNTIME_ARRAY_BODY(n), length + 1,
+                               elementCount);
+      if (j < i) {
+        i = j;
+      }
+    }
+    return i;
+  }
+
+  Element* locate(const char* name, unsigned* length, bool tryDirectory,
+                  System::FileType* type)
+  {
+    unsigned jar = indexedElement(name, tryDirectory);
+    for (unsigned i = 0; i < directoryCount and directories[i] < jar; ++i) {
+      Element* e = elements[directories[i]];
+      *type = e->stat(name, length, tryDirectory);
+      if (*type != System::TypeDoesNotExist) {
+        return e;
       }
     }
-    
+
+    if (jar < elementCount) {
+      Element* e = elements[jar];
+      *type = e->stat(name, length, tryDirectory);
+      if (*type != System::TypeDoesNotExist) {
+        return e;
+      }
+    }
+
+    *type = System::TypeDoesNotExist;
     return 0;
   }
 
+  virtual System::Region* find(const char* name) {
+    unsigned jar = indexedElement(name, false);
+    System::Region* r = 0;
+    for (unsigned i = 0;
+         r == 0 and i < directoryCount and directories[i] < jar; ++i)
+    {
+      r = elements[directories[i]]->find(name);
+    }
+
+    if (r == 0 and jar < elementCount) {
+      r = elements[jar]->find(name);
+    }
+
+    if (r and profileLock) {
+      record(name);
+    }
+
+    return r;
+  }
+
   virtual System::FileType stat(const char* name, unsigned* length,
                                 bool tryDirectory)
   {
-    for (Element* e = path_; e; e = e->next) {
-      System::FileType type = e->stat(name, length, tryDirectory);
-      if (type != System::TypeDoesNotExist) {
-        return type;
-      }
-    }
-    
-    return System::TypeDoesNotExist;
+    System::FileType type;
+    locate(name, length, tryDirectory, &type);
+    return type;
   }
 
   virtual const char* urlPrefix(const char* name) {
+    unsigned length;
+    System::FileType type;
+    Element* e = locate(name, &length, true, &type);
+    return e ? e->urlPrefix() : 0;
+  }
+
+  virtual const char* sourceUrl(const char* name) {
+    unsigned length;
+    System::FileType type;
+    Element* e = locate(name, &length, true, &type);
+    return e ? e->sourceUrl() : 0;
+  }
+
+  virtual const char* path() {
+    return pathString;
+  }
+
+  virtual bool fingerprint(uint32_t* value) {
+    uint32_t h = pathString ? hash(pathString) : 0;
     for (Element* e = path_; e; e = e->next) {
-      unsigned length;
-      System::FileType type = e->stat(name, &length, true);
-      if (type != System::TypeDoesNotExist) {
-        return e->urlPrefix();
+      if (e->kind() == Element::DirectoryKind) {
+        return false;
       }
+
+      JarElement* jar = static_cast<JarElement*>(e);
+      if (e->kind() == Element::BuiltinKind) {
+        jar->init();
+      } else {
+        jar->map();
+      }
+
+      const uint8_t* p = jar->region
+        ? JarIndex::findEndOfCentralDirectory(jar->region) : 0;
+      if (p == 0
+          or centralDirectoryOffset(p) > jar->region->length()
+          or centralDirectorySize(p)
+          > jar->region->length() - centralDirectoryOffset(p))
+      {
+        return false;
+      }
+
+      // the central directory holds the modification time and CRC of
+      // each entry, so hashing it is enough to notice any change
+      h = (h * 31) + jar->region->length();
+      h = (h * 31) + hash
+        (jar->region->start() + centralDirectoryOffset(p),
+         centralDirectorySize(p));
     }
 
-    return 0;
+    *value = h;
+    return true;
   }
 
-  virtual const char* sourceUrl(const char* name) {
-    for (Element* e = path_; e; e = e->next) {
-      unsigned length;
-      System::FileType type = e->stat(name, &length, true);
-      if (type != System::TypeDoesNotExist) {
-        return e->sourceUrl();
+  virtual void prefetch(unsigned threadCount, const char* profile) {
+    System::Region* order = 0;
+    if (profile) {
+      if (not system->success(system->map(&order, profile))) {
+        // no profile yet, so record one as we go and write it out
+        // when we're disposed
+        order = 0;
+        this->profile = copy(allocator, profile);
+        expect(system, system->success(system->make(&profileLock)));
       }
     }
 
-    return 0;
+    if (threadCount) {
+      prefetcher = new (allocator->allocate(sizeof(Prefetcher)))
+        Prefetcher(system, allocator);
+
+      if (order) {
+        unsigned start = 0;
+        unsigned length;
+        while (readLine(order->start(), order->length(), &start, &length)) {
+          RUNTIME_ARRAY(char, name, length + 1);
+          memcpy(RUNTIME_ARRAY_BODY(name), order->start() + start, length);
+          RUNTIME_ARRAY_BODY(name)[length] = 0;
+
+          for (Element* e = path_; e; e = e->next) {
+            if (e->prefetch(prefetcher, RUNTIME_ARRAY_BODY(name))) {
+              break;
+            }
+          }
+
+          start += length;
+        }
+      } else {
+        for (Element* e = path_; e; e = e->next) {
+          e->prefetch(prefetcher, 0);
+        }
+      }
+
+      prefetcher->start(threadCount);
+    }
+
+    if (order) {
+      order->dispose();
+    }
   }
 
-  virtual const char* path() {
-    return pathString;
+  void record(const char* name) {
+    unsigned length = strlen(name);
+    ProfileEntry* entry = static_cast<ProfileEntry*>
+      (allocator->allocate(sizeof(ProfileEntry) + length));
+    entry->next = 0;
+    entry->length = length;
+    memcpy(entry->name, name, length);
+
+    profileLock->acquire();
+
+    if (profileLast) {
+      profileLast->next = entry;
+    } else {
+      profileFirst = entry;
+    }
+    profileLast = entry;
+
+    profileLock->release();
   }
 
-  virtual void dispose() {
+  void writeProfile() {
+    // several finders may share a profile, so append rather than
+    // overwrite:
+    FILE* out = vm::fopen(profile, "ab");
+    if (out == 0 and DebugFind) {
+      fprintf(stderr, "unable to open %s\n", profile);
+    }
+
+    for (ProfileEntry* e = profileFirst; e;) {
+      ProfileEntry* t = e;
+      e = e->next;
+
+      if (out) {
+        fprintf(out, "%.*s\n", t->length, t->name);
+      }
+      allocator->free(t, sizeof(ProfileEntry) + t->length);
+    }
+
+    if (out) {
+      fclose(out);
+    }
+
+    profileLock->dispose();
+    allocator->free(profile, strlen(profile) + 1);
+  }
+
+  void disposeElements() {
     for (Element* e = path_; e;) {
       Element* t = e;
       e = e->next;
       t->dispose();
     }
+    path_ = 0;
+
+    if (elements) {
+      allocator->free(elements, sizeof(Element*) * elementCount);
+      allocator->free(directories, sizeof(unsigned) * directoryCount);
+      elements = 0;
+      directories = 0;
+      elementCount = 0;
+      directoryCount = 0;
+    }
+
+    if (index) {
+      index->dispose();
+      index = 0;
+    }
+  }
+
+  virtual void dispose() {
+    if (prefetcher) {
+      prefetcher->dispose();
+    }
+    if (profileLock) {
+      writeProfile();
+    }
+    disposeElements();
+    if (indexRegion) {
+      indexRegion->dispose();
+    }
     if (pathString) {
       allocator->free(pathString, strlen(pathString) + 1);
     }
@@ -951,6 +1910,17 @@ class MyFinder: public Finder {
   Allocator* allocator;
   Element* path_;
   const char* pathString;
+  Element** elements;
+  unsigned elementCount;
+  unsigned* directories;
+  unsigned directoryCount;
+  ClasspathIndex* index;
+  System::Region* indexRegion;
+  Prefetcher* prefetcher;
+  const char* profile;
+  System::Mutex* profileLock;
+  ProfileEntry* profileFirst;
+  ProfileEntry* profileLast;
 };
 
 } // namespace
@@ -958,9 +1928,11 @@ class MyFinder: public Finder {
 namespace vm {
 
 JNIEXPORT Finder*
-makeFinder(System* s, Allocator* a, const char* path, const char* bootLibrary)
+makeFinder(System* s, Allocator* a, const char* path, const char* bootLibrary,
+           const char* indexCache)
 {
-  return new (a->allocate(sizeof(MyFinder))) MyFinder(s, a, path, bootLibrary);
+  return new (a->allocate(sizeof(MyFinder)))
+    MyFinder(s, a, path, bootLibrary, indexCache);
 }
 
 Finder*
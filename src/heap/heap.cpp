@@ -602,15 +602,29 @@ fixie(void* body)
 void
 free(Context* c, Fixie** fixies, bool resetImmortal = false);
 
+class PointerList {
+ public:
+  PointerList():
+    data(0),
+    size(0),
+    capacity(0)
+  { }
+
+  void** data;
+  unsigned size;
+  unsigned capacity;
+};
+
 class Context {
  public:
-  Context(System* system, unsigned limit):
+  Context(System* system, unsigned limit, bool compactGen2):
     system(system),
     client(0),
     count(0),
     limit(limit),
     lowMemoryThreshold(limit / 2),
     lock(0),
+    pinLock(0),
     
     immortalHeapStart(0),
     immortalHeapEnd(0),
@@ -632,6 +646,12 @@ class Context {
     nextHeapMap(&nextGen2, 1, nextPageMap.scale * 1024, &nextPageMap, true),
     nextGen2(this, &nextHeapMap, 0, 0),
 
+    startMap(&gen2, 1, 1, 0, true),
+    endMap(&gen2, 1, 1, 0, true),
+    pinMap(&gen2, 1, 1, 0, true),
+    youngMap(&nextGen1, 1, 1, 0, true),
+    offsets(0),
+
     gen2Base(0),
     incomingFootprint(0),
     tenureFootprint(0),
@@ -646,6 +666,10 @@ class Context {
 
     mode(Heap::MinorCollection),
 
+    compactGen2(compactGen2),
+    compacting(false),
+    crowdedGen2(false),
+
     fixies(0),
     tenuredFixies(0),
     dirtyTenuredFixies(0),
@@ -656,7 +680,9 @@ class Context {
     totalCollectionTime(0),
     totalTime(0)
   {
-    if (not system->success(system->make(&lock))) {
+    if (not (system->success(system->make(&lock))
+             and system->success(system->make(&pinLock))))
+    {
       system->abort();
     }
   }
@@ -667,6 +693,7 @@ class Context {
     gen2.dispose();
     nextGen2.dispose();
     lock->dispose();
+    pinLock->dispose();
   }
 
   void disposeFixies() {
@@ -683,6 +710,7 @@ class Context {
   unsigned lowMemoryThreshold;
 
   System::Mutex* lock;
+  System::Mutex* pinLock;
 
   uintptr_t* immortalHeapStart;
   uintptr_t* immortalHeapEnd;
@@ -703,6 +731,28 @@ class Context {
   Segment::Map nextHeapMap;
   Segment nextGen2;
 
+  // the following are only allocated while gen2 is being compacted in
+  // place: startMap and endMap mark the first and last words of each
+  // live object, pinMap marks objects which may not move, youngMap
+  // marks slots in nextGen1 which refer to gen2, and offsets holds
+  // the compacted offset of each BitsPerWord-sized block of gen2
+  Segment::Map startMap;
+  Segment::Map endMap;
+  Segment::Map pinMap;
+  Segment::Map youngMap;
+  unsigned* offsets;
+
+  // gen2 objects which have been marked but not yet visited
+  PointerList markStack;
+
+  // (slot, value) pairs for slots outside gen2 and nextGen1 which
+  // refer to gen2
+  PointerList slots;
+
+  // gen2 objects pinned by the client, once for each call to
+  // Heap::pin which has not yet been matched by a call to Heap::unpin
+  PointerList pins;
+
   unsigned gen2Base;
   
   unsigned incomingFootprint;
@@ -718,6 +768,10 @@ class Context {
 
   Heap::CollectionType mode;
 
+  bool compactGen2;
+  bool compacting;
+  bool crowdedGen2;
+
   Fixie* fixies;
   Fixie* tenuredFixies;
   Fixie* dirtyTenuredFixies;
@@ -770,6 +824,13 @@ oversizedGen2(Context* c)
     and c->gen2.position() < (c->gen2.capacity() / 4);
 }
 
+// whether compacting gen2 in place would serve as well as copying it
+inline bool
+mayCompactGen2(Context* c)
+{
+  return not (oversizedGen2(c) or c->crowdedGen2);
+}
+
 inline unsigned
 memoryNeeded(Context* c)
 {
@@ -792,6 +853,12 @@ initNextGen1(Context* c)
     (&(c->nextGen1), max(1, log(TenureThreshold)), 1, 0, false);
 
   unsigned minimum = minimumNextGen1Capacity(c);
+  if (c->compacting) {
+    // nothing is tenured while gen2 is compacted, so objects which
+    // would otherwise be promoted stay in gen1 for another cycle
+    minimum += c->tenureFootprint + c->tenurePadding;
+  }
+
   unsigned desired = minimum;
 
   new (&(c->nextGen1)) Segment(c, &(c->nextAgeMap), desired, minimum);
@@ -834,6 +901,44 @@ initNextGen2(Context* c)
   }
 }
 
+void
+push(Context* c, PointerList* list, void* p)
+{
+  if (list->size == list->capacity) {
+    unsigned capacity = max(1024, list->capacity * 2);
+    void** data = static_cast<void**>
+      (local::allocate(c, capacity * BytesPerWord));
+
+    if (list->data) {
+      memcpy(data, list->data, list->size * BytesPerWord);
+      free(c, list->data, list->capacity * BytesPerWord);
+    }
+
+    list->data = data;
+    list->capacity = capacity;
+  }
+
+  list->data[list->size++] = p;
+}
+
+inline void*
+pop(Context* c UNUSED, PointerList* list)
+{
+  assert(c, list->size);
+  return list->data[--list->size];
+}
+
+void
+dispose(Context* c, PointerList* list)
+{
+  if (list->data) {
+    free(c, list->data, list->capacity * BytesPerWord);
+  }
+  list->data = 0;
+  list->size = 0;
+  list->capacity = 0;
+}
+
 inline bool
 fresh(Context* c, void* o)
 {
@@ -1012,6 +1117,13 @@ copy2(Context* c, void* o)
         }
 
         return copyTo(c, &(c->gen2), o, size);
+      } else if (c->compacting) {
+        o = copyTo(c, &(c->nextGen1), o, size);
+
+        c->nextAgeMap.setOnly(o, age);
+        c->tenureFootprint += size;
+
+        return o;
       } else {
         return copyTo(c, &(c->nextGen2), o, size);
       }
@@ -1075,6 +1187,10 @@ update3(Context* c, void* o, bool* needsVisit)
   } else if (immortalHeapContains(c, o)) {
     *needsVisit = false;
     return o;    
+  } else if (fresh(c, o)) {
+    // already copied, e.g. when a root is visited twice
+    *needsVisit = false;
+    return o;
   } else if (wasCollected(c, o)) {
     *needsVisit = false;
     return follow(c, o);
@@ -1084,12 +1200,38 @@ update3(Context* c, void* o, bool* needsVisit)
   }
 }
 
+void
+markGen2(Context* c, void* o)
+{
+  if (not c->startMap.get(o)) {
+    unsigned size = c->client->sizeInWords(o);
+
+    c->startMap.setOnly(o);
+    c->endMap.setOnly(static_cast<uintptr_t*>(o) + size - 1);
+
+    // an object whose hash has been taken but which has no room to
+    // store it must keep its address, since that is its hash code.
+    // Objects pinned by the client were marked in startCompaction.
+    if (c->client->copiedSizeInWords(o) != size) {
+      c->pinMap.setOnly(o);
+    }
+
+    push(c, &(c->markStack), o);
+  }
+}
+
 void*
 update2(Context* c, void* o, bool* needsVisit)
 {
-  if (c->mode == Heap::MinorCollection and c->gen2.contains(o)) {
-    *needsVisit = false;
-    return o;
+  if (c->gen2.contains(o)) {
+    if (c->mode == Heap::MinorCollection) {
+      *needsVisit = false;
+      return o;
+    } else if (c->compacting) {
+      markGen2(c, o);
+      *needsVisit = false;
+      return o;
+    }
   }
 
   return update3(c, o, needsVisit);
@@ -1129,7 +1271,7 @@ updateHeapMap(Context* c, void* p, void* target, unsigned offset, void* result)
   Segment* seg;
   Segment::Map* map;
 
-  if (c->mode == Heap::MinorCollection) {
+  if (c->mode == Heap::MinorCollection or c->compacting) {
     seg = &(c->gen2);
     map = &(c->heapMap);
   } else {
@@ -1166,6 +1308,23 @@ updateHeapMap(Context* c, void* p, void* target, unsigned offset, void* result)
   }
 }
 
+void
+recordSlot(Context* c, void** p, void* value)
+{
+  if (c->gen2.contains(p)) {
+    // while compacting, the gen2 heap map records every slot which
+    // must be updated once live objects have been moved
+    c->heapMap.set(p);
+  } else if (c->gen2.contains(value)) {
+    if (c->nextGen1.contains(p)) {
+      c->youngMap.set(p);
+    } else if (not c->gen1.contains(p)) {
+      push(c, &(c->slots), p);
+      push(c, &(c->slots), value);
+    }
+  }
+}
+
 void*
 update(Context* c, void** p, void* target, unsigned offset, bool* needsVisit)
 {
@@ -1178,6 +1337,10 @@ update(Context* c, void** p, void* target, unsigned offset, bool* needsVisit)
 
   if (result) {
     updateHeapMap(c, p, target, offset, result);
+
+    if (c->compacting) {
+      recordSlot(c, p, result);
+    }
   }
 
   return result;
@@ -1583,6 +1746,39 @@ visitMarkedFixies(Context* c)
   }  
 }
 
+void
+visitMarked(Context* c)
+{
+  visitMarkedFixies(c);
+
+  while (c->markStack.size) {
+    void* o = pop(c, &(c->markStack));
+
+    if (Debug) {
+      fprintf(stderr, "visit gen2 object %p\n", o);
+    }
+
+    class Walker: public Heap::Walker {
+     public:
+      Walker(Context* c, void* o):
+        c(c), o(o)
+      { }
+
+      virtual bool visit(unsigned offset) {
+        local::collect(c, o, offset);
+        return true;
+      }
+
+      Context* c;
+      void* o;
+    } w(c, o);
+
+    c->client->walk(o, &w);
+
+    visitMarkedFixies(c);
+  }
+}
+
 void
 collect(Context* c, Segment::Map* map, unsigned start, unsigned end,
         bool* dirty, bool expectDirty UNUSED)
@@ -1633,7 +1829,7 @@ collect2(Context* c)
   c->gen1Padding = 0;
   c->tenurePadding = 0;
 
-  if (c->mode == Heap::MajorCollection) {
+  if (c->mode == Heap::MajorCollection and not c->compacting) {
     c->gen2Padding = 0;
   }
 
@@ -1654,7 +1850,7 @@ collect2(Context* c)
 
     virtual void visit(void* p) {
       local::collect(c, static_cast<void**>(p));
-      visitMarkedFixies(c);
+      visitMarked(c);
     }
 
     Context* c;
@@ -1663,6 +1859,275 @@ collect2(Context* c)
   c->client->visitRoots(&v);
 }
 
+void
+initSideMap(Context* c, Segment::Map* map)
+{
+  map->data = static_cast<uintptr_t*>
+    (local::allocate(c, map->size() * BytesPerWord));
+  map->init();
+}
+
+void
+disposeSideMap(Context* c, Segment::Map* map)
+{
+  if (map->data) {
+    free(c, map->data, map->size() * BytesPerWord);
+    map->data = 0;
+  }
+}
+
+unsigned
+nextBit(uintptr_t* map, unsigned i, unsigned limit)
+{
+  while (i < limit) {
+    uintptr_t w = map[wordOf(i)] >> bitOf(i);
+    if (w) {
+      while ((w & 1) == 0) {
+        w >>= 1;
+        ++ i;
+      }
+      return min(i, limit);
+    } else {
+      i = indexOf(wordOf(i) + 1, 0);
+    }
+  }
+  return limit;
+}
+
+void
+clearRange(uintptr_t* map, unsigned start, unsigned end)
+{
+  for (unsigned i = start; i < end;) {
+    if (bitOf(i) == 0 and i + BitsPerWord <= end) {
+      map[wordOf(i)] = 0;
+      i += BitsPerWord;
+    } else {
+      clearBit(map, i);
+      ++ i;
+    }
+  }
+}
+
+inline unsigned
+liveSize(Context* c, unsigned start)
+{
+  return nextBit(c->endMap.data, start, c->gen2.position()) - start + 1;
+}
+
+inline bool
+pinned(Context* c, unsigned start)
+{
+  return getBit(c->pinMap.data, start);
+}
+
+void
+startCompaction(Context* c)
+{
+  // the gen2 heap map is rebuilt from scratch once objects have been
+  // moved, so we use it to track slots in the meantime
+  for (Segment::Map* map = &(c->heapMap); map; map = map->child) {
+    memset(map->data, 0, map->size() * BytesPerWord);
+  }
+
+  initSideMap(c, &(c->startMap));
+  initSideMap(c, &(c->endMap));
+  initSideMap(c, &(c->pinMap));
+
+  for (unsigned i = 0; i < c->pins.size; ++i) {
+    c->pinMap.setOnly(c->pins.data[i]);
+  }
+
+  if (c->nextGen1.capacity()) {
+    initSideMap(c, &(c->youngMap));
+  }
+}
+
+void
+planCompaction(Context* c, unsigned blocks)
+{
+  unsigned end = c->gen2.position();
+  unsigned position = 0;
+  unsigned block = 0;
+
+  c->gen2Padding = 0;
+
+  for (unsigned i = nextBit(c->startMap.data, 0, end); i < end;) {
+    while (block <= wordOf(i)) {
+      c->offsets[block++] = position;
+    }
+
+    unsigned size = liveSize(c, i);
+    if (pinned(c, i)) {
+      assert(c, position <= i);
+
+      position = i + size;
+      ++ c->gen2Padding;
+    } else {
+      position += size;
+    }
+
+    i = nextBit(c->startMap.data, i + size, end);
+  }
+
+  while (block < blocks) {
+    c->offsets[block++] = position;
+  }
+}
+
+void*
+forward(Context* c, void* o)
+{
+  unsigned i = c->gen2.indexOf(o);
+
+  assert(c, getBit(c->startMap.data, i));
+
+  if (pinned(c, i)) {
+    return o;
+  }
+
+  unsigned position = c->offsets[wordOf(i)];
+  for (unsigned j = nextBit(c->startMap.data, indexOf(wordOf(i), 0), i);
+       j < i;)
+  {
+    unsigned size = liveSize(c, j);
+    if (pinned(c, j)) {
+      position = j + size;
+    } else {
+      position += size;
+    }
+
+    j = nextBit(c->startMap.data, j + size, i);
+  }
+
+  return c->gen2.data + position;
+}
+
+void
+updateSlots(Context* c)
+{
+  if (c->nextGen1.position()) {
+    for (Segment::Map::Iterator it(&(c->youngMap), 0, c->nextGen1.position());
+         it.hasMore();)
+    {
+      void** p = static_cast<void**>(c->nextGen1.get(it.next()));
+      void* o = maskAlignedPointer(*p);
+      if (c->gen2.contains(o)) {
+        local::set(p, forward(c, o));
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < c->slots.size; i += 2) {
+    void** p = static_cast<void**>(c->slots.data[i]);
+    void* o = c->slots.data[i + 1];
+
+    // a slot may have been recorded more than once, so only update
+    // it if it still holds the original value
+    if (maskAlignedPointer(*p) == o) {
+      local::set(p, forward(c, o));
+    }
+  }
+}
+
+inline bool
+young(Context* c, void* o)
+{
+  return o
+    and not (immortalHeapContains(c, o)
+             or (c->client->isFixed(o)
+                 and fixie(o)->age >= FixieTenureThreshold));
+}
+
+void
+moveObjects(Context* c)
+{
+  for (Segment::Map* map = &(c->heapMap); map->child; map = map->child) {
+    memset(map->data, 0, map->size() * BytesPerWord);
+  }
+
+  unsigned end = c->gen2.position();
+  unsigned position = 0;
+  unsigned last = 0;
+
+  for (unsigned i = nextBit(c->startMap.data, 0, end); i < end;) {
+    clearRange(c->pointerMap.data, last, i);
+
+    unsigned size = liveSize(c, i);
+    unsigned destination = pinned(c, i) ? i : position;
+
+    // update the object's slots before moving it, setting heap map
+    // bits at their new locations for any which refer to younger
+    // objects.  Those locations are never ahead of the iterator.
+    for (Segment::Map::Iterator it(&(c->pointerMap), i, i + size);
+         it.hasMore();)
+    {
+      unsigned slot = it.next();
+      void** p = static_cast<void**>(c->gen2.get(slot));
+
+      c->pointerMap.clearOnly(slot);
+
+      void* o = maskAlignedPointer(*p);
+      if (c->gen2.contains(o)) {
+        local::set(p, forward(c, o));
+      } else if (young(c, o)) {
+        c->heapMap.set(c->gen2.data + destination + (slot - i));
+      }
+    }
+
+    if (destination != i) {
+      memmove(c->gen2.data + destination, c->gen2.data + i,
+              size * BytesPerWord);
+    }
+
+    position = destination + size;
+    last = i + size;
+
+    i = nextBit(c->startMap.data, last, end);
+  }
+
+  clearRange(c->pointerMap.data, last, end);
+
+  if (Verbose2) {
+    fprintf(stderr, "compact gen2 from %d to %d bytes\n",
+            end * BytesPerWord, position * BytesPerWord);
+  }
+
+  c->gen2.position_ = position;
+}
+
+void
+compact(Context* c)
+{
+  assert(c, c->markStack.size == 0);
+
+  unsigned end = c->gen2.position();
+  if (end) {
+    unsigned blocks = ceilingDivide(end, BitsPerWord);
+    c->offsets = static_cast<unsigned*>
+      (local::allocate(c, blocks * sizeof(unsigned)));
+
+    planCompaction(c, blocks);
+    updateSlots(c);
+    moveObjects(c);
+
+    free(c, c->offsets, blocks * sizeof(unsigned));
+    c->offsets = 0;
+  }
+
+  disposeSideMap(c, &(c->startMap));
+  disposeSideMap(c, &(c->endMap));
+  disposeSideMap(c, &(c->pinMap));
+  disposeSideMap(c, &(c->youngMap));
+
+  dispose(c, &(c->slots));
+  dispose(c, &(c->markStack));
+
+  // compaction cannot grow gen2, so if it is still nearly full, the
+  // next major collection will copy it to a larger space instead
+  c->crowdedGen2 = c->gen2.remaining() < c->gen2.capacity() / 4
+    or c->tenureFootprint + c->tenurePadding > c->gen2.remaining();
+}
+
 void
 collect(Context* c)
 {
@@ -1688,9 +2153,22 @@ collect(Context* c)
     c->mode = Heap::MajorCollection;
   }
 
+  // copying gen2 would move any objects pinned there, so we compact
+  // it instead while there are any, whether or not compaction is
+  // otherwise enabled.  Heap::pin refuses new pins while gen2 is
+  // oversized or crowded, since compaction can neither shrink nor
+  // grow it, so this only overrides those criteria for pins taken
+  // before gen2 reached that state.
+  c->compacting = c->mode == Heap::MajorCollection
+    and c->gen2.capacity()
+    and (c->pins.size
+         or (c->compactGen2 and mayCompactGen2(c)));
+
   int64_t then;
   if (Verbose) {
-    if (c->mode == Heap::MajorCollection) {
+    if (c->compacting) {
+      fprintf(stderr, "major collection (compacting)\n");
+    } else if (c->mode == Heap::MajorCollection) {
       fprintf(stderr, "major collection\n");
     } else {
       fprintf(stderr, "minor collection\n");
@@ -1720,17 +2198,24 @@ collect(Context* c)
 
   initNextGen1(c);
 
-  if (c->mode == Heap::MajorCollection) {
+  if (c->compacting) {
+    startCompaction(c);
+  } else if (c->mode == Heap::MajorCollection) {
     initNextGen2(c);
   }
 
   collect2(c);
 
-  c->gen1.replaceWith(&(c->nextGen1));
-  if (c->mode == Heap::MajorCollection) {
+  if (c->compacting) {
+    compact(c);
+    c->compacting = false;
+  } else if (c->mode == Heap::MajorCollection) {
     c->gen2.replaceWith(&(c->nextGen2));
+    c->crowdedGen2 = false;
   }
 
+  c->gen1.replaceWith(&(c->nextGen1));
+
   sweepFixies(c);
 
   if (Verbose) {
@@ -1844,8 +2329,8 @@ free_(Context* c, const void* p, unsigned size)
 
 class MyHeap: public Heap {
  public:
-  MyHeap(System* system, unsigned limit):
-    c(system, limit)
+  MyHeap(System* system, unsigned limit, bool compactGen2):
+    c(system, limit, compactGen2)
   { }
 
   virtual void setClient(Heap::Client* client) {
@@ -1943,7 +2428,52 @@ class MyHeap: public Heap {
                and fixie(target)->age >= FixieTenureThreshold);
   }
 
+  virtual bool pin(void* p) {
+    if (c.client->isFixed(p) or immortalHeapContains(&c, p)) {
+      return true;
+    } else if (c.gen2.contains(p) and mayCompactGen2(&c)) {
+      ACQUIRE(c.pinLock);
+
+      push(&c, &(c.pins), p);
+
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  virtual bool unpin(void* p) {
+    if (c.client->isFixed(p) or immortalHeapContains(&c, p)) {
+      return true;
+    }
+
+    ACQUIRE(c.pinLock);
+
+    // pins are usually released in the reverse order they were
+    // taken, so search from the most recent
+    for (unsigned i = c.pins.size; i > 0; --i) {
+      if (c.pins.data[i - 1] == p) {
+        c.pins.data[i - 1] = c.pins.data[--c.pins.size];
+        return true;
+      }
+    }
+    return false;
+  }
+
   virtual void mark(void* p, unsigned offset, unsigned count) {
+    if (c.compacting
+        and not (c.gen2.contains(p) and c.startMap.get(p) == 0))
+    {
+      // a slot written during the collection (e.g. while processing
+      // weak references) must be updated along with the rest
+      for (unsigned i = 0; i < count; ++i) {
+        void** target = static_cast<void**>(p) + offset + i;
+        if (maskAlignedPointer(*target)) {
+          recordSlot(&c, target, maskAlignedPointer(*target));
+        }
+      }
+    }
+
     if (needsMark(p)) {
 #ifndef USE_ATOMIC_OPERATIONS
       ACQUIRE(c.lock);
@@ -2035,6 +2565,21 @@ class MyHeap: public Heap {
 
     if (p == 0) {
       return Null;
+    } else if (c.compacting) {
+      // nothing is promoted while gen2 is compacted, so only gen2
+      // objects are reported as tenured
+      if (c.gen2.contains(p)) {
+        return c.startMap.get(p) ? Tenured : Unreachable;
+      } else if (c.client->isFixed(p)) {
+        return fixie(p)->dead() ? Unreachable : Reachable;
+      } else if (c.nextGen1.contains(p)
+                 or immortalHeapContains(&c, p)
+                 or wasCollected(&c, p))
+      {
+        return Reachable;
+      } else {
+        return Unreachable;
+      }
     } else if (c.client->isFixed(p)) {
       Fixie* f = fixie(p);
       return f->dead()
@@ -2067,6 +2612,7 @@ class MyHeap: public Heap {
   }
 
   virtual void dispose() {
+    local::dispose(&c, &(c.pins));
     c.dispose();
     assert(&c, c.count == 0);
     c.system->free(this);
@@ -2082,10 +2628,10 @@ class MyHeap: public Heap {
 namespace vm {
 
 Heap*
-makeHeap(System* system, unsigned limit)
+makeHeap(System* system, unsigned limit, bool compactGen2)
 {  
   return new (system->tryAllocate(sizeof(local::MyHeap)))
-    local::MyHeap(system, limit);
+    local::MyHeap(system, limit, compactGen2);
 }
 
 } // namespace vm
@@ -346,13 +346,18 @@ pushFrame(Thread* t, object method)
 
   unsigned frame = base + locals;
   pokeInt(t, frame + FrameNextOffset, t->frame);
-  t->frame = frame;
+  pokeInt(t, frame + FrameBaseOffset, base);
+  pokeObject(t, frame + FrameMethodOffset, method);
+  pokeInt(t, frame + FrameIpOffset, 0);
 
   t->sp = frame + FrameFootprint;
 
-  pokeInt(t, frame + FrameBaseOffset, base);
-  pokeObject(t, frame + FrameMethodOffset, method);
-  pokeInt(t, t->frame + FrameIpOffset, 0);
+  // the profiler may walk this thread's frames from a signal handler
+  // at any point, so the frame must be complete before it becomes
+  // reachable from t->frame
+  storeStoreMemoryBarrier();
+
+  t->frame = frame;
 }
 
 void
@@ -685,11 +690,11 @@ findExceptionHandler(Thread* t, object method, unsigned ip)
 {
   PROTECT(t, method);
 
-  object eht = codeExceptionHandlerTable(t, methodCode(t, method));
+  unsigned length = codeExceptionHandlerCount(t, methodCode(t, method));
       
-  if (eht) {
-    for (unsigned i = 0; i < exceptionHandlerTableLength(t, eht); ++i) {
-      uint64_t eh = exceptionHandlerTableBody(t, eht, i);
+  if (length) {
+    for (unsigned i = 0; i < length; ++i) {
+      uint64_t eh = codeExceptionHandler(t, methodCode(t, method), i);
 
       if (ip - 1 >= exceptionHandlerStart(eh)
           and ip - 1 < exceptionHandlerEnd(eh))
@@ -700,12 +705,11 @@ findExceptionHandler(Thread* t, object method, unsigned ip)
           t->exception = 0;
           PROTECT(t, e);
 
-          PROTECT(t, eht);
           catchType = resolveClassInPool
             (t, method, exceptionHandlerCatchType(eh) - 1);
 
           if (catchType) {
-            eh = exceptionHandlerTableBody(t, eht, i);
+            eh = codeExceptionHandler(t, methodCode(t, method), i);
             t->exception = e;
           } else {
             // can't find what we're supposed to catch - move on.
@@ -2940,6 +2944,35 @@ invoke(Thread* t, object method)
   return result;
 }
 
+// The interpreter always boxes results, so this is for the sake of
+// callers of Processor::invokeListUnboxed and friends.
+uint64_t
+unbox(vm::Thread* t, unsigned returnCode, object result)
+{
+  switch (returnCode) {
+  case ByteField:
+  case BooleanField:
+  case CharField:
+  case ShortField:
+  case FloatField:
+  case IntField:
+    return static_cast<uint32_t>(intValue(t, result));
+
+  case LongField:
+  case DoubleField:
+    return longValue(t, result);
+
+  case ObjectField:
+    return reinterpret_cast<uintptr_t>(result);
+
+  case VoidField:
+    return 0;
+
+  default:
+    abort(t);
+  }
+}
+
 class MyProcessor: public Processor {
  public:
   MyProcessor(System* s, Allocator* allocator):
@@ -3006,6 +3039,12 @@ class MyProcessor: public Processor {
     // ignore
   }
 
+  virtual void
+  initMethod(vm::Thread*, object)
+  {
+    // ignore
+  }
+
   virtual void
   visitObjects(vm::Thread* vmt, Heap::Visitor* v)
   {
@@ -3033,6 +3072,30 @@ class MyProcessor: public Processor {
     walker.walk(v);
   }
 
+  virtual void
+  walkInterruptedStack(vm::Thread* vmt, void*, void*, void*,
+                       StackVisitor* v)
+  {
+    Thread* t = static_cast<Thread*>(vmt);
+
+    // the interpreter's frames live in Thread::stack rather than on
+    // the native stack, so the register values don't matter, but we
+    // can't update the ip of the current frame as walkStack does
+    // since we may have interrupted code which is using it
+    int frame = t->frame;
+
+    // popFrame lowers t->sp before unlinking the frame, so a frame
+    // which extends past t->sp is being popped; don't report it
+    if (frame >= 0
+        and static_cast<unsigned>(frame) + FrameFootprint > t->sp)
+    {
+      return;
+    }
+
+    MyStackWalker walker(t, frame);
+    walker.walk(v);
+  }
+
   virtual int
   lineNumber(vm::Thread* t, object method, int ip)
   {
@@ -3055,6 +3118,14 @@ class MyProcessor: public Processor {
     }
   }
 
+  virtual bool
+  ensureLocalCapacity(vm::Thread* vmt, unsigned capacity)
+  {
+    Thread* t = static_cast<Thread*>(vmt);
+
+    return t->sp + capacity < stackSizeInWords(t) / 2;
+  }
+
   virtual bool
   pushLocalFrame(vm::Thread* vmt, unsigned capacity)
   {
@@ -3154,6 +3225,23 @@ class MyProcessor: public Processor {
     return local::invoke(t, method);
   }
 
+  virtual uint64_t
+  invokeArrayUnboxed(vm::Thread* t, object method, object this_,
+                     const jvalue* arguments)
+  {
+    unsigned returnCode = methodReturnCode(t, method);
+    return unbox(t, returnCode, invokeArray(t, method, this_, arguments));
+  }
+
+  virtual uint64_t
+  invokeListUnboxed(vm::Thread* t, object method, object this_,
+                    bool indirectObjects, va_list arguments)
+  {
+    unsigned returnCode = methodReturnCode(t, method);
+    return unbox(t, returnCode, invokeList
+                 (t, method, this_, indirectObjects, arguments));
+  }
+
   virtual object
   invokeList(vm::Thread* vmt, object loader, const char* className,
              const char* methodName, const char* methodSpec, object this_,
@@ -22,6 +22,10 @@ namespace {
 
 namespace local {
 
+const unsigned MinimumStringBufferSize = 64;
+const unsigned MaximumPooledStringBufferSize = 4 * 1024;
+const unsigned MaximumPooledStringBufferCount = 4;
+
 jint JNICALL
 AttachCurrentThread(Machine* m, Thread** t, void*)
 {
@@ -130,13 +134,116 @@ GetStringLength(Thread* t, jstring s)
   return stringLength(t, *s);
 }
 
+void*
+allocateStringBuffer(Thread* t, unsigned size)
+{
+  for (Thread::StringBuffer** p = &(t->stringBuffers); *p;
+       p = &((*p)->next))
+  {
+    Thread::StringBuffer* b = *p;
+    if (b->capacity >= size) {
+      *p = b->next;
+      return b->data;
+    }
+  }
+
+  // round small sizes up so that buffers are more likely to fit
+  // whatever string comes next
+  unsigned capacity = size;
+  if (size <= MaximumPooledStringBufferSize) {
+    capacity = MinimumStringBufferSize;
+    while (capacity < size) {
+      capacity *= 2;
+    }
+  }
+
+  return (new (t->m->heap->allocate(sizeof(Thread::StringBuffer) + capacity))
+          Thread::StringBuffer(capacity))->data;
+}
+
+void
+releaseStringBuffer(Thread* t, const void* p)
+{
+  Thread::StringBuffer* b = reinterpret_cast<Thread::StringBuffer*>
+    (static_cast<uint8_t*>(const_cast<void*>(p))
+     - sizeof(Thread::StringBuffer));
+
+  if (b->capacity <= MaximumPooledStringBufferSize) {
+    unsigned count = 0;
+    for (Thread::StringBuffer* o = t->stringBuffers; o; o = o->next) {
+      ++ count;
+    }
+
+    if (count < MaximumPooledStringBufferCount) {
+      b->next = t->stringBuffers;
+      t->stringBuffers = b;
+      return;
+    }
+  }
+
+  t->m->heap->free(b, sizeof(Thread::StringBuffer) + b->capacity);
+}
+
+// Returns a pointer to the characters of the string as stored in its
+// backing array if that array is of the specified type and can be
+// handed to native code as is, or null otherwise.  The caller must pin
+// the array before using the pointer.
+const void*
+directStringChars(Thread* t, object string, Machine::Type type)
+{
+  object data = stringData(t, string);
+  if (objectClass(t, data) == vm::type(t, type)) {
+    if (type == Machine::ByteArrayType) {
+      // GetStringUTFChars must return a null-terminated string
+      unsigned end = stringOffset(t, string) + stringLength(t, string);
+      if (end < byteArrayLength(t, data)
+          and byteArrayBody(t, data, end) == 0)
+      {
+        return &byteArrayBody(t, data, stringOffset(t, string));
+      }
+    } else {
+      return &charArrayBody(t, data, stringOffset(t, string));
+    }
+  }
+  return 0;
+}
+
+// Called on entry to a Get*Critical function with the thread active.
+// Pins the specified object so that the collector may run while native
+// code holds a pointer into it, or, if it is too young to be pinned,
+// enters a critical region which holds off the collector until the
+// matching exitCritical.
+void
+enterCritical(Thread* t, object o)
+{
+  if (not t->m->heap->pin(o)) {
+    ++ t->criticalLevel;
+  }
+}
+
+void
+exitCritical(Thread* t, object o)
+{
+  if (not t->m->heap->unpin(o)) {
+    expect(t, t->criticalLevel);
+    -- t->criticalLevel;
+  }
+}
+
 const jchar* JNICALL
 GetStringChars(Thread* t, jstring s, jboolean* isCopy)
 {
   ENTER(t, Thread::ActiveState);
 
+  const jchar* direct = static_cast<const jchar*>
+    (directStringChars(t, *s, Machine::CharArrayType));
+  if (direct and t->m->heap->pin(stringData(t, *s))) {
+    if (isCopy) *isCopy = false;
+    return direct;
+  }
+
   jchar* chars = static_cast<jchar*>
-    (t->m->heap->allocate((stringLength(t, *s) + 1) * sizeof(jchar)));
+    (allocateStringBuffer(t, (stringLength(t, *s) + 1) * sizeof(jchar)));
   stringChars(t, *s, chars);
 
   if (isCopy) *isCopy = true;
@@ -148,7 +255,11 @@ ReleaseStringChars(Thread* t, jstring s, const jchar* chars)
 {
   ENTER(t, Thread::ActiveState);
 
-  t->m->heap->free(chars, (stringLength(t, *s) + 1) * sizeof(jchar));
+  if (chars == directStringChars(t, *s, Machine::CharArrayType)) {
+    t->m->heap->unpin(stringData(t, *s));
+  } else {
+    releaseStringBuffer(t, chars);
+  }
 }
 
 void JNICALL
@@ -166,28 +277,41 @@ GetStringCritical(Thread* t, jstring s, jboolean* isCopy)
     enter(t, Thread::ActiveState);
   }
 
-  ++ t->criticalLevel;
-
   if (isCopy) {
     *isCopy = true;
   }
   
+  const jchar* chars;
   object data = stringData(t, *s);
   if (objectClass(t, data) == type(t, Machine::ByteArrayType)) {
-    return GetStringChars(t, s, isCopy);
+    chars = GetStringChars(t, s, isCopy);
   } else {
-    return &charArrayBody(t, data, stringOffset(t, *s));
+    chars = &charArrayBody(t, data, stringOffset(t, *s));
+    enterCritical(t, data);
   }
+
+  if (t->criticalLevel == 0) {
+    enter(t, Thread::IdleState);
+  }
+
+  return chars;
 }
 
 void JNICALL
 ReleaseStringCritical(Thread* t, jstring s, const jchar* chars)
 {
-  if (objectClass(t, stringData(t, *s)) == type(t, Machine::ByteArrayType)) {
+  if (t->criticalLevel == 0) {
+    enter(t, Thread::ActiveState);
+  }
+
+  object data = stringData(t, *s);
+  if (objectClass(t, data) == type(t, Machine::ByteArrayType)) {
     ReleaseStringChars(t, s, chars);
+  } else {
+    exitCritical(t, data);
   }
 
-  if ((-- t->criticalLevel) == 0) {
+  if (t->criticalLevel == 0) {
     enter(t, Thread::IdleState);
   }
 }
@@ -205,9 +329,17 @@ GetStringUTFChars(Thread* t, jstring s, jboolean* isCopy)
 {
   ENTER(t, Thread::ActiveState);
 
+  // strings are only stored as byte arrays if they're pure ASCII,
+  // in which case the bytes are already valid modified UTF-8
+  const char* direct = static_cast<const char*>
+    (directStringChars(t, *s, Machine::ByteArrayType));
+  if (direct and t->m->heap->pin(stringData(t, *s))) {
+    if (isCopy) *isCopy = false;
+    return direct;
+  }
+
   int length = stringUTFLength(t, *s);
-  char* chars = static_cast<char*>
-    (t->m->heap->allocate(length + 1));
+  char* chars = static_cast<char*>(allocateStringBuffer(t, length + 1));
   stringUTFChars(t, *s, chars, length);
 
   if (isCopy) *isCopy = true;
@@ -219,7 +351,11 @@ ReleaseStringUTFChars(Thread* t, jstring s, const char* chars)
 {
   ENTER(t, Thread::ActiveState);
 
-  t->m->heap->free(chars, stringUTFLength(t, *s) + 1);
+  if (chars == directStringChars(t, *s, Machine::ByteArrayType)) {
+    t->m->heap->unpin(stringData(t, *s));
+  } else {
+    releaseStringBuffer(t, chars);
+  }
 }
 
 void JNICALL
@@ -719,8 +855,8 @@ callIntMethodV(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[1];
   va_list* a = reinterpret_cast<va_list*>(arguments[2]);
 
-  return intValue
-    (t, t->m->processor->invokeList(t, getMethod(t, m), *o, true, *a));
+  return t->m->processor->invokeListUnboxed
+    (t, getMethod(t, m), *o, true, *a);
 }
 
 jboolean JNICALL
@@ -753,8 +889,8 @@ callIntMethodA(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[1];
   const jvalue* a = reinterpret_cast<const jvalue*>(arguments[2]);
 
-  return intValue
-     (t, t->m->processor->invokeArray(t, getMethod(t, m), *o, a));
+  return t->m->processor->invokeArrayUnboxed
+     (t, getMethod(t, m), *o, a);
 }
 
 jboolean JNICALL
@@ -906,8 +1042,8 @@ callLongMethodV(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[1];
   va_list* a = reinterpret_cast<va_list*>(arguments[2]);
 
-  return longValue
-    (t, t->m->processor->invokeList(t, getMethod(t, m), *o, true, *a));
+  return t->m->processor->invokeListUnboxed
+    (t, getMethod(t, m), *o, true, *a);
 }
 
 jlong JNICALL
@@ -940,8 +1076,8 @@ callLongMethodA(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[1];
   const jvalue* a = reinterpret_cast<const jvalue*>(arguments[2]);
 
-  return longValue
-     (t, t->m->processor->invokeArray(t, getMethod(t, m), *o, a));
+  return t->m->processor->invokeArrayUnboxed
+     (t, getMethod(t, m), *o, a);
 }
 
 jlong JNICALL
@@ -1144,8 +1280,8 @@ callStaticIntMethodV(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[0];
   va_list* a = reinterpret_cast<va_list*>(arguments[1]);
 
-  return intValue
-    (t, t->m->processor->invokeList(t, getStaticMethod(t, m), 0, true, *a));
+  return t->m->processor->invokeListUnboxed
+    (t, getStaticMethod(t, m), 0, true, *a);
 }
 
 jboolean JNICALL
@@ -1175,8 +1311,8 @@ callStaticIntMethodA(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[0];
   const jvalue* a = reinterpret_cast<const jvalue*>(arguments[1]);
 
-  return intValue
-     (t, t->m->processor->invokeArray(t, getStaticMethod(t, m), 0, a));
+  return t->m->processor->invokeArrayUnboxed
+     (t, getStaticMethod(t, m), 0, a);
 }
 
 jboolean JNICALL
@@ -1309,8 +1445,8 @@ callStaticLongMethodV(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[0];
   va_list* a = reinterpret_cast<va_list*>(arguments[1]);
 
-  return longValue
-    (t, t->m->processor->invokeList(t, getStaticMethod(t, m), 0, true, *a));
+  return t->m->processor->invokeListUnboxed
+    (t, getStaticMethod(t, m), 0, true, *a);
 }
 
 jlong JNICALL
@@ -1340,8 +1476,8 @@ callStaticLongMethodA(Thread* t, uintptr_t* arguments)
   jmethodID m = arguments[0];
   const jvalue* a = reinterpret_cast<const jvalue*>(arguments[1]);
 
-  return longValue
-     (t, t->m->processor->invokeArray(t, getStaticMethod(t, m), 0, a));
+  return t->m->processor->invokeArrayUnboxed
+     (t, getStaticMethod(t, m), 0, a);
 }
 
 jlong JNICALL
@@ -1526,6 +1662,27 @@ getField(Thread* t, jfieldID f)
   return field;
 }
 
+// Like run, but skips setting up a checkpoint when the accessor can't
+// throw, which is always the case unless it must lock the field (see
+// acquireFieldForRead and acquireFieldForWrite).
+uint64_t
+runFieldAccess(Thread* t, uint64_t (*function)(Thread*, uintptr_t*),
+               uintptr_t* arguments)
+{
+  ENTER(t, Thread::ActiveState);
+
+  object field = getField(t, arguments[1]);
+  if (UNLIKELY(BytesPerWord == 4
+               and (fieldFlags(t, field) & ACC_VOLATILE)
+               and (fieldCode(t, field) == DoubleField
+                    or fieldCode(t, field) == LongField)))
+  {
+    return runRaw(t, function, arguments);
+  } else {
+    return function(t, arguments);
+  }
+}
+
 uint64_t
 getObjectField(Thread* t, uintptr_t* arguments)
 {
@@ -1545,7 +1702,7 @@ GetObjectField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return reinterpret_cast<jobject>(run(t, getObjectField, arguments));
+  return reinterpret_cast<jobject>(runFieldAccess(t, getObjectField, arguments));
 }
 
 uint64_t
@@ -1566,7 +1723,7 @@ GetBooleanField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return run(t, getBooleanField, arguments);
+  return runFieldAccess(t, getBooleanField, arguments);
 }
 
 uint64_t
@@ -1587,7 +1744,7 @@ GetByteField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return run(t, getByteField, arguments);
+  return runFieldAccess(t, getByteField, arguments);
 }
 
 uint64_t
@@ -1608,7 +1765,7 @@ GetCharField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return run(t, getCharField, arguments);
+  return runFieldAccess(t, getCharField, arguments);
 }
 
 uint64_t
@@ -1629,7 +1786,7 @@ GetShortField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return run(t, getShortField, arguments);
+  return runFieldAccess(t, getShortField, arguments);
 }
 
 uint64_t
@@ -1650,7 +1807,7 @@ GetIntField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return run(t, getIntField, arguments);
+  return runFieldAccess(t, getIntField, arguments);
 }
 
 uint64_t
@@ -1671,7 +1828,7 @@ GetLongField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return run(t, getLongField, arguments);
+  return runFieldAccess(t, getLongField, arguments);
 }
 
 uint64_t
@@ -1692,7 +1849,7 @@ GetFloatField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return bitsToFloat(run(t, getFloatField, arguments));
+  return bitsToFloat(runFieldAccess(t, getFloatField, arguments));
 }
 
 uint64_t
@@ -1713,7 +1870,7 @@ GetDoubleField(Thread* t, jobject o, jfieldID field)
   uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(o),
                             field };
 
-  return bitsToDouble(run(t, getDoubleField, arguments));
+  return bitsToDouble(runFieldAccess(t, getDoubleField, arguments));
 }
 
 uint64_t
@@ -1738,7 +1895,7 @@ SetObjectField(Thread* t, jobject o, jfieldID field, jobject v)
                             field,
                             reinterpret_cast<uintptr_t>(v) };
 
-  run(t, setObjectField, arguments);
+  runFieldAccess(t, setObjectField, arguments);
 }
 
 uint64_t
@@ -1763,7 +1920,7 @@ SetBooleanField(Thread* t, jobject o, jfieldID field, jboolean v)
                             field,
                             v };
 
-  run(t, setBooleanField, arguments);
+  runFieldAccess(t, setBooleanField, arguments);
 }
 
 uint64_t
@@ -1788,7 +1945,7 @@ SetByteField(Thread* t, jobject o, jfieldID field, jbyte v)
                             field,
                             static_cast<uintptr_t>(v) };
 
-  run(t, setByteField, arguments);
+  runFieldAccess(t, setByteField, arguments);
 }
 
 uint64_t
@@ -1813,7 +1970,7 @@ SetCharField(Thread* t, jobject o, jfieldID field, jchar v)
                             field,
                             v };
 
-  run(t, setCharField, arguments);
+  runFieldAccess(t, setCharField, arguments);
 }
 
 uint64_t
@@ -1838,7 +1995,7 @@ SetShortField(Thread* t, jobject o, jfieldID field, jshort v)
                             field,
                             static_cast<uintptr_t>(v) };
 
-  run(t, setShortField, arguments);
+  runFieldAccess(t, setShortField, arguments);
 }
 
 uint64_t
@@ -1863,7 +2020,7 @@ SetIntField(Thread* t, jobject o, jfieldID field, jint v)
                             field,
                             static_cast<uintptr_t>(v) };
 
-  run(t, setIntField, arguments);
+  runFieldAccess(t, setIntField, arguments);
 }
 
 uint64_t
@@ -1889,7 +2046,7 @@ SetLongField(Thread* t, jobject o, jfieldID field, jlong v)
   arguments[1] = field;
   memcpy(arguments + 2, &v, sizeof(jlong));
 
-  run(t, setLongField, arguments);
+  runFieldAccess(t, setLongField, arguments);
 }
 
 uint64_t
@@ -1914,7 +2071,7 @@ SetFloatField(Thread* t, jobject o, jfieldID field, jfloat v)
                             field,
                             floatToBits(v) };
 
-  run(t, setFloatField, arguments);
+  runFieldAccess(t, setFloatField, arguments);
 }
 
 uint64_t
@@ -1940,7 +2097,7 @@ SetDoubleField(Thread* t, jobject o, jfieldID field, jdouble v)
   arguments[1] = field;
   memcpy(arguments + 2, &v, sizeof(jdouble));
 
-  run(t, setDoubleField, arguments);
+  runFieldAccess(t, setDoubleField, arguments);
 }
 
 object
@@ -2504,10 +2661,22 @@ DeleteWeakGlobalRef(Thread* t, jobject r)
   DeleteGlobalRef(t, r);
 }
 
+uint64_t
+ensureLocalCapacity(Thread* t, uintptr_t* arguments)
+{
+  if (t->m->processor->ensureLocalCapacity(t, arguments[0])) {
+    return 1;
+  } else {
+    throw_(t, root(t, Machine::OutOfMemoryError));
+  }
+}
+
 jint JNICALL
-EnsureLocalCapacity(Thread*, jint)
+EnsureLocalCapacity(Thread* t, jint capacity)
 {
-  return 0;
+  uintptr_t arguments[] = { static_cast<uintptr_t>(capacity) };
+
+  return run(t, ensureLocalCapacity, arguments) ? 0 : -1;
 }
 
 jthrowable JNICALL
@@ -3149,21 +3318,33 @@ GetPrimitiveArrayCritical(Thread* t, jarray array, jboolean* isCopy)
     enter(t, Thread::ActiveState);
   }
 
-  ++ t->criticalLevel;
-  
   if (isCopy) {
     *isCopy = true;
   }
 
   expect(t, *array);
 
-  return reinterpret_cast<uintptr_t*>(*array) + 2;
+  void* body = reinterpret_cast<uintptr_t*>(*array) + 2;
+
+  enterCritical(t, *array);
+
+  if (t->criticalLevel == 0) {
+    enter(t, Thread::IdleState);
+  }
+
+  return body;
 }
 
 void JNICALL
-ReleasePrimitiveArrayCritical(Thread* t, jarray, void*, jint)
+ReleasePrimitiveArrayCritical(Thread* t, jarray array, void*, jint)
 {
-  if ((-- t->criticalLevel) == 0) {
+  if (t->criticalLevel == 0) {
+    enter(t, Thread::ActiveState);
+  }
+
+  exitCritical(t, *array);
+
+  if (t->criticalLevel == 0) {
     enter(t, Thread::IdleState);
   }
 }
@@ -3786,6 +3967,10 @@ JNI_CreateJavaVM(Machine** m, Thread** t, void* args)
   const char* bootClasspath = 0;
   const char* bootClasspathAppend = "";
   const char* crashDumpDirectory = 0;
+  unsigned prefetchThreads = 0;
+  const char* prefetchProfile = 0;
+  const char* indexCache = 0;
+  bool compactGen2 = false;
 
   unsigned propertyCount = 0;
 
@@ -3831,6 +4016,22 @@ JNI_CreateJavaVM(Machine** m, Thread** t, void* args)
                          sizeof(EMBED_PREFIX_PROPERTY)) == 0)
       {
         embedPrefix = p + sizeof(EMBED_PREFIX_PROPERTY);
+      } else if (strncmp(p, CLASSPATH_PREFETCH_PROPERTY "=",
+                         sizeof(CLASSPATH_PREFETCH_PROPERTY)) == 0)
+      {
+        prefetchThreads = atoi(p + sizeof(CLASSPATH_PREFETCH_PROPERTY));
+      } else if (strncmp(p, CLASSPATH_PROFILE_PROPERTY "=",
+                         sizeof(CLASSPATH_PROFILE_PROPERTY)) == 0)
+      {
+        prefetchProfile = p + sizeof(CLASSPATH_PROFILE_PROPERTY);
+      } else if (strncmp(p, CLASSPATH_INDEX_PROPERTY "=",
+                         sizeof(CLASSPATH_INDEX_PROPERTY)) == 0)
+      {
+        indexCache = p + sizeof(CLASSPATH_INDEX_PROPERTY);
+      } else if (strncmp(p, GC_COMPACT_PROPERTY "=",
+                         sizeof(GC_COMPACT_PROPERTY)) == 0)
+      {
+        compactGen2 = strcmp(p + sizeof(GC_COMPACT_PROPERTY), "true") == 0;
       }
 
       ++ propertyCount;
@@ -3844,7 +4045,7 @@ JNI_CreateJavaVM(Machine** m, Thread** t, void* args)
   if (classpath == 0) classpath = ".";
   
   System* s = makeSystem(crashDumpDirectory);
-  Heap* h = makeHeap(s, heapLimit);
+  Heap* h = makeHeap(s, heapLimit, compactGen2);
   Classpath* c = makeClasspath(s, h, javaHome, embedPrefix);
 
   if (bootClasspath == 0) {
@@ -3873,11 +4074,27 @@ JNI_CreateJavaVM(Machine** m, Thread** t, void* args)
   if(bootLibraryEnd)
     *bootLibraryEnd = 0;
 
+  // the boot and application finders each get their own index cache
+  const char* bootIndexCache = indexCache
+    ? append(h, indexCache, ".boot") : 0;
+  const char* appIndexCache = indexCache
+    ? append(h, indexCache, ".app") : 0;
+
   Finder* bf = makeFinder
-    (s, h, RUNTIME_ARRAY_BODY(bootClasspathBuffer), bootLibrary);
-  Finder* af = makeFinder(s, h, classpath, bootLibrary);
+    (s, h, RUNTIME_ARRAY_BODY(bootClasspathBuffer), bootLibrary,
+     bootIndexCache);
+  Finder* af = makeFinder(s, h, classpath, bootLibrary, appIndexCache);
   if(bootLibrary)
     free(bootLibrary);
+  if (indexCache) {
+    h->free(bootIndexCache, strlen(bootIndexCache) + 1);
+    h->free(appIndexCache, strlen(appIndexCache) + 1);
+  }
+
+  if (prefetchThreads or prefetchProfile) {
+    bf->prefetch(prefetchThreads, prefetchProfile);
+    af->prefetch(prefetchThreads, prefetchProfile);
+  }
   Processor* p = makeProcessor(s, h, true);
 
   const char** properties = static_cast<const char**>
@@ -9,9 +9,11 @@
    details. */
 
 #include "lzma-util.h"
+#include <avian/util/math.h>
 #include "C/LzmaDec.h"
 
 using namespace vm;
+using namespace avian::util;
 
 namespace {
 
@@ -24,6 +26,141 @@ read4(const uint8_t* in)
     |    (static_cast<int32_t>(in[0])      );
 }
 
+void
+decode(System* s, Allocator* a, const uint8_t* in, unsigned inSize,
+       uint8_t* out, unsigned outSize)
+{
+  const unsigned PropHeaderSize = 5;
+  const unsigned HeaderSize = 13;
+
+  SizeT outSizeT = outSize;
+  SizeT inSizeT = inSize - HeaderSize;
+  LzmaAllocator allocator(a);
+
+  ELzmaStatus status;
+  int result = LzmaDecode
+    (out, &outSizeT, in + HeaderSize, &inSizeT, in, PropHeaderSize,
+     LZMA_FINISH_END, &status, &(allocator.allocator));
+
+  expect(s, result == SZ_OK);
+  expect(s, status == LZMA_STATUS_FINISHED_WITH_MARK);
+}
+
+class Chunk {
+ public:
+  const uint8_t* in;
+  unsigned inSize;
+  uint8_t* out;
+  unsigned outSize;
+};
+
+class ChunkDecoder: public System::Runnable {
+ public:
+  ChunkDecoder(System* s, Allocator* a, System::Mutex* lock, Chunk* chunks,
+               unsigned count, unsigned* next):
+    s(s), a(a), lock(lock), chunks(chunks), count(count), next(next),
+    thread(0)
+  { }
+
+  virtual void attach(System::Thread* t) {
+    thread = t;
+  }
+
+  virtual void run() {
+    while (true) {
+      lock->acquire();
+      unsigned i = (*next)++;
+      lock->release();
+
+      if (i >= count) {
+        break;
+      }
+
+      decode(s, a, chunks[i].in, chunks[i].inSize, chunks[i].out,
+             chunks[i].outSize);
+    }
+  }
+
+  virtual bool interrupted() {
+    return false;
+  }
+
+  virtual void setInterrupted(bool) { }
+
+  System* s;
+  Allocator* a;
+  System::Mutex* lock;
+  Chunk* chunks;
+  unsigned count;
+  unsigned* next;
+  System::Thread* thread;
+};
+
+uint8_t*
+decodeChunked(System* s, Allocator* a, uint8_t* in, unsigned inSize,
+              unsigned* outSize)
+{
+  unsigned count = read4(in + 4);
+  int32_t outSize32 = read4(in + 8);
+  expect(s, outSize32 >= 0);
+
+  const uint8_t* sizes = in + 12;
+  const uint8_t* p = sizes + (count * 4);
+  expect(s, p <= in + inSize);
+
+  uint8_t* out = static_cast<uint8_t*>(a->allocate(outSize32));
+
+  Chunk* chunks = static_cast<Chunk*>(a->allocate(sizeof(Chunk) * count));
+  unsigned offset = 0;
+  for (unsigned i = 0; i < count; ++i) {
+    chunks[i].in = p;
+    chunks[i].inSize = read4(sizes + (i * 4));
+    chunks[i].out = out + offset;
+    chunks[i].outSize = read4(p + 5);
+
+    p += chunks[i].inSize;
+    offset += chunks[i].outSize;
+
+    expect(s, p <= in + inSize);
+    expect(s, offset <= static_cast<unsigned>(outSize32));
+  }
+  expect(s, offset == static_cast<unsigned>(outSize32));
+
+  System::Mutex* lock;
+  expect(s, s->success(s->make(&lock)));
+
+  unsigned next = 0;
+  unsigned threadCount = min(count, LZMADecodeThreadCount) - 1;
+
+  ChunkDecoder* decoders = static_cast<ChunkDecoder*>
+    (a->allocate(sizeof(ChunkDecoder) * (threadCount + 1)));
+
+  for (unsigned i = 0; i <= threadCount; ++i) {
+    new (decoders + i) ChunkDecoder(s, a, lock, chunks, count, &next);
+  }
+
+  // the current thread decodes its share of the chunks along with
+  // the helpers:
+  for (unsigned i = 1; i <= threadCount; ++i) {
+    expect(s, s->success(s->start(decoders + i)));
+  }
+
+  decoders[0].run();
+
+  for (unsigned i = 1; i <= threadCount; ++i) {
+    decoders[i].thread->join();
+    decoders[i].thread->dispose();
+  }
+
+  a->free(decoders, sizeof(ChunkDecoder) * (threadCount + 1));
+  a->free(chunks, sizeof(Chunk) * count);
+  lock->dispose();
+
+  *outSize = outSize32;
+
+  return out;
+}
+
 } // namespace
 
 namespace vm {
@@ -33,24 +170,17 @@ decodeLZMA(System* s, Allocator* a, uint8_t* in, unsigned inSize,
            unsigned* outSize)
 {
   const unsigned PropHeaderSize = 5;
-  const unsigned HeaderSize = 13;
+
+  if (static_cast<uint32_t>(read4(in)) == LZMAChunkedMagic) {
+    return decodeChunked(s, a, in, inSize, outSize);
+  }
 
   int32_t outSize32 = read4(in + PropHeaderSize);
   expect(s, outSize32 >= 0);
-  SizeT outSizeT = outSize32;
 
   uint8_t* out = static_cast<uint8_t*>(a->allocate(outSize32));
 
-  SizeT inSizeT = inSize;
-  LzmaAllocator allocator(a);
-
-  ELzmaStatus status;
-  int result = LzmaDecode
-    (out, &outSizeT, in + HeaderSize, &inSizeT, in, PropHeaderSize,
-     LZMA_FINISH_END, &status, &(allocator.allocator));
-
-  expect(s, result == SZ_OK);
-  expect(s, status == LZMA_STATUS_FINISHED_WITH_MARK);
+  decode(s, a, in, inSize, out, outSize32);
 
   *outSize = outSize32;
 
@@ -58,4 +188,3 @@ decodeLZMA(System* s, Allocator* a, uint8_t* in, unsigned inSize,
 }
 
 } // namespace vm
-
@@ -9,9 +9,11 @@
    details. */
 
 #include "lzma-util.h"
+#include <avian/util/math.h>
 #include "C/LzmaEnc.h"
 
 using namespace vm;
+using namespace avian::util;
 
 namespace {
 
@@ -21,14 +23,69 @@ myProgress(void*, UInt64, UInt64)
   return SZ_OK;
 }
 
+void
+write4(uint8_t* out, uint32_t v)
+{
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
+uint8_t*
+encodeChunked(System* s, Allocator* a, uint8_t* in, unsigned inSize,
+              unsigned* outSize, unsigned chunkSize)
+{
+  unsigned count = ceilingDivide(inSize, chunkSize);
+
+  uint8_t** chunks = static_cast<uint8_t**>
+    (a->allocate(sizeof(uint8_t*) * count));
+  unsigned* sizes = static_cast<unsigned*>
+    (a->allocate(sizeof(unsigned) * count));
+
+  unsigned headerSize = 12 + (count * 4);
+  unsigned total = headerSize;
+  for (unsigned i = 0; i < count; ++i) {
+    unsigned offset = i * chunkSize;
+    chunks[i] = encodeLZMA
+      (s, a, in + offset, min(chunkSize, inSize - offset), sizes + i);
+    total += sizes[i];
+  }
+
+  uint8_t* out = static_cast<uint8_t*>(a->allocate(total));
+  write4(out, LZMAChunkedMagic);
+  write4(out + 4, count);
+  write4(out + 8, inSize);
+
+  unsigned offset = headerSize;
+  for (unsigned i = 0; i < count; ++i) {
+    write4(out + 12 + (i * 4), sizes[i]);
+    memcpy(out + offset, chunks[i], sizes[i]);
+    offset += sizes[i];
+
+    a->free(chunks[i], sizes[i]);
+  }
+
+  a->free(sizes, sizeof(unsigned) * count);
+  a->free(chunks, sizeof(uint8_t*) * count);
+
+  *outSize = total;
+
+  return out;
+}
+
 } // namespace
 
 namespace vm {
 
 uint8_t*
 encodeLZMA(System* s, Allocator* a, uint8_t* in, unsigned inSize,
-           unsigned* outSize)
+           unsigned* outSize, unsigned chunkSize)
 {
+  if (chunkSize and inSize > chunkSize) {
+    return encodeChunked(s, a, in, inSize, outSize, chunkSize);
+  }
+
   const unsigned PropHeaderSize = 5;
   const unsigned HeaderSize = 13;
 
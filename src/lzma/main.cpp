@@ -17,6 +17,13 @@
 
 namespace {
 
+const unsigned PropHeaderSize = 5;
+const unsigned HeaderSize = 13;
+
+// must match LZMAChunkedMagic in src/avian/lzma.h:
+const uint32_t ChunkedMagic = 0x435a4cff;
+const unsigned DefaultChunkSize = 1024 * 1024;
+
 int32_t
 read4(const uint8_t* in)
 {
@@ -26,6 +33,15 @@ read4(const uint8_t* in)
     |    (static_cast<int32_t>(in[0])      );
 }
 
+void
+write4(uint8_t* out, uint32_t v)
+{
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
 void*
 myAllocate(void*, size_t size)
 {
@@ -44,12 +60,103 @@ myProgress(void*, UInt64, UInt64)
   return SZ_OK;
 }
 
+int
+encodeData(uint8_t* out, SizeT* outSize, const uint8_t* in, SizeT inSize)
+{
+  ISzAlloc allocator = { myAllocate, myFree };
+
+  CLzmaEncProps props;
+  LzmaEncProps_Init(&props);
+  props.level = 9;
+  props.writeEndMark = 1;
+
+  ICompressProgress progress = { myProgress };
+
+  SizeT propsSize = PropHeaderSize;
+
+  int32_t inSize32 = inSize;
+  memcpy(out + PropHeaderSize, &inSize32, 4);
+
+  *outSize -= HeaderSize;
+  int result = LzmaEncode
+    (out + HeaderSize, outSize, in, inSize, &props, out,
+     &propsSize, 1, &progress, &allocator, &allocator);
+
+  *outSize += HeaderSize;
+
+  return result;
+}
+
+// Compresses the input as a sequence of independent chunks which the
+// VM can decode in parallel (see decodeLZMA in src/lzma-decode.cpp):
+int
+encodeChunked(uint8_t* out, SizeT* outSize, const uint8_t* in, SizeT inSize,
+              unsigned chunkSize)
+{
+  unsigned count = (inSize + chunkSize - 1) / chunkSize;
+
+  write4(out, ChunkedMagic);
+  write4(out + 4, count);
+  write4(out + 8, inSize);
+
+  SizeT offset = 12 + (count * 4);
+  for (unsigned i = 0; i < count; ++i) {
+    SizeT start = i * chunkSize;
+    SizeT length = inSize - start < chunkSize ? inSize - start : chunkSize;
+
+    SizeT size = *outSize - offset;
+    int result = encodeData(out + offset, &size, in + start, length);
+    if (result != SZ_OK) {
+      return result;
+    }
+
+    write4(out + 12 + (i * 4), size);
+    offset += size;
+  }
+
+  *outSize = offset;
+
+  return SZ_OK;
+}
+
+int
+decodeChunked(uint8_t* out, SizeT* outSize, const uint8_t* in,
+              ELzmaStatus* status)
+{
+  ISzAlloc allocator = { myAllocate, myFree };
+
+  unsigned count = read4(in + 4);
+  const uint8_t* p = in + 12 + (count * 4);
+
+  SizeT offset = 0;
+  for (unsigned i = 0; i < count; ++i) {
+    SizeT inSize = read4(in + 12 + (i * 4)) - HeaderSize;
+    SizeT size = *outSize - offset;
+
+    int result = LzmaDecode
+      (out + offset, &size, p + HeaderSize, &inSize, p, PropHeaderSize,
+       LZMA_FINISH_END, status, &allocator);
+    if (result != SZ_OK) {
+      return result;
+    }
+
+    p += inSize + HeaderSize;
+    offset += size;
+  }
+
+  *outSize = offset;
+
+  return SZ_OK;
+}
+
 void
 usageAndExit(const char* program)
 {
   fprintf(stderr,
           "usage: %s {encode|decode} <input file> <output file> "
-          "[<uncompressed size>]", program);
+          "[<uncompressed size>]\n"
+          "       %s encode-chunked <input file> <output file> "
+          "[<chunk size>]\n", program, program);
   exit(-1);
 }
 
@@ -62,7 +169,8 @@ main(int argc, const char** argv)
     usageAndExit(argv[0]);
   }
 
-  bool encode = strcmp(argv[1], "encode") == 0;
+  bool chunked = strcmp(argv[1], "encode-chunked") == 0;
+  bool encode = chunked or strcmp(argv[1], "encode") == 0;
 
   uint8_t* data = 0;
   unsigned size;
@@ -102,12 +210,19 @@ main(int argc, const char** argv)
   bool success = false;
 
   if (data) {
-    const unsigned PropHeaderSize = 5;
-    const unsigned HeaderSize = 13;
+    unsigned chunkSize = DefaultChunkSize;
+    if (chunked and argc == 5) {
+      chunkSize = atoi(argv[4]);
+    }
 
     SizeT outSize;
-    if (encode) {
+    if (chunked) {
+      unsigned count = (size + chunkSize - 1) / chunkSize;
+      outSize = (size * 2) + 12 + (count * (4 + HeaderSize));
+    } else if (encode) {
       outSize = size * 2;
+    } else if (static_cast<uint32_t>(read4(data)) == ChunkedMagic) {
+      outSize = read4(data + 8);
     } else {
       int32_t outSize32 = read4(data + PropHeaderSize);
       if (outSize32 >= 0) {
@@ -126,24 +241,12 @@ main(int argc, const char** argv)
         ISzAlloc allocator = { myAllocate, myFree };
         ELzmaStatus status = LZMA_STATUS_NOT_SPECIFIED;
         int result;
-        if (encode) {
-          CLzmaEncProps props;
-          LzmaEncProps_Init(&props);
-          props.level = 9;
-          props.writeEndMark = 1;
-
-          ICompressProgress progress = { myProgress };
-
-          SizeT propsSize = PropHeaderSize;
-
-          int32_t inSize32 = inSize;
-          memcpy(out + PropHeaderSize, &inSize32, 4);
-          
-          result = LzmaEncode
-            (out + HeaderSize, &outSize, data, inSize, &props, out,
-             &propsSize, 1, &progress, &allocator, &allocator);
-
-          outSize += HeaderSize;
+        if (chunked) {
+          result = encodeChunked(out, &outSize, data, inSize, chunkSize);
+        } else if (encode) {
+          result = encodeData(out, &outSize, data, inSize);
+        } else if (static_cast<uint32_t>(read4(data)) == ChunkedMagic) {
+          result = decodeChunked(out, &outSize, data, &status);
         } else {
           result = LzmaDecode
             (out, &outSize, data + HeaderSize, &inSize, data, PropHeaderSize,
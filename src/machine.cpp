@@ -16,6 +16,8 @@
 #include "avian/processor.h"
 #include "avian/arch.h"
 #include "avian/lzma.h"
+#include "avian/archive.h"
+#include "avian/profiler.h"
 
 #include <avian/util/runtime-array.h>
 #include <avian/util/math.h>
@@ -502,6 +504,88 @@ clearTargetIfFinalizable(Thread* t, object r)
   }
 }
 
+void
+removeWeakNode(Thread* t, Heap::Visitor* v, object map, object n)
+{
+  object array = hashMapArray(t, map);
+  unsigned index = weakNodeHash(t, n) & (arrayLength(t, array) - 1);
+
+  object* p = &arrayBody(t, array, index);
+  while (*p != n) {
+    p = &weakNodeNext(t, *p);
+  }
+
+  *p = weakNodeNext(t, n);
+  v->visit(p);
+
+  weakNodeKey(t, n) = 0;
+  -- hashMapSize(t, map);
+}
+
+void
+visitWeakHashMap(Thread* t, Heap::Visitor* v, object map, bool major)
+{
+  if (map == 0) {
+    // not yet created during bootstrap
+    return;
+  }
+
+  Heap* h = t->m->heap;
+
+  if (major) {
+    // sweep the whole table, since any key may have died
+    object array = hashMapArray(t, map);
+    if (array) {
+      for (unsigned i = 0; i < arrayLength(t, array); ++i) {
+        for (object* p = &arrayBody(t, array, i); *p;) {
+          v->visit(p);
+
+          object n = *p;
+          if (h->status(weakNodeKey(t, n)) == Heap::Unreachable) {
+            *p = weakNodeNext(t, n);
+            weakNodeKey(t, n) = 0;
+            -- hashMapSize(t, map);
+          } else {
+            v->visit(&weakNodeKey(t, n));
+            p = &weakNodeNext(t, n);
+          }
+        }
+      }
+    }
+  }
+
+  // only keys which have not yet been tenured may die in a minor
+  // collection, and the nodes holding those keys are on the young
+  // list
+  for (object* p = &weakHashMapYoung(t, map); *p;) {
+    if (h->status(*p) == Heap::Unreachable) {
+      // the node was dropped from the table (e.g. because the table
+      // itself is garbage)
+      *p = weakNodeVmNext(t, *p);
+      continue;
+    }
+
+    v->visit(p);
+
+    object n = *p;
+    if (weakNodeKey(t, n) == 0) {
+      // already removed by the sweep above
+      *p = weakNodeVmNext(t, n);
+    } else if (h->status(weakNodeKey(t, n)) == Heap::Unreachable) {
+      removeWeakNode(t, v, map, n);
+      *p = weakNodeVmNext(t, n);
+    } else {
+      v->visit(&weakNodeKey(t, n));
+
+      if (h->status(weakNodeKey(t, n)) == Heap::Tenured) {
+        *p = weakNodeVmNext(t, n);
+      } else {
+        p = &weakNodeVmNext(t, n);
+      }
+    }
+  }
+}
+
 void
 postVisit(Thread* t, Heap::Visitor* v)
 {
@@ -655,6 +739,19 @@ postVisit(Thread* t, Heap::Visitor* v)
       }
     }
   }
+
+  // the finalizers queued above have already been visited, but we
+  // visit the links again so the heap can update them if it moves
+  // objects after this point
+  for (object* p = &(m->finalizeQueue); *p; p = &finalizerNext(t, *p)) {
+    v->visit(p);
+  }
+
+  // sweep the weak-keyed tables last, so that keys resurrected for
+  // finalization above are retained until they are finally released
+  visitWeakHashMap(t, v, root(t, Machine::MonitorMap), major);
+  visitWeakHashMap(t, v, root(t, Machine::StringMap), major);
+  visitWeakHashMap(t, v, root(t, Machine::ByteArrayMap), major);
 }
 
 void
@@ -848,30 +945,33 @@ makeByteArray(Thread* t, Stream& s, unsigned length)
   return value;
 }
 
-void
-removeByteArray(Thread* t, object o)
-{
-  hashMapRemove
-    (t, root(t, Machine::ByteArrayMap), o, byteArrayHash, objectEqual);
-}
+class InternLockResource: public Thread::Resource {
+ public:
+  InternLockResource(Thread* t): Resource(t) {
+    bool contended = not t->m->internLock->tryAcquire(t->systemThread);
+    if (contended) {
+      ENTER(t, Thread::IdleState);
+      t->m->internLock->acquire(t->systemThread);
+    }
 
-object
-internByteArray(Thread* t, object array)
-{
-  PROTECT(t, array);
+    // these are only updated while the lock is held, so they need no
+    // further synchronization
+    ++ t->m->internLockCount;
+    if (contended) {
+      ++ t->m->internContentionCount;
+    }
 
-  ACQUIRE(t, t->m->referenceLock);
+    stress(t);
+  }
 
-  object n = hashMapFindNode
-    (t, root(t, Machine::ByteArrayMap), array, byteArrayHash, byteArrayEqual);
-  if (n) {
-    return jreferenceTarget(t, tripleFirst(t, n));
-  } else {
-    hashMapInsert(t, root(t, Machine::ByteArrayMap), array, 0, byteArrayHash);
-    addFinalizer(t, array, removeByteArray);
-    return array;
+  ~InternLockResource() {
+    t->m->internLock->release(t->systemThread);
   }
-}
+
+  virtual void release() {
+    this->InternLockResource::~InternLockResource();
+  }
+};
 
 unsigned
 parsePoolEntry(Thread* t, Stream& s, uint32_t* index, object pool, unsigned i)
@@ -1801,20 +1901,15 @@ parseCode(Thread* t, Stream& s, object pool)
     disassembleCode("      ", &codeBody(t, code, 0), length);
   }
 
+  // the exception handler and line number tables are only needed if
+  // the method is run, so we save them in class file form and parse
+  // them later (see expandCodeTables)
+  unsigned ehtPosition = s.position();
   unsigned ehtLength = s.read2();
-  if (ehtLength) {
-    object eht = makeExceptionHandlerTable(t, ehtLength);
-    for (unsigned i = 0; i < ehtLength; ++i) {
-      unsigned start = s.read2();
-      unsigned end = s.read2();
-      unsigned ip = s.read2();
-      unsigned catchType = s.read2();
-      exceptionHandlerTableBody(t, eht, i) = exceptionHandler
-        (start, end, ip, catchType);
-    }
+  s.skip(ehtLength * 8);
 
-    set(t, code, CodeExceptionHandlerTable, eht);
-  }
+  unsigned lntPosition = 0;
+  unsigned lntLength = 0;
 
   unsigned attributeCount = s.read2();
   for (unsigned j = 0; j < attributeCount; ++j) {
@@ -1824,18 +1919,30 @@ parseCode(Thread* t, Stream& s, object pool)
     if (vm::strcmp(reinterpret_cast<const int8_t*>("LineNumberTable"),
                    &byteArrayBody(t, name, 0)) == 0)
     {
-      unsigned lntLength = s.read2();
-      object lnt = makeLineNumberTable(t, lntLength);
-      for (unsigned i = 0; i < lntLength; ++i) {
-        unsigned ip = s.read2();
-        unsigned line = s.read2();
-        lineNumberTableBody(t, lnt, i) = lineNumber(ip, line);
-      }
+      lntPosition = s.position();
+      lntLength = length;
+    }
 
-      set(t, code, CodeLineNumberTable, lnt);
-    } else {
-      s.skip(length);
+    s.skip(length);
+  }
+
+  if (ehtLength or lntLength) {
+    unsigned end = s.position();
+
+    object tables = makeByteArray(t, 2 + (ehtLength * 8) + lntLength);
+    uint8_t* body = reinterpret_cast<uint8_t*>(&byteArrayBody(t, tables, 0));
+
+    s.setPosition(ehtPosition);
+    s.read(body, 2 + (ehtLength * 8));
+
+    if (lntLength) {
+      s.setPosition(lntPosition);
+      s.read(body + 2 + (ehtLength * 8), lntLength);
     }
+
+    s.setPosition(end);
+
+    set(t, code, CodeExceptionHandlerTable, tables);
   }
 
   return code;
@@ -1904,6 +2011,49 @@ addInterfaceMethods(Thread* t, object class_, object virtualMap,
   return 0;
 }
 
+// Returns true if the specified no-argument constructor does nothing
+// but call a superclass constructor which is itself trivial, in which
+// case the JIT compiler may elide it entirely.
+bool
+trivialConstructor(Thread* t, object class_, object method)
+{
+  if (vm::strcmp(reinterpret_cast<const int8_t*>("()V"),
+                 &byteArrayBody(t, methodSpec(t, method), 0)) != 0)
+  {
+    return false;
+  }
+
+  object code = methodCode(t, method);
+  object super = classSuper(t, class_);
+  if (code == 0) {
+    return false;
+  } else if (super == 0) {
+    return emptyMethod(t, method);
+  } else if (codeLength(t, code) != 5
+             or codeBody(t, code, 0) != aload_0
+             or codeBody(t, code, 1) != invokespecial
+             or codeBody(t, code, 4) != return_)
+  {
+    return false;
+  }
+
+  unsigned index = (codeBody(t, code, 2) << 8) | codeBody(t, code, 3);
+  object reference = singletonObject(t, codePool(t, code), index - 1);
+  if (objectClass(t, reference) != type(t, Machine::ReferenceType)
+      or not byteArrayEqual
+      (t, referenceClass(t, reference), className(t, super)))
+  {
+    return false;
+  }
+
+  object target = findMethodInClass
+    (t, super, referenceName(t, reference), referenceSpec(t, reference));
+
+  return target
+    and methodClass(t, target) == super
+    and (methodVmFlags(t, target) & TrivialConstructorFlag);
+}
+
 void
 parseMethodTable(Thread* t, Stream& s, object class_, object pool)
 {
@@ -2059,6 +2209,23 @@ parseMethodTable(Thread* t, Stream& s, object class_, object pool)
           (t, virtualMap, method, methodHash, methodEqual);
 
         if (p) {
+          if (UNLIKELY(methodVmFlags(t, tripleSecond(t, p))
+                       & EffectivelyFinalFlag))
+          {
+            // calls to the overridden method were compiled as direct
+            // calls when the boot image was built, so this class
+            // cannot be supported without rebuilding it:
+            object overridden = tripleSecond(t, p);
+            throwNew(t, Machine::IncompatibleClassChangeErrorType,
+                     "%s overrides %s.%s%s, which was devirtualized in "
+                     "the boot image",
+                     &byteArrayBody(t, className(t, class_), 0),
+                     &byteArrayBody
+                     (t, className(t, methodClass(t, overridden)), 0),
+                     &byteArrayBody(t, methodName(t, overridden), 0),
+                     &byteArrayBody(t, methodSpec(t, overridden), 0));
+          }
+
           methodOffset(t, method) = methodOffset(t, tripleFirst(t, p));
 
           set(t, p, TripleSecond, method);
@@ -2094,6 +2261,10 @@ parseMethodTable(Thread* t, Stream& s, object class_, object pool)
                     &byteArrayBody(t, methodName(t, method), 0)) == 0)
         {
           methodVmFlags(t, method) |= ConstructorFlag;
+
+          if (trivialConstructor(t, class_, method)) {
+            methodVmFlags(t, method) |= TrivialConstructorFlag;
+          }
         }
       }
 
@@ -2525,28 +2696,6 @@ resolveArrayClass(Thread* t, object loader, object spec, bool throw_,
   }
 }
 
-void
-removeMonitor(Thread* t, object o)
-{
-  unsigned hash;
-  if (DebugMonitors) {
-    hash = objectHash(t, o);
-  }
-
-  object m = hashMapRemove
-    (t, root(t, Machine::MonitorMap), o, objectHash, objectEqual);
-
-  if (DebugMonitors) {
-    fprintf(stderr, "dispose monitor %p for object %x\n", m, hash);
-  }
-}
-
-void
-removeString(Thread* t, object o)
-{
-  hashMapRemove(t, root(t, Machine::StringMap), o, stringHash, objectEqual);
-}
-
 void
 bootClass(Thread* t, Machine::Type type, int superType, uint32_t objectMask,
           unsigned fixedSize, unsigned arrayElementSize, unsigned vtableLength)
@@ -2731,7 +2880,7 @@ boot(Thread* t)
 
   setRoot(t, Machine::BootstrapClassMap, makeHashMap(t, 0, 0));
 
-  setRoot(t, Machine::StringMap, makeWeakHashMap(t, 0, 0));
+  setRoot(t, Machine::StringMap, makeWeakHashMap(t, 0, 0, 0));
 
   { object interfaceTable = makeArray(t, 4);
 
@@ -2979,6 +3128,55 @@ findInTable(Thread* t, object table, object name, object spec,
   return 0;
 }
 
+bool
+validBootImageFile(BootImageFile* file, size_t length)
+{
+  return length >= sizeof(BootImageFile)
+    and file->magic == BootImageFile::Magic
+    and file->codeOffset + file->codeSize <= length
+    and file->imageOffset + file->imageSize <= length
+    and file->imageSize >= sizeof(BootImage);
+}
+
+BootImage*
+mapBootImage(Thread* t, const char* path, uint8_t** code)
+{
+  System* s = t->m->system;
+
+  // peek at the header to find out where the generator expects the
+  // file to be mapped:
+  void* base = 0;
+  { System::Region* header;
+    if (s->success(s->map(&header, path))) {
+      BootImageFile* file = reinterpret_cast<BootImageFile*>
+        (const_cast<uint8_t*>(header->start()));
+
+      if (validBootImageFile(file, header->length())) {
+        base = reinterpret_cast<void*>(static_cast<uintptr_t>(file->base));
+      }
+      header->dispose();
+    }
+  }
+
+  System::Region* region;
+  if (not s->success(s->mapImage(&region, path, base))) {
+    fprintf(stderr, "unable to map boot image %s\n", path);
+    abort(t);
+  }
+
+  uint8_t* start = const_cast<uint8_t*>(region->start());
+  BootImageFile* file = reinterpret_cast<BootImageFile*>(start);
+  if (not validBootImageFile(file, region->length())) {
+    fprintf(stderr, "invalid boot image file %s\n", path);
+    abort(t);
+  }
+
+  t->m->bootimageRegion = region;
+
+  *code = start + file->codeOffset;
+  return reinterpret_cast<BootImage*>(start + file->imageOffset);
+}
+
 } // namespace
 
 namespace vm {
@@ -3001,6 +3199,9 @@ Machine::Machine(System* system, Heap* heap, Finder* bootFinder,
   exclusive(0),
   finalizeThread(0),
   jniReferences(0),
+  classLoadLocks(0),
+  archive(0),
+  profiler(0),
   properties(properties),
   propertyCount(propertyCount),
   arguments(arguments),
@@ -3016,10 +3217,12 @@ Machine::Machine(System* system, Heap* heap, Finder* bootFinder,
   heapLock(0),
   classLock(0),
   referenceLock(0),
+  internLock(0),
   shutdownLock(0),
   libraries(0),
   errorLog(0),
   bootimage(0),
+  bootimageRegion(0),
   types(0),
   roots(0),
   finalizers(0),
@@ -3032,7 +3235,9 @@ Machine::Machine(System* system, Heap* heap, Finder* bootFinder,
   triedBuiltinOnLoad(false),
   dumpedHeapOnOOM(false),
   alive(true),
-  heapPoolIndex(0)
+  heapPoolIndex(0),
+  internLockCount(0),
+  internContentionCount(0)
 {
   heap->setClient(heapClient);
 
@@ -3051,6 +3256,7 @@ Machine::Machine(System* system, Heap* heap, Finder* bootFinder,
       not system->success(system->make(&heapLock)) or
       not system->success(system->make(&classLock)) or
       not system->success(system->make(&referenceLock)) or
+      not system->success(system->make(&internLock)) or
       not system->success(system->make(&shutdownLock)) or
       not system->success
       (system->load(&libraries, bootstrapPropertyDup)))
@@ -3077,11 +3283,22 @@ Machine::Machine(System* system, Heap* heap, Finder* bootFinder,
 void
 Machine::dispose()
 {
+  const char* stats = findProperty(this, INTERN_STATS_PROPERTY);
+  if (stats and ::strcmp(stats, "true") == 0) {
+    fprintf(stderr, "intern lock acquired %u times, contended %u times\n",
+            internLockCount, internContentionCount);
+  }
+
+  if (archive) {
+    archive->dispose();
+  }
+
   localThread->dispose();
   stateLock->dispose();
   heapLock->dispose();
   classLock->dispose();
   referenceLock->dispose();
+  internLock->dispose();
   shutdownLock->dispose();
 
   if (libraries) {
@@ -3102,6 +3319,10 @@ Machine::dispose()
     heap->free(bootimage, bootimageSize);
   }
 
+  if (bootimageRegion) {
+    bootimageRegion->dispose();
+  }
+
   heap->free(arguments, sizeof(const char*) * argumentCount);
 
   heap->free(properties, sizeof(const char*) * propertyCount);
@@ -3133,7 +3354,8 @@ Thread::Thread(Machine* m, object javaThread, Thread* parent):
               (m->heap->allocate(ThreadHeapSizeInBytes))),
   heap(defaultHeap),
   backupHeapIndex(0),
-  flags(ActiveFlag)
+  flags(ActiveFlag),
+  stringBuffers(0)
 { }
 
 void
@@ -3156,7 +3378,9 @@ Thread::init()
     BootImage* image = 0;
     uint8_t* code = 0;
     const char* imageFunctionName = findProperty(m, "avian.bootimage");
-    if (imageFunctionName) {
+    if (imageFunctionName and strncmp("file:", imageFunctionName, 5) == 0) {
+      image = mapBootImage(this, imageFunctionName + 5, &code);
+    } else if (imageFunctionName) {
       bool lzma = strncmp("lzma:", imageFunctionName, 5) == 0;
       const char* symbolName
         = lzma ? imageFunctionName + 5 : imageFunctionName;
@@ -3203,14 +3427,28 @@ Thread::init()
       boot(this);
     }
 
-    setRoot(this, Machine::ByteArrayMap, makeWeakHashMap(this, 0, 0));
-    setRoot(this, Machine::MonitorMap, makeWeakHashMap(this, 0, 0));
+    setRoot(this, Machine::ByteArrayMap, makeWeakHashMap(this, 0, 0, 0));
+    setRoot(this, Machine::MonitorMap, makeWeakHashMap(this, 0, 0, 0));
 
     setRoot(this, Machine::ClassRuntimeDataTable, makeVector(this, 0, 0));
     setRoot(this, Machine::MethodRuntimeDataTable, makeVector(this, 0, 0));
     setRoot(this, Machine::JNIMethodTable, makeVector(this, 0, 0));
     setRoot(this, Machine::JNIFieldTable, makeVector(this, 0, 0));
 
+    // classes from a boot image need no parsing, so there is nothing
+    // for an archive to save
+    if (not (image and code)) {
+      const char* archive = findProperty(m, ARCHIVE_PROPERTY);
+      if (archive) {
+        m->archive = makeArchive(this, archive);
+      }
+    }
+
+    const char* profile = findProperty(m, PROFILE_PROPERTY);
+    if (profile) {
+      m->profiler = makeProfiler(this, profile);
+    }
+
     m->localThread->set(this);
   }
 
@@ -3250,6 +3488,12 @@ Thread::dispose()
 
   m->heap->free(defaultHeap, ThreadHeapSizeInBytes);
 
+  for (StringBuffer* b = stringBuffers; b;) {
+    StringBuffer* next = b->next;
+    m->heap->free(b, sizeof(StringBuffer) + b->capacity);
+    b = next;
+  }
+
   m->processor->dispose(this);
 }
 
@@ -3290,6 +3534,14 @@ shutDown(Thread* t)
     }
   }
 
+  // stop sampling and write the profile now that no more Java code
+  // will run except for finalizers
+  if (t->m->profiler) {
+    Profiler* profiler = t->m->profiler;
+    t->m->profiler = 0;
+    profiler->dispose(t);
+  }
+
   // tell finalize thread to exit and wait for it to do so
   { ACQUIRE(t, t->m->stateLock);
     Thread* finalizeThread = t->m->finalizeThread;
@@ -4115,6 +4367,83 @@ runParseClass(Thread* t, uintptr_t* arguments)
     (parseClass(t, loader, region->start(), region->length(), throwType));
 }
 
+uint64_t
+runLoadArchivedClass(Thread* t, uintptr_t* arguments)
+{
+  object loader = reinterpret_cast<object>(arguments[0]);
+  object spec = reinterpret_cast<object>(arguments[1]);
+  Machine::Type throwType = static_cast<Machine::Type>(arguments[2]);
+
+  return reinterpret_cast<uintptr_t>
+    (t->m->archive->load(t, loader, spec, throwType));
+}
+
+// Serializes attempts to load a given class through a given system
+// class loader, so that unrelated classes may be parsed concurrently
+// without holding classLock.  The loader and spec are referenced via
+// the caller's (protected) variables so that they remain valid across
+// collections.
+class ClassLoadLock: public Thread::Resource {
+ public:
+  ClassLoadLock(Thread* t, object* loader, object* spec):
+    Resource(t), loader(loader), spec(spec), peer(0), owner(false)
+  {
+    ACQUIRE(t, t->m->classLock);
+
+    while (true) {
+      ClassLoadLock* other = find(t);
+      if (other == 0) {
+        break;
+      } else if (other->t == t) {
+        // a recursive attempt by this thread to load the same class;
+        // let the outer attempt release the lock
+        return;
+      }
+
+      ENTER(t, Thread::IdleState);
+      t->m->classLock->wait(t->systemThread, 0);
+    }
+
+    owner = true;
+    peer = t->m->classLoadLocks;
+    t->m->classLoadLocks = this;
+  }
+
+  ~ClassLoadLock() {
+    if (owner) {
+      ACQUIRE(t, t->m->classLock);
+
+      for (ClassLoadLock** p = &(t->m->classLoadLocks); *p; p = &((*p)->peer))
+      {
+        if (*p == this) {
+          *p = peer;
+          break;
+        }
+      }
+
+      t->m->classLock->notifyAll(t->systemThread);
+    }
+  }
+
+  virtual void release() {
+    this->ClassLoadLock::~ClassLoadLock();
+  }
+
+  ClassLoadLock* find(Thread* t) {
+    for (ClassLoadLock* p = t->m->classLoadLocks; p; p = p->peer) {
+      if (*(p->loader) == *loader and byteArrayEqual(t, *(p->spec), *spec)) {
+        return p;
+      }
+    }
+    return 0;
+  }
+
+  object* loader;
+  object* spec;
+  ClassLoadLock* peer;
+  bool owner;
+};
+
 object
 resolveSystemClass(Thread* t, object loader, object spec, bool throw_,
                    Machine::Type throwType)
@@ -4122,10 +4451,15 @@ resolveSystemClass(Thread* t, object loader, object spec, bool throw_,
   PROTECT(t, loader);
   PROTECT(t, spec);
 
-  ACQUIRE(t, t->m->classLock);
+  object class_ = findLoadedClass(t, loader, spec);
+  if (class_) {
+    return class_;
+  }
 
-  object class_ = hashMapFind
-    (t, classLoaderMap(t, loader), spec, byteArrayHash, byteArrayEqual);
+  ClassLoadLock lock(t, &loader, &spec);
+
+  // another thread may have loaded the class while we waited
+  class_ = findLoadedClass(t, loader, spec);
 
   if (class_ == 0) {
     PROTECT(t, class_);
@@ -4149,37 +4483,54 @@ resolveSystemClass(Thread* t, object loader, object spec, bool throw_,
              ".class",
              7);
 
-      System::Region* region = static_cast<Finder*>
-        (systemClassLoaderFinder(t, loader))->find
-        (RUNTIME_ARRAY_BODY(file));
+      if (t->m->archive) {
+        uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(loader),
+                                  reinterpret_cast<uintptr_t>(spec),
+                                  static_cast<uintptr_t>(throwType) };
 
-      if (region) {
-        if (Verbose) {
-          fprintf(stderr, "parsing %s\n", &byteArrayBody(t, spec, 0));
-        }
+        class_ = reinterpret_cast<object>
+          (runRaw(t, runLoadArchivedClass, arguments));
+      }
+
+      if (class_ == 0 and t->exception == 0) {
+        System::Region* region = static_cast<Finder*>
+          (systemClassLoaderFinder(t, loader))->find
+          (RUNTIME_ARRAY_BODY(file));
 
-        { THREAD_RESOURCE(t, System::Region*, region, region->dispose());
+        if (region) {
+          if (Verbose) {
+            fprintf(stderr, "parsing %s\n", &byteArrayBody(t, spec, 0));
+          }
 
-          uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(loader),
-                                    reinterpret_cast<uintptr_t>(region),
-                                    static_cast<uintptr_t>(throwType) };
+          { THREAD_RESOURCE(t, System::Region*, region, region->dispose());
 
-          // parse class file
-          class_ = reinterpret_cast<object>
-            (runRaw(t, runParseClass, arguments));
+            uintptr_t arguments[] = { reinterpret_cast<uintptr_t>(loader),
+                                      reinterpret_cast<uintptr_t>(region),
+                                      static_cast<uintptr_t>(throwType) };
 
-          if (UNLIKELY(t->exception)) {
-            if (throw_) {
-              object e = t->exception;
-              t->exception = 0;
-              vm::throw_(t, e);
-            } else {
-              t->exception = 0;
-              return 0;
-            }
+            // parse class file
+            class_ = reinterpret_cast<object>
+              (runRaw(t, runParseClass, arguments));
           }
+
+          if (class_ and t->m->archive) {
+            t->m->archive->save(t, class_);
+          }
+        }
+      }
+
+      if (UNLIKELY(t->exception)) {
+        if (throw_) {
+          object e = t->exception;
+          t->exception = 0;
+          vm::throw_(t, e);
+        } else {
+          t->exception = 0;
+          return 0;
         }
+      }
 
+      if (class_) {
         if (Verbose) {
           fprintf(stderr, "done parsing %s: %p\n",
                   &byteArrayBody(t, spec, 0),
@@ -4214,6 +4565,8 @@ resolveSystemClass(Thread* t, object loader, object spec, bool throw_,
     }
 
     if (class_) {
+      ACQUIRE(t, t->m->classLock);
+
       hashMapInsert(t, classLoaderMap(t, loader), spec, class_, byteArrayHash);
 
       t->m->classpath->updatePackageMap(t, class_);
@@ -4613,7 +4966,7 @@ objectMonitor(Thread* t, object o, bool createNew)
 {
   assert(t, t->state == Thread::ActiveState);
 
-  object m = hashMapFind
+  object m = weakHashMapFind
     (t, root(t, Machine::MonitorMap), o, objectHash, objectEqual);
 
   if (m) {
@@ -4628,7 +4981,7 @@ objectMonitor(Thread* t, object o, bool createNew)
 
     { ENTER(t, Thread::ExclusiveState);
 
-      m = hashMapFind
+      m = weakHashMapFind
         (t, root(t, Machine::MonitorMap), o, objectHash, objectEqual);
 
       if (m) {
@@ -4648,9 +5001,7 @@ objectMonitor(Thread* t, object o, bool createNew)
                 objectHash(t, o));
       }
 
-      hashMapInsert(t, root(t, Machine::MonitorMap), o, m, objectHash);
-
-      addFinalizer(t, o, removeMonitor);
+      weakHashMapInsert(t, root(t, Machine::MonitorMap), o, m, objectHash);
     }
 
     return m;
@@ -4662,22 +5013,130 @@ objectMonitor(Thread* t, object o, bool createNew)
 object
 intern(Thread* t, object s)
 {
+  // see internByteArray for why the unlocked lookup is safe
+  object n = weakHashMapFindNode
+    (t, root(t, Machine::StringMap), s, stringHash, stringEqual);
+  if (n) {
+    return weakNodeKey(t, n);
+  }
+
   PROTECT(t, s);
 
-  ACQUIRE(t, t->m->referenceLock);
+  InternLockResource lock(t);
 
-  object n = hashMapFindNode
+  n = weakHashMapFindNode
     (t, root(t, Machine::StringMap), s, stringHash, stringEqual);
 
   if (n) {
-    return jreferenceTarget(t, tripleFirst(t, n));
+    return weakNodeKey(t, n);
   } else {
-    hashMapInsert(t, root(t, Machine::StringMap), s, 0, stringHash);
-    addFinalizer(t, s, removeString);
+    weakHashMapInsert(t, root(t, Machine::StringMap), s, 0, stringHash);
     return s;
   }
 }
 
+object
+internByteArray(Thread* t, object array)
+{
+  // most lookups find an existing entry, so we try without the lock
+  // first.  A concurrent insert or resize may cause us to miss an
+  // entry, but never to find a wrong one, and we'll look again below
+  // before inserting.
+  object n = weakHashMapFindNode
+    (t, root(t, Machine::ByteArrayMap), array, byteArrayHash, byteArrayEqual);
+  if (n) {
+    return weakNodeKey(t, n);
+  }
+
+  PROTECT(t, array);
+
+  InternLockResource lock(t);
+
+  n = weakHashMapFindNode
+    (t, root(t, Machine::ByteArrayMap), array, byteArrayHash, byteArrayEqual);
+  if (n) {
+    return weakNodeKey(t, n);
+  } else {
+    weakHashMapInsert
+      (t, root(t, Machine::ByteArrayMap), array, 0, byteArrayHash);
+    return array;
+  }
+}
+
+void
+expandCodeTables(Thread* t, object code)
+{
+  PROTECT(t, code);
+
+  object tables = codeExceptionHandlerTable(t, code);
+  PROTECT(t, tables);
+
+  class Client: public Stream::Client {
+   public:
+    Client(Thread* t): t(t) { }
+
+    virtual void NO_RETURN handleError() {
+      abort(t);
+    }
+
+   private:
+    Thread* t;
+  } client(t);
+
+  // see parseCode for the layout of the tables array
+  unsigned ehtLength;
+  unsigned lntLength = 0;
+  { Stream s(&client, reinterpret_cast<const uint8_t*>
+             (&byteArrayBody(t, tables, 0)), byteArrayLength(t, tables));
+
+    ehtLength = s.read2();
+    s.skip(ehtLength * 8);
+    if (s.position() < byteArrayLength(t, tables)) {
+      lntLength = s.read2();
+    }
+  }
+
+  object eht = ehtLength ? makeExceptionHandlerTable(t, ehtLength) : 0;
+  PROTECT(t, eht);
+
+  object lnt = lntLength ? makeLineNumberTable(t, lntLength) : 0;
+  PROTECT(t, lnt);
+
+  // no allocation happens past this point, so the tables array can't
+  // move while we read it
+  Stream s(&client, reinterpret_cast<const uint8_t*>
+           (&byteArrayBody(t, tables, 0)), byteArrayLength(t, tables));
+
+  s.skip(2);
+  for (unsigned i = 0; i < ehtLength; ++i) {
+    unsigned start = s.read2();
+    unsigned end = s.read2();
+    unsigned ip = s.read2();
+    unsigned catchType = s.read2();
+    exceptionHandlerTableBody(t, eht, i) = exceptionHandler
+      (start, end, ip, catchType);
+  }
+
+  if (lntLength) {
+    s.skip(2);
+    for (unsigned i = 0; i < lntLength; ++i) {
+      unsigned ip = s.read2();
+      unsigned line = s.read2();
+      lineNumberTableBody(t, lnt, i) = lineNumber(ip, line);
+    }
+  }
+
+  // another thread may be expanding the same tables concurrently,
+  // which is harmless since we'll both produce the same result, but
+  // readers must not see the exception handler table replaced before
+  // the line number table is in place
+  set(t, code, CodeLineNumberTable, lnt);
+
+  storeStoreMemoryBarrier();
+
+  set(t, code, CodeExceptionHandlerTable, eht);
+}
+
 void
 collect(Thread* t, Heap::CollectionType type)
 {
@@ -5198,16 +5657,14 @@ vmAddressFromLine(Thread* t, object m, unsigned line)
 {
   object code = methodCode(t, m);
   printf("code: %p\n", code);
-  object lnt = codeLineNumberTable(t, code);
-  printf("lnt: %p\n", lnt);
 	
-  if (lnt) {
+  if (code) {
     unsigned last = 0;
     unsigned bottom = 0;
-    unsigned top = lineNumberTableLength(t, lnt);
+    unsigned top = codeLineNumberCount(t, code);
     for(unsigned i = bottom; i < top; i++)
     {
-      uint64_t ln = lineNumberTableBody(t, lnt, i);
+      uint64_t ln = codeLineNumber(t, code, i);
       if(lineNumberLine(ln) == line)
         return reinterpret_cast<void*>(lineNumberIp(ln));
       else if(lineNumberLine(ln) > line)
@@ -267,17 +267,17 @@ findLineNumber(Thread* t, object method, unsigned ip)
   -- ip;
 
   object code = methodCode(t, method);
-  object lnt = codeLineNumberTable(t, code);
-  if (lnt) {
+  unsigned length = codeLineNumberCount(t, code);
+  if (length) {
     unsigned bottom = 0;
-    unsigned top = lineNumberTableLength(t, lnt);
+    unsigned top = length;
     for (unsigned span = top - bottom; span; span = top - bottom) {
       unsigned middle = bottom + (span / 2);
-      uint64_t ln = lineNumberTableBody(t, lnt, middle);
+      uint64_t ln = codeLineNumber(t, code, middle);
 
       if (ip >= lineNumberIp(ln)
-          and (middle + 1 == lineNumberTableLength(t, lnt)
-               or ip < lineNumberIp(lineNumberTableBody(t, lnt, middle + 1))))
+          and (middle + 1 == length
+               or ip < lineNumberIp(codeLineNumber(t, code, middle + 1))))
       {
         return lineNumberLine(ln);
       } else if (ip < lineNumberIp(ln)) {
@@ -287,8 +287,8 @@ findLineNumber(Thread* t, object method, unsigned ip)
       }
     }
 
-    if (top < lineNumberTableLength(t, lnt)) {
-      return lineNumberLine(lineNumberTableBody(t, lnt, top));
+    if (top < length) {
+      return lineNumberLine(codeLineNumber(t, code, top));
     } else {
       return UnknownLine;
     }
@@ -0,0 +1,490 @@
+/* Copyright (c) 2008-2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#include "avian/profiler.h"
+#include "avian/processor.h"
+
+using namespace vm;
+
+namespace {
+
+const unsigned DefaultIntervalInMicroseconds = 10 * 1000;
+const unsigned MinimumIntervalInMicroseconds = 100;
+const unsigned DrainIntervalInMilliseconds = 50;
+
+// deeper stacks are truncated, keeping the innermost frames
+const unsigned MaxDepth = 64;
+
+// these must be powers of two
+const unsigned SampleCapacity = 4096;
+const unsigned NameCapacity = 16 * 1024;
+
+const unsigned NamePoolSizeInBytes = 1024 * 1024;
+const unsigned InitialStackCapacity = 1024;
+
+// 64-bit FNV-1a, truncated to a word on 32-bit systems; zero is
+// reserved to mark empty slots in the name table
+uintptr_t
+hash(uint64_t h, const int8_t* s, unsigned length)
+{
+  for (unsigned i = 0; i < length; ++i) {
+    h = (h ^ static_cast<uint8_t>(s[i])) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+class MyProfiler: public Profiler {
+ public:
+  // A sample slot is claimed by the interrupted thread, filled in,
+  // and then published by setting its sequence number to one more
+  // than its position in the ring.  Frames are stored innermost
+  // first, as hashes of their method names.
+  class Sample {
+   public:
+    volatile uintptr_t sequence;
+    unsigned depth;
+    uintptr_t frames[MaxDepth];
+  };
+
+  class Name {
+   public:
+    volatile uintptr_t key;
+    const char* volatile value;
+  };
+
+  class Stack {
+   public:
+    uintptr_t hash;
+    unsigned count;
+    unsigned depth;
+    uintptr_t frames[MaxDepth];
+  };
+
+  class Sampler: public System::ThreadVisitor {
+   public:
+    Sampler(MyProfiler* profiler): profiler(profiler) { }
+
+    virtual void visit(void* ip, void* stack, void* link) {
+      profiler->sample(ip, stack, link);
+    }
+
+    MyProfiler* profiler;
+  };
+
+  class Drainer: public System::Runnable {
+   public:
+    Drainer(MyProfiler* profiler):
+      profiler(profiler), thread(0)
+    { }
+
+    virtual void attach(System::Thread* t) {
+      thread = t;
+    }
+
+    virtual void run() {
+      profiler->run(thread);
+    }
+
+    virtual bool interrupted() {
+      return false;
+    }
+
+    virtual void setInterrupted(bool) { }
+
+    MyProfiler* profiler;
+    System::Thread* thread;
+  };
+
+  MyProfiler(Thread* t, const char* file, unsigned interval):
+    m(t->m),
+    s(t->m->system),
+    allocator(t->m->heap),
+    file(file),
+    sampler(this),
+    drainer(this),
+    samples(static_cast<Sample*>
+            (allocator->allocate(sizeof(Sample) * SampleCapacity))),
+    names(static_cast<Name*>
+          (allocator->allocate(sizeof(Name) * NameCapacity))),
+    pool(static_cast<char*>(allocator->allocate(NamePoolSizeInBytes))),
+    stacks(static_cast<Stack*>
+           (allocator->allocate(sizeof(Stack) * InitialStackCapacity))),
+    stackCapacity(InitialStackCapacity),
+    stackCount(0),
+    head(0),
+    tail(0),
+    poolPosition(0),
+    dropped(0),
+    stopped(false),
+    stopping(false)
+  {
+    memset(samples, 0, sizeof(Sample) * SampleCapacity);
+    memset(names, 0, sizeof(Name) * NameCapacity);
+    memset(stacks, 0, sizeof(Stack) * stackCapacity);
+
+    unattachedFrame = tag("[unattached]");
+    nativeFrame = tag("[native]");
+    exclusiveFrame = tag("[exclusive]");
+    vmFrame = tag("[vm]");
+    unknownFrame = tag("[unknown]");
+
+    expect(s, s->success(s->make(&monitor)));
+    expect(s, s->success(s->make(&tableLock)));
+    expect(s, s->success(s->start(&drainer)));
+
+    if (not s->success(s->handleProfileTick(&sampler, interval))) {
+      fprintf(stderr, "warning: unable to start profiler\n");
+    }
+  }
+
+  uintptr_t tag(const char* name) {
+    return intern(reinterpret_cast<const int8_t*>(name), strlen(name), 0, 0);
+  }
+
+  // Finds or adds the name made of the specified class and method
+  // names (or just the first if the second is null), returning its
+  // hash.  This runs in signal context, so the table is a fixed-size
+  // open addressing scheme which is updated without locks.  If the
+  // table or pool is full, the name is dropped and the frame will be
+  // written as unknown.
+  uintptr_t intern(const int8_t* class_, unsigned classLength,
+                   const int8_t* method, unsigned methodLength)
+  {
+    uint64_t h = hash(0xcbf29ce484222325ULL, class_, classLength);
+    if (method) {
+      h = hash(h, reinterpret_cast<const int8_t*>("."), 1);
+      h = hash(h, method, methodLength);
+    }
+
+    uintptr_t key = h ? h : 1;
+
+    for (unsigned i = 0; i < NameCapacity; ++i) {
+      Name* n = names + ((key + i) & (NameCapacity - 1));
+      if (n->key == key) {
+        return key;
+      } else if (n->key == 0
+                 and atomicCompareAndSwap
+                 (const_cast<uintptr_t*>(&(n->key)), 0, key))
+      {
+        unsigned length = classLength
+          + (method ? 1 + methodLength : 0) + 1;
+
+        uintptr_t offset;
+        do {
+          offset = poolPosition;
+          if (offset + length > NamePoolSizeInBytes) {
+            return key;
+          }
+        } while (not atomicCompareAndSwap
+                 (const_cast<uintptr_t*>(&poolPosition), offset,
+                  offset + length));
+
+        char* p = pool + offset;
+        for (unsigned j = 0; j < classLength; ++j) {
+          *(p++) = class_[j] == '/' ? '.' : class_[j];
+        }
+        if (method) {
+          *(p++) = '.';
+          memcpy(p, method, methodLength);
+          p += methodLength;
+        }
+        *p = 0;
+
+        storeStoreMemoryBarrier();
+
+        n->value = pool + offset;
+        return key;
+      } else if (n->key == key) {
+        // another thread claimed the slot for the same name
+        return key;
+      }
+    }
+
+    return unknownFrame;
+  }
+
+  const char* name(uintptr_t key) {
+    for (unsigned i = 0; i < NameCapacity; ++i) {
+      Name* n = names + ((key + i) & (NameCapacity - 1));
+      if (n->key == key) {
+        const char* value = n->value;
+        loadMemoryBarrier();
+        return value ? value : "[unknown]";
+      } else if (n->key == 0) {
+        break;
+      }
+    }
+    return "[unknown]";
+  }
+
+  class Visitor: public Processor::StackVisitor {
+   public:
+    Visitor(Thread* t, MyProfiler* profiler, Sample* sample):
+      t(t), profiler(profiler), sample(sample)
+    { }
+
+    virtual bool visit(Processor::StackWalker* walker) {
+      if (sample->depth == MaxDepth) {
+        return false;
+      }
+
+      object method = walker->method();
+      object class_ = className(t, methodClass(t, method));
+      object name = methodName(t, method);
+
+      sample->frames[sample->depth++] = profiler->intern
+        (&byteArrayBody(t, class_, 0), byteArrayLength(t, class_) - 1,
+         &byteArrayBody(t, name, 0), byteArrayLength(t, name) - 1);
+
+      return true;
+    }
+
+    Thread* t;
+    MyProfiler* profiler;
+    Sample* sample;
+  };
+
+  void sample(void* ip, void* stack, void* link) {
+    if (not stopped) {
+      uintptr_t index;
+      do {
+        index = head;
+        if (index - tail >= SampleCapacity) {
+          atomicAdd(&dropped, 1);
+          return;
+        }
+      } while (not atomicCompareAndSwap
+               (const_cast<uintptr_t*>(&head), index, index + 1));
+
+      Sample* sample = samples + (index & (SampleCapacity - 1));
+      sample->depth = 0;
+
+      Thread* t = static_cast<Thread*>(m->localThread->get());
+      if (t == 0) {
+        sample->frames[sample->depth++] = unattachedFrame;
+      } else if (t->state == Thread::ActiveState) {
+        // the collector can't run while this thread is active, so
+        // it's safe to look at the heap from here
+        Visitor v(t, this, sample);
+        m->processor->walkInterruptedStack(t, ip, stack, link, &v);
+
+        if (sample->depth == 0) {
+          sample->frames[sample->depth++] = vmFrame;
+        }
+      } else if (t->state == Thread::ExclusiveState) {
+        sample->frames[sample->depth++] = exclusiveFrame;
+      } else {
+        sample->frames[sample->depth++] = nativeFrame;
+      }
+
+      storeStoreMemoryBarrier();
+
+      sample->sequence = index + 1;
+    }
+  }
+
+  Stack* find(Stack* table, unsigned capacity, uintptr_t h, unsigned depth,
+              const uintptr_t* frames)
+  {
+    for (unsigned i = h & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+      Stack* e = table + i;
+      if (e->count == 0
+          or (e->hash == h and e->depth == depth
+              and memcmp(e->frames, frames, depth * BytesPerWord) == 0))
+      {
+        return e;
+      }
+    }
+  }
+
+  void grow() {
+    unsigned newCapacity = stackCapacity * 2;
+    Stack* newStacks = static_cast<Stack*>
+      (allocator->allocate(sizeof(Stack) * newCapacity));
+    memset(newStacks, 0, sizeof(Stack) * newCapacity);
+
+    for (unsigned i = 0; i < stackCapacity; ++i) {
+      Stack* e = stacks + i;
+      if (e->count) {
+        memcpy(find(newStacks, newCapacity, e->hash, e->depth, e->frames),
+               e, sizeof(Stack));
+      }
+    }
+
+    allocator->free(stacks, sizeof(Stack) * stackCapacity);
+    stacks = newStacks;
+    stackCapacity = newCapacity;
+  }
+
+  // Moves published samples from the ring into the table of distinct
+  // stacks.  The caller must hold tableLock.
+  void drain() {
+    while (true) {
+      Sample* sample = samples + (tail & (SampleCapacity - 1));
+      if (sample->sequence != tail + 1) {
+        break;
+      }
+
+      loadMemoryBarrier();
+
+      uintptr_t h = hash(0xcbf29ce484222325ULL,
+                         reinterpret_cast<const int8_t*>(sample->frames),
+                         sample->depth * BytesPerWord);
+
+      Stack* e = find(stacks, stackCapacity, h, sample->depth,
+                      sample->frames);
+      if (e->count == 0) {
+        e->hash = h;
+        e->depth = sample->depth;
+        memcpy(e->frames, sample->frames, sample->depth * BytesPerWord);
+        ++ stackCount;
+      }
+      ++ e->count;
+
+      tail = tail + 1;
+
+      if (stackCount * 4 > stackCapacity * 3) {
+        grow();
+      }
+    }
+  }
+
+  void run(System::Thread* thread) {
+    monitor->acquire(thread);
+    while (not stopping) {
+      monitor->wait(thread, DrainIntervalInMilliseconds);
+
+      tableLock->acquire();
+      drain();
+      tableLock->release();
+    }
+    monitor->release(thread);
+  }
+
+  virtual bool dump(Thread*) {
+    tableLock->acquire();
+
+    drain();
+
+    FILE* out = vm::fopen(file, "wb");
+    if (out) {
+      for (unsigned i = 0; i < stackCapacity; ++i) {
+        Stack* e = stacks + i;
+        if (e->count) {
+          for (unsigned j = e->depth; j > 0; --j) {
+            fprintf(out, j == e->depth ? "%s" : ";%s",
+                    name(e->frames[j - 1]));
+          }
+          fprintf(out, " %u\n", e->count);
+        }
+      }
+
+      if (dropped) {
+        fprintf(out, "[dropped] %u\n", static_cast<unsigned>(dropped));
+      }
+
+      fclose(out);
+    }
+
+    tableLock->release();
+
+    return out != 0;
+  }
+
+  virtual void dispose(Thread* t) {
+    stopped = true;
+
+    // this doesn't return until any handlers which were already
+    // running have finished, so the buffers may be freed below
+    s->handleProfileTick(0, 0);
+
+    monitor->acquire(t->systemThread);
+    stopping = true;
+    monitor->notifyAll(t->systemThread);
+    monitor->release(t->systemThread);
+
+    drainer.thread->join();
+    drainer.thread->dispose();
+
+    if (not dump(t)) {
+      fprintf(stderr, "warning: unable to write profile to %s\n", file);
+    }
+
+    monitor->dispose();
+    tableLock->dispose();
+
+    allocator->free(samples, sizeof(Sample) * SampleCapacity);
+    allocator->free(names, sizeof(Name) * NameCapacity);
+    allocator->free(pool, NamePoolSizeInBytes);
+    allocator->free(stacks, sizeof(Stack) * stackCapacity);
+    allocator->free(file, strlen(file) + 1);
+
+    allocator->free(this, sizeof(*this));
+  }
+
+  Machine* m;
+  System* s;
+  Allocator* allocator;
+  const char* file;
+  Sampler sampler;
+  Drainer drainer;
+  System::Monitor* monitor;
+  System::Mutex* tableLock;
+  Sample* samples;
+  Name* names;
+  char* pool;
+  Stack* stacks;
+  unsigned stackCapacity;
+  unsigned stackCount;
+  volatile uintptr_t head;
+  volatile uintptr_t tail;
+  volatile uintptr_t poolPosition;
+  volatile uintptr_t dropped;
+  volatile bool stopped;
+  bool stopping;
+  uintptr_t unattachedFrame;
+  uintptr_t nativeFrame;
+  uintptr_t exclusiveFrame;
+  uintptr_t vmFrame;
+  uintptr_t unknownFrame;
+};
+
+} // namespace
+
+namespace vm {
+
+Profiler*
+makeProfiler(Thread* t, const char* spec)
+{
+  const char* comma = strchr(spec, ',');
+  unsigned length = comma ? comma - spec : strlen(spec);
+
+  unsigned interval = DefaultIntervalInMicroseconds;
+  if (comma) {
+    if (strncmp(comma + 1, "interval=", 9) == 0) {
+      interval = atoi(comma + 10);
+      if (interval < MinimumIntervalInMicroseconds) {
+        interval = MinimumIntervalInMicroseconds;
+      }
+    } else {
+      fprintf(stderr, "warning: ignoring unrecognized profiler option: %s\n",
+              comma + 1);
+    }
+  }
+
+  char* file = static_cast<char*>(t->m->heap->allocate(length + 1));
+  memcpy(file, spec, length);
+  file[length] = 0;
+
+  return new (t->m->heap->allocate(sizeof(MyProfiler)))
+    MyProfiler(t, file, interval);
+}
+
+} // namespace vm
@@ -0,0 +1,334 @@
+/* Copyright (c) 2008-2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+// Runs the programs in bench/ under one or more VM builds, reports
+// throughput and per-operation latency percentiles for each, and
+// compares the throughput against a baseline file written by an
+// earlier run.  Each benchmark is run several times and the run with
+// the median throughput is reported, so that one noisy run neither
+// causes nor hides a regression.  Each line of a baseline file has the form
+//
+//   <configuration> <benchmark> <operations per second>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  define popen _popen
+#  define pclose _pclose
+#endif
+
+namespace {
+
+const unsigned DefaultBatches = 20;
+const unsigned DefaultWarmups = 3;
+const unsigned DefaultRuns = 3;
+const double DefaultTolerance = 10;
+
+struct Vm {
+  const char* label;
+  const char* executable;
+};
+
+struct Measurement {
+  double opsPerSecond;
+  double p50;
+  double p90;
+  double p99;
+};
+
+struct Result {
+  const char* label;
+  const char* benchmark;
+  double opsPerSecond;
+};
+
+struct Results {
+  Results(): array(0), count(0), capacity(0) { }
+
+  void append(const char* label, const char* benchmark, double opsPerSecond)
+  {
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      array = static_cast<Result*>
+        (realloc(array, capacity * sizeof(Result)));
+    }
+
+    array[count].label = label;
+    array[count].benchmark = benchmark;
+    array[count].opsPerSecond = opsPerSecond;
+    ++ count;
+  }
+
+  const Result* find(const char* label, const char* benchmark) const {
+    for (unsigned i = 0; i < count; ++i) {
+      if (strcmp(array[i].label, label) == 0
+          and strcmp(array[i].benchmark, benchmark) == 0)
+      {
+        return array + i;
+      }
+    }
+    return 0;
+  }
+
+  Result* array;
+  unsigned count;
+  unsigned capacity;
+};
+
+void
+usageAndExit(const char* name)
+{
+  fprintf(stderr, "usage: %s [-batches <count>] [-warmups <count>] "
+          "[-runs <count>] [-baseline <file>] [-output <file>] [-tolerance <percent>] "
+          "-cp <classpath> -vm <configuration> <executable> "
+          "[-vm <configuration> <executable> ...] <benchmark> ...\n",
+          name);
+  exit(-1);
+}
+
+char*
+copy(const char* s)
+{
+  unsigned length = strlen(s);
+  char* p = static_cast<char*>(malloc(length + 1));
+  memcpy(p, s, length + 1);
+  return p;
+}
+
+bool
+readBaseline(const char* path, Results* results)
+{
+  FILE* in = fopen(path, "rb");
+  if (in == 0) {
+    fprintf(stderr, "unable to open baseline %s\n", path);
+    return false;
+  }
+
+  char label[256];
+  char benchmark[256];
+  double opsPerSecond;
+  while (fscanf(in, "%255s %255s %lf", label, benchmark, &opsPerSecond)
+         == 3)
+  {
+    results->append(copy(label), copy(benchmark), opsPerSecond);
+  }
+
+  fclose(in);
+  return true;
+}
+
+int
+compareDoubles(const void* a, const void* b)
+{
+  double x = *static_cast<const double*>(a);
+  double y = *static_cast<const double*>(b);
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+double
+percentile(const double* sorted, unsigned count, unsigned percent)
+{
+  unsigned index = (count * percent + 99) / 100;
+  return sorted[index == 0 ? 0 : index - 1];
+}
+
+int
+compareMeasurements(const void* a, const void* b)
+{
+  return compareDoubles
+    (&static_cast<const Measurement*>(a)->opsPerSecond,
+     &static_cast<const Measurement*>(b)->opsPerSecond);
+}
+
+// runs one benchmark under one VM once, returning false if it failed
+bool
+run(const Vm* vm, const char* classpath, const char* benchmark,
+    unsigned batches, unsigned warmups, Measurement* measurement)
+{
+  char command[4096];
+  snprintf(command, sizeof(command), "\"%s\" -cp \"%s\" %s %u %u",
+           vm->executable, classpath, benchmark, batches, warmups);
+
+  FILE* in = popen(command, "r");
+  if (in == 0) {
+    fprintf(stderr, "unable to run %s\n", command);
+    return false;
+  }
+
+  double* nanosPerOp = static_cast<double*>
+    (malloc(batches * sizeof(double)));
+  unsigned count = 0;
+  double totalOperations = 0;
+  double totalNanos = 0;
+
+  char line[256];
+  while (fgets(line, sizeof(line), in)) {
+    double operations;
+    double nanos;
+    if (sscanf(line, "batch %lf %lf", &operations, &nanos) == 2
+        and operations > 0 and count < batches)
+    {
+      nanosPerOp[count++] = nanos / operations;
+      totalOperations += operations;
+      totalNanos += nanos;
+    }
+  }
+
+  int status = pclose(in);
+  bool success = status == 0 and count and totalNanos > 0;
+  if (success) {
+    qsort(nanosPerOp, count, sizeof(double), compareDoubles);
+    measurement->opsPerSecond = totalOperations * 1e9 / totalNanos;
+    measurement->p50 = percentile(nanosPerOp, count, 50);
+    measurement->p90 = percentile(nanosPerOp, count, 90);
+    measurement->p99 = percentile(nanosPerOp, count, 99);
+  } else {
+    fprintf(stderr, "%s failed under %s (status %d, %u batches)\n",
+            benchmark, vm->label, status, count);
+  }
+
+  free(nanosPerOp);
+  return success;
+}
+
+} // namespace
+
+int
+main(int ac, const char** av)
+{
+  unsigned batches = DefaultBatches;
+  unsigned warmups = DefaultWarmups;
+  unsigned runs = DefaultRuns;
+  double tolerance = DefaultTolerance;
+  const char* baselinePath = 0;
+  const char* outputPath = 0;
+  const char* classpath = 0;
+
+  Vm* vms = static_cast<Vm*>(malloc(ac * sizeof(Vm)));
+  unsigned vmCount = 0;
+  const char** benchmarks = static_cast<const char**>
+    (malloc(ac * sizeof(const char*)));
+  unsigned benchmarkCount = 0;
+
+  for (int i = 1; i < ac; ++i) {
+    if (strcmp(av[i], "-batches") == 0 and i + 1 < ac) {
+      batches = atoi(av[++i]);
+    } else if (strcmp(av[i], "-warmups") == 0 and i + 1 < ac) {
+      warmups = atoi(av[++i]);
+    } else if (strcmp(av[i], "-runs") == 0 and i + 1 < ac) {
+      runs = atoi(av[++i]);
+    } else if (strcmp(av[i], "-tolerance") == 0 and i + 1 < ac) {
+      tolerance = atof(av[++i]);
+    } else if (strcmp(av[i], "-baseline") == 0 and i + 1 < ac) {
+      baselinePath = av[++i];
+    } else if (strcmp(av[i], "-output") == 0 and i + 1 < ac) {
+      outputPath = av[++i];
+    } else if (strcmp(av[i], "-cp") == 0 and i + 1 < ac) {
+      classpath = av[++i];
+    } else if (strcmp(av[i], "-vm") == 0 and i + 2 < ac) {
+      vms[vmCount].label = av[++i];
+      vms[vmCount].executable = av[++i];
+      ++ vmCount;
+    } else if (av[i][0] == '-') {
+      usageAndExit(av[0]);
+    } else {
+      benchmarks[benchmarkCount++] = av[i];
+    }
+  }
+
+  if (classpath == 0 or vmCount == 0 or benchmarkCount == 0
+      or batches == 0 or runs == 0)
+  {
+    usageAndExit(av[0]);
+  }
+
+  Results baseline;
+  if (baselinePath and not readBaseline(baselinePath, &baseline)) {
+    return -1;
+  }
+
+  fprintf(stdout, "%-28s %-14s %14s %10s %10s %10s\n", "configuration",
+          "benchmark", "ops/sec", "p50 ns/op", "p90 ns/op", "p99 ns/op");
+
+  Measurement* measurements = static_cast<Measurement*>
+    (malloc(runs * sizeof(Measurement)));
+
+  Results results;
+  unsigned failures = 0;
+  unsigned regressions = 0;
+  for (unsigned i = 0; i < vmCount; ++i) {
+    for (unsigned j = 0; j < benchmarkCount; ++j) {
+      unsigned count = 0;
+      while (count < runs and run(vms + i, classpath, benchmarks[j],
+                                  batches, warmups, measurements + count))
+      {
+        ++ count;
+      }
+
+      if (count < runs) {
+        ++ failures;
+        continue;
+      }
+
+      qsort(measurements, count, sizeof(Measurement), compareMeasurements);
+      const Measurement* median = measurements + (count / 2);
+      double opsPerSecond = median->opsPerSecond;
+
+      fprintf(stdout, "%-28s %-14s %14.0f %10.1f %10.1f %10.1f",
+              vms[i].label, benchmarks[j], opsPerSecond,
+              median->p50, median->p90, median->p99);
+
+      results.append(vms[i].label, benchmarks[j], opsPerSecond);
+
+      const Result* old = baseline.find(vms[i].label, benchmarks[j]);
+      if (old and old->opsPerSecond > 0) {
+        double change = (opsPerSecond - old->opsPerSecond) * 100
+          / old->opsPerSecond;
+
+        fprintf(stdout, " %+7.1f%%", change);
+
+        if (change < -tolerance) {
+          fprintf(stdout, " regression");
+          ++ regressions;
+        }
+      }
+
+      fprintf(stdout, "\n");
+      fflush(stdout);
+    }
+  }
+
+  free(measurements);
+
+  if (outputPath) {
+    FILE* out = fopen(outputPath, "wb");
+    if (out == 0) {
+      fprintf(stderr, "unable to open %s\n", outputPath);
+      return -1;
+    }
+
+    for (unsigned i = 0; i < results.count; ++i) {
+      fprintf(out, "%s %s %.0f\n", results.array[i].label,
+              results.array[i].benchmark, results.array[i].opsPerSecond);
+    }
+
+    fclose(out);
+  }
+
+  if (regressions) {
+    fprintf(stderr, "%u benchmark(s) regressed by more than %.1f%%\n",
+            regressions, tolerance);
+  }
+
+  return failures or regressions ? -1 : 0;
+}
@@ -274,10 +274,350 @@ targetFieldOffset(Thread* t, object typeMaps, object field)
     ->targetFixedOffsets()[fieldOffset(t, field)];
 }
 
+int32_t
+codeInt32At(Thread* t, object code, unsigned ip)
+{
+  return (codeBody(t, code, ip) << 24) | (codeBody(t, code, ip + 1) << 16)
+    | (codeBody(t, code, ip + 2) << 8) | codeBody(t, code, ip + 3);
+}
+
+unsigned
+instructionLength(Thread* t, object code, unsigned ip)
+{
+  switch (codeBody(t, code, ip)) {
+  case bipush: case ldc: case newarray: case ret:
+  case iload: case lload: case fload: case dload: case aload:
+  case istore: case lstore: case fstore: case dstore: case astore:
+    return 2;
+
+  case sipush: case ldc_w: case ldc2_w: case iinc:
+  case ifeq: case ifne: case iflt: case ifge: case ifgt: case ifle:
+  case if_icmpeq: case if_icmpne: case if_icmplt: case if_icmpge:
+  case if_icmpgt: case if_icmple: case if_acmpeq: case if_acmpne:
+  case ifnull: case ifnonnull: case goto_: case jsr:
+  case getstatic: case putstatic: case getfield: case putfield:
+  case invokevirtual: case invokespecial: case invokestatic:
+  case new_: case anewarray: case checkcast: case instanceof:
+    return 3;
+
+  case multianewarray:
+    return 4;
+
+  case invokeinterface: case goto_w: case jsr_w:
+    return 5;
+
+  case wide:
+    return codeBody(t, code, ip + 1) == iinc ? 6 : 4;
+
+  case tableswitch: {
+    unsigned base = (ip + 4) & ~3;
+    int32_t bottom = codeInt32At(t, code, base + 4);
+    int32_t top = codeInt32At(t, code, base + 8);
+    return base + 12 + ((top - bottom + 1) * 4) - ip;
+  }
+
+  case lookupswitch: {
+    unsigned base = (ip + 4) & ~3;
+    int32_t pairCount = codeInt32At(t, code, base + 4);
+    return base + 8 + (pairCount * 8) - ip;
+  }
+
+  default:
+    return 1;
+  }
+}
+
+class InvocationVisitor {
+ public:
+  virtual void visit(Thread* t, unsigned instruction, object target) = 0;
+};
+
+void
+visitInvocations(Thread* t, object method, InvocationVisitor* v)
+{
+  PROTECT(t, method);
+
+  for (unsigned ip = 0; ip < codeLength(t, methodCode(t, method));) {
+    object code = methodCode(t, method);
+    unsigned instruction = codeBody(t, code, ip);
+    switch (instruction) {
+    case invokeinterface:
+    case invokespecial:
+    case invokestatic:
+    case invokevirtual: {
+      unsigned index = (codeBody(t, code, ip + 1) << 8)
+        | codeBody(t, code, ip + 2);
+
+      object target = resolveMethod(t, method, index - 1, false);
+      if (target) {
+        v->visit(t, instruction, target);
+      }
+    } break;
+
+    default: break;
+    }
+
+    ip += instructionLength(t, methodCode(t, method), ip);
+  }
+}
+
+void
+addOverrider(Thread* t, object overriders, object method, object overrider)
+{
+  PROTECT(t, overriders);
+  PROTECT(t, method);
+  PROTECT(t, overrider);
+
+  object list = hashMapFind(t, overriders, method, objectHash, objectEqual);
+  for (object p = list; p; p = pairSecond(t, p)) {
+    if (pairFirst(t, p) == overrider) {
+      return;
+    }
+  }
+
+  hashMapInsertOrReplace
+    (t, overriders, method, makePair(t, overrider, list), objectHash,
+     objectEqual);
+}
+
+// Builds a map from each method in the boot classpath to the list of
+// methods which override or implement it.  This is a closed-world
+// analysis: we assume no classes will be loaded at runtime other
+// than those we see here.
+object
+findOverriders(Thread* t)
+{
+  object overriders = makeHashMap(t, 0, 0);
+  PROTECT(t, overriders);
+
+  for (HashMapIterator it(t, classLoaderMap(t, root(t, Machine::BootLoader)));
+       it.hasMore();)
+  {
+    object c = tripleSecond(t, it.next());
+    PROTECT(t, c);
+
+    if (classFlags(t, c) & ACC_INTERFACE) {
+      continue;
+    }
+
+    object super = classSuper(t, c);
+    if (super and classVirtualTable(t, super)) {
+      for (unsigned i = 0; i < arrayLength(t, classVirtualTable(t, super));
+           ++i)
+      {
+        object method = arrayBody(t, classVirtualTable(t, c), i);
+        object overridden = arrayBody(t, classVirtualTable(t, super), i);
+        if (method != overridden) {
+          addOverrider(t, overriders, overridden, method);
+        }
+      }
+    }
+
+    object itable = classInterfaceTable(t, c);
+    if (itable) {
+      PROTECT(t, itable);
+
+      for (unsigned i = 0; i < arrayLength(t, itable); i += 2) {
+        object interface = arrayBody(t, itable, i);
+        PROTECT(t, interface);
+
+        object methods = arrayBody(t, itable, i + 1);
+        if (methods) {
+          PROTECT(t, methods);
+
+          for (unsigned j = 0; j < arrayLength(t, methods); ++j) {
+            addOverrider
+              (t, overriders,
+               arrayBody(t, classVirtualTable(t, interface), j),
+               arrayBody(t, methods, j));
+          }
+        }
+      }
+    }
+  }
+
+  return overriders;
+}
+
+void
+markEffectivelyFinal(Thread* t, object overriders)
+{
+  for (HashMapIterator it(t, classLoaderMap(t, root(t, Machine::BootLoader)));
+       it.hasMore();)
+  {
+    object c = tripleSecond(t, it.next());
+    if ((classFlags(t, c) & ACC_INTERFACE) == 0 and classMethodTable(t, c)) {
+      for (unsigned i = 0; i < arrayLength(t, classMethodTable(t, c)); ++i) {
+        object method = arrayBody(t, classMethodTable(t, c), i);
+        if (methodVirtual(t, method)
+            and (methodFlags(t, method) & ACC_ABSTRACT) == 0
+            and hashMapFind
+            (t, overriders, method, objectHash, objectEqual) == 0)
+        {
+          methodVmFlags(t, method) |= EffectivelyFinalFlag;
+        }
+      }
+    }
+  }
+}
+
+bool
+nameEqual(Thread* t, object name, const char* s)
+{
+  return ::strcmp(reinterpret_cast<char*>(&byteArrayBody(t, name, 0)), s)
+    == 0;
+}
+
+bool
+nameStartsWith(Thread* t, object name, const char* prefix)
+{
+  return ::strncmp
+    (reinterpret_cast<char*>(&byteArrayBody(t, name, 0)), prefix,
+     strlen(prefix)) == 0;
+}
+
+// Returns true if the specified method may be called by means other
+// than bytecode we can see, e.g. by the VM itself.  This need not be
+// exact, since any method we miss will still be compiled on demand at
+// runtime.
+bool
+isRoot(Thread* t, object method, const char* className,
+       const char* methodName, const char* methodSpec)
+{
+  object class_ = methodClass(t, method);
+
+  if (className) {
+    if (nameEqual(t, vm::className(t, class_), className)
+        and (methodName == 0
+             or nameEqual(t, vm::methodName(t, method), methodName))
+        and (methodSpec == 0
+             or nameEqual(t, vm::methodSpec(t, method), methodSpec)))
+    {
+      return true;
+    }
+  } else if ((methodFlags(t, method) & ACC_STATIC)
+             and nameEqual(t, vm::methodName(t, method), "main")
+             and nameEqual
+             (t, vm::methodSpec(t, method), "([Ljava/lang/String;)V"))
+  {
+    return true;
+  }
+
+  return (methodVmFlags(t, method) & ClassInitFlag)
+    or nameStartsWith(t, vm::className(t, class_), "avian/")
+    or (nameEqual(t, vm::methodSpec(t, method), "()V")
+        and (nameEqual(t, vm::methodName(t, method), "run")
+             or nameEqual(t, vm::methodName(t, method), "finalize")))
+    or ((methodVmFlags(t, method) & ConstructorFlag)
+        and isAssignableFrom
+        (t, type(t, Machine::ThrowableType), class_));
+}
+
+void
+reach(Thread* t, object reachable, object* worklist, object method)
+{
+  if (hashMapFind(t, reachable, method, objectHash, objectEqual) == 0) {
+    PROTECT(t, reachable);
+    PROTECT(t, method);
+
+    hashMapInsert(t, reachable, method, method, objectHash);
+
+    *worklist = makePair(t, method, *worklist);
+  }
+}
+
+// Marks every method with code which cannot be reached from the roots
+// identified by isRoot so that it will be left for the JIT to compile
+// on demand.  Returns the number of methods so marked.
+unsigned
+markUnreachable(Thread* t, object overriders, const char* className,
+                const char* methodName, const char* methodSpec)
+{
+  PROTECT(t, overriders);
+
+  object reachable = makeHashMap(t, 0, 0);
+  PROTECT(t, reachable);
+
+  object worklist = 0;
+  PROTECT(t, worklist);
+
+  for (HashMapIterator it(t, classLoaderMap(t, root(t, Machine::BootLoader)));
+       it.hasMore();)
+  {
+    object c = tripleSecond(t, it.next());
+    if (classMethodTable(t, c)) {
+      PROTECT(t, c);
+
+      for (unsigned i = 0; i < arrayLength(t, classMethodTable(t, c)); ++i) {
+        object method = arrayBody(t, classMethodTable(t, c), i);
+        if (isRoot(t, method, className, methodName, methodSpec)) {
+          reach(t, reachable, &worklist, method);
+        }
+      }
+    }
+  }
+
+  class Visitor: public InvocationVisitor {
+   public:
+    Visitor(object* reachable, object* worklist):
+      reachable(reachable), worklist(worklist)
+    { }
+
+    virtual void visit(Thread* t, unsigned, object target) {
+      reach(t, *reachable, worklist, target);
+    }
+
+    object* reachable;
+    object* worklist;
+  } visitor(&reachable, &worklist);
+
+  while (worklist) {
+    object method = pairFirst(t, worklist);
+    worklist = pairSecond(t, worklist);
+    PROTECT(t, method);
+
+    if (methodCode(t, method)) {
+      visitInvocations(t, method, &visitor);
+    }
+
+    // a method reached by virtual or interface dispatch may resolve
+    // to any method which overrides it:
+    for (object p = hashMapFind
+           (t, overriders, method, objectHash, objectEqual);
+         p; p = pairSecond(t, p))
+    {
+      PROTECT(t, p);
+      reach(t, reachable, &worklist, pairFirst(t, p));
+    }
+  }
+
+  unsigned count = 0;
+  for (HashMapIterator it(t, classLoaderMap(t, root(t, Machine::BootLoader)));
+       it.hasMore();)
+  {
+    object c = tripleSecond(t, it.next());
+    if (classMethodTable(t, c)) {
+      for (unsigned i = 0; i < arrayLength(t, classMethodTable(t, c)); ++i) {
+        object method = arrayBody(t, classMethodTable(t, c), i);
+        if (methodCode(t, method)
+            and hashMapFind
+            (t, reachable, method, objectHash, objectEqual) == 0)
+        {
+          methodVmFlags(t, method) |= LazyCompileFlag;
+          ++ count;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
 object
 makeCodeImage(Thread* t, Zone* zone, BootImage* image, uint8_t* code,
-              const char* className, const char* methodName,
-              const char* methodSpec, object typeMaps)
+              target_uintptr_t codeBase, const char* className,
+              const char* methodName, const char* methodSpec,
+              object typeMaps, bool devirtualize, bool stripUnreachable)
 {
   PROTECT(t, typeMaps);
 
@@ -595,6 +935,40 @@ makeCodeImage(Thread* t, Zone* zone, BootImage* image, uint8_t* code,
     }
   }
 
+  unsigned lazyCount = 0;
+  if (devirtualize or stripUnreachable) {
+    object overriders = findOverriders(t);
+    PROTECT(t, overriders);
+
+    if (devirtualize) {
+      markEffectivelyFinal(t, overriders);
+    }
+
+    if (stripUnreachable) {
+      lazyCount = markUnreachable
+        (t, overriders, className, methodName, methodSpec);
+    }
+  }
+
+  class CallSiteCounter: public InvocationVisitor {
+   public:
+    CallSiteCounter(): virtualCount(0), directCount(0) { }
+
+    virtual void visit(Thread* t, unsigned instruction, object target) {
+      if (instruction == invokevirtual and methodVirtual(t, target)) {
+        ++ virtualCount;
+        if (methodVmFlags(t, target) & EffectivelyFinalFlag) {
+          ++ directCount;
+        }
+      }
+    }
+
+    unsigned virtualCount;
+    unsigned directCount;
+  } callSiteCounter;
+
+  unsigned compiledCount = 0;
+
   for (Finder::Iterator it(finder); it.hasMore();) {
     unsigned nameSize = 0;
     const char* name = it.next(&nameSize);
@@ -624,8 +998,16 @@ makeCodeImage(Thread* t, Zone* zone, BootImage* image, uint8_t* code,
                       (t, vm::methodSpec(t, method), 0)), methodSpec)
                     == 0)))
           {
-            if (methodCode(t, method)
-                or (methodFlags(t, method) & ACC_NATIVE))
+            if (methodVmFlags(t, method) & LazyCompileFlag) {
+              // leave this method pointing at the default thunk so
+              // the JIT will compile it if it is ever called:
+              codeCompiled(t, methodCode(t, method))
+                = reinterpret_cast<uintptr_t>
+                (code + image->thunks.default_.start);
+
+              methods = makePair(t, method, methods);
+            } else if (methodCode(t, method)
+                       or (methodFlags(t, method) & ACC_NATIVE))
             {
               PROTECT(t, method);
 
@@ -634,6 +1016,12 @@ makeCodeImage(Thread* t, Zone* zone, BootImage* image, uint8_t* code,
 
               if (methodCode(t, method)) {
                 methods = makePair(t, method, methods);
+
+                ++ compiledCount;
+
+                if (devirtualize) {
+                  visitInvocations(t, method, &callSiteCounter);
+                }
               }
             }
 
@@ -690,11 +1078,21 @@ makeCodeImage(Thread* t, Zone* zone, BootImage* image, uint8_t* code,
 
   for (; methods; methods = pairSecond(t, methods)) {
     codeCompiled(t, methodCode(t, pairFirst(t, methods)))
-      -= reinterpret_cast<uintptr_t>(code);
+      += codeBase - reinterpret_cast<uintptr_t>(code);
   }
 
   t->m->processor->normalizeVirtualThunks(t);
 
+  if (stripUnreachable) {
+    fprintf(stderr, "compiled %d methods, left %d unreachable methods "
+            "to the JIT\n", compiledCount, lazyCount);
+  }
+
+  if (devirtualize) {
+    fprintf(stderr, "devirtualized %d of %d virtual call sites\n",
+            callSiteCounter.directCount, callSiteCounter.virtualCount);
+  }
+
   return constants;
 }
 
@@ -1266,6 +1664,55 @@ updateConstants(Thread* t, object constants, HeapMap* heapTable)
   }
 }
 
+void
+relocateHeap(target_uintptr_t* map, unsigned size, target_uintptr_t* heap,
+             target_uintptr_t address)
+{
+  for (unsigned word = 0; word < size; ++word) {
+    target_uintptr_t w = targetVW(map[word]);
+    if (w) {
+      for (unsigned bit = 0; bit < TargetBitsPerWord; ++bit) {
+        if (w & (static_cast<target_uintptr_t>(1) << bit)) {
+          unsigned index = (word * TargetBitsPerWord) + bit;
+
+          target_uintptr_t v = targetVW(heap[index]);
+          target_uintptr_t number = v & TargetBootMask;
+          target_uintptr_t mark = v >> TargetBootShift;
+
+          if (number) {
+            heap[index] = targetVW
+              ((address + ((number - 1) * TargetBytesPerWord)) | mark);
+          } else {
+            heap[index] = targetVW(mark);
+          }
+        }
+      }
+    }
+  }
+}
+
+void
+writeImageFile(OutputStream* out, BootImageFile* file, uint8_t* code,
+               Buffer* bootimageData)
+{
+  BootImageFile targetFile;
+  targetFile.magic = targetV4(file->magic);
+  targetFile.codeOffset = targetV4(file->codeOffset);
+  targetFile.codeSize = targetV4(file->codeSize);
+  targetFile.imageOffset = targetV4(file->imageOffset);
+  targetFile.imageSize = targetV4(file->imageSize);
+  targetFile.base = targetV8(file->base);
+
+  out->writeChunk(&targetFile, sizeof(BootImageFile));
+  out->writeRepeat(0, file->codeOffset - sizeof(BootImageFile));
+
+  out->writeChunk(code, file->codeSize);
+  out->writeRepeat
+    (0, file->imageOffset - (file->codeOffset + file->codeSize));
+
+  out->writeChunk(bootimageData->data, bootimageData->length);
+}
+
 BootImage::Thunk
 targetThunk(BootImage::Thunk t)
 {
@@ -1275,11 +1722,12 @@ targetThunk(BootImage::Thunk t)
 
 void
 writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutput,
+                OutputStream* imageOutput, uint64_t imageBase,
                 BootImage* image, uint8_t* code, const char* className,
                 const char* methodName, const char* methodSpec,
                 const char* bootimageStart, const char* bootimageEnd,
                 const char* codeimageStart, const char* codeimageEnd,
-                bool useLZMA)
+                bool useLZMA, bool devirtualize, bool stripUnreachable)
 {
   setRoot(t, Machine::OutOfMemoryError,
           make(t, type(t, Machine::OutOfMemoryErrorType)));
@@ -1469,15 +1917,20 @@ writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutp
          objectHash);
     }
 
+    // when writing a relocated image file, the code will be found
+    // right after the first ImageFileAlignment-sized page of the file:
+    image->codeBase = imageBase ? imageBase + ImageFileAlignment : 0;
+
     constants = makeCodeImage
-      (t, &zone, image, code, className, methodName, methodSpec, typeMaps);
+      (t, &zone, image, code, image->codeBase, className, methodName,
+       methodSpec, typeMaps, devirtualize, stripUnreachable);
 
     PROTECT(t, constants);
 
     // these roots will not be used when the bootimage is loaded, so
     // there's no need to preserve them:
     setRoot(t, Machine::PoolMap, 0);
-    setRoot(t, Machine::ByteArrayMap, makeWeakHashMap(t, 0, 0));
+    setRoot(t, Machine::ByteArrayMap, makeWeakHashMap(t, 0, 0, 0));
 
     // name all primitive classes so we don't try to update immutable
     // references at runtime:
@@ -1585,11 +2038,13 @@ writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutp
   unsigned* stringTable = static_cast<unsigned*>
     (t->m->heap->allocate(image->stringCount * sizeof(unsigned)));
 
-  { unsigned i = 0;
-    for (HashMapIterator it(t, root(t, Machine::StringMap)); it.hasMore();) {
-      stringTable[i++] = targetVW
-        (heapWalker->map()->find
-         (jreferenceTarget(t, tripleFirst(t, it.next()))));
+  { object array = hashMapArray(t, root(t, Machine::StringMap));
+    unsigned i = 0;
+    for (unsigned j = 0; array and j < arrayLength(t, array); ++j) {
+      for (object n = arrayBody(t, array, j); n; n = weakNodeNext(t, n)) {
+        stringTable[i++] = targetVW
+          (heapWalker->map()->find(weakNodeKey(t, n)));
+      }
     }
   }
 
@@ -1605,6 +2060,31 @@ writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutp
           image->bootClassCount, image->stringCount, image->callCount,
           image->heapSize, image->codeSize);
 
+  BootImageFile file;
+  file.magic = BootImageFile::Magic;
+  file.codeOffset = ImageFileAlignment;
+  file.codeSize = image->codeSize;
+  file.imageOffset = pad(file.codeOffset + file.codeSize, ImageFileAlignment);
+  file.base = imageBase;
+
+  unsigned heapOffset = pad
+    (sizeof(BootImage)
+     + (image->bootClassCount * sizeof(unsigned))
+     + (image->appClassCount * sizeof(unsigned))
+     + (image->stringCount * sizeof(unsigned))
+     + (image->callCount * sizeof(unsigned) * 2), TargetBytesPerWord)
+    + pad(heapMapSize(image->heapSize), TargetBytesPerWord);
+
+  if (imageBase) {
+    image->heapBase = imageBase + file.imageOffset + heapOffset;
+
+    relocateHeap
+      (heapMap, ceilingDivide(heapMapSize(image->heapSize), TargetBytesPerWord),
+       heap, image->heapBase);
+  } else {
+    image->heapBase = 0;
+  }
+
   Buffer bootimageData;
 
   if (true) {
@@ -1623,6 +2103,9 @@ writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutp
 #include "bootimage-fields.cpp"
 #undef THUNK_FIELD
 
+      targetImage.heapBase = targetV8(image->heapBase);
+      targetImage.codeBase = targetV8(image->codeBase);
+
       bootimageData.write(&targetImage, sizeof(BootImage));
     }
 
@@ -1647,6 +2130,21 @@ writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutp
 
     bootimageData.write(heap, pad(image->heapSize, TargetBytesPerWord));
 
+    expect(t, offset + pad(heapMapSize(image->heapSize), TargetBytesPerWord)
+           == heapOffset);
+
+    if (imageOutput) {
+      file.imageSize = bootimageData.length;
+
+      writeImageFile(imageOutput, &file, code, &bootimageData);
+
+      for(SymbolInfo* sym = compilationHandler.symbols.begin(); sym != compilationHandler.symbols.end(); sym++) {
+        t->m->heap->free(const_cast<void*>((const void*)sym->name.text), sym->name.length + 1);
+      }
+
+      return;
+    }
+
     // fwrite(code, pad(image->codeSize, TargetBytesPerWord), 1, codeOutput);
     
     Platform* platform = Platform::getPlatform(PlatformInfo((PlatformInfo::Format)AVIAN_TARGET_FORMAT, (PlatformInfo::Architecture)AVIAN_TARGET_ARCH));
@@ -1666,7 +2164,8 @@ writeBootImage2(Thread* t, OutputStream* bootimageOutput, OutputStream* codeOutp
     if (useLZMA) {
 #ifdef AVIAN_USE_LZMA
       bootimage = encodeLZMA(t->m->system, t->m->heap, bootimageData.data,
-                             bootimageData.length, &bootimageLength);
+                             bootimageData.length, &bootimageLength,
+                             LZMAChunkSize);
 
       fprintf(stderr, "compressed heap size %d\n", bootimageLength);
 #else
@@ -1710,11 +2209,15 @@ writeBootImage(Thread* t, uintptr_t* arguments)
   const char* codeimageStart = reinterpret_cast<const char*>(arguments[9]);
   const char* codeimageEnd = reinterpret_cast<const char*>(arguments[10]);
   bool useLZMA = arguments[11];
+  OutputStream* imageOutput = reinterpret_cast<OutputStream*>(arguments[12]);
+  uint64_t imageBase = *reinterpret_cast<uint64_t*>(arguments[13]);
+  bool devirtualize = arguments[14];
+  bool stripUnreachable = arguments[15];
 
   writeBootImage2
-    (t, bootimageOutput, codeOutput, image, code, className, methodName,
-     methodSpec, bootimageStart, bootimageEnd, codeimageStart, codeimageEnd,
-     useLZMA);
+    (t, bootimageOutput, codeOutput, imageOutput, imageBase, image, code,
+     className, methodName, methodSpec, bootimageStart, bootimageEnd,
+     codeimageStart, codeimageEnd, useLZMA, devirtualize, stripUnreachable);
 
   return 1;
 }
@@ -1818,6 +2321,197 @@ void ArgParser::printUsage(const char* exe) {
   }
 }
 
+class ClassDigest {
+ public:
+  uint64_t name;
+  uint64_t content;
+};
+
+const uint32_t CacheMagic = 0x42494331;
+
+uint64_t
+hashBytes(uint64_t h, const void* data, unsigned length)
+{
+  // 64-bit FNV-1a
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  for (unsigned i = 0; i < length; ++i) {
+    h = (h ^ p[i]) * 0x100000001b3LL;
+  }
+  return h;
+}
+
+uint64_t
+hashString(uint64_t h, const char* s)
+{
+  return s ? hashBytes(h, s, strlen(s) + 1) : hashBytes(h, "", 1);
+}
+
+int
+compareDigests(const void* a, const void* b)
+{
+  uint64_t an = static_cast<const ClassDigest*>(a)->name;
+  uint64_t bn = static_cast<const ClassDigest*>(b)->name;
+  return an < bn ? -1 : (an > bn ? 1 : 0);
+}
+
+// A record of the class files and options used to produce a boot
+// image, used to avoid regenerating an image whose inputs have not
+// changed since the last run.
+class Cache {
+ public:
+  Cache(): options(0), count(0), capacity(0), digests(0) { }
+
+  ~Cache() {
+    ::free(digests);
+  }
+
+  void add(uint64_t name, uint64_t content) {
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      digests = static_cast<ClassDigest*>
+        (realloc(digests, capacity * sizeof(ClassDigest)));
+    }
+    digests[count].name = name;
+    digests[count].content = content;
+    ++ count;
+  }
+
+  void sort() {
+    qsort(digests, count, sizeof(ClassDigest), compareDigests);
+  }
+
+  bool read(const char* path) {
+    FILE* in = fopen(path, "rb");
+    if (in == 0) {
+      return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t n = 0;
+    bool success = fread(&magic, sizeof(uint32_t), 1, in) == 1
+      and magic == CacheMagic
+      and fread(&options, sizeof(uint64_t), 1, in) == 1
+      and fread(&n, sizeof(uint32_t), 1, in) == 1;
+
+    for (unsigned i = 0; success and i < n; ++i) {
+      ClassDigest d;
+      success = fread(&d, sizeof(ClassDigest), 1, in) == 1;
+      if (success) {
+        add(d.name, d.content);
+      }
+    }
+
+    fclose(in);
+    return success;
+  }
+
+  bool write(const char* path) {
+    FILE* out = fopen(path, "wb");
+    if (out == 0) {
+      return false;
+    }
+
+    uint32_t n = count;
+    bool success = fwrite(&CacheMagic, sizeof(uint32_t), 1, out) == 1
+      and fwrite(&options, sizeof(uint64_t), 1, out) == 1
+      and fwrite(&n, sizeof(uint32_t), 1, out) == 1
+      and fwrite(digests, sizeof(ClassDigest), count, out) == count;
+
+    return fclose(out) == 0 and success;
+  }
+
+  // Counts the classes which were added, removed, or modified
+  // relative to the specified (sorted) cache.
+  unsigned difference(Cache* old) {
+    unsigned changed = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+    while (i < count or j < old->count) {
+      if (j == old->count
+          or (i < count and digests[i].name < old->digests[j].name))
+      {
+        ++ changed;
+        ++ i;
+      } else if (i == count or old->digests[j].name < digests[i].name) {
+        ++ changed;
+        ++ j;
+      } else {
+        if (digests[i].content != old->digests[j].content) {
+          ++ changed;
+        }
+        ++ i;
+        ++ j;
+      }
+    }
+    return changed;
+  }
+
+  uint64_t options;
+  unsigned count;
+  unsigned capacity;
+  ClassDigest* digests;
+};
+
+void
+fingerprint(Finder* finder, Cache* cache)
+{
+  for (Finder::Iterator it(finder); it.hasMore();) {
+    unsigned nameSize = 0;
+    const char* name = it.next(&nameSize);
+
+    if (endsWith(".class", name, nameSize)) {
+      System::Region* region = finder->find(name);
+      if (region) {
+        cache->add(hashBytes(0xcbf29ce484222325LL, name, nameSize),
+                   hashBytes(0xcbf29ce484222325LL, region->start(),
+                             region->length()));
+        region->dispose();
+      }
+    }
+  }
+
+  cache->sort();
+}
+
+// Folds the contents of the specified file into a hash, returning
+// false if it cannot be read.  We use this to include the generator
+// itself in the cache key, since the VM and compiler it was linked
+// with determine the contents of the images as much as the classes do.
+bool
+hashFile(uint64_t* h, const char* path)
+{
+  FILE* in = fopen(path, "rb");
+  if (in == 0) {
+    return false;
+  }
+
+  uint8_t buffer[8192];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    *h = hashBytes(*h, buffer, length);
+  }
+
+  bool success = not ferror(in);
+  fclose(in);
+  return success;
+}
+
+bool
+exists(const char* path)
+{
+  if (path == 0) {
+    return true;
+  }
+
+  FILE* f = fopen(path, "rb");
+  if (f) {
+    fclose(f);
+    return true;
+  } else {
+    return false;
+  }
+}
+
 char*
 myStrndup(const char* src, unsigned length)
 {
@@ -1835,6 +2529,11 @@ public:
   const char* bootimage;
   const char* codeimage;
 
+  const char* imageFile;
+  uint64_t imageBase;
+
+  const char* cache;
+
   char* entryClass;
   char* entryMethod;
   char* entrySpec;
@@ -1847,6 +2546,9 @@ public:
 
   bool useLZMA;
 
+  bool devirtualize;
+  bool stripUnreachable;
+
   bool maybeSplit(const char* src, char*& destA, char*& destB) {
     if(src) {
       const char* split = strchr(src, ':');
@@ -1871,12 +2573,18 @@ public:
   {
     ArgParser parser;
     Arg classpath(parser, true, "cp", "<classpath>");
-    Arg bootimage(parser, true, "bootimage", "<bootimage file>");
-    Arg codeimage(parser, true, "codeimage", "<codeimage file>");
+    Arg bootimage(parser, false, "bootimage", "<bootimage file>");
+    Arg codeimage(parser, false, "codeimage", "<codeimage file>");
+    Arg imageFile(parser, false, "image-file", "<mappable image file>");
+    Arg imageBase(parser, false, "image-base", "<preferred address of image file>");
     Arg entry(parser, false, "entry", "<class name>[.<method name>[<method spec>]]");
     Arg bootimageSymbols(parser, false, "bootimage-symbols", "<start symbol name>:<end symbol name>");
     Arg codeimageSymbols(parser, false, "codeimage-symbols", "<start symbol name>:<end symbol name>");
     Arg useLZMA(parser, false, "use-lzma", 0);
+    Arg devirtualize(parser, false, "devirtualize", 0);
+    Arg stripUnreachable(parser, false, "strip-unreachable", 0);
+    Arg aotOnly(parser, false, "aot-only", 0);
+    Arg cache(parser, false, "cache", "<file recording the inputs of the last run>");
 
     if(!parser.parse(ac, av)) {
       parser.printUsage(av[0]);
@@ -1886,7 +2594,44 @@ public:
     this->classpath = classpath.value;
     this->bootimage = bootimage.value;
     this->codeimage = codeimage.value;
+    this->imageFile = imageFile.value;
+    this->imageBase = imageBase.value ? strtoull(imageBase.value, 0, 0) : 0;
     this->useLZMA = useLZMA.value != 0;
+    this->devirtualize = devirtualize.value != 0;
+    this->stripUnreachable = stripUnreachable.value != 0;
+    this->cache = cache.value;
+
+    if ((imageFile.value != 0) == (bootimage.value != 0 or codeimage.value != 0)
+        or (imageFile.value == 0 and (bootimage.value == 0 or codeimage.value == 0)))
+    {
+      fprintf(stderr, "expected either -bootimage and -codeimage or -image-file\n");
+      parser.printUsage(av[0]);
+      exit(1);
+    }
+
+    // methods left out of the code image are compiled on demand, which
+    // a VM built without the JIT cannot do
+    if (this->stripUnreachable and aotOnly.value) {
+      fprintf(stderr, "-strip-unreachable may not be combined with "
+              "-aot-only\n");
+      parser.printUsage(av[0]);
+      exit(1);
+    }
+
+    if (imageFile.value and this->useLZMA) {
+      fprintf(stderr, "-use-lzma may not be combined with -image-file\n");
+      parser.printUsage(av[0]);
+      exit(1);
+    }
+
+    if (imageBase.value and (imageFile.value == 0
+                             or this->imageBase % ImageFileAlignment))
+    {
+      fprintf(stderr, "-image-base requires -image-file and must be aligned "
+              "to %d bytes\n", ImageFileAlignment);
+      parser.printUsage(av[0]);
+      exit(1);
+    }
 
     if(entry.value) {
       if(const char* entryClassEnd = strchr(entry.value, '.')) {
@@ -1952,11 +2697,34 @@ public:
     }
   }
 
+  uint64_t optionsHash() {
+    uint64_t h = 0xcbf29ce484222325LL;
+    h = hashString(h, bootimage);
+    h = hashString(h, codeimage);
+    h = hashString(h, imageFile);
+    h = hashBytes(h, &imageBase, sizeof(uint64_t));
+    h = hashString(h, entryClass);
+    h = hashString(h, entryMethod);
+    h = hashString(h, entrySpec);
+    h = hashString(h, bootimageStart);
+    h = hashString(h, bootimageEnd);
+    h = hashString(h, codeimageStart);
+    h = hashString(h, codeimageEnd);
+    h = hashBytes(h, &useLZMA, sizeof(bool));
+    h = hashBytes(h, &devirtualize, sizeof(bool));
+    h = hashBytes(h, &stripUnreachable, sizeof(bool));
+
+    unsigned target = (AVIAN_TARGET_ARCH << 16) | (AVIAN_TARGET_FORMAT << 8)
+      | TargetBytesPerWord;
+    return hashBytes(h, &target, sizeof(unsigned));
+  }
+
   void dump() {
     printf(
       "classpath = %s\n"
       "bootimage = %s\n"
       "codeimage = %s\n"
+      "imageFile = %s\n"
       "entryClass = %s\n"
       "entryMethod = %s\n"
       "entrySpec = %s\n"
@@ -1967,6 +2735,7 @@ public:
       classpath,
       bootimage,
       codeimage,
+      imageFile,
       entryClass,
       entryMethod,
       entrySpec,
@@ -1977,6 +2746,40 @@ public:
   }
 };
 
+int
+generate(Thread* t, Arguments* args, BootImage* image, uint8_t* code,
+         OutputStream* bootimageOutput, OutputStream* codeOutput,
+         OutputStream* imageOutput)
+{
+  uintptr_t arguments[] = {
+    reinterpret_cast<uintptr_t>(bootimageOutput),
+    reinterpret_cast<uintptr_t>(codeOutput),
+    reinterpret_cast<uintptr_t>(image),
+    reinterpret_cast<uintptr_t>(code),
+    reinterpret_cast<uintptr_t>(args->entryClass),
+    reinterpret_cast<uintptr_t>(args->entryMethod),
+    reinterpret_cast<uintptr_t>(args->entrySpec),
+    reinterpret_cast<uintptr_t>(args->bootimageStart),
+    reinterpret_cast<uintptr_t>(args->bootimageEnd),
+    reinterpret_cast<uintptr_t>(args->codeimageStart),
+    reinterpret_cast<uintptr_t>(args->codeimageEnd),
+    static_cast<uintptr_t>(args->useLZMA),
+    reinterpret_cast<uintptr_t>(imageOutput),
+    reinterpret_cast<uintptr_t>(&(args->imageBase)),
+    static_cast<uintptr_t>(args->devirtualize),
+    static_cast<uintptr_t>(args->stripUnreachable)
+  };
+
+  run(t, writeBootImage, arguments);
+
+  if (t->exception) {
+    printTrace(t, t->exception);
+    return -1;
+  } else {
+    return 0;
+  }
+}
+
 } // namespace
 
 int
@@ -1989,6 +2792,41 @@ main(int ac, const char** av)
   Heap* h = makeHeap(s, HeapCapacity * 2);
   Classpath* c = makeClasspath(s, h, AVIAN_JAVA_HOME, AVIAN_EMBED_PREFIX);
   Finder* f = makeFinder(s, h, args.classpath, 0);
+
+  // The code image is laid out as a single unit (methods call each
+  // other directly and refer to the heap image by offset), so it
+  // cannot be patched class by class.  What we can do is skip the
+  // whole run if none of the class files or options have changed
+  // since the image was last generated.  If we can't find our own
+  // executable to fold it into the key, we rebuild unconditionally:
+  Cache cache;
+  if (args.cache) {
+    cache.options = args.optionsHash();
+    if (not hashFile(&cache.options, av[0])) {
+      fprintf(stderr, "unable to read %s; ignoring %s\n", av[0], args.cache);
+      args.cache = 0;
+    }
+  }
+
+  if (args.cache) {
+    fingerprint(f, &cache);
+
+    Cache old;
+    if (old.read(args.cache)) {
+      unsigned changed = cache.difference(&old);
+      if (changed == 0 and old.options == cache.options
+          and exists(args.bootimage) and exists(args.codeimage)
+          and exists(args.imageFile))
+      {
+        fprintf(stderr, "boot image is up to date\n");
+        return 0;
+      }
+
+      fprintf(stderr, "%d of %d classes changed since the last run\n",
+              changed, cache.count);
+    }
+  }
+
   Processor* p = makeProcessor(s, h, false);
 
   // todo: currently, the compiler cannot compile code with jumps or
@@ -2014,39 +2852,35 @@ main(int ac, const char** av)
   enter(t, Thread::ActiveState);
   enter(t, Thread::IdleState);
 
-  FileOutputStream bootimageOutput(args.bootimage);
-  if (!bootimageOutput.isValid()) {
-    fprintf(stderr, "unable to open %s\n", args.bootimage);    
-    return -1;
-  }
+  int result;
+  if (args.imageFile) {
+    FileOutputStream imageOutput(args.imageFile);
+    if (!imageOutput.isValid()) {
+      fprintf(stderr, "unable to open %s\n", args.imageFile);
+      return -1;
+    }
 
-  FileOutputStream codeOutput(args.codeimage);
-  if (!codeOutput.isValid()) {
-    fprintf(stderr, "unable to open %s\n", args.codeimage);    
-    return -1;
-  }
+    result = generate(t, &args, &image, code, 0, 0, &imageOutput);
+  } else {
+    FileOutputStream bootimageOutput(args.bootimage);
+    if (!bootimageOutput.isValid()) {
+      fprintf(stderr, "unable to open %s\n", args.bootimage);    
+      return -1;
+    }
 
-  uintptr_t arguments[] = {
-    reinterpret_cast<uintptr_t>(&bootimageOutput),
-    reinterpret_cast<uintptr_t>(&codeOutput),
-    reinterpret_cast<uintptr_t>(&image),
-    reinterpret_cast<uintptr_t>(code),
-    reinterpret_cast<uintptr_t>(args.entryClass),
-    reinterpret_cast<uintptr_t>(args.entryMethod),
-    reinterpret_cast<uintptr_t>(args.entrySpec),
-    reinterpret_cast<uintptr_t>(args.bootimageStart),
-    reinterpret_cast<uintptr_t>(args.bootimageEnd),
-    reinterpret_cast<uintptr_t>(args.codeimageStart),
-    reinterpret_cast<uintptr_t>(args.codeimageEnd),
-    static_cast<uintptr_t>(args.useLZMA)
-  };
+    FileOutputStream codeOutput(args.codeimage);
+    if (!codeOutput.isValid()) {
+      fprintf(stderr, "unable to open %s\n", args.codeimage);    
+      return -1;
+    }
 
-  run(t, writeBootImage, arguments);
+    result = generate
+      (t, &args, &image, code, &bootimageOutput, &codeOutput, 0);
+  }
 
-  if (t->exception) {
-    printTrace(t, t->exception);
-    return -1;
-  } else {
-    return 0;
+  if (result == 0 and args.cache and not cache.write(args.cache)) {
+    fprintf(stderr, "unable to write %s\n", args.cache);
   }
+
+  return result;
 }
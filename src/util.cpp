@@ -325,21 +325,11 @@ hashMapFindNode(Thread* t, object map, object key,
                 uint32_t (*hash)(Thread*, object),
                 bool (*equal)(Thread*, object, object))
 {
-  bool weak = objectClass(t, map) == type(t, Machine::WeakHashMapType);
-
   object array = hashMapArray(t, map);
   if (array) {
     unsigned index = hash(t, key) & (arrayLength(t, array) - 1);
     for (object n = arrayBody(t, array, index); n; n = tripleThird(t, n)) {
-      object k = tripleFirst(t, n);
-      if (weak) {
-        k = jreferenceTarget(t, k);
-        if (k == 0) {
-          continue;
-        }
-      }
-
-      if (equal(t, key, k)) {
+      if (equal(t, key, tripleFirst(t, n))) {
         return n;
       }
     }
@@ -373,21 +363,12 @@ hashMapResize(Thread* t, object map, uint32_t (*hash)(Thread*, object),
     }
 
     if (oldArray) {
-      bool weak = objectClass(t, map) == type(t, Machine::WeakHashMapType);
       for (unsigned i = 0; i < arrayLength(t, oldArray); ++i) {
         object next;
         for (object p = arrayBody(t, oldArray, i); p; p = next) {
           next = tripleThird(t, p);
 
-          object k = tripleFirst(t, p);
-          if (weak) {
-            k = jreferenceTarget(t, k);
-            if (k == 0) {
-              continue;
-            }
-          }
-
-          unsigned index = hash(t, k) & (newLength - 1);
+          unsigned index = hash(t, tripleFirst(t, p)) & (newLength - 1);
 
           set(t, p, TripleThird, arrayBody(t, newArray, index));
           set(t, newArray, ArrayBody + (index * BytesPerWord), p);
@@ -411,8 +392,6 @@ hashMapInsert(Thread* t, object map, object key, object value,
 
   uint32_t h = hash(t, key);
 
-  bool weak = objectClass(t, map) == type(t, Machine::WeakHashMapType);
-
   object array = hashMapArray(t, map);
 
   ++ hashMapSize(t, map);
@@ -426,22 +405,7 @@ hashMapInsert(Thread* t, object map, object key, object value,
     array = hashMapArray(t, map);
   }
 
-  object k = key;
-
-  if (weak) {
-    PROTECT(t, key);
-    PROTECT(t, value);
-
-    object r = makeWeakReference(t, 0, 0, 0, 0);
-    jreferenceTarget(t, r) = key;
-    jreferenceVmNext(t, r) = t->m->weakReferences;
-    t->m->weakReferences = r;
-    k = r;
-
-    array = hashMapArray(t, map);
-  }
-
-  object n = makeTriple(t, k, value, 0);
+  object n = makeTriple(t, key, value, 0);
 
   array = hashMapArray(t, map);
 
@@ -469,24 +433,13 @@ hashMapRemove(Thread* t, object map, object key,
               uint32_t (*hash)(Thread*, object),
               bool (*equal)(Thread*, object, object))
 {
-  bool weak = objectClass(t, map) == type(t, Machine::WeakHashMapType);
-
   object array = hashMapArray(t, map);
   object o = 0;
   if (array) {
     unsigned index = hash(t, key) & (arrayLength(t, array) - 1);
     object p = 0;
     for (object n = arrayBody(t, array, index); n;) {
-      object k = tripleFirst(t, n);
-      if (weak) {
-        k = jreferenceTarget(t, k);
-        if (k == 0) {
-          n = tripleThird(t, hashMapRemoveNode(t, map, index, p, n));
-          continue;
-        }
-      }
-
-      if (equal(t, key, k)) {
+      if (equal(t, key, tripleFirst(t, n))) {
         o = tripleSecond(t, hashMapRemoveNode(t, map, index, p, n));
         break;
       } else {
@@ -504,6 +457,113 @@ hashMapRemove(Thread* t, object map, object key,
   return o;
 }
 
+object
+weakHashMapFindNode(Thread* t, object map, object key,
+                    uint32_t (*hash)(Thread*, object),
+                    bool (*equal)(Thread*, object, object))
+{
+  object array = hashMapArray(t, map);
+  if (array) {
+    uint32_t h = hash(t, key);
+    unsigned index = h & (arrayLength(t, array) - 1);
+    for (object n = arrayBody(t, array, index); n; n = weakNodeNext(t, n)) {
+      if (weakNodeHash(t, n) == h and equal(t, key, weakNodeKey(t, n))) {
+        return n;
+      }
+    }
+  }
+  return 0;
+}
+
+void
+weakHashMapResize(Thread* t, object map, unsigned size)
+{
+  PROTECT(t, map);
+
+  object oldArray = hashMapArray(t, map);
+  PROTECT(t, oldArray);
+
+  unsigned newLength = nextPowerOfTwo(size);
+  if (oldArray and arrayLength(t, oldArray) == newLength) {
+    return;
+  }
+
+  object newArray = makeArray(t, newLength);
+
+  if (oldArray != hashMapArray(t, map)) {
+    // a resize was performed during a GC via the makeArray call
+    // above; nothing left to do
+    return;
+  }
+
+  if (oldArray) {
+    // each node stores its key's hash, so there's no need to
+    // recompute it here
+    for (unsigned i = 0; i < arrayLength(t, oldArray); ++i) {
+      object next;
+      for (object p = arrayBody(t, oldArray, i); p; p = next) {
+        next = weakNodeNext(t, p);
+
+        unsigned index = weakNodeHash(t, p) & (newLength - 1);
+
+        set(t, p, WeakNodeNext, arrayBody(t, newArray, index));
+        set(t, newArray, ArrayBody + (index * BytesPerWord), p);
+      }
+    }
+  }
+
+  // readers may search the table without holding a lock, so make sure
+  // they can't see the new array before it is populated
+  storeStoreMemoryBarrier();
+
+  set(t, map, HashMapArray, newArray);
+}
+
+object
+weakHashMapInsert(Thread* t, object map, object key, object value,
+                  uint32_t (*hash)(Thread*, object))
+{
+  // note that we reinitialize the array variable whenever an
+  // allocation (and thus possibly a collection) occurs, in case the
+  // array changes due to a table resize or entries are swept.
+
+  PROTECT(t, map);
+  PROTECT(t, key);
+  PROTECT(t, value);
+
+  uint32_t h = hash(t, key);
+
+  object array = hashMapArray(t, map);
+
+  if (array == 0 or hashMapSize(t, map) + 1 >= arrayLength(t, array) * 2) {
+    weakHashMapResize(t, map, array ? arrayLength(t, array) * 2 : 16);
+  }
+
+  object n = makeWeakNode(t, 0, value, 0, 0, h);
+
+  // the key is held weakly, and the node stays on the map's young
+  // list until the key is tenured so that minor collections need
+  // only check those nodes for dead keys (see postVisit in
+  // machine.cpp)
+  weakNodeKey(t, n) = key;
+  weakNodeVmNext(t, n) = weakHashMapYoung(t, map);
+  weakHashMapYoung(t, map) = n;
+
+  array = hashMapArray(t, map);
+
+  unsigned index = h & (arrayLength(t, array) - 1);
+
+  set(t, n, WeakNodeNext, arrayBody(t, array, index));
+
+  storeStoreMemoryBarrier();
+
+  set(t, array, ArrayBody + (index * BytesPerWord), n);
+
+  ++ hashMapSize(t, map);
+
+  return n;
+}
+
 void
 listAppend(Thread* t, object list, object value)
 {
@@ -92,15 +92,18 @@ const int PipeSignal = SIGPIPE;
 const unsigned PipeSignalIndex = 4;
 const int DivideByZeroSignal = SIGFPE;
 const unsigned DivideByZeroSignalIndex = 5;
+const int ProfileSignal = SIGPROF;
+const unsigned ProfileSignalIndex = 6;
 
 const int signals[] = { VisitSignal,
                         SegFaultSignal,
                         InterruptSignal,
                         AltSegFaultSignal,
                         PipeSignal,
-                        DivideByZeroSignal };
+                        DivideByZeroSignal,
+                        ProfileSignal };
 
-const unsigned SignalCount = 6;
+const unsigned SignalCount = 7;
 
 class MySystem;
 MySystem* system;
@@ -601,7 +604,9 @@ class MySystem: public System {
 
   MySystem():
     threadVisitor(0),
-    visitTarget(0)
+    visitTarget(0),
+    profileVisitor(0),
+    profileHandlers(0)
   {
     expect(this, system == 0);
     system = this;
@@ -623,6 +628,11 @@ class MySystem: public System {
       memset(&sa, 0, sizeof(struct sigaction));
       sigemptyset(&(sa.sa_mask));
       sa.sa_flags = SA_SIGINFO;
+      if (signals[index] == ProfileSignal) {
+        // profile ticks may arrive at any time, so avoid failing
+        // whatever system call they happen to interrupt
+        sa.sa_flags |= SA_RESTART;
+      }
       sa.sa_sigaction = handleSignal;
     
       return sigaction(signals[index], &sa, oldHandlers + index);
@@ -713,6 +723,40 @@ class MySystem: public System {
     return registerHandler(handler, DivideByZeroSignalIndex);
   }
 
+  virtual Status handleProfileTick(ThreadVisitor* visitor,
+                                   unsigned intervalInMicroseconds)
+  {
+    itimerval timer;
+    memset(&timer, 0, sizeof(itimerval));
+
+    if (visitor) {
+      profileVisitor = visitor;
+
+      Status s = registerHandler(&nullHandler, ProfileSignalIndex);
+      if (s) return s;
+
+      timer.it_interval.tv_sec = intervalInMicroseconds / 1000000;
+      timer.it_interval.tv_usec = intervalInMicroseconds % 1000000;
+      timer.it_value = timer.it_interval;
+
+      return setitimer(ITIMER_PROF, &timer, 0);
+    } else {
+      setitimer(ITIMER_PROF, &timer, 0);
+
+      profileVisitor = 0;
+
+      // a handler may have read the old visitor just before we
+      // cleared it, so wait for every running handler to finish
+      // before letting the caller free that visitor
+      storeLoadMemoryBarrier();
+      while (profileHandlers) {
+        yield();
+      }
+
+      return registerHandler(0, ProfileSignalIndex);
+    }
+  }
+
   virtual Status visit(System::Thread* st UNUSED, System::Thread* sTarget,
                        ThreadVisitor* visitor)
   {
@@ -803,6 +847,35 @@ class MySystem: public System {
     return status;
   }
 
+  virtual Status mapImage(System::Region** region, const char* name,
+                          void* address)
+  {
+    Status status = 1;
+
+    int fd = ::open(name, O_RDONLY);
+    if (fd != -1) {
+      struct stat s;
+      int r = fstat(fd, &s);
+      if (r != -1) {
+        // A private mapping is copy-on-write, so only the pages we
+        // actually modify are duplicated; the rest stay shared with
+        // every other process mapping the same file.  The address is
+        // only a hint; the caller must check where we ended up.
+        void* data = mmap(address, s.st_size,
+                          PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE,
+                          fd, 0);
+        if (data != MAP_FAILED) {
+          *region = new (allocate(this, sizeof(Region)))
+            Region(this, static_cast<uint8_t*>(data), s.st_size);
+          status = 0;
+        }
+      }
+      close(fd);
+    }
+
+    return status;
+  }
+
   virtual Status open(System::Directory** directory, const char* name) {
     Status status = 1;
     
@@ -955,6 +1028,8 @@ class MySystem: public System {
   ThreadVisitor* threadVisitor;
   Thread* visitTarget;
   System::Monitor* visitLock;
+  ThreadVisitor* volatile profileVisitor;
+  volatile uintptr_t profileHandlers;
 };
 
 void
@@ -1033,6 +1108,23 @@ handleSignal(int signal, siginfo_t*, void* context)
     index = PipeSignalIndex;
   } break;
 
+  case ProfileSignal: {
+    index = ProfileSignalIndex;
+
+    // count this handler before reading the visitor so that
+    // handleProfileTick can tell when it is no longer in use
+    atomicAdd(&(system->profileHandlers), 1);
+
+    System::ThreadVisitor* visitor = system->profileVisitor;
+    if (visitor) {
+      int error = errno;
+      visitor->visit(ip, stack, link);
+      errno = error;
+    }
+
+    atomicAdd(&(system->profileHandlers), -1);
+  } break;
+
   default: abort();
   }
 
@@ -1040,6 +1132,7 @@ handleSignal(int signal, siginfo_t*, void* context)
   case VisitSignal:
   case InterruptSignal:
   case PipeSignal:
+  case ProfileSignal:
     break;
 
   default:
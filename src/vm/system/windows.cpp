@@ -754,6 +754,12 @@ class MySystem: public System {
     return registerHandler(handler, DivideByZeroIndex);
   }
 
+  virtual Status handleProfileTick(ThreadVisitor*, unsigned) {
+    // not yet supported; this would need a sampler thread which
+    // suspends each thread in turn, as visit does
+    return 1;
+  }
+
   virtual Status visit(System::Thread* st UNUSED, System::Thread* sTarget,
                        ThreadVisitor* visitor)
   {
@@ -855,6 +861,57 @@ class MySystem: public System {
     return status;
   }
 
+  virtual Status mapImage(System::Region** region, const char* name,
+                          void* address)
+  {
+    Status status = 1;
+#if !defined(WINAPI_FAMILY) || WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
+    size_t nameLen = strlen(name) * 2;
+    RUNTIME_ARRAY(wchar_t, wideName, nameLen + 1);
+    MultiByteToWideChar(CP_UTF8, 0, name, -1, RUNTIME_ARRAY_BODY(wideName), nameLen + 1);
+    HANDLE file = CreateFileW(RUNTIME_ARRAY_BODY(wideName),
+                              FILE_READ_DATA | FILE_EXECUTE, FILE_SHARE_READ,
+                              0, OPEN_EXISTING, 0, 0);
+    if (file != INVALID_HANDLE_VALUE) {
+      unsigned size = GetFileSize(file, 0);
+      if (size != INVALID_FILE_SIZE) {
+        // copy-on-write: pages we never modify stay shared with other
+        // processes mapping the same file
+        HANDLE mapping = CreateFileMapping
+          (file, 0, PAGE_EXECUTE_WRITECOPY, 0, size, 0);
+        if (mapping) {
+          void* data = MapViewOfFileEx
+            (mapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0, address);
+          if (data == 0 and address) {
+            data = MapViewOfFileEx
+              (mapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0, 0);
+          }
+
+          if (data) {
+            *region = new (allocate(this, sizeof(Region)))
+              Region(this, static_cast<uint8_t*>(data), size, file, mapping);
+            status = 0;
+          }
+
+          if (status) {
+            CloseHandle(mapping);
+          }
+        }
+      }
+
+      if (status) {
+        CloseHandle(file);
+      }
+    }
+#else
+    (void) region;
+    (void) name;
+    (void) address;
+#endif
+
+    return status;
+  }
+
   virtual Status open(System::Directory** directory, const char* name) {
     Status status = 1;
 
@@ -1,6 +1,9 @@
 import java.io.File;
 import java.io.FileInputStream;
 import java.io.FileOutputStream;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
 
 public class Files {
   private static void expect(boolean v) {
@@ -37,6 +40,107 @@ public class Files {
     }
   }
   
+  private static String string(ByteBuffer b) {
+    byte[] bytes = new byte[b.remaining()];
+    b.get(bytes);
+    return new String(bytes);
+  }
+
+  private static void channelTest() throws Exception {
+    File f = File.createTempFile("avian.", null);
+    File g = File.createTempFile("avian.", null);
+    try {
+      byte[] message = "hello, world!\n".getBytes();
+
+      FileOutputStream out = new FileOutputStream(f);
+      try {
+        FileChannel c = out.getChannel();
+        expect(c.write(ByteBuffer.wrap(message)) == message.length);
+        expect(c.position() == message.length);
+
+        // positional writes leave the channel position alone
+        expect(c.write(ByteBuffer.wrap("H".getBytes()), 0) == 1);
+        expect(c.position() == message.length);
+        expect(c.size() == message.length);
+      } finally {
+        out.close();
+      }
+
+      FileInputStream in = new FileInputStream(f);
+      try {
+        FileChannel c = in.getChannel();
+
+        // as do positional reads, into heap and direct buffers alike
+        ByteBuffer b = ByteBuffer.allocate(5);
+        expect(c.read(b, 7) == 5);
+        expect(c.position() == 0);
+        b.flip();
+        expect(string(b).equals("world"));
+
+        b = ByteBuffer.allocateDirect(5);
+        expect(c.read(b, 0) == 5);
+        b.flip();
+        expect(string(b).equals("Hello"));
+
+        expect(c.read(ByteBuffer.allocate(1), message.length) == -1);
+
+        // mappings need not start on a page boundary
+        MappedByteBuffer m = c.map(FileChannel.MapMode.READ_ONLY, 7, 5);
+        expect(m.remaining() == 5);
+        expect(string(m).equals("world"));
+
+        // private mappings may be written through a read-only channel
+        // without changing the file
+        m = c.map(FileChannel.MapMode.PRIVATE, 7, 5);
+        m.put(0, (byte) 'W');
+        expect(string(m).equals("World"));
+
+        b = ByteBuffer.allocate(5);
+        expect(c.read(b, 7) == 5);
+        b.flip();
+        expect(string(b).equals("world"));
+
+        FileOutputStream copy = new FileOutputStream(g);
+        try {
+          expect(c.transferTo(7, message.length, copy.getChannel())
+                 == message.length - 7);
+        } finally {
+          copy.close();
+        }
+      } finally {
+        in.close();
+      }
+
+      expect(g.length() == message.length - 7);
+
+      out = new FileOutputStream(g.getPath(), true);
+      try {
+        FileChannel c = out.getChannel();
+        c.truncate(5);
+        expect(c.size() == 5);
+
+        // truncating to a larger size does nothing
+        c.truncate(10);
+        expect(c.size() == 5);
+      } finally {
+        out.close();
+      }
+
+      in = new FileInputStream(g);
+      try {
+        ByteBuffer b = ByteBuffer.allocate(16);
+        expect(in.getChannel().read(b) == 5);
+        b.flip();
+        expect(string(b).equals("world"));
+      } finally {
+        in.close();
+      }
+    } finally {
+      f.delete();
+      g.delete();
+    }
+  }
+
   public static void main(String[] args) throws Exception {
     isAbsoluteTest(true);
     isAbsoluteTest(false);
@@ -80,6 +184,8 @@ public class Files {
     expect(new File("foo/bar//").getParent().equals("foo"));
 
     expect(new File("foo/nonexistent-directory").listFiles() == null);
+
+    channelTest();
   }
 
 }
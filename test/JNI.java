@@ -59,6 +59,10 @@ public class JNI {
 
   private static native Object testLocalRef(Object o);
 
+  private static native boolean testLocalRefs(Integer[] values, int depth);
+
+  private static native boolean pinAndCollect(int[] array, int collections);
+
   public static int method242() { return 242; }
   
   public static final int field950 = 950;
@@ -112,5 +116,38 @@ public class JNI {
     { Object o = new Object();
       expect(testLocalRef(o) == o);
     }
+
+    { Integer[] values = new Integer[1000];
+      for (int i = 0; i < values.length; ++i) {
+        values[i] = new Integer(i);
+      }
+
+      expect(testLocalRefs(values, 3));
+    }
+
+    { Object[] garbage = new Object[256];
+      for (int i = 0; i < garbage.length; ++i) {
+        garbage[i] = new int[16];
+      }
+
+      int[] array = new int[64];
+      for (int i = 0; i < array.length; ++i) {
+        array[i] = i;
+      }
+
+      garbage = null;
+
+      // collect enough times to move the array into the old
+      // generation, where it can be pinned
+      for (int i = 0; i < 8; ++i) {
+        System.gc();
+      }
+
+      expect(pinAndCollect(array, 4));
+
+      for (int i = 0; i < array.length; ++i) {
+        expect(array[i] == -i);
+      }
+    }
   }
 }
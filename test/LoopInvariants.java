@@ -0,0 +1,199 @@
+public class LoopInvariants {
+  private static boolean running1 = true;
+  private static boolean running2 = true;
+  private static boolean running3 = true;
+
+  private boolean running = true;
+
+  private int[] array = { 1, 2, 3, 4, 5 };
+  private int[] divisors = { 1, 0, 2, 0, 5 };
+  private int[][] matrix = { { 1, 2 }, { 3 }, { }, { 4, 5, 6 } };
+
+  private static class Table {
+    public static int[] values = { 10, 20, 30 };
+  }
+
+  private static class Holder {
+    public int[] array;
+  }
+
+  private static void expect(boolean v) {
+    if (! v) throw new RuntimeException();
+  }
+
+  private static class ClearsOnNew {
+    static {
+      running1 = false;
+    }
+  }
+
+  private static class ClearsOnGet {
+    public static int value = 42;
+
+    static {
+      running2 = false;
+    }
+  }
+
+  private static class ClearsOnPut {
+    public static int value;
+
+    static {
+      running3 = false;
+    }
+  }
+
+  private void stop() {
+    running = false;
+  }
+
+  // Each loop below reads a field which something in the loop may
+  // change.  If that read were wrongly hoisted out of the loop, the
+  // loop would run to its limit instead of stopping after one pass.
+
+  private static int newInLoop() {
+    int n = 0;
+    while (running1 && n < 1000) {
+      ++ n;
+      new ClearsOnNew();
+    }
+    return n;
+  }
+
+  private static int getstaticInLoop() {
+    int n = 0;
+    while (running2 && n < 1000) {
+      ++ n;
+      int v = ClearsOnGet.value;
+    }
+    return n;
+  }
+
+  private static int putstaticInLoop() {
+    int n = 0;
+    while (running3 && n < 1000) {
+      ++ n;
+      ClearsOnPut.value = n;
+    }
+    return n;
+  }
+
+  private int callInLoop() {
+    int n = 0;
+    while (running && n < 1000) {
+      ++ n;
+      stop();
+    }
+    return n;
+  }
+
+  // Each loop below reads fields which nothing in the loop changes,
+  // so those reads may be hoisted into a preheader, which must not
+  // change the result.
+
+  private int lengthBound() {
+    int sum = 0;
+    for (int i = 0; i < this.array.length; ++i) {
+      sum += this.array[i];
+    }
+    return sum;
+  }
+
+  private static int initializedStatic() {
+    int sum = 0;
+    for (int i = 0; i < Table.values.length; ++i) {
+      sum += Table.values[i];
+    }
+    return sum;
+  }
+
+  private int switches() {
+    int sum = 0;
+    for (int i = 0; i < this.array.length; ++i) {
+      switch (i) {
+      case 0: sum += 1; break;
+      case 1: sum += 2; break;
+      case 2: sum += 3; break;
+      case 3: sum += 4; break;
+      default: sum += 5; break;
+      }
+
+      switch (this.array[i] * 1000) {
+      case 1000: sum += 10; break;
+      case 3000: sum += 30; break;
+      case 1000000: sum += 1; break;
+      default: sum += 100; break;
+      }
+    }
+    return sum;
+  }
+
+  private int tryInLoop() {
+    int sum = 0;
+    int errors = 0;
+    for (int i = 0; i < this.divisors.length; ++i) {
+      try {
+        sum += 100 / this.divisors[i];
+      } catch (ArithmeticException e) {
+        ++ errors;
+      }
+    }
+    return sum * 10 + errors;
+  }
+
+  private int nestedLoops() {
+    int sum = 0;
+    for (int i = 0; i < this.matrix.length; ++i) {
+      for (int j = 0; j < this.matrix[i].length; ++j) {
+        sum += this.matrix[i][j];
+      }
+    }
+    return sum;
+  }
+
+  private static int thrownAtLine;
+
+  private static int sumThroughNull(Holder h) {
+    try {
+      int sum = 0;
+      for (int i = 0; i < h.array.length; ++i) { // NullPointerLine
+        sum += h.array[i];
+      }
+      return sum;
+    } catch (NullPointerException e) {
+      thrownAtLine = e.getStackTrace()[0].getLineNumber();
+      return -1;
+    }
+  }
+
+  // the line marked NullPointerLine above
+  private static final int NullPointerLine = 159;
+
+  public static void main(String[] args) {
+    expect(newInLoop() == 1);
+    expect(getstaticInLoop() == 1);
+    expect(putstaticInLoop() == 1);
+    expect(new LoopInvariants().callInLoop() == 1);
+
+    LoopInvariants l = new LoopInvariants();
+    expect(l.lengthBound() == 15);
+
+    expect(Table.values.length == 3);
+    expect(initializedStatic() == 60);
+
+    expect(l.switches() == 15 + 10 + 100 + 30 + 100 + 100);
+    expect(l.tryInLoop() == (100 + 50 + 20) * 10 + 2);
+    expect(l.nestedLoops() == 21);
+
+    Holder h = new Holder();
+    h.array = new int[] { 1, 2, 3 };
+    expect(sumThroughNull(h) == 6);
+
+    h.array = null;
+    expect(sumThroughNull(h) == -1);
+    expect(thrownAtLine == NullPointerLine);
+
+    expect(sumThroughNull(null) == -1);
+    expect(thrownAtLine == NullPointerLine);
+  }
+}
@@ -2,6 +2,12 @@ public class NullPointer {
   private int x;
   private Object y;
 
+  // no subclass overrides this, and it never touches "this", so a
+  // devirtualized call must check for null explicitly
+  public int ignoreThis() {
+    return 42;
+  }
+
   private static void throw_(Object o) {
     o.toString();
   }
@@ -41,6 +47,14 @@ public class NullPointer {
       e.printStackTrace();
     }
 
+    // invokevirtual (devirtualized)
+    try {
+      ((NullPointer) null).ignoreThis();
+      throw new RuntimeException();
+    } catch (NullPointerException e) {
+      e.printStackTrace();
+    }
+
     // arraylength
     try {
       int a = ((byte[]) null).length;
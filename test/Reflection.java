@@ -1,5 +1,7 @@
 import java.lang.reflect.Method;
 import java.lang.reflect.Field;
+import java.lang.reflect.Constructor;
+import java.lang.reflect.InvocationTargetException;
 
 public class Reflection {
   public static boolean booleanMethod() {
@@ -38,6 +40,93 @@ public class Reflection {
     if (! v) throw new RuntimeException();
   }
 
+  public static class Target {
+    public static int constructed;
+
+    public Target() {
+      ++ constructed;
+    }
+
+    public int add(int a, Integer b, String message) {
+      if (message != null) {
+        throw new RuntimeException(message);
+      }
+      return a + b;
+    }
+
+    public static double widen(short s, int i, long l, float f, double d) {
+      return s + i + l + f + d;
+    }
+  }
+
+  // The VM may switch to a faster way of calling a method after it has
+  // been invoked reflectively a number of times, so we make sure it
+  // behaves the same way before and after.
+  private static void invokeRepeatedly() throws Exception {
+    Method add = Target.class.getMethod
+      ("add", Integer.TYPE, Integer.class, String.class);
+    Method widen = Target.class.getMethod
+      ("widen", Short.TYPE, Integer.TYPE, Long.TYPE, Float.TYPE, Double.TYPE);
+    Constructor constructor = Target.class.getConstructor();
+    Target target = new Target();
+
+    for (int i = 0; i < 40; ++i) {
+      expect(i + 1 == (Integer) add.invoke(target, i, 1, null));
+
+      try {
+        add.invoke(target, "1", 1, null);
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      try {
+        add.invoke(target, null, 1, null);
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      try {
+        add.invoke(target, 1, 1, new Object());
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      try {
+        add.invoke(target, 1, 1, "oops");
+        expect(false);
+      } catch (InvocationTargetException e) {
+        expect("oops".equals(e.getCause().getMessage()));
+      }
+
+      // primitive arguments are widened as needed, but never narrowed
+      expect(76.0 == (Double) widen.invoke
+             (null, (byte) 1, (short) 2, 3, 'A', 5L));
+      expect(79.0 == (Double) widen.invoke
+             (null, (short) 1, 'B', (byte) 3, 4L, 5.0f));
+
+      try {
+        widen.invoke(null, 1, 2, 3, 4, 5);
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      try {
+        widen.invoke(null, (short) 1, 2L, 3, 4, 5);
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      try {
+        widen.invoke(null, (short) 1, 2, 3, 4.0, 5);
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      try {
+        widen.invoke(null, (short) 1, true, 3, 4, 5);
+        expect(false);
+      } catch (IllegalArgumentException e) { }
+
+      expect(constructor.newInstance() instanceof Target);
+    }
+
+    expect(Target.constructed == 41);
+  }
+
   public static void main(String[] args) throws Exception {
     Class system = Class.forName("java.lang.System");
     Field out = system.getDeclaredField("out");
@@ -67,5 +156,7 @@ public class Reflection {
 
     expect(7.0 == (Double) Reflection.class.getMethod
            ("doubleMethod").invoke(null));
+
+    invokeRepeatedly();
   }
 }
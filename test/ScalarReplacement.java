@@ -0,0 +1,158 @@
+public class ScalarReplacement {
+  private static int lazyInitializations = 0;
+
+  private static void expect(boolean v) {
+    if (! v) throw new RuntimeException();
+  }
+
+  private static class Pair {
+    public int a;
+    public int b;
+  }
+
+  private static class LongAndReference {
+    public long value;
+    public Object reference;
+  }
+
+  private static class DoubleAndReference {
+    public double value;
+    public Object reference;
+  }
+
+  private static class Lazy {
+    public int value;
+
+    static {
+      ++ lazyInitializations;
+    }
+  }
+
+  // The JIT may replace an object which never escapes the method that
+  // allocates it with locals holding its fields.  Each method below
+  // either uses such an object in a way that replacement must preserve
+  // or lets it escape in a way the analysis must notice.
+
+  private static int allocateInLoop(int n) {
+    int sum = 0;
+    Pair p = new Pair();
+    for (int i = 0; i < n; ++i) {
+      p = new Pair();
+      p.a = i;
+      p.b = i * 2;
+      sum += p.a;
+    }
+    return sum + p.b;
+  }
+
+  private static int assignOnOneBranch(boolean assign) {
+    Pair p = null;
+    if (assign) {
+      p = new Pair();
+      p.a = 5;
+      p.b = 6;
+    }
+    return p == null ? -1 : p.a + p.b;
+  }
+
+  private static int assignOnBothBranches(boolean first) {
+    Pair p;
+    if (first) {
+      p = new Pair();
+      p.a = 1;
+    } else {
+      p = new Pair();
+      p.a = 2;
+    }
+    return p.a;
+  }
+
+  private static void makeGarbage() {
+    for (int i = 0; i < 1024; ++i) {
+      Object o = new int[64];
+    }
+    System.gc();
+  }
+
+  private static long longAndReference() {
+    LongAndReference h = new LongAndReference();
+    h.value = 1L << 40;
+    h.reference = new int[] { 42 };
+
+    // the array is only reachable through the replaced field here
+    makeGarbage();
+
+    return h.value + ((int[]) h.reference)[0];
+  }
+
+  private static double doubleAndReference() {
+    DoubleAndReference h = new DoubleAndReference();
+    h.value = 2.5;
+    h.reference = "hello".concat(", world!");
+
+    makeGarbage();
+
+    return h.value + ((String) h.reference).length();
+  }
+
+  private static int readInHandler(int[] array, int index) {
+    Pair p = new Pair();
+    p.a = 1;
+    p.b = 2;
+    try {
+      p.a = array[index];
+    } catch (ArrayIndexOutOfBoundsException e) {
+      return p.a + p.b + 100;
+    }
+    return p.a + p.b;
+  }
+
+  private static int twoLiveFromOneSite() {
+    Pair previous = new Pair();
+    int sum = 0;
+    for (int i = 1; i <= 3; ++i) {
+      Pair p = new Pair();
+      p.a = i;
+      // previous still refers to the object allocated by this same
+      // instruction in the last iteration
+      sum += previous.a * 10 + p.a;
+      previous = p;
+    }
+    return sum * 10 + previous.a;
+  }
+
+  private static int pendingInitialization(int v) {
+    Lazy l = new Lazy();
+    l.value = v;
+    return l.value;
+  }
+
+  public static void main(String[] args) {
+    for (int i = 0; i < 3; ++i) {
+      expect(allocateInLoop(0) == 0);
+      expect(allocateInLoop(10) == 45 + 18);
+
+      expect(assignOnOneBranch(true) == 11);
+      expect(assignOnOneBranch(false) == -1);
+
+      expect(assignOnBothBranches(true) == 1);
+      expect(assignOnBothBranches(false) == 2);
+
+      expect(longAndReference() == (1L << 40) + 42);
+      expect(doubleAndReference() == 2.5 + 13);
+
+      expect(readInHandler(new int[] { 5 }, 0) == 7);
+      expect(readInHandler(new int[] { 5 }, 1) == 103);
+
+      expect(twoLiveFromOneSite() == 363);
+    }
+
+    // Lazy must not be initialized until the allocation runs, and then
+    // only once
+    expect(lazyInitializations == 0);
+    expect(pendingInitialization(5) == 5);
+    expect(lazyInitializations == 1);
+    expect(pendingInitialization(6) == 6);
+    expect(lazyInitializations == 1);
+  }
+}
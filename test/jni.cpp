@@ -107,6 +107,130 @@ Java_JNI_testLocalRef(JNIEnv* e, jclass, jobject o)
   return e->NewLocalRef(o);
 }
 
+namespace {
+
+bool
+checkLocalRefs(JNIEnv* e, jobject* refs, jsize count, jmethodID intValue)
+{
+  for (jsize i = 0; i < count; ++i) {
+    if (e->CallIntMethod(refs[i], intValue) != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Makes a local reference to each element of values in a new local
+// frame, recursing until depth reaches one and collecting there, then
+// checks that every reference in this frame survived.
+bool
+nestedLocalRefs(JNIEnv* e, jobjectArray values, jint depth, jclass system,
+                jmethodID gc, jmethodID intValue)
+{
+  jsize count = e->GetArrayLength(values);
+  if (e->PushLocalFrame(count + 1) != 0) {
+    return false;
+  }
+
+  jobject* refs = static_cast<jobject*>(malloc(count * sizeof(jobject)));
+  for (jsize i = 0; i < count; ++i) {
+    refs[i] = e->GetObjectArrayElement(values, i);
+  }
+
+  bool success;
+  if (depth > 1) {
+    success = nestedLocalRefs(e, values, depth - 1, system, gc, intValue);
+  } else {
+    e->CallStaticVoidMethod(system, gc);
+    success = true;
+  }
+
+  success = checkLocalRefs(e, refs, count, intValue) and success;
+
+  jobject last = e->PopLocalFrame(refs[count - 1]);
+  success = e->CallIntMethod(last, intValue) == count - 1 and success;
+  e->DeleteLocalRef(last);
+
+  free(refs);
+
+  return success;
+}
+
+} // namespace
+
+// Makes more local references than fit in one segment, both in this
+// native frame and in nested local frames, and checks that each still
+// refers to the right object after a collection.  Each element of
+// values must be an Integer equal to its index.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_JNI_testLocalRefs(JNIEnv* e, jclass, jobjectArray values, jint depth)
+{
+  jclass system = e->FindClass("java/lang/System");
+  jmethodID gc = e->GetStaticMethodID(system, "gc", "()V");
+  jclass integer = e->FindClass("java/lang/Integer");
+  jmethodID intValue = e->GetMethodID(integer, "intValue", "()I");
+
+  jsize count = e->GetArrayLength(values);
+  if (e->EnsureLocalCapacity(count) != 0) {
+    return false;
+  }
+
+  jobject* refs = static_cast<jobject*>(malloc(count * sizeof(jobject)));
+  for (jsize i = 0; i < count; ++i) {
+    refs[i] = e->GetObjectArrayElement(values, i);
+  }
+
+  e->CallStaticVoidMethod(system, gc);
+
+  bool success = checkLocalRefs(e, refs, count, intValue)
+    and nestedLocalRefs(e, values, depth, system, gc, intValue)
+    and checkLocalRefs(e, refs, count, intValue);
+
+  free(refs);
+
+  return success;
+}
+
+// Holds a critical pointer into the specified array across several
+// collections, then checks that the array hasn't moved and that writes
+// through the pointer are seen by Java code.  This relies on the array
+// being old enough to be pinned, since otherwise the thread would hold
+// off the collector and may not call back into the VM.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_JNI_pinAndCollect(JNIEnv* e, jclass, jintArray array, jint collections)
+{
+  jclass system = e->FindClass("java/lang/System");
+  jmethodID gc = e->GetStaticMethodID(system, "gc", "()V");
+  jsize length = e->GetArrayLength(array);
+
+  jint* body = static_cast<jint*>(e->GetPrimitiveArrayCritical(array, 0));
+
+  bool success = true;
+  for (jint i = 0; i < collections; ++i) {
+    e->CallStaticVoidMethod(system, gc);
+
+    for (jsize j = 0; j < length; ++j) {
+      if (body[j] != j) {
+        success = false;
+      }
+    }
+  }
+
+  jint* current = static_cast<jint*>(e->GetPrimitiveArrayCritical(array, 0));
+  if (current != body) {
+    success = false;
+  }
+  e->ReleasePrimitiveArrayCritical(array, current, 0);
+
+  for (jsize j = 0; j < length; ++j) {
+    body[j] = -j;
+  }
+
+  e->ReleasePrimitiveArrayCritical(array, body, 0);
+
+  return success;
+}
+
 extern "C" JNIEXPORT jobject JNICALL
 Java_Buffers_allocateNative(JNIEnv* e, jclass, jint capacity)
 {
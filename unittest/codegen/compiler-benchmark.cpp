@@ -0,0 +1,341 @@
+/* Copyright (c) 2008-2013, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#include <stdio.h>
+
+#include "avian/common.h"
+#include <avian/vm/heap/heap.h>
+#include <avian/vm/system/system.h>
+#include "avian/target.h"
+
+#include <avian/vm/codegen/assembler.h>
+#include <avian/vm/codegen/compiler.h>
+#include <avian/vm/codegen/targets.h>
+#include <avian/vm/codegen/lir.h>
+#include <avian/vm/codegen/promise.h>
+#include <avian/vm/codegen/registers.h>
+
+#include "test-harness.h"
+
+using namespace avian::codegen;
+using namespace vm;
+
+namespace {
+
+const unsigned ParameterFootprint = 2;
+const unsigned LocalFootprint = 16;
+const unsigned MaxStack = 4;
+const unsigned CodeCapacityInBytes = 1024 * 1024;
+
+class BenchmarkEnv {
+public:
+  System* s;
+  Heap* heap;
+  Assembler::Architecture* arch;
+  uint8_t* code;
+
+  BenchmarkEnv(Assembler::Architecture* (*makeArchitecture)(System*, bool)):
+    s(makeSystem(0)),
+    heap(makeHeap(s, 64 * 1024 * 1024)),
+    arch(makeArchitecture(s, true)),
+    code(static_cast<uint8_t*>(heap->allocate(CodeCapacityInBytes)))
+  {
+    arch->acquire();
+  }
+
+  ~BenchmarkEnv() {
+    heap->free(code, CodeCapacityInBytes);
+    arch->release();
+    heap->dispose();
+    s->dispose();
+  }
+};
+
+// The programs below use only integer arithmetic, loads and stores of
+// locals, and branches, none of which need thunks on any supported
+// architecture, but the compiler may still ask for one; since the
+// code is never run, any address will do.
+class BenchmarkClient: public Compiler::Client {
+public:
+  virtual intptr_t getThunk(lir::UnaryOperation, unsigned) {
+    return 0x1000;
+  }
+
+  virtual intptr_t getThunk(lir::BinaryOperation, unsigned, unsigned) {
+    return 0x1000;
+  }
+
+  virtual intptr_t getThunk(lir::TernaryOperation, unsigned, unsigned,
+                            bool* threadParameter)
+  {
+    *threadParameter = false;
+    return 0x1000;
+  }
+};
+
+// Generates a synthetic method of the specified number of logical
+// instructions and compiles it, following the same protocol as
+// compile.cpp: branch targets are compiled depth-first with the
+// compiler state saved and restored around them.
+class ProgramBuilder {
+public:
+  ProgramBuilder(Compiler* c, unsigned size, unsigned pressure):
+    c(c),
+    size(size),
+    pressure(pressure),
+    visited(static_cast<bool*>(calloc(size, sizeof(bool))))
+  { }
+
+  ~ProgramBuilder() {
+    free(visited);
+  }
+
+  void build() {
+    for (unsigned i = 0; i < ParameterFootprint; ++i) {
+      c->initLocal(1, i, Compiler::IntegerType);
+    }
+
+    compileFrom(0);
+  }
+
+  Compiler::Operand* arithmetic(unsigned ip, Compiler::Operand* a,
+                                Compiler::Operand* b)
+  {
+    switch (ip % 4) {
+    case 0: return c->add(4, a, b);
+    case 1: return c->sub(4, a, b);
+    case 2: return c->xor_(4, a, b);
+    default: return c->and_(4, a, b);
+    }
+  }
+
+  void instruction(unsigned ip) {
+    if (pressure) {
+      // load many locals up front so they are all live at once
+      Compiler::Operand* values[LocalFootprint];
+      for (unsigned i = 0; i < pressure; ++i) {
+        values[i] = c->loadLocal(1, (ip + i) % LocalFootprint);
+      }
+
+      Compiler::Operand* result = values[0];
+      for (unsigned i = 1; i < pressure; ++i) {
+        result = arithmetic
+          (ip + i, result, c->mul(4, values[i], values[pressure - i]));
+      }
+
+      c->storeLocal(1, result, ip % LocalFootprint);
+    } else {
+      Compiler::Operand* a = c->loadLocal(1, ip % LocalFootprint);
+      Compiler::Operand* b = c->loadLocal(1, (ip * 7 + 3) % LocalFootprint);
+      c->storeLocal(1, arithmetic(ip, a, b), (ip + 1) % LocalFootprint);
+    }
+  }
+
+  void compileFrom(unsigned ip) {
+    while (ip < size) {
+      if (visited[ip]) {
+        c->visitLogicalIp(ip);
+        return;
+      }
+      visited[ip] = true;
+
+      c->startLogicalIp(ip);
+
+      if (ip == 0) {
+        for (unsigned i = ParameterFootprint; i < LocalFootprint; ++i) {
+          c->storeLocal
+            (1, c->constant(i, Compiler::IntegerType), i);
+        }
+      }
+
+      if (ip == size - 1) {
+        c->return_(4, c->loadLocal(1, 0));
+        return;
+      } else if (ip % 8 == 7 and ip + 3 < size) {
+        Compiler::Operand* a = c->loadLocal(1, ip % LocalFootprint);
+        Compiler::Operand* b = c->loadLocal(1, (ip + 5) % LocalFootprint);
+        c->jumpIfLess(4, a, b, c->promiseConstant
+                      (c->machineIp(ip + 3), Compiler::AddressType));
+
+        Compiler::State* state = c->saveState();
+        compileFrom(ip + 3);
+        c->restoreState(state);
+      } else {
+        instruction(ip);
+      }
+
+      ++ ip;
+    }
+  }
+
+  Compiler* c;
+  unsigned size;
+  unsigned pressure;
+  bool* visited;
+};
+
+unsigned
+compileProgram(BenchmarkEnv& env, unsigned size, unsigned pressure)
+{
+  Zone zone(env.s, env.heap, 64 * 1024);
+  Assembler* a = env.arch->makeAssembler(env.heap, &zone);
+  BenchmarkClient client;
+  Compiler* c = makeCompiler(env.s, a, &zone, &client);
+
+  c->init(size, ParameterFootprint, LocalFootprint,
+          env.arch->alignFrameSize
+          (LocalFootprint - ParameterFootprint + MaxStack
+           + env.arch->frameFootprint(5)));
+
+  ProgramBuilder(c, size, pressure).build();
+
+  c->compile(0, 0);
+
+  unsigned length = c->resolve(env.code);
+  expect(env.s, pad(length, TargetBytesPerWord)
+         + pad(c->poolSize(), TargetBytesPerWord) <= CodeCapacityInBytes);
+
+  c->write();
+
+  c->dispose();
+  a->dispose();
+
+  return length;
+}
+
+// measures the whole pipeline, from LIR to machine code
+class CompileBenchmark: public Benchmark {
+public:
+  CompileBenchmark(const char* name, unsigned size):
+    Benchmark(name, "methods"),
+    size(size)
+  { }
+
+  virtual void run(unsigned iterations) {
+    BenchmarkEnv env(makeArchitectureNative);
+    for (unsigned i = 0; i < iterations; ++i) {
+      compileProgram(env, size, 0);
+    }
+  }
+
+  unsigned size;
+};
+
+CompileBenchmark compile16Benchmark("Compile/16", 16);
+CompileBenchmark compile128Benchmark("Compile/128", 128);
+CompileBenchmark compile1024Benchmark("Compile/1024", 1024);
+CompileBenchmark compile8192Benchmark("Compile/8192", 8192);
+
+// keeps more values live than there are registers, so most of the
+// time goes to the register allocator picking and stealing targets
+class RegisterAllocationBenchmark: public Benchmark {
+public:
+  RegisterAllocationBenchmark(const char* name, unsigned pressure):
+    Benchmark(name, "methods"),
+    pressure(pressure)
+  { }
+
+  virtual void run(unsigned iterations) {
+    BenchmarkEnv env(makeArchitectureNative);
+    for (unsigned i = 0; i < iterations; ++i) {
+      compileProgram(env, 256, pressure);
+    }
+  }
+
+  unsigned pressure;
+};
+
+RegisterAllocationBenchmark registerAllocation4Benchmark
+("RegisterAllocation/4", 4);
+RegisterAllocationBenchmark registerAllocation8Benchmark
+("RegisterAllocation/8", 8);
+RegisterAllocationBenchmark registerAllocation16Benchmark
+("RegisterAllocation/16", 16);
+
+// measures an assembler backend alone: encoding a block of moves and
+// arithmetic between registers, resolving it, and writing it out
+class AssemblerBenchmark: public Benchmark {
+public:
+  static const unsigned InstructionCount = 1024;
+
+  AssemblerBenchmark(const char* name,
+                     Assembler::Architecture* (*makeArchitecture)
+                     (System*, bool)):
+    Benchmark(name, "blocks"),
+    makeArchitecture(makeArchitecture)
+  { }
+
+  virtual void run(unsigned iterations) {
+    BenchmarkEnv env(makeArchitecture);
+
+    int registers[4];
+    unsigned count = 0;
+    const RegisterFile* file = env.arch->registerFile();
+    for (int r = file->generalRegisters.start;
+         r < file->generalRegisters.limit and count < 4; ++r)
+    {
+      if ((file->generalRegisters.mask & (1 << r))
+          and not env.arch->reserved(r))
+      {
+        registers[count++] = r;
+      }
+    }
+    expect(env.s, count == 4);
+
+    for (unsigned i = 0; i < iterations; ++i) {
+      Zone zone(env.s, env.heap, 64 * 1024);
+      Assembler* a = env.arch->makeAssembler(env.heap, &zone);
+
+      for (unsigned j = 0; j < InstructionCount; ++j) {
+        lir::Register src(registers[j % 4]);
+        lir::Register dst(registers[(j + 1) % 4]);
+        OperandInfo srcInfo(TargetBytesPerWord, lir::RegisterOperand, &src);
+        OperandInfo dstInfo(TargetBytesPerWord, lir::RegisterOperand, &dst);
+
+        if (j % 2) {
+          a->apply(lir::Move, srcInfo, dstInfo);
+        } else {
+          a->apply(j % 4 ? lir::Add : lir::Xor, srcInfo, dstInfo, dstInfo);
+        }
+      }
+
+      a->apply(lir::Return);
+
+      unsigned length = a->endBlock(false)->resolve(0, 0);
+      expect(env.s, length <= CodeCapacityInBytes);
+
+      a->setDestination(env.code);
+      a->write();
+      a->dispose();
+    }
+  }
+
+  Assembler::Architecture* (*makeArchitecture)(System*, bool);
+};
+
+AssemblerBenchmark nativeAssemblerBenchmark
+("Assembler/native", makeArchitectureNative);
+
+#ifdef AVIAN_CODEGEN_TARGETS_ALL
+#  if TARGET_BYTES_PER_WORD == 4
+// the ARM and PowerPC backends only generate 32-bit code
+AssemblerBenchmark armAssemblerBenchmark
+("Assembler/arm", makeArchitectureArm);
+AssemblerBenchmark powerpcAssemblerBenchmark
+("Assembler/powerpc", makeArchitecturePowerpc);
+#  endif
+#  if (AVIAN_TARGET_ARCH != AVIAN_ARCH_X86) \
+  && (AVIAN_TARGET_ARCH != AVIAN_ARCH_X86_64)
+AssemblerBenchmark x86AssemblerBenchmark
+("Assembler/x86", makeArchitectureX86);
+#  endif
+#endif
+
+} // namespace
@@ -9,10 +9,18 @@
    details. */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "avian/common.h"
 #include "test-harness.h"
 
+#ifdef PLATFORM_WINDOWS
+#  include <windows.h>
+#else
+#  include <time.h>
+#  include <sys/time.h>
+#endif
+
 // since we aren't linking against libstdc++, we must implement this
 // ourselves:
 extern "C" void __cxa_pure_virtual(void) { abort(); }
@@ -45,7 +53,123 @@ bool Test::runAll() {
   return failures == 0;
 }
 
-int main(int argc UNUSED, char** argv UNUSED) {
+Benchmark* Benchmark::first = 0;
+Benchmark** Benchmark::last = &first;
+
+Benchmark::Benchmark(const char* name, const char* unit):
+  next(0),
+  name(name),
+  unit(unit)
+{
+  *last = this;
+  last = &next;
+}
+
+int64_t Benchmark::now() {
+#ifdef PLATFORM_WINDOWS
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return static_cast<int64_t>
+    (static_cast<double>(counter.QuadPart) * 1e9 / frequency.QuadPart);
+#elif defined CLOCK_MONOTONIC
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+#else
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return static_cast<int64_t>(tv.tv_sec) * 1000000000LL
+    + static_cast<int64_t>(tv.tv_usec) * 1000;
+#endif
+}
+
+bool Benchmark::runAll(const Options& options) {
+  const int64_t minimum = static_cast<int64_t>(options.minimumMillis)
+    * 1000000;
+
+  for(Benchmark* b = Benchmark::first; b; b = b->next) {
+    if(options.filter
+       and strncmp(b->name, options.filter, strlen(options.filter)) != 0)
+    {
+      continue;
+    }
+
+    // warm up caches and lazily initialized state first
+    b->run(1);
+
+    unsigned iterations = options.iterations ? options.iterations : 1;
+    int64_t elapsed;
+    while(true) {
+      int64_t start = now();
+      b->run(iterations);
+      elapsed = now() - start;
+
+      if(options.iterations or elapsed >= minimum
+         or iterations >= 0x40000000)
+      {
+        break;
+      }
+      iterations *= 2;
+    }
+
+    double perSecond = elapsed > 0
+      ? static_cast<double>(iterations) * 1e9 / elapsed : 0;
+
+    printf("%24s: %12.1f %s/s (%u in %.3f ms)\n", b->name, perSecond,
+           b->unit, iterations, static_cast<double>(elapsed) / 1e6);
+
+    if(options.output) {
+      fprintf(options.output, "%s %u %lld %.1f %s\n", b->name, iterations,
+              static_cast<long long>(elapsed), perSecond, b->unit);
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool bench = false;
+  Benchmark::Options options;
+  const char* outputPath = 0;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-bench") == 0) {
+      bench = true;
+      if(i + 1 < argc and argv[i + 1][0] != '-') {
+        options.filter = argv[++i];
+      }
+    } else if(strcmp(argv[i], "-iterations") == 0 and i + 1 < argc) {
+      options.iterations = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "-min-time") == 0 and i + 1 < argc) {
+      options.minimumMillis = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "-output") == 0 and i + 1 < argc) {
+      outputPath = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [-bench [<name prefix>]] "
+              "[-iterations <count>] [-min-time <milliseconds>] "
+              "[-output <file>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if(bench) {
+    if(outputPath) {
+      options.output = fopen(outputPath, "wb");
+      if(options.output == 0) {
+        fprintf(stderr, "unable to open %s\n", outputPath);
+        return 1;
+      }
+    }
+
+    bool success = Benchmark::runAll(options);
+
+    if(options.output) {
+      fclose(options.output);
+    }
+    return success ? 0 : 1;
+  }
+
   if(Test::runAll()) {
     return 0;
   }
@@ -84,4 +84,51 @@ public:
   static bool runAll();
 };
 
+// A timed workload, run instead of the tests when the harness is
+// passed "-bench".  Each call to run performs the specified number of
+// iterations; the harness keeps doubling that number until a call
+// takes at least the minimum time and reports the throughput of the
+// last call in iterations per second.
+class Benchmark {
+private:
+  Benchmark* next;
+  static Benchmark* first;
+  static Benchmark** last;
+
+  friend int main(int argc, char** argv);
+
+public:
+  class Options {
+  public:
+    Options():
+      filter(0),
+      iterations(0),
+      minimumMillis(200),
+      output(0)
+    { }
+
+    // only benchmarks whose names start with this string are run
+    const char* filter;
+    // if non-zero, run exactly this many iterations instead of
+    // calibrating
+    unsigned iterations;
+    unsigned minimumMillis;
+    // if non-null, receives one line per benchmark in the form
+    // "<name> <iterations> <nanoseconds> <per second> <unit>"
+    FILE* output;
+  };
+
+  const char* const name;
+  // what one iteration processes, e.g. "methods"
+  const char* const unit;
+
+  Benchmark(const char* name, const char* unit);
+
+  virtual void run(unsigned iterations) = 0;
+
+  static int64_t now();
+
+  static bool runAll(const Options& options);
+};
+
 #endif // TEST_HARNESS_H